@@ -59,60 +59,65 @@
 #include <fnmatch.h>
 #include "archive.h"
 
-/* note: if you vary hash_prime sizes be aware,
- * 1) tweaking these will have a big effect on how much memory this program uses.
- * 2) for computational efficiency these hash tables should be at least 20%
- *    larger than the maximum number of elements stored in it.
- * 3) all _hash_prime's must be a prime number or chaos is assured, if your looking
- *    for a prime, try http://www.utm.edu/research/primes/lists/small/10000.txt
- * 4) if you go bigger than 15 bits you may get into trouble (untested) as its
- *    sometimes cast to an unsigned, if you go to 16 bit you will overlap
- *    int's and chaos is assured, 16381 is the max prime for 14 bit field
+/* Names (package names, versions, status strings, dependency lines)
+ * are stored once in name_hashtable[] and referred to by their index.
+ * Package nodes and status nodes live in package_hashtable[] and
+ * status_hashtable[]. All three are growable vectors; index 0 is never
+ * used, and element [count] is always NULL, which is what searches
+ * return when nothing is found.
+ *
+ * Each vector has an open-addressed index of element numbers next
+ * to it, which is doubled in size whenever it becomes half full.
+ * Package and status nodes are hashed by their package name, so all
+ * versions of a package sit in the same probe sequence.
  */
+typedef struct hash_slot_s {
+	unsigned num;  /* 0: empty slot */
+	unsigned hash;
+} hash_slot_t;
+
+typedef struct hash_index_s {
+	hash_slot_t *slot;
+	unsigned mask; /* number of slots - 1 */
+	unsigned used;
+} hash_index_t;
 
-/* NAME_HASH_PRIME, Stores package names and versions,
- * I estimate it should be at least 50% bigger than PACKAGE_HASH_PRIME,
- * as there a lot of duplicate version numbers */
-#define NAME_HASH_PRIME 16381
-
-/* PACKAGE_HASH_PRIME, Maximum number of unique packages,
- * It must not be smaller than STATUS_HASH_PRIME,
- * Currently only packages from status_hashtable are stored in here, but in
- * future this may be used to store packages not only from a status file,
- * but an available_hashtable, and even multiple packages files.
- * Package can be stored more than once if they have different versions.
- * e.g. The same package may have different versions in the status file
- *      and available file */
-#define PACKAGE_HASH_PRIME 10007
 typedef struct edge_s {
 	unsigned operator:4; /* was:3 */
 	unsigned type:4;
-	unsigned name:16; /* was:14 */
-	unsigned version:16; /* was:14 */
+	unsigned name;
+	unsigned version;
 } edge_t;
 
 typedef struct common_node_s {
-	unsigned name:16; /* was:14 */
-	unsigned version:16; /* was:14 */
-	unsigned num_of_edges:16; /* was:14 */
+	unsigned name;
+	unsigned version;
+	unsigned num_of_edges;
 	edge_t **edge;
 } common_node_t;
 
 /* Currently it doesnt store packages that have state-status of not-installed
  * So it only really has to be the size of the maximum number of packages
- * likely to be installed at any one time, so there is a bit of leeway here */
-#define STATUS_HASH_PRIME 8191
+ * likely to be installed at any one time */
 typedef struct status_node_s {
-	unsigned package:16; /* was:14 */       /* has to fit PACKAGE_HASH_PRIME */
-	unsigned status:16; /* was:14 */        /* has to fit STATUS_HASH_PRIME */
+	unsigned package;
+	unsigned status;
 } status_node_t;
 
 
 /* Globals */
 struct globals {
-	char          *name_hashtable[NAME_HASH_PRIME + 1];
-	common_node_t *package_hashtable[PACKAGE_HASH_PRIME + 1];
-	status_node_t *status_hashtable[STATUS_HASH_PRIME + 1];
+	char          **name_hashtable;
+	common_node_t **package_hashtable;
+	status_node_t **status_hashtable;
+	unsigned name_count;
+	unsigned package_count;
+	unsigned status_count;
+	hash_index_t name_index;
+	hash_index_t package_index;
+	hash_index_t status_index;
+	/* Maps name of a virtual package to packages which provide it */
+	hash_index_t provides_index;
 };
 #define G (*ptr_to_globals)
 #define name_hashtable    (G.name_hashtable   )
@@ -120,6 +125,7 @@ struct globals {
 #define status_hashtable  (G.status_hashtable )
 #define INIT_G() do { \
 	SET_PTR_TO_GLOBALS(xzalloc(sizeof(G))); \
+	init_hashtables(); \
 } while (0)
 
 
@@ -150,68 +156,138 @@ enum operator_e {
 typedef struct deb_file_s {
 	char *control_file;
 	char *filename;
-	unsigned package:16; /* was:14 */
+	unsigned package;
 } deb_file_t;
 
 
-static void make_hash(const char *key, unsigned *start, unsigned *decrement, const int hash_prime)
+static unsigned make_hash(const char *key)
 {
-	unsigned long hash_num = key[0];
-	int len = strlen(key);
-	int i;
+	/* FNV-1a */
+	unsigned hash_num = 2166136261U;
 
-	/* Maybe i should have uses a "proper" hashing algorithm here instead
-	 * of making one up myself, seems to be working ok though. */
-	for (i = 1; i < len; i++) {
-		/* shifts the ascii based value and adds it to previous value
-		 * shift amount is mod 24 because long int is 32 bit and data
-		 * to be shifted is 8, don't want to shift data to where it has
-		 * no effect */
-		hash_num += (key[i] + key[i-1]) << ((key[i] * i) % 24);
+	while (*key) {
+		hash_num ^= (unsigned char)*key++;
+		hash_num *= 16777619;
 	}
-	*start = (unsigned) hash_num % hash_prime;
-	*decrement = (unsigned) 1 + (hash_num % (hash_prime - 1));
+	return hash_num;
 }
 
-/* this adds the key to the hash table */
-static int search_name_hashtable(const char *key)
+/* Package and status nodes are hashed by the number of their name */
+static unsigned make_num_hash(unsigned num)
 {
-	unsigned probe_address;
-	unsigned probe_decrement;
+	return num * 0x9e3779b1U;
+}
 
-	make_hash(key, &probe_address, &probe_decrement, NAME_HASH_PRIME);
-	while (name_hashtable[probe_address] != NULL) {
-		if (strcmp(name_hashtable[probe_address], key) == 0) {
-			return probe_address;
-		}
-		probe_address -= probe_decrement;
-		if ((int)probe_address < 0) {
-			probe_address += NAME_HASH_PRIME;
+static void hash_index_init(hash_index_t *index)
+{
+	index->mask = 255;
+	index->slot = xzalloc((index->mask + 1) * sizeof(index->slot[0]));
+}
+
+static void hash_index_add(hash_index_t *index, unsigned num, unsigned hash)
+{
+	unsigned i;
+
+	if (index->used >= (index->mask + 1) / 2) {
+		hash_slot_t *old_slot = index->slot;
+		unsigned old_mask = index->mask;
+
+		index->mask = old_mask * 2 + 1;
+		index->slot = xzalloc((index->mask + 1) * sizeof(index->slot[0]));
+		index->used = 0;
+		for (i = 0; i <= old_mask; i++) {
+			if (old_slot[i].num)
+				hash_index_add(index, old_slot[i].num, old_slot[i].hash);
 		}
+		free(old_slot);
 	}
-	name_hashtable[probe_address] = xstrdup(key);
-	return probe_address;
+
+	i = hash & index->mask;
+	while (index->slot[i].num)
+		i = (i + 1) & index->mask;
+	index->slot[i].num = num;
+	index->slot[i].hash = hash;
+	index->used++;
 }
 
-/* this DOESNT add the key to the hashtable
- * TODO make it consistent with search_name_hashtable
- */
+static void init_hashtables(void)
+{
+	/* Element 0 is never used. Name 0 is used by status nodes
+	 * which have no status, make it safe to print */
+	name_hashtable = xrealloc_vector(name_hashtable, 8, 0);
+	name_hashtable[0] = (char*)"";
+	G.name_count = 1;
+	package_hashtable = xrealloc_vector(package_hashtable, 8, 0);
+	G.package_count = 1;
+	status_hashtable = xrealloc_vector(status_hashtable, 8, 0);
+	G.status_count = 1;
+
+	hash_index_init(&G.name_index);
+	hash_index_init(&G.package_index);
+	hash_index_init(&G.status_index);
+	hash_index_init(&G.provides_index);
+}
+
+/* this DOESNT add the key, returns 0 if it isn't there */
+static unsigned find_name_hashtable(const char *key)
+{
+	const hash_index_t *index = &G.name_index;
+	unsigned hash = make_hash(key);
+	unsigned i, num;
+
+	for (i = hash & index->mask; (num = index->slot[i].num) != 0; i = (i + 1) & index->mask) {
+		if (index->slot[i].hash == hash && strcmp(name_hashtable[num], key) == 0)
+			return num;
+	}
+	return 0;
+}
+
+/* this adds the key to the hash table */
+static unsigned search_name_hashtable(const char *key)
+{
+	unsigned num = find_name_hashtable(key);
+
+	if (num)
+		return num;
+	num = G.name_count++;
+	name_hashtable = xrealloc_vector(name_hashtable, 8, num);
+	name_hashtable[num] = xstrdup(key);
+	hash_index_add(&G.name_index, num, make_hash(key));
+	return num;
+}
+
+/* this DOESNT add a status node to the hashtable, use set_status_node()
+ * on the returned number to add it */
 static unsigned search_status_hashtable(const char *key)
 {
-	unsigned probe_address;
-	unsigned probe_decrement;
+	const hash_index_t *index = &G.status_index;
+	unsigned name = find_name_hashtable(key);
+	unsigned hash = make_num_hash(name);
+	unsigned i, num;
 
-	make_hash(key, &probe_address, &probe_decrement, STATUS_HASH_PRIME);
-	while (status_hashtable[probe_address] != NULL) {
-		if (strcmp(key, name_hashtable[package_hashtable[status_hashtable[probe_address]->package]->name]) == 0) {
-			break;
-		}
-		probe_address -= probe_decrement;
-		if ((int)probe_address < 0) {
-			probe_address += STATUS_HASH_PRIME;
+	if (name == 0) /* no such name, so no such package either */
+		return G.status_count;
+
+	for (i = hash & index->mask; (num = index->slot[i].num) != 0; i = (i + 1) & index->mask) {
+		if (index->slot[i].hash == hash
+		 && package_hashtable[status_hashtable[num]->package]->name == name
+		) {
+			return num;
 		}
 	}
-	return probe_address;
+	return G.status_count;
+}
+
+static void set_status_node(unsigned num, status_node_t *status_node)
+{
+	if (num == G.status_count) {
+		unsigned name = package_hashtable[status_node->package]->name;
+
+		status_hashtable = xrealloc_vector(status_hashtable, 8, num);
+		G.status_count++;
+		hash_index_add(&G.status_index, num, make_num_hash(name));
+	}
+	status_hashtable[num] = status_node;
 }
 
 static int order(char x)
@@ -341,58 +417,90 @@ static int test_version(const unsigned version1, const unsigned version2, const
 	return FALSE;
 }
 
-static int search_package_hashtable(const unsigned name, const unsigned version, const unsigned operator)
+/* this DOESNT add the package to the hashtable, use set_package_node()
+ * on the returned number to add it */
+static unsigned search_package_hashtable(const unsigned name, const unsigned version, const unsigned operator)
 {
-	unsigned probe_address;
-	unsigned probe_decrement;
-
-	make_hash(name_hashtable[name], &probe_address, &probe_decrement, PACKAGE_HASH_PRIME);
-	while (package_hashtable[probe_address] != NULL) {
-		if (package_hashtable[probe_address]->name == name) {
-			if (operator == VER_ANY) {
-				return probe_address;
-			}
-			if (test_version(package_hashtable[probe_address]->version, version, operator)) {
-				return probe_address;
-			}
+	const hash_index_t *index = &G.package_index;
+	unsigned hash = make_num_hash(name);
+	unsigned i, num;
+
+	for (i = hash & index->mask; (num = index->slot[i].num) != 0; i = (i + 1) & index->mask) {
+		if (index->slot[i].hash != hash || package_hashtable[num]->name != name)
+			continue;
+		if (operator == VER_ANY) {
+			return num;
 		}
-		probe_address -= probe_decrement;
-		if ((int)probe_address < 0) {
-			probe_address += PACKAGE_HASH_PRIME;
+		if (test_version(package_hashtable[num]->version, version, operator)) {
+			return num;
 		}
 	}
-	return probe_address;
+	return G.package_count;
+}
+
+static int package_provides(const common_node_t *p, unsigned needle)
+{
+	unsigned j;
+
+	for (j = 0; j < p->num_of_edges; j++)
+		if (p->edge[j]->type == EDGE_PROVIDES && p->edge[j]->name == needle)
+			return 1;
+	return 0;
 }
 
 /*
- * This function searches through the entire package_hashtable looking
- * for a package which provides "needle". It returns the index into
- * the package_hashtable for the providing package.
+ * This function returns the index into the package_hashtable for
+ * a package which provides "needle".
  *
  * needle is the index into name_hashtable of the package we are
  * looking for.
  *
- * start_at is the index in the package_hashtable to start looking
- * at. If start_at is -1 then start at the beginning. This is to allow
+ * Return the provider with the lowest index bigger than start_at.
+ * If start_at is -1 then start at the beginning. This is to allow
  * for repeated searches since more than one package might provide
  * needle.
- *
- * FIXME: I don't think this is very efficient, but I thought I'd keep
- * it simple for now until it proves to be a problem.
  */
 static int search_for_provides(int needle, int start_at)
 {
-	int i, j;
-	common_node_t *p;
-	for (i = start_at + 1; i < PACKAGE_HASH_PRIME; i++) {
-		p = package_hashtable[i];
-		if (p == NULL)
+	const hash_index_t *index = &G.provides_index;
+	unsigned hash = make_num_hash(needle);
+	unsigned i, num;
+	int found = -1;
+
+	for (i = hash & index->mask; (num = index->slot[i].num) != 0; i = (i + 1) & index->mask) {
+		if (index->slot[i].hash != hash
+		 || (int)num <= start_at
+		 || (found != -1 && (int)num >= found)
+		) {
+			continue;
+		}
+		/* The node may have been replaced since it was indexed */
+		if (package_hashtable[num] && package_provides(package_hashtable[num], needle))
+			found = num;
+	}
+	return found;
+}
+
+static void set_package_node(unsigned num, common_node_t *new_node)
+{
+	unsigned j;
+
+	if (num == G.package_count) {
+		package_hashtable = xrealloc_vector(package_hashtable, 8, num);
+		G.package_count++;
+		hash_index_add(&G.package_index, num, make_num_hash(new_node->name));
+	}
+	package_hashtable[num] = new_node;
+
+	for (j = 0; j < new_node->num_of_edges; j++) {
+		const edge_t *edge = new_node->edge[j];
+
+		if (edge->type != EDGE_PROVIDES)
 			continue;
-		for (j = 0; j < p->num_of_edges; j++)
-			if (p->edge[j]->type == EDGE_PROVIDES && p->edge[j]->name == needle)
-				return i;
+		/* Not indexed yet? (lowest provider above num-1 would be num) */
+		if (search_for_provides(edge->name, (int)num - 1) != (int)num)
+			hash_index_add(&G.provides_index, num, make_num_hash(edge->name));
 	}
-	return -1;
 }
 
 /*
@@ -603,77 +711,101 @@ static int read_package_field(const char *package_buffer, char **field_name, cha
 	return next_offset;
 }
 
-static unsigned fill_package_struct(char *control_buffer)
+static const char package_field_names[] ALIGN1 =
+	"Package\0""Version\0"
+	"Pre-Depends\0""Depends\0""Replaces\0""Provides\0"
+	"Conflicts\0""Suggests\0""Recommends\0""Enhances\0"
+	"Status\0";
+
+/* Stores one control field in new_node. If status is not NULL,
+ * the Status: field is stored there */
+static void fill_package_field(common_node_t *new_node, const char *field_name,
+		char *field_value, unsigned *status)
 {
-	static const char field_names[] ALIGN1 =
-		"Package\0""Version\0"
-		"Pre-Depends\0""Depends\0""Replaces\0""Provides\0"
-		"Conflicts\0""Suggests\0""Recommends\0""Enhances\0";
+	switch (index_in_strings(package_field_names, field_name)) {
+	case 0: /* Package */
+		new_node->name = search_name_hashtable(field_value);
+		break;
+	case 1: /* Version */
+		new_node->version = search_name_hashtable(field_value);
+		break;
+	case 2: /* Pre-Depends */
+		add_split_dependencies(new_node, field_value, EDGE_PRE_DEPENDS);
+		break;
+	case 3: /* Depends */
+		add_split_dependencies(new_node, field_value, EDGE_DEPENDS);
+		break;
+	case 4: /* Replaces */
+		add_split_dependencies(new_node, field_value, EDGE_REPLACES);
+		break;
+	case 5: /* Provides */
+		add_split_dependencies(new_node, field_value, EDGE_PROVIDES);
+		break;
+	case 6: /* Conflicts */
+		add_split_dependencies(new_node, field_value, EDGE_CONFLICTS);
+		break;
+	case 7: /* Suggests */
+		add_split_dependencies(new_node, field_value, EDGE_SUGGESTS);
+		break;
+	case 8: /* Recommends */
+		add_split_dependencies(new_node, field_value, EDGE_RECOMMENDS);
+		break;
+	case 9: /* Enhances */
+		add_split_dependencies(new_node, field_value, EDGE_ENHANCES);
+		break;
+	case 10: /* Status */
+		if (status && field_value)
+			*status = search_name_hashtable(field_value);
+		break;
+	}
+}
 
+static common_node_t *new_package_node(unsigned *status)
+{
 	common_node_t *new_node = xzalloc(sizeof(common_node_t));
+
+	if (status)
+		*status = 0;
+	new_node->version = search_name_hashtable("unknown");
+	return new_node;
+}
+
+/* Adds a filled in node to the package table, or discards it
+ * if it has no version */
+static unsigned add_package_node(common_node_t *new_node)
+{
+	unsigned num;
+
+	if (new_node->version == search_name_hashtable("unknown")) {
+		free_package(new_node);
+		return -1;
+	}
+	num = search_package_hashtable(new_node->name, new_node->version, VER_EQUAL);
+	free_package(package_hashtable[num]);
+	set_package_node(num, new_node);
+	return num;
+}
+
+/* Parses the control paragraph in one pass. If status is not NULL,
+ * the Status: field is stored there too (0 if there is none) */
+static unsigned fill_package_struct(char *control_buffer, unsigned *status)
+{
+	common_node_t *new_node = new_package_node(status);
 	char *field_name;
 	char *field_value;
 	int field_start = 0;
-	int num = -1;
 	int buffer_length = strlen(control_buffer);
 
-	new_node->version = search_name_hashtable("unknown");
 	while (field_start < buffer_length) {
-		unsigned field_num;
-
 		field_start += read_package_field(&control_buffer[field_start],
 				&field_name, &field_value);
 
-		if (field_name == NULL) {
-			goto fill_package_struct_cleanup;
-		}
-
-		field_num = index_in_strings(field_names, field_name);
-		switch (field_num) {
-		case 0: /* Package */
-			new_node->name = search_name_hashtable(field_value);
-			break;
-		case 1: /* Version */
-			new_node->version = search_name_hashtable(field_value);
-			break;
-		case 2: /* Pre-Depends */
-			add_split_dependencies(new_node, field_value, EDGE_PRE_DEPENDS);
-			break;
-		case 3: /* Depends */
-			add_split_dependencies(new_node, field_value, EDGE_DEPENDS);
-			break;
-		case 4: /* Replaces */
-			add_split_dependencies(new_node, field_value, EDGE_REPLACES);
-			break;
-		case 5: /* Provides */
-			add_split_dependencies(new_node, field_value, EDGE_PROVIDES);
-			break;
-		case 6: /* Conflicts */
-			add_split_dependencies(new_node, field_value, EDGE_CONFLICTS);
-			break;
-		case 7: /* Suggests */
-			add_split_dependencies(new_node, field_value, EDGE_SUGGESTS);
-			break;
-		case 8: /* Recommends */
-			add_split_dependencies(new_node, field_value, EDGE_RECOMMENDS);
-			break;
-		case 9: /* Enhances */
-			add_split_dependencies(new_node, field_value, EDGE_ENHANCES);
-			break;
-		}
- fill_package_struct_cleanup:
+		if (field_name != NULL)
+			fill_package_field(new_node, field_name, field_value, status);
 		free(field_name);
 		free(field_value);
 	}
-
-	if (new_node->version == search_name_hashtable("unknown")) {
-		free_package(new_node);
-		return -1;
-	}
-	num = search_package_hashtable(new_node->name, new_node->version, VER_EQUAL);
-	free_package(package_hashtable[num]);
-	package_hashtable[num] = new_node;
-	return num;
+	return add_package_node(new_node);
 }
 
 /* if num = 1, it returns the want status, 2 returns flag, 3 returns status */
@@ -751,35 +883,63 @@ static const char *describe_status(int status_num)
 	return "is not installed or flagged to be installed";
 }
 
+/* The status file can be large: stream it line by line instead of
+ * pulling in whole paragraphs. Each field (with its continuation
+ * lines) is handed to fill_package_field() as soon as it ends */
 static void index_status_file(const char *filename)
 {
-	FILE *status_file;
-	char *control_buffer;
-	char *status_line;
-	status_node_t *status_node = NULL;
-	unsigned status_num;
-
-	status_file = xfopen_for_read(filename);
-	while ((control_buffer = xmalloc_fgetline_str(status_file, "\n\n")) != NULL) {
-		const unsigned package_num = fill_package_struct(control_buffer);
-		if (package_num != -1) {
-			status_node = xmalloc(sizeof(status_node_t));
-			/* fill_package_struct doesnt handle the status field */
-			status_line = strstr(control_buffer, "Status:");
-			if (status_line != NULL) {
-				status_line += 7;
-				status_line += strspn(status_line, " \n\t");
-				status_line = xstrndup(status_line, strcspn(status_line, "\n"));
-				status_node->status = search_name_hashtable(status_line);
-				free(status_line);
+	line_reader_t *lr;
+	common_node_t *new_node = NULL;
+	char *field = NULL;
+	char *line;
+	size_t len;
+	unsigned status;
+
+	lr = line_reader_open(xfopen_for_read(filename), 0);
+	do {
+		line = line_reader_next(lr, &len);
+		if (line && line[0] == ' ' && field) {
+			/* Continuation of the current field */
+			char *t = xasprintf("%s\n%s", field, line);
+			free(field);
+			field = t;
+			continue;
+		}
+		if (field) {
+			char *field_name;
+			char *field_value;
+
+			read_package_field(field, &field_name, &field_value);
+			if (field_name != NULL)
+				fill_package_field(new_node, field_name, field_value, &status);
+			free(field_name);
+			free(field_value);
+			free(field);
+			field = NULL;
+		}
+		if (!line || len == 0) {
+			/* End of paragraph */
+			if (new_node) {
+				const unsigned package_num = add_package_node(new_node);
+				if (package_num != -1) {
+					status_node_t *status_node = xmalloc(sizeof(status_node_t));
+					unsigned status_num;
+
+					status_node->status = status;
+					status_node->package = package_num;
+					status_num = search_status_hashtable(name_hashtable[package_hashtable[package_num]->name]);
+					free(status_hashtable[status_num]);
+					set_status_node(status_num, status_node);
+				}
+				new_node = NULL;
 			}
-			status_node->package = package_num;
-			status_num = search_status_hashtable(name_hashtable[package_hashtable[status_node->package]->name]);
-			status_hashtable[status_num] = status_node;
+			continue;
 		}
-		free(control_buffer);
-	}
-	fclose(status_file);
+		if (!new_node)
+			new_node = new_package_node(&status);
+		field = line_reader_copy(line, len);
+	} while (line);
+	line_reader_close(lr);
 }
 
 static void write_buffer_no_status(FILE *new_status_file, const char *control_buffer)
@@ -998,7 +1158,7 @@ static int check_deps(deb_file_t **deb_file, int deb_start /*, int dep_max_count
 					common_node_t *new_node = xzalloc(sizeof(common_node_t));
 					new_node->name = package_hashtable[package_num]->edge[j]->name;
 					new_node->version = package_hashtable[package_num]->edge[j]->version;
-					package_hashtable[conflicts_package_num] = new_node;
+					set_package_node(conflicts_package_num, new_node);
 				}
 				conflicts = xrealloc_vector(conflicts, 2, conflicts_num);
 				conflicts[conflicts_num] = conflicts_package_num;
@@ -1050,7 +1210,7 @@ static int check_deps(deb_file_t **deb_file, int deb_start /*, int dep_max_count
 
 
 	/* Check dependendcies */
-	for (i = 0; i < PACKAGE_HASH_PRIME; i++) {
+	for (i = 1; i < G.package_count; i++) {
 		int status_num = 0;
 		int number_of_alternatives = 0;
 		const edge_t * root_of_alternatives = NULL;
@@ -1315,7 +1475,7 @@ static void list_packages(const char *pattern)
 	puts("+++-==============-==============");
 
 	/* go through status hash, dereference package hash and finally strings */
-	for (i = 0; i < STATUS_HASH_PRIME+1; i++) {
+	for (i = 1; i < G.status_count; i++) {
 		if (status_hashtable[i]) {
 			const char *stat_str;  /* status string */
 			const char *name_str;  /* package name */
@@ -1532,7 +1692,8 @@ static char FAST_FUNC filter_rename_config(archive_handle_t *archive_handle)
 	char *name_ptr = archive_handle->file_header->name + 1;
 
 	/* Is this file marked as config file? */
-	if (!find_list_entry(archive_handle->accept, name_ptr))
+	if (!find_compiled_list_entry(&archive_handle->accept_compiled,
+			archive_handle->accept, name_ptr))
 		return EXIT_SUCCESS; /* no */
 
 	fd = open(name_ptr, O_RDONLY);
@@ -1554,7 +1715,9 @@ static char FAST_FUNC filter_rename_config(archive_handle_t *archive_handle)
 		free(buf);
 
 		/* Is it changed after install? */
-		if (find_list_entry(archive_handle->accept, md5line) == NULL) {
+		if (find_compiled_list_entry(&archive_handle->accept_compiled,
+				archive_handle->accept, md5line) == NULL
+		) {
 			printf("Warning: Creating %s as %s.dpkg-new\n", name_ptr, name_ptr);
 			archive_handle->file_header->name = xasprintf("%s.dpkg-new", archive_handle->file_header->name);
 		}
@@ -1792,7 +1955,7 @@ int dpkg_main(int argc UNUSED_PARAM, char **argv)
 				bb_error_msg_and_die("can't extract control file");
 			}
 			deb_file[deb_count]->filename = xstrdup(argv[0]);
-			package_num = fill_package_struct(deb_file[deb_count]->control_file);
+			package_num = fill_package_struct(deb_file[deb_count]->control_file, NULL);
 
 			if (package_num == -1) {
 				bb_error_msg("invalid control file in %s", argv[0]);
@@ -1814,7 +1977,8 @@ int dpkg_main(int argc UNUSED_PARAM, char **argv)
 					/* reinstreq isnt changed to "ok" until the package control info
 					 * is written to the status file*/
 					status_node->status = search_name_hashtable("install reinstreq not-installed");
-					status_hashtable[status_num] = status_node;
+					free(status_hashtable[status_num]);
+					set_status_node(status_num, status_node);
 				} else {
 					set_status(status_num, "install", 1);
 					set_status(status_num, "reinstreq", 2);
@@ -1899,21 +2063,25 @@ int dpkg_main(int argc UNUSED_PARAM, char **argv)
 
 		free(deb_file);
 
-		for (i = 0; i < NAME_HASH_PRIME; i++) {
+		for (i = 1; i < G.name_count; i++) {
 			free(name_hashtable[i]);
 		}
 
-		for (i = 0; i < PACKAGE_HASH_PRIME; i++) {
+		for (i = 1; i < G.package_count; i++) {
 			free_package(package_hashtable[i]);
 		}
 
-		for (i = 0; i < STATUS_HASH_PRIME; i++) {
+		for (i = 1; i < G.status_count; i++) {
 			free(status_hashtable[i]);
 		}
 
 		free(status_hashtable);
 		free(package_hashtable);
 		free(name_hashtable);
+		free(G.name_index.slot);
+		free(G.package_index.slot);
+		free(G.status_index.slot);
+		free(G.provides_index.slot);
 	}
 
 	return EXIT_SUCCESS;
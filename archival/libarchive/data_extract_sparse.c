@@ -0,0 +1,66 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * Licensed under GPLv2 or later, see file LICENSE in this source tree.
+ */
+
+#include "libbb.h"
+#include "archive.h"
+
+/* Write out a GNU sparse file. The archive holds only the data parts
+ * listed in tar__sparse_map. If dst_fd is a regular file, holes are
+ * seeked over and stay holes there; otherwise (pipe, tty, file opened
+ * with O_APPEND) they are written out as zeros.
+ */
+void FAST_FUNC data_extract_sparse(archive_handle_t *archive_handle, int dst_fd, int ignore_write_errors)
+{
+	file_header_t *file_header = archive_handle->file_header;
+	const off_t *map = file_header->tar__sparse_map;
+	unsigned cnt = file_header->tar__sparse_cnt;
+	off_t sign = ignore_write_errors ? -1 : 1; /* see bb_copyfd_exact_size */
+	off_t pos = 0, data_end = 0;
+	char *zeros = NULL;
+	struct stat st;
+
+	if (fstat(dst_fd, &st) != 0
+	 || !S_ISREG(st.st_mode)
+	 || (fcntl(dst_fd, F_GETFL) & O_APPEND)
+	) {
+		zeros = xzalloc(4 * 1024);
+	}
+
+	while (1) {
+		off_t hole = (cnt ? map[0] : file_header->tar__sparse_realsize) - pos;
+
+		if (hole > 0) {
+			pos += hole;
+			if (!zeros)
+				xlseek(dst_fd, hole, SEEK_CUR);
+			while (zeros && hole) {
+				int n = hole < 4 * 1024 ? hole : 4 * 1024;
+				if (full_write(dst_fd, zeros, n) != n
+				 && !ignore_write_errors
+				) {
+					bb_perror_msg_and_die(bb_msg_write_error);
+				}
+				hole -= n;
+			}
+		}
+		if (!cnt)
+			break;
+		bb_copyfd_exact_size(archive_handle->src_fd, dst_fd, map[1] * sign);
+		if (map[1]) {
+			pos += map[1];
+			data_end = pos;
+		}
+		map += 2;
+		cnt--;
+	}
+	if (data_end < pos && !zeros) {
+		/* Hole at EOF: write last byte to set file size.
+		 * (ftruncate would cut off what may follow
+		 * in a preexisting file on stdout) */
+		xlseek(dst_fd, -1, SEEK_CUR);
+		xwrite(dst_fd, "", 1);
+	}
+	free(zeros);
+}
@@ -92,6 +92,11 @@ void FAST_FUNC data_extract_to_command(archive_handle_t *archive_handle)
 #if ENABLE_FEATURE_TAR_UNAME_GNAME
 			str2env(tar_env, TAR_UNAME, file_header->tar__uname);
 			str2env(tar_env, TAR_GNAME, file_header->tar__gname);
+#endif
+#if ENABLE_FEATURE_TAR_SPARSE
+			if (file_header->tar__sparse_map)
+				dec2env(tar_env, TAR_SIZE, file_header->tar__sparse_realsize);
+			else
 #endif
 			dec2env(tar_env, TAR_SIZE, file_header->size);
 			dec2env(tar_env, TAR_UID, file_header->uid);
@@ -109,6 +114,11 @@ void FAST_FUNC data_extract_to_command(archive_handle_t *archive_handle)
 		close(p[0]);
 		/* Our caller is expected to do signal(SIGPIPE, SIG_IGN)
 		 * so that we don't die if child don't read all the input: */
+#if ENABLE_FEATURE_TAR_SPARSE
+		if (file_header->tar__sparse_map)
+			data_extract_sparse(archive_handle, p[1], 1);
+		else
+#endif
 		bb_copyfd_exact_size(archive_handle->src_fd, p[1], -file_header->size);
 		close(p[1]);
 
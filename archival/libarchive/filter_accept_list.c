@@ -13,7 +13,8 @@
  */
 char FAST_FUNC filter_accept_list(archive_handle_t *archive_handle)
 {
-	if (find_list_entry(archive_handle->accept, archive_handle->file_header->name))
+	if (find_compiled_list_entry(&archive_handle->accept_compiled,
+			archive_handle->accept, archive_handle->file_header->name))
 		return EXIT_SUCCESS;
 	return EXIT_FAILURE;
 }
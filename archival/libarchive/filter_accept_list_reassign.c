@@ -18,7 +18,9 @@
 char FAST_FUNC filter_accept_list_reassign(archive_handle_t *archive_handle)
 {
 	/* Check the file entry is in the accept list */
-	if (find_list_entry(archive_handle->accept, archive_handle->file_header->name)) {
+	if (find_compiled_list_entry(&archive_handle->accept_compiled,
+			archive_handle->accept, archive_handle->file_header->name)
+	) {
 		const char *name_ptr;
 
 		/* Find extension */
@@ -20,11 +20,13 @@ char FAST_FUNC filter_accept_reject_list(archive_handle_t *archive_handle)
 	key = archive_handle->file_header->name;
 
 	/* If the key is in a reject list fail */
-	reject_entry = find_list_entry2(archive_handle->reject, key);
+	reject_entry = find_compiled_list_entry2(&archive_handle->reject_compiled,
+			archive_handle->reject, key);
 	if (reject_entry) {
 		return EXIT_FAILURE;
 	}
-	accept_entry = find_list_entry2(archive_handle->accept, key);
+	accept_entry = find_compiled_list_entry2(&archive_handle->accept_compiled,
+			archive_handle->accept, key);
 
 	/* Fail if an accept list was specified and the key wasnt in there */
 	if ((accept_entry == NULL) && archive_handle->accept) {
@@ -21,34 +21,207 @@ const llist_t* FAST_FUNC find_list_entry(const llist_t *list, const char *filena
 	return NULL;
 }
 
+/* Truncate filename to the number of path components in pattern */
+static const char *leading_components(char *buf, const char *pattern, const char *filename)
+{
+	int pattern_slash_cnt;
+	const char *c;
+	char *d;
+
+	c = pattern;
+	pattern_slash_cnt = 0;
+	while (*c)
+		if (*c++ == '/') pattern_slash_cnt++;
+	c = filename;
+	d = buf;
+	/* paranoia is better than buffer overflows */
+	while (*c && d != buf + PATH_MAX-1) {
+		if (*c == '/' && --pattern_slash_cnt < 0)
+			break;
+		*d++ = *c++;
+	}
+	*d = '\0';
+	return buf;
+}
+
 /* Same, but compares only path components present in pattern
  * (extra trailing path components in filename are assumed to match)
  */
 const llist_t* FAST_FUNC find_list_entry2(const llist_t *list, const char *filename)
 {
 	char buf[PATH_MAX];
-	int pattern_slash_cnt;
-	const char *c;
-	char *d;
 
 	while (list) {
-		c = list->data;
-		pattern_slash_cnt = 0;
-		while (*c)
-			if (*c++ == '/') pattern_slash_cnt++;
-		c = filename;
-		d = buf;
-		/* paranoia is better than buffer overflows */
-		while (*c && d != buf + sizeof(buf)-1) {
-			if (*c == '/' && --pattern_slash_cnt < 0)
-				break;
-			*d++ = *c++;
-		}
-		*d = '\0';
-		if (fnmatch(list->data, buf, 0) == 0) {
+		if (fnmatch(list->data, leading_components(buf, list->data, filename), 0) == 0) {
 			return list;
 		}
 		list = list->link;
 	}
 	return NULL;
 }
+
+/* Compiled pattern list. Patterns without fnmatch special chars
+ * go into a hash table. Wildcard patterns are still fnmatch'ed, but
+ * only if their leading literal part matches.
+ * A lookup then takes O(strlen(filename)) hash probes plus a few fnmatch
+ * calls, not a fnmatch call per pattern.
+ */
+struct match_list_t {
+	const llist_t *list;    /* compiled from this list */
+	unsigned hash_mask;
+	struct match_literal {
+		const llist_t *entry;
+		unsigned hash;
+		unsigned len;
+	} *literal;             /* open addressing, hash_mask+1 slots */
+	unsigned wild_cnt;
+	struct match_wild {
+		const llist_t *entry;
+		unsigned fixed_len;     /* length of literal part */
+	} *wild;                /* in list order */
+};
+
+#define FNV_INIT 2166136261U
+#define FNV(h, c) (((h) ^ (unsigned char)(c)) * 16777619U)
+
+static const llist_t *find_literal(const match_list_t *m,
+		const char *name, unsigned len, unsigned hash)
+{
+	unsigned i = hash & m->hash_mask;
+
+	while (m->literal[i].entry) {
+		if (m->literal[i].hash == hash
+		 && m->literal[i].len == len
+		 && memcmp(m->literal[i].entry->data, name, len) == 0
+		) {
+			return m->literal[i].entry;
+		}
+		i = (i + 1) & m->hash_mask;
+	}
+	return NULL;
+}
+
+static const match_list_t *compile_list(match_list_t **compiled, const llist_t *list)
+{
+	match_list_t *m = *compiled;
+	const llist_t *l;
+	unsigned n, size;
+
+	/* The list must not be changed after it was compiled,
+	 * but it may be replaced by another one */
+	if (m && m->list == list)
+		return m;
+	if (m) {
+		free(m->literal);
+		free(m->wild);
+		free(m);
+	}
+
+	n = 0;
+	for (l = list; l; l = l->link)
+		n++;
+	size = 16;
+	while (size < 2 * n)
+		size <<= 1;
+
+	*compiled = m = xzalloc(sizeof(*m));
+	m->list = list;
+	m->hash_mask = size - 1;
+	m->literal = xzalloc(size * sizeof(m->literal[0]));
+	m->wild = xmalloc(n * sizeof(m->wild[0]));
+
+	for (l = list; l; l = l->link) {
+		const char *p = l->data;
+		unsigned len = strcspn(p, "*?[\\");
+		unsigned hash;
+
+		if (p[len]) {
+			m->wild[m->wild_cnt].entry = l;
+			m->wild[m->wild_cnt].fixed_len = len;
+			m->wild_cnt++;
+			continue;
+		}
+		hash = FNV_INIT;
+		while (*p)
+			hash = FNV(hash, *p++);
+		/* The first one of duplicates is found, as with list walk */
+		if (!find_literal(m, l->data, len, hash)) {
+			unsigned i = hash & m->hash_mask;
+			while (m->literal[i].entry)
+				i = (i + 1) & m->hash_mask;
+			m->literal[i].entry = l;
+			m->literal[i].hash = hash;
+			m->literal[i].len = len;
+		}
+	}
+	return m;
+}
+
+/* find_list_entry() using list compiled into *compiled on first use */
+const llist_t* FAST_FUNC find_compiled_list_entry(match_list_t **compiled,
+		const llist_t *list, const char *filename)
+{
+	const match_list_t *m;
+	const llist_t *found;
+	const char *p;
+	unsigned hash, i;
+
+	if (!list)
+		return NULL;
+	m = compile_list(compiled, list);
+
+	hash = FNV_INIT;
+	for (p = filename; *p; p++)
+		hash = FNV(hash, *p);
+	found = find_literal(m, filename, p - filename, hash);
+
+	for (i = 0; !found && i < m->wild_cnt; i++) {
+		const llist_t *l = m->wild[i].entry;
+		if (strncmp(filename, l->data, m->wild[i].fixed_len) == 0
+		 && fnmatch(l->data, filename, 0) == 0
+		) {
+			found = l;
+		}
+	}
+	return found;
+}
+
+/* find_list_entry2() using list compiled into *compiled on first use */
+const llist_t* FAST_FUNC find_compiled_list_entry2(match_list_t **compiled,
+		const llist_t *list, const char *filename)
+{
+	char buf[PATH_MAX];
+	const match_list_t *m;
+	const char *p;
+	unsigned hash, i;
+
+	if (!list)
+		return NULL;
+	m = compile_list(compiled, list);
+
+	/* Literal pattern matches if it is filename
+	 * or filename's leading path components */
+	hash = FNV_INIT;
+	for (p = filename; ; p++) {
+		if (*p == '/' || *p == '\0') {
+			const llist_t *found = find_literal(m, filename, p - filename, hash);
+			if (found)
+				return found;
+			if (*p == '\0')
+				break;
+		}
+		hash = FNV(hash, *p);
+	}
+
+	for (i = 0; i < m->wild_cnt; i++) {
+		const llist_t *l = m->wild[i].entry;
+		/* Leading literal part can't contain more path components
+		 * than we compare, it's safe to check it on whole filename */
+		if (strncmp(filename, l->data, m->wild[i].fixed_len) == 0
+		 && fnmatch(l->data, leading_components(buf, l->data, filename), 0) == 0
+		) {
+			return l;
+		}
+	}
+	return NULL;
+}
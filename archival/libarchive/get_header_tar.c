@@ -90,6 +90,60 @@ static unsigned long long getOctal(char *str, int len)
 }
 #define GET_OCTAL(a) getOctal((a), sizeof(a))
 
+#if ENABLE_FEATURE_TAR_SPARSE
+static off_t get_sparse_num(const char *p)
+{
+	char buf[13]; /* getOctal wants to trash the next char */
+	memcpy(buf, p, 12);
+	return getOctal(buf, 12);
+}
+
+/* Old GNU sparse file: read the map of data parts from the header
+ * and from extension blocks following it */
+static void get_sparse_map(archive_handle_t *archive_handle, const char *hdr)
+{
+	file_header_t *file_header = archive_handle->file_header;
+	char ext_hdr[512];
+	const char *sp = hdr + TAR_SPARSE_MAP;
+	int n = TAR_SPARSE_IN_HDR;
+	char extended = hdr[TAR_SPARSE_EXTENDED];
+	off_t *map = NULL;
+	unsigned cnt = 0;
+	off_t pos = 0, stored = 0;
+
+	file_header->tar__sparse_realsize = get_sparse_num(hdr + TAR_SPARSE_REALSIZE);
+	while (1) {
+		/* Unused entries are all zeros */
+		for (; n != 0 && sp[0]; n--, sp += 24) {
+			off_t offset = get_sparse_num(sp);
+			off_t len = get_sparse_num(sp + 12);
+			if (offset < pos || len < 0)
+				goto bad;
+			map = xrealloc_vector(map, 4, 2 * cnt);
+			map[2 * cnt] = offset;
+			map[2 * cnt + 1] = len;
+			cnt++;
+			pos = offset + len;
+			stored += len;
+		}
+		if (!extended)
+			break;
+		xread(archive_handle->src_fd, ext_hdr, 512);
+		archive_handle->offset += 512;
+		sp = ext_hdr;
+		n = TAR_SPARSE_IN_EXT;
+		extended = ext_hdr[TAR_SPARSE_IN_EXT * 24];
+	}
+	if (stored != file_header->size || pos > file_header->tar__sparse_realsize) {
+ bad:
+		bb_error_msg_and_die("corrupted sparse map");
+	}
+	/* Non-NULL map marks the file as sparse */
+	file_header->tar__sparse_map = map ? map : xzalloc(sizeof(*map));
+	file_header->tar__sparse_cnt = cnt;
+}
+#endif
+
 #if ENABLE_FEATURE_TAR_SELINUX
 /* Scan a PAX header for SELinux contexts, via "RHT.security.selinux" keyword.
  * This is what Red Hat's patched version of tar uses.
@@ -331,6 +385,14 @@ char FAST_FUNC get_header_tar(archive_handle_t *archive_handle)
 	/* Set bits 0-11 of the files mode */
 	file_header->mode = 07777 & GET_OCTAL(tar.mode);
 
+#if ENABLE_FEATURE_TAR_SPARSE
+	if (tar.typeflag == 'S') {
+		get_sparse_map(archive_handle, (char*)&tar);
+		/* prefix[] held the map, the name is all in name[] */
+		tar.prefix[0] = '\0';
+		parse_names = 1;
+	}
+#endif
 	file_header->name = NULL;
 	if (!p_longname && parse_names) {
 		/* we trash mode[0] here, it's ok */
@@ -412,10 +474,17 @@ char FAST_FUNC get_header_tar(archive_handle_t *archive_handle)
 		archive_handle->offset += file_header->size;
 		/* return get_header_tar(archive_handle); */
 		goto again;
+# if ENABLE_FEATURE_TAR_SPARSE
+	case 'S':	/* Sparse file, the map is read above */
+		file_header->mode |= S_IFREG;
+		break;
+# endif
 	case 'D':	/* GNU dump dir */
 	case 'M':	/* Continuation of multi volume archive */
 	case 'N':	/* Old GNU for names > 100 characters */
+# if !ENABLE_FEATURE_TAR_SPARSE
 	case 'S':	/* Sparse file */
+# endif
 	case 'V':	/* Volume header */
 #endif
 #if !ENABLE_FEATURE_TAR_SELINUX
@@ -492,6 +561,10 @@ char FAST_FUNC get_header_tar(archive_handle_t *archive_handle)
 #if ENABLE_FEATURE_TAR_UNAME_GNAME
 	free(file_header->tar__uname);
 	free(file_header->tar__gname);
+#endif
+#if ENABLE_FEATURE_TAR_SPARSE
+	free(file_header->tar__sparse_map);
+	file_header->tar__sparse_map = NULL;
 #endif
 	return EXIT_SUCCESS;
 }
@@ -10,6 +10,13 @@ void FAST_FUNC header_verbose_list(const file_header_t *file_header)
 {
 	struct tm tm_time;
 	struct tm *ptm = &tm_time; //localtime(&file_header->mtime);
+#if ENABLE_FEATURE_TAR_SPARSE
+	off_t size = file_header->tar__sparse_map
+			? file_header->tar__sparse_realsize
+			: file_header->size;
+#else
+	off_t size = file_header->size;
+#endif
 
 #if ENABLE_FEATURE_TAR_UNAME_GNAME
 	char uid[sizeof(int)*3 + 2];
@@ -33,7 +40,7 @@ void FAST_FUNC header_verbose_list(const file_header_t *file_header)
 		bb_mode_string(file_header->mode),
 		user,
 		group,
-		file_header->size,
+		size,
 		1900 + ptm->tm_year,
 		1 + ptm->tm_mon,
 		ptm->tm_mday,
@@ -50,7 +57,7 @@ void FAST_FUNC header_verbose_list(const file_header_t *file_header)
 		bb_mode_string(file_header->mode),
 		(unsigned)file_header->uid,
 		(unsigned)file_header->gid,
-		file_header->size,
+		size,
 		1900 + ptm->tm_year,
 		1 + ptm->tm_mon,
 		ptm->tm_mday,
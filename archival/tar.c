@@ -60,8 +60,8 @@
 
 #if !ENABLE_FEATURE_SEAMLESS_GZ && !ENABLE_FEATURE_SEAMLESS_BZ2
 /* Do not pass gzip flag to writeTarFile() */
-#define writeTarFile(tar_fd, verboseFlag, dereferenceFlag, include, exclude, gzip) \
-	writeTarFile(tar_fd, verboseFlag, dereferenceFlag, include, exclude)
+#define writeTarFile(tar_fd, verboseFlag, dereferenceFlag, sparseFlag, include, exclude, gzip) \
+	writeTarFile(tar_fd, verboseFlag, dereferenceFlag, sparseFlag, include, exclude)
 #endif
 
 
@@ -73,7 +73,7 @@
 ** Even these functions use the xxxHardLinkInfo() functions.
 */
 typedef struct HardLinkInfo {
-	struct HardLinkInfo *next; /* Next entry in list */
+	struct HardLinkInfo *next; /* Next entry in hash chain */
 	dev_t dev;                 /* Device number */
 	ino_t ino;                 /* Inode number */
 //	short linkCount;           /* (Hard) Link Count */
@@ -86,8 +86,17 @@ typedef struct TarBallInfo {
 	                                 * for the tarball */
 	int verboseFlag;                /* Whether to print extra stuff or not */
 	const llist_t *excludeList;     /* List of files to not include */
-	HardLinkInfo *hlInfoHead;       /* Hard Link Tracking Information */
+	HardLinkInfo **hlInfoHash;      /* Hard Link Tracking Information, */
+	unsigned hlInfoHashSize;        /* hashed by dev/ino */
+	unsigned hlInfoCount;
 	HardLinkInfo *hlInfo;           /* Hard Link Info for the current file */
+#if ENABLE_FEATURE_TAR_SPARSE
+	int sparseFlag;                 /* Look for holes in files (-S) */
+	unsigned sparseCnt;             /* Data parts of the current file: */
+	off_t *sparseMap;               /* (offset, size) pairs */
+	off_t sparseSize;               /* sum of their sizes */
+	unsigned sparseMapPos;          /* next pair to write into header */
+#endif
 //TODO: save only st_dev + st_ino
 	struct stat tarFileStatBuf;     /* Stat info for the tarball, letting
 	                                 * us know the inode and device that the
@@ -108,44 +117,81 @@ enum {
 	CONTTYPE = '7',		/* reserved */
 	GNULONGLINK = 'K',	/* GNU long (>100 chars) link name */
 	GNULONGNAME = 'L',	/* GNU long (>100 chars) file name */
+	GNUSPARSE = 'S',	/* GNU sparse file */
 };
 
-/* Might be faster (and bigger) if the dev/ino were stored in numeric order;) */
-static void addHardLinkInfo(HardLinkInfo **hlInfoHeadPtr,
+/* hlInfoHashSize is a power of 2 */
+static unsigned hashHardLinkInfo(dev_t dev, ino_t ino, unsigned size)
+{
+	unsigned h = (unsigned)ino * 0x9e3779b1 + (unsigned)dev;
+	return (h ^ (h >> 16)) & (size - 1);
+}
+
+static void addHardLinkInfo(TarBallInfo *tbInfo,
 					struct stat *statbuf,
 					const char *fileName)
 {
-	/* Note: hlInfoHeadPtr can never be NULL! */
 	HardLinkInfo *hlInfo;
+	HardLinkInfo **bucket;
+
+	/* Keep chains short: double the table when it gets full */
+	if (tbInfo->hlInfoCount >= tbInfo->hlInfoHashSize) {
+		unsigned newSize = tbInfo->hlInfoHashSize ? tbInfo->hlInfoHashSize * 2 : 256;
+		HardLinkInfo **newHash = xzalloc(newSize * sizeof(newHash[0]));
+		unsigned i;
+
+		for (i = 0; i < tbInfo->hlInfoHashSize; i++) {
+			hlInfo = tbInfo->hlInfoHash[i];
+			while (hlInfo) {
+				HardLinkInfo *hlInfoNext = hlInfo->next;
+				bucket = &newHash[hashHardLinkInfo(hlInfo->dev, hlInfo->ino, newSize)];
+				hlInfo->next = *bucket;
+				*bucket = hlInfo;
+				hlInfo = hlInfoNext;
+			}
+		}
+		free(tbInfo->hlInfoHash);
+		tbInfo->hlInfoHash = newHash;
+		tbInfo->hlInfoHashSize = newSize;
+	}
 
 	hlInfo = xmalloc(sizeof(HardLinkInfo) + strlen(fileName));
-	hlInfo->next = *hlInfoHeadPtr;
-	*hlInfoHeadPtr = hlInfo;
+	bucket = &tbInfo->hlInfoHash[hashHardLinkInfo(statbuf->st_dev, statbuf->st_ino, tbInfo->hlInfoHashSize)];
+	hlInfo->next = *bucket;
+	*bucket = hlInfo;
+	tbInfo->hlInfoCount++;
 	hlInfo->dev = statbuf->st_dev;
 	hlInfo->ino = statbuf->st_ino;
 //	hlInfo->linkCount = statbuf->st_nlink;
 	strcpy(hlInfo->name, fileName);
 }
 
-static void freeHardLinkInfo(HardLinkInfo **hlInfoHeadPtr)
+static void freeHardLinkInfo(TarBallInfo *tbInfo)
 {
 	HardLinkInfo *hlInfo;
 	HardLinkInfo *hlInfoNext;
+	unsigned i;
 
-	if (hlInfoHeadPtr) {
-		hlInfo = *hlInfoHeadPtr;
+	for (i = 0; i < tbInfo->hlInfoHashSize; i++) {
+		hlInfo = tbInfo->hlInfoHash[i];
 		while (hlInfo) {
 			hlInfoNext = hlInfo->next;
 			free(hlInfo);
 			hlInfo = hlInfoNext;
 		}
-		*hlInfoHeadPtr = NULL;
 	}
+	free(tbInfo->hlInfoHash);
+	tbInfo->hlInfoHash = NULL;
+	tbInfo->hlInfoHashSize = tbInfo->hlInfoCount = 0;
 }
 
-/* Might be faster (and bigger) if the dev/ino were stored in numeric order ;) */
-static HardLinkInfo *findHardLinkInfo(HardLinkInfo *hlInfo, struct stat *statbuf)
+static HardLinkInfo *findHardLinkInfo(TarBallInfo *tbInfo, struct stat *statbuf)
 {
+	HardLinkInfo *hlInfo;
+
+	if (!tbInfo->hlInfoHash)
+		return NULL;
+	hlInfo = tbInfo->hlInfoHash[hashHardLinkInfo(statbuf->st_dev, statbuf->st_ino, tbInfo->hlInfoHashSize)];
 	while (hlInfo) {
 		if (statbuf->st_ino == hlInfo->ino
 		 && statbuf->st_dev == hlInfo->dev
@@ -181,6 +227,44 @@ static void putOctal(char *cp, int len, off_t value)
 }
 #define PUT_OCTAL(a, b) putOctal((a), sizeof(a), (b))
 
+/* Put a size into a 12-byte field: octal if it fits,
+ * else GNU base-256 encoding. Returns FALSE if it does not fit at all */
+static int putSize(char *cp, uoff_t value)
+{
+	/* Does octal-encoded size fit? */
+	if (sizeof(value) <= 4
+	 || value <= (uoff_t)0777777777777LL
+	) {
+		putOctal(cp, 12, value);
+		return TRUE;
+	}
+	/* Does base256-encoded size fit?
+	 * It always does unless off_t is wider than 64 bits.
+	 */
+	if (ENABLE_FEATURE_TAR_GNU_EXTENSIONS
+#if ULLONG_MAX > 0xffffffffffffffffLL /* 2^64-1 */
+	 && (value <= 0x3fffffffffffffffffffffffLL)
+#endif
+	) {
+		/* GNU tar uses "base-256 encoding" for very large numbers.
+		 * Encoding is binary, with highest bit always set as a marker
+		 * and sign in next-highest bit:
+		 * 80 00 .. 00 - zero
+		 * bf ff .. ff - largest positive number
+		 * ff ff .. ff - minus 1
+		 * c0 00 .. 00 - smallest negative number
+		 */
+		char *p8 = cp + 12;
+		do {
+			*--p8 = (uint8_t)value;
+			value >>= 8;
+		} while (p8 != cp);
+		*p8 |= 0x80;
+		return TRUE;
+	}
+	return FALSE;
+}
+
 static void chksum_and_xwrite(int fd, struct tar_header_t* hp)
 {
 	/* POSIX says that checksum is done on unsigned bytes
@@ -249,6 +333,74 @@ static void writeLongname(int fd, int type, const char *name, int dir)
 }
 #endif
 
+#if ENABLE_FEATURE_TAR_SPARSE
+# ifndef __MINGW32__
+#  ifndef SEEK_DATA
+/* Linux 3.1+ values. Older kernels fail with EINVAL,
+ * then files are stored without looking for holes */
+#   define SEEK_DATA 3
+#   define SEEK_HOLE 4
+#  endif
+
+/* Find data parts of a file with holes (and only if it has any,
+ * on a filesystem which can tell where they are).
+ * Sets tbInfo->sparseCnt to 0 if the file is to be stored as is */
+static void getSparseMap(TarBallInfo *tbInfo, int fd, off_t filesize)
+{
+	off_t *map = tbInfo->sparseMap;
+	off_t data, end = 0;
+	unsigned cnt = 0;
+
+	tbInfo->sparseCnt = 0;
+	tbInfo->sparseSize = 0;
+	while (end < filesize) {
+		data = lseek(fd, end, SEEK_DATA);
+		if (data < 0) {
+			if (errno != ENXIO) /* SEEK_DATA is not supported */
+				return;
+			break; /* the rest is a hole */
+		}
+		if (data >= filesize)
+			break;
+		end = lseek(fd, data, SEEK_HOLE);
+		if (end < 0)
+			return;
+		if (end > filesize) /* file grew */
+			end = filesize;
+		tbInfo->sparseMap = map = xrealloc_vector(map, 4, 2 * cnt);
+		map[2 * cnt] = data;
+		map[2 * cnt + 1] = end - data;
+		cnt++;
+		tbInfo->sparseSize += end - data;
+	}
+	if (tbInfo->sparseSize == filesize)
+		return; /* no holes */
+	if (end < filesize) {
+		/* Like GNU tar, mark the size of a file ending in a hole
+		 * with an empty data part at EOF */
+		tbInfo->sparseMap = map = xrealloc_vector(map, 4, 2 * cnt);
+		map[2 * cnt] = filesize;
+		map[2 * cnt + 1] = 0;
+		cnt++;
+	}
+	tbInfo->sparseCnt = cnt;
+}
+# endif
+
+/* Put up to n map entries at sp, set "isextended" flag after them
+ * if there are more */
+static void putSparseMap(TarBallInfo *tbInfo, char *sp, int n)
+{
+	while (--n >= 0 && tbInfo->sparseMapPos < tbInfo->sparseCnt) {
+		const off_t *p = &tbInfo->sparseMap[2 * tbInfo->sparseMapPos++];
+		putSize(sp, p[0]);
+		putSize(sp + 12, p[1]);
+		sp += 24;
+	}
+	sp[(n + 1) * 24] = (tbInfo->sparseMapPos < tbInfo->sparseCnt);
+}
+#endif
+
 /* Write out a tar header for the specified file/directory/whatever */
 static int writeTarHeader(struct TarBallInfo *tbInfo,
 		const char *header_name, const char *fileName, struct stat *statbuf)
@@ -317,42 +469,25 @@ static int writeTarHeader(struct TarBallInfo *tbInfo,
 	} else if (S_ISFIFO(statbuf->st_mode)) {
 		header.typeflag = FIFOTYPE;
 	} else if (S_ISREG(statbuf->st_mode)) {
-		/* header.size field is 12 bytes long */
-		/* Does octal-encoded size fit? */
 		uoff_t filesize = statbuf->st_size;
-		if (sizeof(filesize) <= 4
-		 || filesize <= (uoff_t)0777777777777LL
-		) {
-			PUT_OCTAL(header.size, filesize);
+
+		header.typeflag = REGTYPE;
+#if ENABLE_FEATURE_TAR_SPARSE
+		if (tbInfo->sparseCnt) {
+			/* Only data parts are stored */
+			header.typeflag = GNUSPARSE;
+			filesize = tbInfo->sparseSize;
+			putSize((char*)&header + TAR_SPARSE_REALSIZE, statbuf->st_size);
+			tbInfo->sparseMapPos = 0;
+			putSparseMap(tbInfo, (char*)&header + TAR_SPARSE_MAP, TAR_SPARSE_IN_HDR);
 		}
-		/* Does base256-encoded size fit?
-		 * It always does unless off_t is wider than 64 bits.
-		 */
-		else if (ENABLE_FEATURE_TAR_GNU_EXTENSIONS
-#if ULLONG_MAX > 0xffffffffffffffffLL /* 2^64-1 */
-		 && (filesize <= 0x3fffffffffffffffffffffffLL)
 #endif
-		) {
-	                /* GNU tar uses "base-256 encoding" for very large numbers.
-	                 * Encoding is binary, with highest bit always set as a marker
-	                 * and sign in next-highest bit:
-	                 * 80 00 .. 00 - zero
-	                 * bf ff .. ff - largest positive number
-	                 * ff ff .. ff - minus 1
-	                 * c0 00 .. 00 - smallest negative number
-			 */
-			char *p8 = header.size + sizeof(header.size);
-			do {
-				*--p8 = (uint8_t)filesize;
-				filesize >>= 8;
-			} while (p8 != header.size);
-			*p8 |= 0x80;
-		} else {
+		/* header.size field is 12 bytes long */
+		if (!putSize(header.size, filesize)) {
 			bb_error_msg_and_die("can't store file '%s' "
 				"of size %"OFF_FMT"u, aborting",
 				fileName, statbuf->st_size);
 		}
-		header.typeflag = REGTYPE;
 	} else {
 		bb_error_msg("%s: unknown file type", fileName);
 		return FALSE;
@@ -368,6 +503,14 @@ static int writeTarHeader(struct TarBallInfo *tbInfo,
 
 	/* Now write the header out to disk */
 	chksum_and_xwrite(tbInfo->tarFd, &header);
+#if ENABLE_FEATURE_TAR_SPARSE
+	/* and the rest of sparse map, if any */
+	while (tbInfo->sparseMapPos < tbInfo->sparseCnt) {
+		memset(&header, 0, sizeof(header));
+		putSparseMap(tbInfo, (char*)&header, TAR_SPARSE_IN_EXT);
+		xwrite(tbInfo->tarFd, &header, sizeof(header));
+	}
+#endif
 
 	/* Now do the verbose thing (or not) */
 	if (tbInfo->verboseFlag) {
@@ -442,15 +585,15 @@ static int FAST_FUNC writeFileToTarball(const char *fileName, struct stat *statb
 	 * If so -
 	 * Treat the first occurance of a given dev/inode as a file while
 	 * treating any additional occurances as hard links.  This is done
-	 * by adding the file information to the HardLinkInfo linked list.
+	 * by adding the file information to the HardLinkInfo hash table.
 	 */
 	tbInfo->hlInfo = NULL;
 	if (!S_ISDIR(statbuf->st_mode) && statbuf->st_nlink > 1) {
 		DBG("'%s': st_nlink > 1", header_name);
-		tbInfo->hlInfo = findHardLinkInfo(tbInfo->hlInfoHead, statbuf);
+		tbInfo->hlInfo = findHardLinkInfo(tbInfo, statbuf);
 		if (tbInfo->hlInfo == NULL) {
 			DBG("'%s': addHardLinkInfo", header_name);
-			addHardLinkInfo(&tbInfo->hlInfoHead, statbuf, header_name);
+			addHardLinkInfo(tbInfo, statbuf, header_name);
 		}
 	}
 
@@ -483,6 +626,21 @@ static int FAST_FUNC writeFileToTarball(const char *fileName, struct stat *statb
 		if (inputFileFd < 0) {
 			return FALSE;
 		}
+#if ENABLE_FEATURE_TAR_SPARSE
+		tbInfo->sparseCnt = 0;
+# ifndef __MINGW32__
+		/* Fewer blocks than size: there are holes */
+		if (tbInfo->sparseFlag
+		 && (off_t)statbuf->st_blocks * 512 < statbuf->st_size
+		) {
+			getSparseMap(tbInfo, inputFileFd, statbuf->st_size);
+			xlseek(inputFileFd, 0, SEEK_SET);
+		}
+# else
+		/* MinGW has neither st_blocks nor SEEK_DATA,
+		 * files are stored as is */
+# endif
+#endif
 	}
 
 	/* Add an entry to the tarball */
@@ -493,13 +651,27 @@ static int FAST_FUNC writeFileToTarball(const char *fileName, struct stat *statb
 	/* If it was a regular file, write out the body */
 	if (inputFileFd >= 0) {
 		size_t readSize;
+		off_t dataSize = statbuf->st_size;
 		/* Write the file to the archive. */
 		/* We record size into header first, */
 		/* and then write out file. If file shrinks in between, */
 		/* tar will be corrupted. So we don't allow for that. */
 		/* NB: GNU tar 1.16 warns and pads with zeroes */
 		/* or even seeks back and updates header */
-		bb_copyfd_exact_size(inputFileFd, tbInfo->tarFd, statbuf->st_size);
+#if ENABLE_FEATURE_TAR_SPARSE
+		if (tbInfo->sparseCnt) {
+			/* Only data parts are stored, holes are not read */
+			const off_t *p = tbInfo->sparseMap;
+			unsigned i;
+			for (i = 0; i < tbInfo->sparseCnt; i++, p += 2) {
+				xlseek(inputFileFd, p[0], SEEK_SET);
+				bb_copyfd_exact_size(inputFileFd, tbInfo->tarFd, p[1]);
+			}
+			dataSize = tbInfo->sparseSize;
+			tbInfo->sparseCnt = 0;
+		} else
+#endif
+		bb_copyfd_exact_size(inputFileFd, tbInfo->tarFd, dataSize);
 		////off_t readSize;
 		////readSize = bb_copyfd_size(inputFileFd, tbInfo->tarFd, statbuf->st_size);
 		////if (readSize != statbuf->st_size && readSize >= 0) {
@@ -513,7 +685,7 @@ static int FAST_FUNC writeFileToTarball(const char *fileName, struct stat *statb
 
 		/* Pad the file up to the tar block size */
 		/* (a few tricks here in the name of code size) */
-		readSize = (-(int)statbuf->st_size) & (TAR_BLOCK_SIZE-1);
+		readSize = (-(int)dataSize) & (TAR_BLOCK_SIZE-1);
 		memset(block_buf, 0, readSize);
 		xwrite(tbInfo->tarFd, block_buf, readSize);
 	}
@@ -600,15 +772,21 @@ static void NOINLINE vfork_compressor(int tar_fd, int gzip)
 
 /* gcc 4.2.1 inlines it, making code bigger */
 static NOINLINE int writeTarFile(int tar_fd, int verboseFlag,
-	int dereferenceFlag, const llist_t *include,
+	int dereferenceFlag, int sparseFlag UNUSED_PARAM, const llist_t *include,
 	const llist_t *exclude, int gzip)
 {
 	int errorFlag = FALSE;
 	struct TarBallInfo tbInfo;
 
-	tbInfo.hlInfoHead = NULL;
+	tbInfo.hlInfoHash = NULL;
+	tbInfo.hlInfoHashSize = tbInfo.hlInfoCount = 0;
 	tbInfo.tarFd = tar_fd;
 	tbInfo.verboseFlag = verboseFlag;
+#if ENABLE_FEATURE_TAR_SPARSE
+	tbInfo.sparseFlag = sparseFlag;
+	tbInfo.sparseCnt = 0;
+	tbInfo.sparseMap = NULL;
+#endif
 
 	/* Store the stat info for the tarball's file, so
 	 * can avoid including the tarball into itself....  */
@@ -644,8 +822,10 @@ static NOINLINE int writeTarFile(int tar_fd, int verboseFlag,
 	close(tbInfo.tarFd);
 
 	/* Hang up the tools, close up shop, head home */
-	if (ENABLE_FEATURE_CLEAN_UP)
-		freeHardLinkInfo(&tbInfo.hlInfoHead);
+	if (ENABLE_FEATURE_CLEAN_UP) {
+		freeHardLinkInfo(&tbInfo);
+		IF_FEATURE_TAR_SPARSE(free(tbInfo.sparseMap);)
+	}
 
 	if (errorFlag)
 		bb_error_msg("error exit delayed from previous errors");
@@ -664,7 +844,7 @@ static NOINLINE int writeTarFile(int tar_fd, int verboseFlag,
 }
 #else
 int writeTarFile(int tar_fd, int verboseFlag,
-	int dereferenceFlag, const llist_t *include,
+	int dereferenceFlag, int sparseFlag, const llist_t *include,
 	const llist_t *exclude, int gzip);
 #endif /* FEATURE_TAR_CREATE */
 
@@ -748,6 +928,7 @@ static void handle_SIGCHLD(int status)
 //usage:	IF_FEATURE_SEAMLESS_LZMA("a")
 //usage:	IF_FEATURE_TAR_CREATE("h")
 //usage:	IF_FEATURE_TAR_NOPRESERVE_TIME("m")
+//usage:	IF_FEATURE_TAR_CREATE(IF_FEATURE_TAR_SPARSE("S"))
 //usage:	"vO] "
 //usage:	IF_FEATURE_TAR_FROM("[-X FILE] [-T FILE] ")
 //usage:	"[-f TARFILE] [-C DIR] [FILE]..."
@@ -783,6 +964,9 @@ static void handle_SIGCHLD(int status)
 //usage:	IF_FEATURE_TAR_NOPRESERVE_TIME(
 //usage:     "\n	m	Don't restore mtime"
 //usage:	)
+//usage:	IF_FEATURE_TAR_CREATE(IF_FEATURE_TAR_SPARSE(
+//usage:     "\n	S	Don't store holes of sparse files"
+//usage:	))
 //usage:	IF_FEATURE_TAR_FROM(
 //usage:	IF_FEATURE_TAR_LONG_OPTIONS(
 //usage:     "\n	exclude	File to exclude"
@@ -817,6 +1001,7 @@ enum {
 	IF_FEATURE_SEAMLESS_GZ(  OPTBIT_GZIP        ,)
 	IF_FEATURE_SEAMLESS_Z(   OPTBIT_COMPRESS    ,) // 16th bit
 	IF_FEATURE_TAR_NOPRESERVE_TIME(OPTBIT_NOPRESERVE_TIME,)
+	IF_FEATURE_TAR_SPARSE(   OPTBIT_SPARSE      ,)
 #if ENABLE_FEATURE_TAR_LONG_OPTIONS
 	IF_FEATURE_TAR_TO_COMMAND(OPTBIT_2COMMAND   ,)
 	OPTBIT_NUMERIC_OWNER,
@@ -841,6 +1026,7 @@ enum {
 	OPT_GZIP         = IF_FEATURE_SEAMLESS_GZ(  (1 << OPTBIT_GZIP        )) + 0, // z
 	OPT_COMPRESS     = IF_FEATURE_SEAMLESS_Z(   (1 << OPTBIT_COMPRESS    )) + 0, // Z
 	OPT_NOPRESERVE_TIME = IF_FEATURE_TAR_NOPRESERVE_TIME((1 << OPTBIT_NOPRESERVE_TIME)) + 0, // m
+	OPT_SPARSE          = IF_FEATURE_TAR_SPARSE(      (1 << OPTBIT_SPARSE         )) + 0, // S
 	OPT_2COMMAND        = IF_FEATURE_TAR_TO_COMMAND(  (1 << OPTBIT_2COMMAND       )) + 0, // to-command
 	OPT_NUMERIC_OWNER   = IF_FEATURE_TAR_LONG_OPTIONS((1 << OPTBIT_NUMERIC_OWNER  )) + 0, // numeric-owner
 	OPT_NOPRESERVE_PERM = IF_FEATURE_TAR_LONG_OPTIONS((1 << OPTBIT_NOPRESERVE_PERM)) + 0, // no-same-permissions
@@ -883,6 +1069,9 @@ static const char tar_longopts[] ALIGN1 =
 # if ENABLE_FEATURE_TAR_NOPRESERVE_TIME
 	"touch\0"               No_argument       "m"
 # endif
+# if ENABLE_FEATURE_TAR_SPARSE
+	"sparse\0"              No_argument       "S"
+# endif
 # if ENABLE_FEATURE_TAR_TO_COMMAND
 	"to-command\0"		Required_argument "\xfb"
 # endif
@@ -909,6 +1098,7 @@ int tar_main(int argc UNUSED_PARAM, char **argv)
 	const char *tar_filename = "-";
 	unsigned opt;
 	int verboseFlag = 0;
+	match_list_t *passed_compiled = NULL;
 #if ENABLE_FEATURE_TAR_LONG_OPTIONS && ENABLE_FEATURE_TAR_FROM
 	llist_t *excludes = NULL;
 #endif
@@ -972,6 +1162,7 @@ int tar_main(int argc UNUSED_PARAM, char **argv)
 		IF_FEATURE_SEAMLESS_GZ(  "z"   )
 		IF_FEATURE_SEAMLESS_Z(   "Z"   )
 		IF_FEATURE_TAR_NOPRESERVE_TIME("m")
+		IF_FEATURE_TAR_SPARSE(   "S"   )
 		, &base_dir // -C dir
 		, &tar_filename // -f filename
 		IF_FEATURE_TAR_FROM(, &(tar_handle->accept)) // T
@@ -1113,6 +1304,7 @@ int tar_main(int argc UNUSED_PARAM, char **argv)
 #endif
 		/* NB: writeTarFile() closes tar_handle->src_fd */
 		return writeTarFile(tar_handle->src_fd, verboseFlag, opt & OPT_DEREFERENCE,
+				opt & OPT_SPARSE,
 				tar_handle->accept,
 				tar_handle->reject, zipMode);
 	}
@@ -1122,8 +1314,10 @@ int tar_main(int argc UNUSED_PARAM, char **argv)
 
 	/* Check that every file that should have been extracted was */
 	while (tar_handle->accept) {
-		if (!find_list_entry(tar_handle->reject, tar_handle->accept->data)
-		 && !find_list_entry(tar_handle->passed, tar_handle->accept->data)
+		if (!find_compiled_list_entry(&tar_handle->reject_compiled,
+				tar_handle->reject, tar_handle->accept->data)
+		 && !find_compiled_list_entry(&passed_compiled,
+				tar_handle->passed, tar_handle->accept->data)
 		) {
 			bb_error_msg_and_die("%s: not found in archive",
 				tar_handle->accept->data);
@@ -30,9 +30,15 @@
 //usage:     "\n	-q	Quiet"
 //usage:     "\n	-x XLST	Exclude these files"
 //usage:     "\n	-d DIR	Extract files into DIR"
+//usage:	IF_FEATURE_UNZIP_PARALLEL(
+//usage:     "\n	--jobs N Inflate files using N parallel workers"
+//usage:	)
 
 #include "libbb.h"
 #include "archive.h"
+#if ENABLE_FEATURE_UNZIP_PARALLEL
+# include <getopt.h>
+#endif
 
 enum {
 #if BB_BIG_ENDIAN
@@ -155,6 +161,7 @@ struct BUG_cde_header_must_be_16_bytes {
 };
 
 #define FIX_ENDIANNESS_CDE(cde_header) do { \
+	(cde_header).formatted.cdf_size = SWAP_LE32((cde_header).formatted.cdf_size); \
 	(cde_header).formatted.cdf_offset = SWAP_LE32((cde_header).formatted.cdf_offset); \
 } while (0)
 
@@ -165,8 +172,13 @@ enum { zip_fd = 3 };
 
 #define PEEK_FROM_END 16384
 
+/* Central directory, read into memory in one go on first use */
+static uint8_t *cdf_buf;
+static uint32_t cdf_start;
+static uint32_t cdf_size;
+
 /* NB: does not preserve file position! */
-static uint32_t find_cdf_offset(void)
+static uint32_t find_cdf_offset(uint32_t *size)
 {
 	cde_header_t cde_header;
 	unsigned char *p;
@@ -196,6 +208,7 @@ static uint32_t find_cdf_offset(void)
 		memcpy(cde_header.raw, p + 1, CDE_HEADER_LEN);
 		FIX_ENDIANNESS_CDE(cde_header);
 		free(buf);
+		*size = cde_header.formatted.cdf_size;
 		return cde_header.formatted.cdf_offset;
 	}
 	//free(buf);
@@ -204,22 +217,30 @@ static uint32_t find_cdf_offset(void)
 
 static uint32_t read_next_cdf(uint32_t cdf_offset, cdf_header_t *cdf_ptr)
 {
-	off_t org;
-
-	org = xlseek(zip_fd, 0, SEEK_CUR);
-
+	if (!cdf_buf) {
+		off_t org = xlseek(zip_fd, 0, SEEK_CUR);
+
+		cdf_start = find_cdf_offset(&cdf_size);
+		cdf_buf = xmalloc(cdf_size);
+		xlseek(zip_fd, cdf_start, SEEK_SET);
+		xread(zip_fd, cdf_buf, cdf_size);
+		xlseek(zip_fd, org, SEEK_SET);
+	}
 	if (!cdf_offset)
-		cdf_offset = find_cdf_offset();
+		cdf_offset = cdf_start;
 
-	xlseek(zip_fd, cdf_offset + 4, SEEK_SET);
-	xread(zip_fd, cdf_ptr->raw, CDF_HEADER_LEN);
+	if (cdf_size < 4 + CDF_HEADER_LEN
+	 || cdf_offset - cdf_start > cdf_size - (4 + CDF_HEADER_LEN)
+	) {
+		bb_error_msg_and_die("short read");
+	}
+	memcpy(cdf_ptr->raw, cdf_buf + (cdf_offset - cdf_start) + 4, CDF_HEADER_LEN);
 	FIX_ENDIANNESS_CDF(*cdf_ptr);
 	cdf_offset += 4 + CDF_HEADER_LEN
 		+ cdf_ptr->formatted.file_name_length
 		+ cdf_ptr->formatted.extra_field_length
 		+ cdf_ptr->formatted.file_comment_length;
 
-	xlseek(zip_fd, org, SEEK_SET);
 	return cdf_offset;
 };
 #endif
@@ -265,6 +286,128 @@ static void unzip_extract(zip_header_t *zip_header, int dst_fd)
 	}
 }
 
+#if ENABLE_FEATURE_UNZIP_PARALLEL
+/* With --jobs N, the main loop still walks the archive, applies filters,
+ * creates directories and asks overwrite questions in archive order,
+ * but instead of inflating each file it only creates it and records
+ * where its data lives. The recorded files are then inflated by
+ * N forked workers, each with its own descriptor of the zip file.
+ * (Not -j: Info-ZIP uses that for "junk paths").
+ */
+struct unzip_job {
+	char *dst_fn;
+	off_t data_offset;
+	zip_header_t zip_header;
+};
+
+enum { OPT_jobs = 0x100 };
+static const struct option unzip_longopts[] = {
+	{ "jobs", required_argument, NULL, OPT_jobs },
+	{ NULL, 0, NULL, 0 }
+};
+
+static int cmp_job_name(const void *a, const void *b)
+{
+	const struct unzip_job *ja = *(const struct unzip_job **)a;
+	const struct unzip_job *jb = *(const struct unzip_job **)b;
+	int r = strcmp(ja->dst_fn, jb->dst_fn);
+	if (r == 0) /* keep archive order among equal names */
+		r = (ja > jb) - (ja < jb);
+	return r;
+}
+
+/* An archive may hold several members with the same name. Serially,
+ * each one truncates the file and the last one wins. Workers would
+ * write them concurrently, so only keep the last job for each name.
+ */
+static void unzip_drop_dup_jobs(struct unzip_job *job, unsigned job_cnt)
+{
+	struct unzip_job **sorted;
+	unsigned i;
+
+	sorted = xmalloc(job_cnt * sizeof(sorted[0]));
+	for (i = 0; i < job_cnt; i++)
+		sorted[i] = &job[i];
+	qsort(sorted, job_cnt, sizeof(sorted[0]), cmp_job_name);
+	for (i = 1; i < job_cnt; i++) {
+		if (strcmp(sorted[i - 1]->dst_fn, sorted[i]->dst_fn) == 0) {
+			free(sorted[i - 1]->dst_fn);
+			sorted[i - 1]->dst_fn = NULL;
+		}
+	}
+	free(sorted);
+}
+
+static void unzip_run_jobs(const char *zip_fn, struct unzip_job *job, unsigned job_cnt, unsigned workers)
+{
+	off_t *load;
+	unsigned *owner;
+	pid_t *pids;
+	unsigned i, w;
+	int status, failed;
+
+	if (workers > job_cnt)
+		workers = job_cnt;
+	if (workers == 0)
+		return;
+
+	unzip_drop_dup_jobs(job, job_cnt);
+
+	/* Spread the files so that every worker gets
+	 * roughly the same amount of compressed data */
+	load = xzalloc(workers * sizeof(load[0]));
+	owner = xmalloc(job_cnt * sizeof(owner[0]));
+	for (i = 0; i < job_cnt; i++) {
+		unsigned best = 0;
+		if (!job[i].dst_fn) {
+			owner[i] = workers; /* nobody */
+			continue;
+		}
+		for (w = 1; w < workers; w++)
+			if (load[w] < load[best])
+				best = w;
+		owner[i] = best;
+		/* +1: count empty files too */
+		load[best] += job[i].zip_header.formatted.cmpsize + 1;
+	}
+	free(load);
+
+	pids = xmalloc(workers * sizeof(pids[0]));
+	fflush_all();
+	for (w = 0; w < workers; w++) {
+		pids[w] = xfork();
+		if (pids[w] == 0) {
+			/* Child: private file position, can't share zip_fd */
+			xmove_fd(xopen(zip_fn, O_RDONLY), zip_fd);
+			for (i = 0; i < job_cnt; i++) {
+				int dst_fd;
+
+				if (owner[i] != w)
+					continue;
+				dst_fd = xopen(job[i].dst_fn, O_WRONLY);
+				xlseek(zip_fd, job[i].data_offset, SEEK_SET);
+				unzip_extract(&job[i].zip_header, dst_fd);
+				close(dst_fd);
+			}
+			_exit(EXIT_SUCCESS);
+		}
+	}
+
+	failed = 0;
+	for (w = 0; w < workers; w++) {
+		if (safe_waitpid(pids[w], &status, 0) < 0 || status != 0)
+			failed = 1;
+	}
+	if (failed)
+		xfunc_die(); /* worker already said why */
+
+	if (ENABLE_FEATURE_CLEAN_UP) {
+		free(pids);
+		free(owner);
+	}
+}
+#endif
+
 int unzip_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int unzip_main(int argc, char **argv)
 {
@@ -291,6 +434,12 @@ int unzip_main(int argc, char **argv)
 	int opt_range = 0;
 	char key_buf[80];
 	struct stat stat_buf;
+#if ENABLE_FEATURE_UNZIP_PARALLEL
+	unsigned workers = 0;
+	unsigned job_cnt = 0;
+	struct unzip_job *job = NULL;
+	char *zip_fn = NULL;
+#endif
 
 /* -q, -l and -v: UnZip 5.52 of 28 February 2005, by Info-ZIP:
  *
@@ -334,7 +483,11 @@ int unzip_main(int argc, char **argv)
  */
 
 	/* '-' makes getopt return 1 for non-options */
+#if ENABLE_FEATURE_UNZIP_PARALLEL
+	while ((opt = getopt_long(argc, argv, "-d:lnopqxv", unzip_longopts, NULL)) != -1) {
+#else
 	while ((opt = getopt(argc, argv, "-d:lnopqxv")) != -1) {
+#endif
 		switch (opt_range) {
 		case 0: /* Options */
 			switch (opt) {
@@ -362,6 +515,12 @@ int unzip_main(int argc, char **argv)
 				listing = 1;
 				break;
 
+#if ENABLE_FEATURE_UNZIP_PARALLEL
+			case OPT_jobs: /* Parallel workers */
+				workers = xatou_range(optarg, 1, 1024);
+				break;
+#endif
+
 			case 1: /* The zip file */
 				/* +5: space for ".zip" and NUL */
 				src_fn = xmalloc(strlen(optarg) + 5);
@@ -431,6 +590,11 @@ int unzip_main(int argc, char **argv)
 			bb_error_msg_and_die("can't open %s, %s.zip, %s.ZIP", src_fn, src_fn, src_fn);
 		}
 		xmove_fd(src_fd, zip_fd);
+#if ENABLE_FEATURE_UNZIP_PARALLEL
+		/* Workers reopen the file, possibly after chdir */
+		if (workers > 1 && !listing && dst_fd != STDOUT_FILENO)
+			zip_fn = xmalloc_realpath(src_fn);
+#endif
 	}
 
 	/* Change dir if necessary */
@@ -645,6 +809,20 @@ int unzip_main(int argc, char **argv)
 			if (!quiet) {
 				printf("  inflating: %s\n", dst_fn);
 			}
+#if ENABLE_FEATURE_UNZIP_PARALLEL
+			if (zip_fn) {
+				/* File is created, leave inflating to workers */
+				close(dst_fd);
+				job = xrealloc_vector(job, 8, job_cnt);
+				job[job_cnt].dst_fn = dst_fn;
+				job[job_cnt].data_offset = xlseek(zip_fd, 0, SEEK_CUR);
+				job[job_cnt].zip_header = zip_header;
+				job_cnt++;
+				dst_fn = NULL; /* job owns it now */
+				unzip_skip(zip_header.formatted.cmpsize);
+				break;
+			}
+#endif
 			unzip_extract(&zip_header, dst_fd);
 			if (dst_fd != STDOUT_FILENO) {
 				/* closing STDOUT is potentially bad for future business */
@@ -678,6 +856,11 @@ int unzip_main(int argc, char **argv)
 		total_entries++;
 	}
 
+#if ENABLE_FEATURE_UNZIP_PARALLEL
+	if (zip_fn)
+		unzip_run_jobs(zip_fn, job, job_cnt, workers);
+#endif
+
 	if (listing && quiet <= 1) {
 		if (!verbose) {
 			//      "  Length     Date   Time    Name\n"
@@ -48,7 +48,7 @@ int comm_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int comm_main(int argc UNUSED_PARAM, char **argv)
 {
 	char *thisline[2];
-	FILE *stream[2];
+	line_reader_t *stream[2];
 	int i;
 	int order;
 
@@ -57,19 +57,19 @@ int comm_main(int argc UNUSED_PARAM, char **argv)
 	argv += optind;
 
 	for (i = 0; i < 2; ++i) {
-		stream[i] = xfopen_stdin(argv[i]);
+		stream[i] = line_reader_open(xfopen_stdin(argv[i]), LR_NUL_ENDS_LINE);
 	}
 
+	/* A line stays valid until the next read from its own stream,
+	 * no need to copy them */
 	order = 0;
 	thisline[1] = thisline[0] = NULL;
 	while (1) {
 		if (order <= 0) {
-			free(thisline[0]);
-			thisline[0] = xmalloc_fgetline(stream[0]);
+			thisline[0] = line_reader_next(stream[0], NULL);
 		}
 		if (order >= 0) {
-			free(thisline[1]);
-			thisline[1] = xmalloc_fgetline(stream[1]);
+			thisline[1] = line_reader_next(stream[1], NULL);
 		}
 
 		i = !thisline[0] + (!thisline[1] << 1);
@@ -91,8 +91,7 @@ int comm_main(int argc UNUSED_PARAM, char **argv)
 		char *p = thisline[i];
 		writeline(p, i);
 		while (1) {
-			free(p);
-			p = xmalloc_fgetline(stream[i]);
+			p = line_reader_next(stream[i], NULL);
 			if (!p)
 				break;
 			writeline(p, i);
@@ -100,8 +99,8 @@ int comm_main(int argc UNUSED_PARAM, char **argv)
 	}
 
 	if (ENABLE_FEATURE_CLEAN_UP) {
-		fclose(stream[0]);
-		fclose(stream[1]);
+		line_reader_close(stream[0]);
+		line_reader_close(stream[1]);
 	}
 
 	return EXIT_SUCCESS;
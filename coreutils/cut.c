@@ -58,19 +58,23 @@ static int cmpfunc(const void *a, const void *b)
 
 static void cut_file(FILE *file, char delim, const struct cut_list *cut_lists, unsigned nlists)
 {
+	line_reader_t *lr = line_reader_open(file, LR_NUL_ENDS_LINE);
 	char *line;
+	char *printed = NULL;
+	size_t len;
 	unsigned linenum = 0;	/* keep these zero-based to be consistent */
 
 	/* go through every line in the file */
-	while ((line = xmalloc_fgetline(file)) != NULL) {
+	while ((line = line_reader_next(lr, &len)) != NULL) {
 
 		/* set up a list so we can keep track of what's been printed */
-		int linelen = strlen(line);
-		char *printed = xzalloc(linelen + 1);
-		char *orig_line = line;
+		int linelen = len;
 		unsigned cl_pos = 0;
 		int spos;
 
+		printed = xrealloc(printed, linelen + 1);
+		memset(printed, 0, linelen + 1);
+
 		/* cut based on chars/bytes XXX: only works when sizeof(char) == byte */
 		if (option_mask32 & (CUT_OPT_CHAR_FLGS | CUT_OPT_BYTE_FLGS)) {
 			/* print the chars specified in each cut list */
@@ -176,9 +180,9 @@ static void cut_file(FILE *file, char delim, const struct cut_list *cut_lists, u
 		putchar('\n');
  next_line:
 		linenum++;
-		free(printed);
-		free(orig_line);
 	}
+	free(printed);
+	line_reader_close(lr);
 }
 
 int cut_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
@@ -296,7 +300,6 @@ int cut_main(int argc UNUSED_PARAM, char **argv)
 				continue;
 			}
 			cut_file(file, delim, cut_lists, nlists);
-			fclose_if_not_stdin(file);
 		} while (*++argv);
 
 		if (ENABLE_FEATURE_CLEAN_UP)
@@ -271,14 +271,56 @@ print_s_char(size_t n_bytes, const char *block, const char *fmt_string)
 	}
 }
 
+/* Unsigned formats are " %0<width>o", " %0<width>x" or " %<width>u"
+ * (see decode_one_format), and the width fits the largest value.
+ * printf is slow, so each field is formatted to exactly width chars
+ * here, and a row is written out in one go */
 static void
-print_char(size_t n_bytes, const char *block, const char *fmt_string)
+print_unsigned(size_t n_bytes, const char *block, const char *fmt_string, unsigned size)
 {
+	char buf[256 + 16];
+	char *p = buf;
+	int width = atoi(fmt_string + 2);
+	/* hex, octal or (0) decimal */
+	unsigned shift = last_char_is(fmt_string, 'x') ? 4 : last_char_is(fmt_string, 'o') ? 3 : 0;
+
+	n_bytes /= size;
 	while (n_bytes--) {
-		unsigned tmp = *(unsigned char *) block;
-		printf(fmt_string, tmp);
-		block += sizeof(unsigned char);
+		unsigned v;
+		int i;
+
+		if (size == sizeof(char))
+			v = *(unsigned char *) block;
+		else if (size == sizeof(short))
+			v = *(unsigned short *) block;
+		else
+			v = *(unsigned *) block;
+		block += size;
+
+		*p = ' ';
+		p += width + 1;
+		for (i = 1; i <= width; i++) {
+			if (shift) {
+				p[-i] = bb_hexdigits_upcase[v & ((1 << shift) - 1)] | 0x20;
+				v >>= shift;
+			} else {
+				/* decimal is blank padded */
+				p[-i] = (i == 1 || v) ? '0' + v % 10 : ' ';
+				v /= 10;
+			}
+		}
+		if (p > buf + 256) {
+			fwrite(buf, 1, p - buf, stdout);
+			p = buf;
+		}
 	}
+	fwrite(buf, 1, p - buf, stdout);
+}
+
+static void
+print_char(size_t n_bytes, const char *block, const char *fmt_string)
+{
+	print_unsigned(n_bytes, block, fmt_string, sizeof(unsigned char));
 }
 
 static void
@@ -295,23 +337,23 @@ print_s_short(size_t n_bytes, const char *block, const char *fmt_string)
 static void
 print_short(size_t n_bytes, const char *block, const char *fmt_string)
 {
-	n_bytes /= sizeof(unsigned short);
-	while (n_bytes--) {
-		unsigned tmp = *(unsigned short *) block;
-		printf(fmt_string, tmp);
-		block += sizeof(unsigned short);
-	}
+	print_unsigned(n_bytes, block, fmt_string, sizeof(unsigned short));
 }
 
 static void
 print_int(size_t n_bytes, const char *block, const char *fmt_string)
 {
-	n_bytes /= sizeof(unsigned);
-	while (n_bytes--) {
-		unsigned tmp = *(unsigned *) block;
-		printf(fmt_string, tmp);
-		block += sizeof(unsigned);
+	/* signed decimal ints end up here too, those go to printf */
+	if (last_char_is(fmt_string, 'd')) {
+		n_bytes /= sizeof(int);
+		while (n_bytes--) {
+			int tmp = *(int *) block;
+			printf(fmt_string, tmp);
+			block += sizeof(int);
+		}
+		return;
 	}
+	print_unsigned(n_bytes, block, fmt_string, sizeof(unsigned));
 }
 
 #if UINT_MAX == ULONG_MAX
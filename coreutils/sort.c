@@ -195,14 +195,36 @@ static struct sort_key *add_key(void)
 	return *pkey = xzalloc(sizeof(struct sort_key));
 }
 
-#define GET_LINE(fp) \
-	((option_mask32 & FLAG_z) \
-	? bb_get_chunk_from_file(fp, NULL) \
-	: xmalloc_fgetline(fp))
+#define NUL_DELIMITED (option_mask32 & FLAG_z)
 #else
-#define GET_LINE(fp) xmalloc_fgetline(fp)
+#define NUL_DELIMITED 0
 #endif
 
+/* Lines may contain NULs, so each one has its length stored
+ * in front of it */
+static char *save_line(const char *line, size_t len)
+{
+	size_t *p = xmalloc(sizeof(p[0]) + len + 1);
+
+	*p++ = len;
+	memcpy(p, line, len);
+	((char*)p)[len] = '\0';
+	return (char*)p;
+}
+#define LINE_LEN(line) (((size_t*)(line))[-1])
+#define free_line(line) free(&LINE_LEN(line))
+
+static int compare_lines(const char *x, const char *y)
+{
+	size_t xlen = LINE_LEN(x);
+	size_t ylen = LINE_LEN(y);
+	int retval = memcmp(x, y, MIN(xlen, ylen));
+
+	if (retval == 0)
+		retval = (xlen > ylen) - (xlen < ylen);
+	return retval;
+}
+
 /* Iterate through keys list and perform comparisons */
 static int compare_keys(const void *xarg, const void *yarg)
 {
@@ -236,6 +258,9 @@ static int compare_keys(const void *xarg, const void *yarg)
 #else
 			retval = strcmp(x, y);
 #endif
+			/* Whole lines: what follows a NUL counts too */
+			if (retval == 0 && x == *(char **)xarg && y == *(char **)yarg)
+				retval = compare_lines(x, y);
 			break;
 #if ENABLE_FEATURE_SORT_BIG
 		case FLAG_g: {
@@ -303,7 +328,7 @@ static int compare_keys(const void *xarg, const void *yarg)
 
 	/* Perform fallback sort if necessary */
 	if (!retval && !(option_mask32 & FLAG_s))
-		retval = strcmp(*(char **)xarg, *(char **)yarg);
+		retval = compare_lines(*(char **)xarg, *(char **)yarg);
 
 	if (flags & FLAG_r) return -retval;
 	return retval;
@@ -410,15 +435,18 @@ int sort_main(int argc UNUSED_PARAM, char **argv)
 	do {
 		/* coreutils 6.9 compat: abort on first open error,
 		 * do not continue to next file: */
-		FILE *fp = xfopen_stdin(*argv);
+		line_reader_t *lr = line_reader_open(xfopen_stdin(*argv), 0);
+		if (NUL_DELIMITED)
+			lr->delim = '\0';
 		for (;;) {
-			line = GET_LINE(fp);
+			size_t len;
+			line = line_reader_next(lr, &len);
 			if (!line)
 				break;
 			lines = xrealloc_vector(lines, 6, linecount);
-			lines[linecount++] = line;
+			lines[linecount++] = save_line(line, len);
 		}
-		fclose_if_not_stdin(fp);
+		line_reader_close(lr);
 	} while (*++argv);
 
 #if ENABLE_FEATURE_SORT_BIG
@@ -447,7 +475,7 @@ int sort_main(int argc UNUSED_PARAM, char **argv)
 		option_mask32 |= FLAG_s;
 		for (i = 1; i < linecount; i++) {
 			if (compare_keys(&lines[flag], &lines[i]) == 0)
-				free(lines[i]);
+				free_line(lines[i]);
 			else
 				lines[++flag] = lines[i];
 		}
@@ -462,8 +490,10 @@ int sort_main(int argc UNUSED_PARAM, char **argv)
 		xmove_fd(xopen(str_o, O_WRONLY|O_CREAT|O_TRUNC), STDOUT_FILENO);
 #endif
 	flag = (option_mask32 & FLAG_z) ? '\0' : '\n';
-	for (i = 0; i < linecount; i++)
-		printf("%s%c", lines[i], flag);
+	for (i = 0; i < linecount; i++) {
+		fwrite(lines[i], 1, LINE_LEN(lines[i]), stdout);
+		putchar(flag);
+	}
 
 	fflush_stdout_and_exit(EXIT_SUCCESS);
 }
@@ -35,8 +35,10 @@ int uniq_main(int argc UNUSED_PARAM, char **argv)
 	const char *input_filename;
 	unsigned skip_fields, skip_chars, max_chars;
 	unsigned opt;
+	line_reader_t *lr;
 	char *cur_line;
 	const char *cur_compare;
+	size_t len;
 
 	enum {
 		OPT_c = 0x1,
@@ -75,6 +77,7 @@ int uniq_main(int argc UNUSED_PARAM, char **argv)
 		}
 	}
 
+	lr = line_reader_open(stdin, LR_NUL_ENDS_LINE);
 	cur_compare = cur_line = NULL; /* prime the pump */
 
 	do {
@@ -88,7 +91,7 @@ int uniq_main(int argc UNUSED_PARAM, char **argv)
 		dups = 0;
 
 		/* gnu uniq ignores newlines */
-		while ((cur_line = xmalloc_fgetline(stdin)) != NULL) {
+		while ((cur_line = line_reader_next(lr, &len)) != NULL) {
 			cur_compare = cur_line;
 			for (i = skip_fields; i; i--) {
 				cur_compare = skip_whitespace(cur_compare);
@@ -99,10 +102,14 @@ int uniq_main(int argc UNUSED_PARAM, char **argv)
 			}
 
 			if (!old_line || strncmp(old_compare, cur_compare, max_chars)) {
+				/* we need it after the next read: copy.
+				 * Duplicates are never copied */
+				char *p = line_reader_copy(cur_line, len);
+				cur_compare = p + (cur_compare - cur_line);
+				cur_line = p;
 				break;
 			}
 
-			free(cur_line);
 			++dups;  /* testing for overflow seems excessive */
 		}
 
@@ -118,7 +125,12 @@ int uniq_main(int argc UNUSED_PARAM, char **argv)
 		}
 	} while (cur_line);
 
-	die_if_ferror(stdin, input_filename);
+	if (lr->error) {
+		errno = lr->error;
+		bb_simple_perror_msg_and_die(input_filename ? input_filename : bb_msg_standard_input);
+	}
+	if (ENABLE_FEATURE_CLEAN_UP)
+		line_reader_free(lr);
 
 	fflush_stdout_and_exit(EXIT_SUCCESS);
 }
@@ -89,10 +89,7 @@ typedef struct func_s {
 /* I/O stream */
 typedef struct rstream_s {
 	FILE *F;
-	char *buffer;
-	int adv;
-	int size;
-	int pos;
+	line_reader_t *lr;
 	smallint is_pipe;
 } rstream;
 
@@ -1829,33 +1826,45 @@ static int ptest(node *pattern)
 /* read next record from stream rsm into a variable v */
 static int awk_getline(rstream *rsm, var *v)
 {
-	char *b;
-	regmatch_t pmatch[2];
-	int size, a, p, pp = 0;
-	int fd, so, eo, r, rp;
-	char c, *m, *s;
+	line_reader_t *lr;
+	regmatch_t pmatch[1];
+	unsigned avail;
+	int so, eo, rp;
+	char c, *b, *s;
 
 	debug_printf_eval("entered %s()\n", __func__);
 
-	/* we're using our own buffer since we need access to accumulating
-	 * characters
-	 */
-	fd = fileno(rsm->F);
-	m = rsm->buffer;
-	a = rsm->adv;
-	p = rsm->pos;
-	size = rsm->size;
+	lr = rsm->lr;
+	if (!lr) {
+		/* NUL ends a record, as does RS */
+		lr = rsm->lr = line_reader_open(rsm->F, LR_NUL_ENDS_LINE | LR_KEEP_CR);
+	}
 	c = (char) rsplitter.n.info;
-	rp = 0;
 
-	if (!m)
-		m = qrealloc(m, 256, &size);
+	if ((rsplitter.n.info & OPCLSMASK) != OC_REGEXP && c != '\0') {
+		/* single char RS (default "\n"): reader splits records */
+		char rt[2];
 
-	do {
-		b = m + a;
-		so = eo = p;
-		r = 1;
-		if (p > 0) {
+		lr->delim = c;
+		b = line_reader_next(lr, NULL);
+		if (!b)
+			goto eof;
+		setvar_s(v, b);
+		v->type |= VF_USER;
+		rt[0] = (lr->eol == EOF) ? '\0' : lr->eol;
+		rt[1] = '\0';
+		setvar_s(intvar[RT], rt);
+		return 1;
+	}
+
+	/* regex RS or paragraph mode (RS == ""): search in the reader's
+	 * buffer, reading more until the separator doesn't reach its end */
+	rp = 0;
+	for (;;) {
+		avail = lr->end - lr->pos;
+		so = eo = avail;
+		if (avail > 0) {
+			b = lr->buf + lr->pos;
 			if ((rsplitter.n.info & OPCLSMASK) == OC_REGEXP) {
 				if (regexec(icase ? rsplitter.n.r.ire : rsplitter.n.l.re,
 							b, 1, pmatch, 0) == 0) {
@@ -1864,15 +1873,6 @@ static int awk_getline(rstream *rsm, var *v)
 					if (b[eo] != '\0')
 						break;
 				}
-			} else if (c != '\0') {
-				s = strchr(b+pp, c);
-				if (!s)
-					s = memchr(b+pp, '\0', p - pp);
-				if (s) {
-					so = eo = s-b;
-					eo++;
-					break;
-				}
 			} else {
 				while (b[rp] == '\n')
 					rp++;
@@ -1886,46 +1886,33 @@ static int awk_getline(rstream *rsm, var *v)
 				}
 			}
 		}
-
-		if (a > 0) {
-			memmove(m, m+a, p+1);
-			b = m;
-			a = 0;
-		}
-
-		m = qrealloc(m, a+p+128, &size);
-		b = m + a;
-		pp = p;
-		p += safe_read(fd, b+p, size-p-1);
-		if (p < pp) {
-			p = 0;
-			r = 0;
-			setvar_i(intvar[ERRNO], errno);
-		}
-		b[p] = '\0';
-
-	} while (p > pp);
-
-	if (p == 0) {
-		r--;
-	} else {
-		c = b[so]; b[so] = '\0';
-		setvar_s(v, b+rp);
-		v->type |= VF_USER;
-		b[so] = c;
-		c = b[eo]; b[eo] = '\0';
-		setvar_s(intvar[RT], b+so);
-		b[eo] = c;
+		/* moves data to lr->buf start: offsets from lr->pos stay valid */
+		if (!line_reader_fill(lr))
+			break;
 	}
+	if (avail == 0)
+		goto eof;
 
-	rsm->buffer = m;
-	rsm->adv = a + eo;
-	rsm->pos = p - eo;
-	rsm->size = size;
-
-	debug_printf_eval("returning from %s(): %d\n", __func__, r);
-
-	return r;
+	b = lr->buf + lr->pos;
+	c = b[so]; b[so] = '\0';
+	setvar_s(v, b+rp);
+	v->type |= VF_USER;
+	b[so] = c;
+	c = b[eo]; b[eo] = '\0';
+	setvar_s(intvar[RT], b+so);
+	b[eo] = c;
+	lr->pos += eo;
+
+	debug_printf_eval("returning from %s(): 1\n", __func__);
+	return 1;
+
+ eof:
+	if (lr->error) {
+		setvar_i(intvar[ERRNO], lr->error);
+		lr->error = 0;
+		return -1;
+	}
+	return 0;
 }
 
 static int fmt_num(char *b, int size, const char *format, double n, int int_as_int)
@@ -2739,7 +2726,8 @@ static var *evaluate(node *op, var *res)
 					 */
 					if (rsm->F)
 						err = rsm->is_pipe ? pclose(rsm->F) : fclose(rsm->F);
-					free(rsm->buffer);
+					if (rsm->lr)
+						line_reader_free(rsm->lr);
 					hash_remove(fdhash, L.s);
 				}
 				if (err)
@@ -2967,7 +2955,9 @@ static rstream *next_input_file(void)
 	if (rsm.F)
 		fclose(rsm.F);
 	rsm.F = NULL;
-	rsm.pos = rsm.adv = 0;
+	if (rsm.lr)
+		line_reader_free(rsm.lr);
+	rsm.lr = NULL;
 
 	do {
 		if (getvar_i(intvar[ARGIND])+1 >= getvar_i(intvar[ARGC])) {
@@ -22,22 +22,74 @@
 
 static const char fmt_eof[] ALIGN1 = "cmp: EOF on %s\n";
 static const char fmt_differ[] ALIGN1 = "%s %s differ: char %"OFF_FMT"u, line %u\n";
-// This fmt_l_opt uses gnu-isms.  SUSv3 would be "%.0s%.0s%"OFF_FMT"u %o %o\n"
-static const char fmt_l_opt[] ALIGN1 = "%.0s%.0s%"OFF_FMT"u %3o %3o\n";
+// This fmt_l_opt uses gnu-isms.  SUSv3 would be "%"OFF_FMT"u %o %o\n"
+static const char fmt_l_opt[] ALIGN1 = "%"OFF_FMT"u %3o %3o\n";
 
 static const char opt_chars[] ALIGN1 = "sl";
 #define CMP_OPT_s (1<<0)
 #define CMP_OPT_l (1<<1)
 
+#define CMP_BUFSZ (64 * 1024)
+
+static size_t read_input(int fd, uint8_t *buf, size_t size, const char *filename)
+{
+	ssize_t r = safe_read(fd, buf, size);
+	if (r < 0)
+		bb_simple_perror_msg_and_die(filename);
+	return r;
+}
+
+/* Seeks past SKIP bytes if input is seekable, reads them otherwise */
+static void skip_input(int fd, off_t skip, uint8_t *buf, const char *filename)
+{
+	if (skip == 0 || lseek(fd, skip, SEEK_CUR) != (off_t)-1)
+		return;
+	while (skip) {
+		size_t r = read_input(fd, buf, MIN(skip, CMP_BUFSZ), filename);
+		if (r == 0)
+			break;
+		skip -= r;
+	}
+}
+
+/* Returns index of the first byte which differs, or n */
+static size_t mismatch(const uint8_t *p1, const uint8_t *p2, size_t n)
+{
+	size_t i;
+
+	/* memcmp is fast, but does not tell where the difference is.
+	 * Narrow it down to a small block, look at bytes only there */
+	if (memcmp(p1, p2, n) == 0)
+		return n;
+	i = 0;
+	while (n - i > 256 && memcmp(p1 + i, p2 + i, 256) == 0)
+		i += 256;
+	while (p1[i] == p2[i])
+		i++;
+	return i;
+}
+
+static unsigned count_newlines(const uint8_t *p, size_t n)
+{
+	const uint8_t *end = p + n;
+	unsigned cnt = 0;
+
+	while ((p = memchr(p, '\n', end - p)) != NULL) {
+		cnt++;
+		p++;
+	}
+	return cnt;
+}
+
 int cmp_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int cmp_main(int argc UNUSED_PARAM, char **argv)
 {
-	FILE *fp1, *fp2, *outfile = stdout;
+	int fd1, fd2;
 	const char *filename1, *filename2 = "-";
 	off_t skip1 = 0, skip2 = 0, char_pos = 0;
-	int line_pos = 1; /* Hopefully won't overflow... */
-	const char *fmt;
-	int c1, c2;
+	unsigned line_pos = 1; /* Hopefully won't overflow... */
+	uint8_t *buf1, *buf2, *p1, *p2;
+	size_t len1, len2;
 	unsigned opt;
 	int retval = 0;
 
@@ -62,9 +114,9 @@ int cmp_main(int argc UNUSED_PARAM, char **argv)
 	xfunc_error_retval = 2;  /* missing file results in exitcode 2 */
 	if (opt & CMP_OPT_s)
 		logmode = 0;  /* -s suppresses open error messages */
-	fp1 = xfopen_stdin(filename1);
-	fp2 = xfopen_stdin(filename2);
-	if (fp1 == fp2) {		/* Paranoia check... stdin == stdin? */
+	fd1 = fileno(xfopen_stdin(filename1));
+	fd2 = fileno(xfopen_stdin(filename2));
+	if (fd1 == fd2) {		/* Paranoia check... stdin == stdin? */
 		/* Note that we don't bother reading stdin.  Neither does gnu wc.
 		 * But perhaps we should, so that other apps down the chain don't
 		 * get the input.  Consider 'echo hello | (cmp - - && cat -)'.
@@ -73,58 +125,67 @@ int cmp_main(int argc UNUSED_PARAM, char **argv)
 	}
 	logmode = LOGMODE_STDIO;
 
-	if (opt & CMP_OPT_l)
-		fmt = fmt_l_opt;
-	else
-		fmt = fmt_differ;
-
+	buf1 = xmalloc(2 * CMP_BUFSZ);
+	buf2 = buf1 + CMP_BUFSZ;
 	if (ENABLE_DESKTOP) {
-		while (skip1) { getc(fp1); skip1--; }
-		while (skip2) { getc(fp2); skip2--; }
+		skip_input(fd1, skip1, buf1, filename1);
+		skip_input(fd2, skip2, buf2, filename2);
 	}
-	do {
-		c1 = getc(fp1);
-		c2 = getc(fp2);
-		++char_pos;
-		if (c1 != c2) {			/* Remember: a read error may have occurred. */
-			retval = 1;		/* But assume the files are different for now. */
-			if (c2 == EOF) {
-				/* We know that fp1 isn't at EOF or in an error state.  But to
-				 * save space below, things are setup to expect an EOF in fp1
-				 * if an EOF occurred.  So, swap things around.
-				 */
-				fp1 = fp2;
-				filename1 = filename2;
-				c1 = c2;
-			}
-			if (c1 == EOF) {
-				die_if_ferror(fp1, filename1);
-				fmt = fmt_eof;	/* Well, no error, so it must really be EOF. */
-				outfile = stderr;
-				/* There may have been output to stdout (option -l), so
-				 * make sure we fflush before writing to stderr. */
-				fflush_all();
-			}
-			if (!(opt & CMP_OPT_s)) {
-				if (opt & CMP_OPT_l) {
-					line_pos = c1;	/* line_pos is unused in the -l case. */
-				}
-				fprintf(outfile, fmt, filename1, filename2, char_pos, line_pos, c2);
-				if (opt) {	/* This must be -l since not -s. */
-					/* If we encountered an EOF,
-					 * the while check will catch it. */
-					continue;
+
+	/* Compare blocks. Reads can be short (pipes), so compare
+	 * as much as both buffers have, keep the rest for later */
+	p1 = p2 = NULL; /* for compiler */
+	len1 = len2 = 0;
+	for (;;) {
+		size_t n, i;
+
+		if (len1 == 0) {
+			len1 = read_input(fd1, buf1, CMP_BUFSZ, filename1);
+			p1 = buf1;
+		}
+		if (len2 == 0) {
+			len2 = read_input(fd2, buf2, CMP_BUFSZ, filename2);
+			p2 = buf2;
+		}
+		if (len1 == 0 || len2 == 0) {
+			if (len1 != len2) {
+				retval = 1;
+				if (!(opt & CMP_OPT_s)) {
+					/* There may have been output to stdout (option -l), so
+					 * make sure we fflush before writing to stderr. */
+					fflush_all();
+					fprintf(stderr, fmt_eof, len1 ? filename2 : filename1);
 				}
 			}
 			break;
 		}
-		if (c1 == '\n') {
-			++line_pos;
-		}
-	} while (c1 != EOF);
 
-	die_if_ferror(fp1, filename1);
-	die_if_ferror(fp2, filename2);
+		n = MIN(len1, len2);
+		i = 0;
+		for (;;) {
+			size_t same = mismatch(p1 + i, p2 + i, n - i);
 
+			if (!opt) /* line_pos is only printed without options */
+				line_pos += count_newlines(p1 + i, same);
+			i += same;
+			if (i == n)
+				break;
+			retval = 1;
+			if (!(opt & CMP_OPT_l)) {
+				if (!opt)
+					printf(fmt_differ, filename1, filename2,
+						char_pos + i + 1, line_pos);
+				goto out;
+			}
+			printf(fmt_l_opt, char_pos + i + 1, p1[i], p2[i]);
+			i++;
+		}
+		char_pos += n;
+		p1 += n;
+		len1 -= n;
+		p2 += n;
+		len2 -= n;
+	}
+ out:
 	fflush_stdout_and_exit(retval);
 }
@@ -96,6 +96,9 @@
 //usage:     "\n	-t	Expand tabs to spaces in output"
 //usage:     "\n	-U	Output LINES lines of context"
 //usage:     "\n	-w	Ignore all whitespace"
+//usage:	IF_FEATURE_DIFF_ALGORITHM(
+//usage:     "\n	--algorithm=ALG	stone (default), myers or patience"
+//usage:	)
 
 #include "libbb.h"
 
@@ -133,6 +136,12 @@ enum {                  /* Commandline flags */
 };
 #define FLAG(x) (1 << FLAG_##x)
 
+enum {                  /* --algorithm */
+	ALGO_STONE,
+	ALGO_MYERS,
+	ALGO_PATIENCE,
+};
+
 /* We cache file position to avoid excessive seeking */
 typedef struct FILE_and_pos_t {
 	FILE *ft_fp;
@@ -141,6 +150,7 @@ typedef struct FILE_and_pos_t {
 
 struct globals {
 	smallint exit_status;
+	IF_FEATURE_DIFF_ALGORITHM(smallint algorithm;)
 	int opt_U_context;
 	const char *other_dir;
 	char *label[2];
@@ -148,6 +158,7 @@ struct globals {
 };
 #define G (*ptr_to_globals)
 #define exit_status        (G.exit_status       )
+#define algorithm          (G.algorithm         )
 #define opt_U_context      (G.opt_U_context     )
 #define label              (G.label             )
 #define stb                (G.stb               )
@@ -346,6 +357,306 @@ struct line {
 	unsigned value;
 };
 
+#if ENABLE_FEATURE_DIFF_ALGORITHM
+/* --algorithm=myers: the linear space variant of the O(ND) algorithm
+ * from E. Myers, "An O(ND) Difference Algorithm and Its Variations".
+ * The middle snake of the shortest edit script is searched for from
+ * both ends at once, and both halves are diffed recursively.
+ * Like in libxdiff, the search is cut short after about sqrt(N)
+ * edits (unless -d), and the furthest reaching path is taken instead.
+ *
+ * --algorithm=patience first matches lines which occur exactly once
+ * in both files (their longest common subsequence, found by patience
+ * sorting), and diffs the gaps between them. This keeps frequent
+ * lines like "}" or blank ones from being matched across functions.
+ * Ranges without such lines are handed over to Myers.
+ *
+ * Both work on line hashes and fill J like stone() does,
+ * hash collisions are sorted out by create_J afterwards.
+ */
+struct myers {
+	const unsigned *a, *b;
+	int *J;         /* J[x] for a[x], already offset by pref */
+	int pref;
+	int *kvdf, *kvdb;
+	unsigned max_cost;
+	smallint minimal;
+	smallint patience;
+};
+
+static void myers_compare(struct myers *m, int off1, int lim1, int off2, int lim2);
+
+static void myers_split(struct myers *m, int off1, int lim1, int off2, int lim2,
+		int *px, int *py)
+{
+	const unsigned *a = m->a, *b = m->b;
+	int *kvdf = m->kvdf, *kvdb = m->kvdb;
+	const int dmin = off1 - lim2, dmax = lim1 - off2;
+	const int fmid = off1 - off2, bmid = lim1 - lim2;
+	const int odd = (fmid - bmid) & 1;
+	int fmin = fmid, fmax = fmid;
+	int bmin = bmid, bmax = bmid;
+	unsigned ec;
+	int d, i1, i2;
+
+	/* kvdf[d] is the furthest x reached on diagonal d = x - y
+	 * going forward, kvdb[d] the same going backward */
+	kvdf[fmid] = off1;
+	kvdb[bmid] = lim1;
+
+	for (ec = 1;; ec++) {
+		if (fmin > dmin)
+			kvdf[--fmin - 1] = -1;
+		else
+			++fmin;
+		if (fmax < dmax)
+			kvdf[++fmax + 1] = -1;
+		else
+			--fmax;
+		for (d = fmax; d >= fmin; d -= 2) {
+			if (kvdf[d - 1] >= kvdf[d + 1])
+				i1 = kvdf[d - 1] + 1;
+			else
+				i1 = kvdf[d + 1];
+			i2 = i1 - d;
+			while (i1 < lim1 && i2 < lim2 && a[i1] == b[i2])
+				i1++, i2++;
+			kvdf[d] = i1;
+			if (odd && bmin <= d && d <= bmax && kvdb[d] <= i1) {
+				*px = i1;
+				*py = i2;
+				return;
+			}
+		}
+
+		if (bmin > dmin)
+			kvdb[--bmin - 1] = INT_MAX;
+		else
+			++bmin;
+		if (bmax < dmax)
+			kvdb[++bmax + 1] = INT_MAX;
+		else
+			--bmax;
+		for (d = bmax; d >= bmin; d -= 2) {
+			if (kvdb[d - 1] < kvdb[d + 1])
+				i1 = kvdb[d - 1];
+			else
+				i1 = kvdb[d + 1] - 1;
+			i2 = i1 - d;
+			while (i1 > off1 && i2 > off2 && a[i1 - 1] == b[i2 - 1])
+				i1--, i2--;
+			kvdb[d] = i1;
+			if (!odd && fmin <= d && d <= fmax && i1 <= kvdf[d]) {
+				*px = i1;
+				*py = i2;
+				return;
+			}
+		}
+
+		if (ec >= m->max_cost) {
+			/* Too expensive: split where either path got furthest */
+			int fbest = -1, fbest1 = -1;
+			int bbest = INT_MAX, bbest1 = INT_MAX;
+
+			for (d = fmax; d >= fmin; d -= 2) {
+				i1 = MIN(kvdf[d], lim1);
+				i2 = i1 - d;
+				if (lim2 < i2) {
+					i1 = lim2 + d;
+					i2 = lim2;
+				}
+				if (fbest < i1 + i2) {
+					fbest = i1 + i2;
+					fbest1 = i1;
+				}
+			}
+			for (d = bmax; d >= bmin; d -= 2) {
+				i1 = MAX(off1, kvdb[d]);
+				i2 = i1 - d;
+				if (i2 < off2) {
+					i1 = off2 + d;
+					i2 = off2;
+				}
+				if (i1 + i2 < bbest) {
+					bbest = i1 + i2;
+					bbest1 = i1;
+				}
+			}
+			if ((lim1 + lim2) - bbest < fbest - (off1 + off2)) {
+				*px = fbest1;
+				*py = fbest - fbest1;
+			} else {
+				*px = bbest1;
+				*py = bbest - bbest1;
+			}
+			return;
+		}
+	}
+}
+
+enum {
+	UNIQ_A_DUP = 1, /* line occurs more than once in a[] */
+	UNIQ_B_ONE = 2, /* ...once in b[] */
+	UNIQ_B_DUP = 4, /* ...more than once in b[] */
+};
+
+/* Hash table slot of value v, holding 1 + index of its first line in a[off..] */
+static int *uniq_slot(int *tab, unsigned bits, const unsigned *a, int off, unsigned v)
+{
+	unsigned mask = (1 << bits) - 1;
+	unsigned h = (v * 0x9e3779b1) >> (32 - bits);
+
+	while (tab[h] && a[off + tab[h] - 1] != v)
+		h = (h + 1) & mask;
+	return &tab[h];
+}
+
+/* Returns 0 if there are no lines unique in both ranges */
+static int patience_compare(struct myers *m, int off1, int lim1, int off2, int lim2)
+{
+	const unsigned *a = m->a, *b = m->b;
+	const int n = lim1 - off1;
+	unsigned bits;
+	int *tab, *ypos, *xs, *ys, *tail, *pred;
+	uint8_t *flags;
+	int i, k, len, x, y;
+
+	for (bits = 1; (1 << bits) < 2 * n; bits++)
+		continue;
+	tab = xzalloc(sizeof(tab[0]) << bits);
+	flags = xzalloc(n);
+	ypos = xmalloc(n * sizeof(ypos[0]));
+	for (x = off1; x < lim1; x++) {
+		int *s = uniq_slot(tab, bits, a, off1, a[x]);
+		if (*s)
+			flags[*s - 1] |= UNIQ_A_DUP;
+		else
+			*s = x - off1 + 1;
+	}
+	for (y = off2; y < lim2; y++) {
+		int *s = uniq_slot(tab, bits, a, off1, b[y]);
+		if (*s) {
+			i = *s - 1;
+			if (flags[i] & UNIQ_B_ONE)
+				flags[i] |= UNIQ_B_DUP;
+			flags[i] |= UNIQ_B_ONE;
+			ypos[i] = y;
+		}
+	}
+	free(tab);
+
+	/* Unique pairs, in the order of a[] */
+	k = 0;
+	xs = xmalloc(n * sizeof(xs[0]));
+	ys = ypos;
+	for (i = 0; i < n; i++) {
+		if (flags[i] == UNIQ_B_ONE) {
+			xs[k] = off1 + i;
+			ys[k] = ypos[i];
+			k++;
+		}
+	}
+	free(flags);
+	if (k == 0) {
+		free(xs);
+		free(ys);
+		return 0;
+	}
+
+	/* Longest increasing subsequence of ys[] */
+	tail = xmalloc(k * sizeof(tail[0]));
+	pred = xmalloc(k * sizeof(pred[0]));
+	len = 0;
+	for (i = 0; i < k; i++) {
+		int lo = 0, hi = len;
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (ys[tail[mid]] < ys[i])
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		pred[i] = lo ? tail[lo - 1] : -1;
+		tail[lo] = i;
+		if (lo == len)
+			len++;
+	}
+	for (i = tail[len - 1], k = len; --k >= 0; i = pred[i])
+		tail[k] = i;
+	free(pred);
+	for (i = 0; i < len; i++) {
+		xs[i] = xs[tail[i]];
+		ys[i] = ys[tail[i]];
+	}
+	free(tail);
+
+	x = off1;
+	y = off2;
+	for (i = 0; i < len; i++) {
+		m->J[xs[i]] = m->pref + ys[i] + 1;
+		myers_compare(m, x, xs[i], y, ys[i]);
+		x = xs[i] + 1;
+		y = ys[i] + 1;
+	}
+	free(xs);
+	free(ys);
+	myers_compare(m, x, lim1, y, lim2);
+	return 1;
+}
+
+static void myers_compare(struct myers *m, int off1, int lim1, int off2, int lim2)
+{
+	int x, y;
+
+	while (off1 < lim1 && off2 < lim2 && m->a[off1] == m->b[off2])
+		m->J[off1++] = m->pref + ++off2;
+	while (off1 < lim1 && off2 < lim2 && m->a[lim1 - 1] == m->b[lim2 - 1])
+		m->J[--lim1] = m->pref + lim2--;
+	if (off1 == lim1 || off2 == lim2)
+		return;
+	if (m->patience && patience_compare(m, off1, lim1, off2, lim2))
+		return;
+	myers_split(m, off1, lim1, off2, lim2, &x, &y);
+	myers_compare(m, off1, x, off2, y);
+	myers_compare(m, x, lim1, y, lim2);
+}
+
+/* Fills J for the lines between the common prefix and suffix */
+static void myers(struct line *nfile[2], const int nlen[2], int pref, int suff, int *J)
+{
+	struct myers m;
+	unsigned *a, *b;
+	int *kvd;
+	int n = nlen[0] - pref - suff;
+	int k = nlen[1] - pref - suff;
+	int i;
+
+	a = xmalloc((n + k + 1) * sizeof(a[0]));
+	b = a + n;
+	for (i = 0; i < n; i++)
+		a[i] = nfile[0][pref + 1 + i].value;
+	for (i = 0; i < k; i++)
+		b[i] = nfile[1][pref + 1 + i].value;
+	free(nfile[0]);
+	free(nfile[1]);
+
+	kvd = xmalloc(2 * (n + k + 3) * sizeof(kvd[0]));
+	m.a = a;
+	m.b = b;
+	m.J = J + pref + 1;
+	m.pref = pref;
+	m.kvdf = kvd + k + 1;
+	m.kvdb = m.kvdf + n + k + 3;
+	m.minimal = (option_mask32 & FLAG(d)) != 0;
+	m.max_cost = m.minimal ? UINT_MAX : MAX(256, isqrt(n + k));
+	m.patience = (algorithm == ALGO_PATIENCE);
+	myers_compare(&m, 0, n, 0, k);
+
+	free(kvd);
+	free(a);
+}
+#endif
+
 static void equiv(struct line *a, int n, struct line *b, int m, int *c)
 {
 	int i = 1, j = 1;
@@ -420,6 +731,57 @@ static void fetch(FILE_and_pos_t *ft, const off_t *ix, int a, int b, int ch)
 	}
 }
 
+/* Fills J for the lines between the common prefix and suffix
+ * using stone(). nfile arrays are reused and freed
+ */
+static void stone_J(struct line *nfile[2], const int nlen[2], int pref, int suff, int *J)
+{
+	int slen[2], *class, *member;
+	struct line *sfile[2];
+	int i, j;
+
+	/* Arrays are pruned by the suffix and prefix length,
+	 * the result being sorted and stored in sfile[fileno],
+	 * and their sizes are stored in slen[fileno]
+	 */
+	for (j = 0; j < 2; j++) {
+		sfile[j] = nfile[j] + pref;
+		slen[j] = nlen[j] - pref - suff;
+		for (i = 0; i <= slen[j]; i++)
+			sfile[j][i].serial = i;
+		qsort(sfile[j] + 1, slen[j], sizeof(*sfile[j]), line_compar);
+	}
+	/* nfile arrays are reused to reduce memory pressure
+	 * The #if zeroed out section performs the same task as the
+	 * one in the #else section.
+	 * Peak memory usage is higher, but one array copy is avoided
+	 * by not using unsort()
+	 */
+#if 0
+	member = xmalloc((slen[1] + 2) * sizeof(member[0]));
+	equiv(sfile[0], slen[0], sfile[1], slen[1], member);
+	free(nfile[1]);
+
+	class = xmalloc((slen[0] + 1) * sizeof(class[0]));
+	for (i = 1; i <= slen[0]; i++) /* Unsorting */
+		class[sfile[0][i].serial] = sfile[0][i].value;
+	free(nfile[0]);
+#else
+	member = (int *)nfile[1];
+	equiv(sfile[0], slen[0], sfile[1], slen[1], member);
+	member = xrealloc(member, (slen[1] + 2) * sizeof(member[0]));
+
+	class = (int *)nfile[0];
+	unsort(sfile[0], slen[0], (int *)nfile[0]);
+	class = xrealloc(class, (slen[0] + 2) * sizeof(class[0]));
+#endif
+	/* Here the magic is performed */
+	stone(class, slen[0], member, J, pref);
+
+	free(class);
+	free(member);
+}
+
 /* Creates the match vector J, where J[i] is the index
  * of the line in the new file corresponding to the line i
  * in the old file. Lines start at 1 instead of 0, that value
@@ -436,8 +798,8 @@ static void fetch(FILE_and_pos_t *ft, const off_t *ix, int a, int b, int ch)
  */
 static NOINLINE int *create_J(FILE_and_pos_t ft[2], int nlen[2], off_t *ix[2])
 {
-	int *J, slen[2], *class, *member;
-	struct line *nfile[2], *sfile[2];
+	int *J;
+	struct line *nfile[2];
 	int pref = 0, suff = 0, i, j, delta;
 
 	/* Lines of both files are hashed, and in the process
@@ -500,56 +862,22 @@ start:
 	for (; suff < nlen[0] - pref && suff < nlen[1] - pref &&
 	       nfile[0][nlen[0] - suff].value == nfile[1][nlen[1] - suff].value;
 	       suff++);
-	/* Arrays are pruned by the suffix and prefix length,
-	 * the result being sorted and stored in sfile[fileno],
-	 * and their sizes are stored in slen[fileno]
-	 */
-	for (j = 0; j < 2; j++) {
-		sfile[j] = nfile[j] + pref;
-		slen[j] = nlen[j] - pref - suff;
-		for (i = 0; i <= slen[j]; i++)
-			sfile[j][i].serial = i;
-		qsort(sfile[j] + 1, slen[j], sizeof(*sfile[j]), line_compar);
-	}
-	/* nfile arrays are reused to reduce memory pressure
-	 * The #if zeroed out section performs the same task as the
-	 * one in the #else section.
-	 * Peak memory usage is higher, but one array copy is avoided
-	 * by not using unsort()
-	 */
-#if 0
-	member = xmalloc((slen[1] + 2) * sizeof(member[0]));
-	equiv(sfile[0], slen[0], sfile[1], slen[1], member);
-	free(nfile[1]);
-
-	class = xmalloc((slen[0] + 1) * sizeof(class[0]));
-	for (i = 1; i <= slen[0]; i++) /* Unsorting */
-		class[sfile[0][i].serial] = sfile[0][i].value;
-	free(nfile[0]);
-#else
-	member = (int *)nfile[1];
-	equiv(sfile[0], slen[0], sfile[1], slen[1], member);
-	member = xrealloc(member, (slen[1] + 2) * sizeof(member[0]));
-
-	class = (int *)nfile[0];
-	unsort(sfile[0], slen[0], (int *)nfile[0]);
-	class = xrealloc(class, (slen[0] + 2) * sizeof(class[0]));
-#endif
 	J = xmalloc((nlen[0] + 2) * sizeof(J[0]));
 	/* The elements of J which fall inside the prefix and suffix regions
 	 * are marked as unchanged, while the ones which fall outside
-	 * are initialized with 0 (no matches), so that function stone can
+	 * are initialized with 0 (no matches), so that stone() or myers() can
 	 * then assign them their right values
 	 */
 	for (i = 0, delta = nlen[1] - nlen[0]; i <= nlen[0]; i++)
 		J[i] = i <= pref            ?  i :
 		       i > (nlen[0] - suff) ? (i + delta) : 0;
-	/* Here the magic is performed */
-	stone(class, slen[0], member, J, pref);
 	J[nlen[0] + 1] = nlen[1] + 1;
-
-	free(class);
-	free(member);
+#if ENABLE_FEATURE_DIFF_ALGORITHM
+	if (algorithm != ALGO_STONE)
+		myers(nfile, nlen, pref, suff, J);
+	else
+#endif
+		stone_J(nfile, nlen, pref, suff, J);
 
 	/* Both files are rescanned, in an effort to find any lines
 	 * which, due to limitations intrinsic to any hashing algorithm,
@@ -939,6 +1267,9 @@ static const char diff_longopts[] ALIGN1 =
 	"report-identical-files\0"   No_argument       "s"
 	"starting-file\0"            Required_argument "S"
 	"minimal\0"                  No_argument       "d"
+# if ENABLE_FEATURE_DIFF_ALGORITHM
+	"algorithm\0"                Required_argument "\xff"
+# endif
 	;
 #endif
 
@@ -947,6 +1278,7 @@ int diff_main(int argc UNUSED_PARAM, char **argv)
 {
 	int gotstdin = 0, i;
 	char *file[2], *s_start = NULL;
+	IF_FEATURE_DIFF_ALGORITHM(char *algo_arg = NULL;)
 	llist_t *L_arg = NULL;
 
 	INIT_G();
@@ -956,9 +1288,18 @@ int diff_main(int argc UNUSED_PARAM, char **argv)
 #if ENABLE_FEATURE_DIFF_LONG_OPTIONS
 	applet_long_options = diff_longopts;
 #endif
-	getopt32(argv, "abdiL:NqrsS:tTU:wupBE",
-			&L_arg, &s_start, &opt_U_context);
+	getopt32(argv, "abdiL:NqrsS:tTU:wupBE" IF_FEATURE_DIFF_ALGORITHM("\xff:"),
+			&L_arg, &s_start, &opt_U_context
+			IF_FEATURE_DIFF_ALGORITHM(, &algo_arg));
 	argv += optind;
+#if ENABLE_FEATURE_DIFF_ALGORITHM
+	if (algo_arg) {
+		i = index_in_strings("stone\0""myers\0""patience\0", algo_arg);
+		if (i < 0)
+			bb_error_msg_and_die("unknown algorithm '%s'", algo_arg);
+		algorithm = i;
+	}
+#endif
 	while (L_arg)
 		label[!!label[0]] = llist_pop(&L_arg);
 	xfunc_error_retval = 2;
@@ -23,8 +23,9 @@
  * resulting sed_cmd_t structures are appended to a linked list
  * (G.sed_cmd_head/G.sed_cmd_tail).
  *
- * add_input_file() adds a FILE* to the list of input files.  We need to
- * know all input sources ahead of time to find the last line for the $ match.
+ * add_input_file() adds a FILE* (wrapped in a line_reader_t) to the list of
+ * input files.  We need to know all input sources ahead of time to find
+ * the last line for the $ match.
  *
  * process_files() does actual sedding, reading data lines from each input FILE *
  * (which could be stdin) and applying the sed command list (sed_cmd_head) to
@@ -125,7 +126,7 @@ struct globals {
 
 	/* List of input files */
 	int input_file_count, current_input_file;
-	FILE **input_file_list;
+	line_reader_t **input_file_list;
 
 	regmatch_t regmatch[10];
 	regex_t *previous_regex_ptr;
@@ -186,7 +187,7 @@ static void sed_free_and_close_stuff(void)
 	free(G.hold_space);
 
 	while (G.current_input_file < G.input_file_count)
-		fclose(G.input_file_list[G.current_input_file++]);
+		line_reader_close(G.input_file_list[G.current_input_file++]);
 }
 #else
 void sed_free_and_close_stuff(void);
@@ -813,7 +814,9 @@ static void flush_append(void)
 static void add_input_file(FILE *file)
 {
 	G.input_file_list = xrealloc_vector(G.input_file_list, 2, G.input_file_count);
-	G.input_file_list[G.input_file_count++] = file;
+	/* sed sees '\r' and NULs, it writes them back as is */
+	G.input_file_list[G.input_file_count++] = line_reader_open(file,
+			LR_NUL_ENDS_LINE | LR_KEEP_CR);
 }
 
 /* Get next line of input from G.input_file_list, flushing append buffer and
@@ -826,7 +829,7 @@ enum {
 static char *get_next_line(char *gets_char)
 {
 	char *temp = NULL;
-	int len;
+	size_t len;
 	char gc;
 
 	flush_append();
@@ -835,24 +838,17 @@ static char *get_next_line(char *gets_char)
 	 * doesn't end with either '\n' or '\0' */
 	gc = NO_EOL_CHAR;
 	while (G.current_input_file < G.input_file_count) {
-		FILE *fp = G.input_file_list[G.current_input_file];
-		/* Read line up to a newline or NUL byte, inclusive,
-		 * return malloc'ed char[]. length of the chunk read
-		 * is stored in len. NULL if EOF/error */
-		temp = bb_get_chunk_from_file(fp, &len);
+		line_reader_t *lr = G.input_file_list[G.current_input_file];
+		/* Read line up to a newline or NUL byte,
+		 * lr->eol tells which one it was. NULL if EOF/error */
+		temp = line_reader_next(lr, &len);
 		if (temp) {
-			/* len > 0 here, it's ok to do temp[len-1] */
-			char c = temp[len-1];
-			if (c == '\n' || c == '\0') {
-				temp[len-1] = '\0';
-				gc = c;
-				if (c == '\0') {
-					int ch = fgetc(fp);
-					if (ch != EOF)
-						ungetc(ch, fp);
-					else
-						gc = LAST_IS_NUL;
-				}
+			/* pattern space is ours to modify and free */
+			temp = line_reader_copy(temp, len);
+			if (lr->eol != EOF) {
+				gc = lr->eol;
+				if (gc == '\0' && line_reader_eof(lr))
+					gc = LAST_IS_NUL;
 			}
 			/* else we put NO_EOL_CHAR into *gets_char */
 			break;
@@ -866,7 +862,7 @@ static char *get_next_line(char *gets_char)
 		 * (note: *no* newline after "b bang"!) */
 		}
 		/* Close this file and advance to next one */
-		fclose(fp);
+		line_reader_close(lr);
 		G.current_input_file++;
 	}
 	*gets_char = gc;
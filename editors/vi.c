@@ -17,7 +17,6 @@
  *	   it would be easier to change the mark when add/delete lines
  *	More intelligence in refresh()
  *	":r !cmd"  and  "!cmd"  to filter text through an external command
- *	A true "undo" facility
  *	An "ex" line oriented mode- maybe using "cmdedit"
  */
 
@@ -137,6 +136,15 @@
 //config:
 //config:	  This is not clean but helps a lot on serial lines and such.
 //config:
+//config:config FEATURE_VI_UNDO
+//config:	bool "Support undo command 'u' and redo ^R"
+//config:	default y
+//config:	depends on VI
+//config:	help
+//config:	  Keep a journal of changes to the text, so that 'u' can undo
+//config:	  insertions, deletions and replacements one command at a time
+//config:	  and ^R can redo them. ^L still redraws the screen.
+//config:
 //config:config FEATURE_VI_OPTIMIZE_CURSOR
 //config:	bool "Optimize cursor movement"
 //config:	default y
@@ -239,6 +247,25 @@ enum {
 	S_END_ALNUM = 5,	// used in skip_thing() for moving "dot"
 };
 
+#if ENABLE_FEATURE_VI_UNDO
+// One change to text[]. Changes made by one command share "seq"
+// and are undone together. Text is kept by offset, not by pointer:
+// text[] moves when it grows.
+struct undo_object {
+	struct undo_object *prev;	// older change
+	char *text_copy;	// deleted/replaced text; inserted text once undone
+	int start;		// offset of the change in text[]
+	int length;
+	unsigned seq;
+	smallint u_type;
+};
+enum {
+	UNDO_INS,	// "length" chars were inserted at "start"
+	UNDO_DEL,	// text_copy was deleted from "start"
+	UNDO_SWAP,	// text_copy was overwritten at "start"
+};
+#endif
+
 
 /* vi.c expects chars to be unsigned. */
 /* busybox build system provides that, but it's better */
@@ -249,6 +276,10 @@ struct globals {
 	char *text, *end;       // pointers to the user data in memory
 	char *dot;              // where all the action takes place
 	int text_size;		// size of the allocated buffer
+	int text_lines;		// number of '\n' in text[], not counting the last hole
+	int hole_start, hole_len; // last hole made, maybe filled since
+	int tail_len;		// text after the gap, at the back of text[]
+	int nl_pos, nl_cnt;	// there are nl_cnt '\n' before text[nl_pos]
 
 	/* the rest */
 	smallint vi_setops;
@@ -313,6 +344,12 @@ struct globals {
 #if ENABLE_FEATURE_VI_SEARCH
 	char *last_search_pattern; // last pattern from a '/' or '?' search
 #endif
+#if ENABLE_FEATURE_VI_UNDO
+	struct undo_object *undo_stack; // newest change first
+	struct undo_object *redo_stack; // changes undone, newest undo first
+	unsigned undo_seq;      // number of current command
+	smallint undo_busy;     // applying undo/redo, don't record
+#endif
 
 	/* former statics */
 #if ENABLE_FEATURE_VI_YANKMARK
@@ -354,6 +391,12 @@ struct globals {
 #define G (*ptr_to_globals)
 #define text           (G.text          )
 #define text_size      (G.text_size     )
+#define text_lines     (G.text_lines    )
+#define hole_start     (G.hole_start    )
+#define hole_len       (G.hole_len      )
+#define tail_len       (G.tail_len      )
+#define nl_pos         (G.nl_pos        )
+#define nl_cnt         (G.nl_cnt        )
 #define end            (G.end           )
 #define dot            (G.dot           )
 #define reg            (G.reg           )
@@ -394,6 +437,10 @@ struct globals {
 #define last_row                (G.last_row           )
 #define my_pid                  (G.my_pid             )
 #define last_search_pattern     (G.last_search_pattern)
+#define undo_stack              (G.undo_stack         )
+#define redo_stack              (G.redo_stack         )
+#define undo_seq                (G.undo_seq           )
+#define undo_busy               (G.undo_busy          )
 
 #define edit_file__cur_line     (G.edit_file__cur_line)
 #define refresh__old_offset     (G.refresh__old_offset)
@@ -446,6 +493,10 @@ static void dot_delete(void);	// delete the char at 'dot'
 static char *bound_dot(char *);	// make sure  text[0] <= P < "end"
 static char *new_screen(int, int);	// malloc virtual screen memory
 static char *char_insert(char *, char);	// insert the char c at 'p'
+static int plain_char(int);	// char_insert() just stores it
+static int gap_key(int);	// insert mode key which can leave the gap open
+static int input_pending(void);	// more input is waiting
+static int insert_pending(int);	// insert a run of waiting plain chars
 // might reallocate text[]! use p += stupid_insert(p, ...),
 // and be careful to not use pointers into potentially freed text[]!
 static uintptr_t stupid_insert(char *, char);	// stupidly insert the char c at 'p'
@@ -457,6 +508,17 @@ static char *text_hole_delete(char *, char *);	// at "p", delete a 'size' byte h
 // might reallocate text[]! use p += text_hole_make(p, ...),
 // and be careful to not use pointers into potentially freed text[]!
 static uintptr_t text_hole_make(char *, int);	// at "p", make a 'size' byte hole
+static void gap_open(char *);	// park the text far below "p" after a gap
+static void gap_close(void);	// put it back after "end"
+static void count_hole_lines(void);	// add lines of the last hole to text_lines
+static void replace_char(char *, char);	// overwrite the char at "p"
+#if ENABLE_FEATURE_VI_UNDO
+static void undo_push(int, char *, int);	// remember a change to text[]
+static void undo_pop(int);	// undo or redo the last command
+static void undo_free(struct undo_object **);
+#else
+#define undo_push(u_type, p, length) ((void)0)
+#endif
 static char *yank_delete(char *, char *, int, int);	// yank text[] into register then delete
 static void show_help(void);	// display some help info
 static void rawmode(void);	// set "raw" mode on tty
@@ -625,6 +687,8 @@ static int init_text_buffer(char *fn)
 	free(text);
 	text_size = size + 10240;
 	screenbegin = dot = end = text = xzalloc(text_size);
+	text_lines = hole_len = tail_len = 0;
+	nl_pos = nl_cnt = 0;
 
 	if (fn != current_filename) {
 		free(current_filename);
@@ -639,6 +703,11 @@ static int init_text_buffer(char *fn)
 	}
 	file_modified = 0;
 	last_file_modified = -1;
+#if ENABLE_FEATURE_VI_UNDO
+	/* loading the file is not a change to undo */
+	undo_free(&undo_stack);
+	undo_free(&redo_stack);
+#endif
 #if ENABLE_FEATURE_VI_YANKMARK
 	/* init the marks. */
 	memset(mark, 0, sizeof(mark));
@@ -782,6 +851,12 @@ static void edit_file(char *fn)
 		) {
 			start_new_cmd_q(c);
 		}
+#endif
+#if ENABLE_FEATURE_VI_UNDO
+		// changes made by a command and its insert mode
+		// are undone together
+		if (cmd_mode == 0)
+			undo_seq++;
 #endif
 		do_cmd(c);		// execute the user command
 
@@ -1807,6 +1882,58 @@ static char *char_search(char *p, const char *pat, int dir, int range)
 
 #endif /* FEATURE_VI_SEARCH */
 
+// a char which char_insert() would simply put into text[]
+static int plain_char(int c)
+{
+	if (c == erase_char || c == 127)
+		return 0;
+#if ENABLE_FEATURE_VI_SETOPTS
+	if (showmatch && strchr(")]}", c) != NULL)
+		return 0;
+#endif
+	return c == '\t' || (c > 0 && Isprint(c));
+}
+
+// a key which changes text[] only just before "dot" in insert mode
+static int gap_key(int c)
+{
+	return c == '\n' || c == 13 || c == 8 || c == 127 || c == erase_char
+		|| c == '\t' || (c > 0 && Isprint(c));
+}
+
+static int input_pending(void)
+{
+#if ENABLE_FEATURE_VI_DOT_CMD
+	if (ioq && *ioq)
+		return 1;
+#endif
+	return readbuffer[0] || mysleep(0);
+}
+
+// Insert "c" and the plain chars already waiting after it (a paste,
+// or "." replaying an insert) with one text_hole_make(): the text
+// after "dot" is moved once per run instead of once per char.
+// Returns the char which ended the run, or 0.
+static int insert_pending(int c)
+{
+	char buf[MAX_INPUT_LEN];
+	int n = 0;
+
+	for (;;) {
+		buf[n++] = c;
+		c = 0;
+		if (n == sizeof(buf) || !input_pending())
+			break;
+		c = get_one_char();
+		if (!plain_char(c))
+			break;
+	}
+	text_hole_make(dot, n);	// moves "dot" along with text[]
+	memcpy(dot, buf, n);
+	dot += n;
+	return c;
+}
+
 static char *char_insert(char *p, char c) // insert the char c at 'p'
 {
 	if (c == 22) {		// Is this an ctrl-V?
@@ -1821,16 +1948,17 @@ static char *char_insert(char *p, char c) // insert the char c at 'p'
 		cmdcnt = 0;
 		end_cmd_q();	// stop adding to q
 		last_status_cksum = 0;	// force status update
-		if ((p[-1] != '\n') && (dot > text)) {
+		if (dot > text && p[-1] != '\n') {
 			p--;
 		}
 	} else if (c == erase_char || c == 8 || c == 127) { // Is this a BS
 		//     123456789
-		if ((p[-1] != '\n') && (dot>text)) {
+		if (dot > text && p[-1] != '\n') {
 			p--;
 			p = text_hole_delete(p, p);	// shrink buffer 1 char
 		}
 	} else {
+		uintptr_t bias;
 #if ENABLE_FEATURE_VI_SETOPTS
 		// insert a char into text[]
 		char *sp;		// "save p"
@@ -1838,10 +1966,11 @@ static char *char_insert(char *p, char c) // insert the char c at 'p'
 
 		if (c == 13)
 			c = '\n';	// translate \r to \n
+		bias = stupid_insert(p, c);	// insert the char
 #if ENABLE_FEATURE_VI_SETOPTS
-		sp = p;			// remember addr of insert
+		sp = p + bias;		// remember addr of insert
 #endif
-		p += 1 + stupid_insert(p, c);	// insert the char
+		p += 1 + bias;
 #if ENABLE_FEATURE_VI_SETOPTS
 		if (showmatch && strchr(")]}", *sp) != NULL) {
 			showmatching(sp);
@@ -1852,7 +1981,6 @@ static char *char_insert(char *p, char c) // insert the char c at 'p'
 			q = prev_line(p);	// use prev line as template
 			len = strspn(q, " \t"); // space or tab
 			if (len) {
-				uintptr_t bias;
 				bias = text_hole_make(p, len);
 				p += bias;
 				q += bias;
@@ -2054,29 +2182,250 @@ static void showmatching(char *p)
 }
 #endif /* FEATURE_VI_SETOPTS */
 
-// open a hole in text[]
-// might reallocate text[]! use p += text_hole_make(p, ...),
-// and be careful to not use pointers into potentially freed text[]!
-static uintptr_t text_hole_make(char *p, int size)	// at "p", make a 'size' byte hole
+static int count_newlines(const char *p, int len)
+{
+	const char *e = p + len;
+	int cnt = 0;
+
+	while ((p = memchr(p, '\n', e - p)) != NULL) {
+		cnt++;
+		p++;
+	}
+	return cnt;
+}
+
+// the last hole was filled by now, count its lines
+static void count_hole_lines(void)
+{
+	if (hole_len) {
+		text_lines += count_newlines(text + hole_start, hole_len);
+		hole_len = 0;
+	}
+}
+
+// number of '\n' before "p", counted from where we were asked last:
+// the status line asks for "dot" after every key
+static int newlines_before(char *p)
+{
+	int pos = p - text;
+
+	if (pos >= nl_pos)
+		nl_cnt += count_newlines(text + nl_pos, pos - nl_pos);
+	else
+		nl_cnt -= count_newlines(p, nl_pos - pos);
+	nl_pos = pos;
+	return nl_cnt;
+}
+
+// text from "p" on is about to change
+static void newlines_changed(char *p)
+{
+	if (p < text + nl_pos)
+		newlines_before(p);
+}
+
+static void replace_char(char *p, char c)
+{
+	count_hole_lines();
+	newlines_changed(p);
+	undo_push(UNDO_SWAP, p, 1);
+	text_lines += (c == '\n') - (*p == '\n');
+	*p = c;
+	file_modified++;
+}
+
+#if ENABLE_FEATURE_VI_UNDO
+static void undo_free(struct undo_object **stack)
+{
+	struct undo_object *u;
+
+	while ((u = *stack) != NULL) {
+		*stack = u->prev;
+		free(u->text_copy);
+		free(u);
+	}
+}
+
+// called before text is deleted or replaced,
+// and after a hole for new text is made
+static void undo_push(int u_type, char *p, int length)
+{
+	struct undo_object *u = undo_stack;
+	int start = p - text;
+
+	if (undo_busy)
+		return;
+	undo_free(&redo_stack);	// can't redo after a new change
+	if (u && u->seq == undo_seq && u->u_type == u_type) {
+		// typing, repeated 'x' and backspacing extend the last change
+		if (u_type == UNDO_INS && start == u->start + u->length) {
+			u->length += length;
+			return;
+		}
+		if (u_type == UNDO_DEL
+		 && (start == u->start || start + length == u->start)
+		) {
+			u->text_copy = xrealloc(u->text_copy, u->length + length);
+			if (start == u->start) {
+				memcpy(u->text_copy + u->length, p, length);
+			} else {
+				memmove(u->text_copy + length, u->text_copy, u->length);
+				memcpy(u->text_copy, p, length);
+				u->start = start;
+			}
+			u->length += length;
+			return;
+		}
+	}
+	u = xzalloc(sizeof(*u));
+	u->prev = undo_stack;
+	u->start = start;
+	u->length = length;
+	u->seq = undo_seq;
+	u->u_type = u_type;
+	if (u_type != UNDO_INS) {
+		// inserted text is copied only when it is undone
+		u->text_copy = xmalloc(length);
+		memcpy(u->text_copy, p, length);
+	}
+	undo_stack = u;
+}
+
+// undo (redo == 0) or redo all changes made by one command
+static void undo_pop(int redo)
+{
+	struct undo_object **from = redo ? &redo_stack : &undo_stack;
+	struct undo_object **to = redo ? &undo_stack : &redo_stack;
+	struct undo_object *u = *from;
+	unsigned seq;
+
+	if (!u) {
+		status_line(redo ? "Already at newest change" : "Already at oldest change");
+		return;
+	}
+	seq = u->seq;
+	undo_busy = 1;
+	do {
+		char *p;
+		int n = u->length;	// text[] which is read or taken out
+
+		if (u->u_type != UNDO_SWAP && (u->u_type == UNDO_INS) == redo)
+			n = 0;	// text goes back in
+		// the changes of one command are close together: make
+		// them through a gap, the text below is moved only once
+		if (text + u->start + n >= end)
+			gap_close();
+		gap_open(text + u->start + n);
+		p = text + u->start;
+		*from = u->prev;
+		if (u->u_type == UNDO_SWAP) {
+			char c = u->text_copy[0];
+			u->text_copy[0] = *p;
+			replace_char(p, c);
+		} else if ((u->u_type == UNDO_INS) != redo) {
+			// take the text out
+			if (u->u_type == UNDO_INS) {
+				free(u->text_copy);
+				u->text_copy = xmalloc(u->length);
+				memcpy(u->text_copy, p, u->length);
+			}
+			text_hole_delete(p, p + u->length - 1);
+		} else {
+			// put it back
+			p += text_hole_make(p, u->length);
+			memcpy(p, u->text_copy, u->length);
+		}
+		dot = text + u->start;
+		u->prev = *to;
+		*to = u;
+		u = *from;
+	} while (u && u->seq == seq);
+	gap_close();
+	undo_busy = 0;
+}
+#endif
+
+// make room for "size" more bytes after "end"
+// might reallocate text[]! the gap must be closed
+static uintptr_t text_grow(int size)
 {
 	uintptr_t bias = 0;
 
-	if (size <= 0)
-		return bias;
-	end += size;		// adjust the new END
-	if (end >= (text + text_size)) {
+	if (end + size >= (text + text_size)) {
 		char *new_text;
-		text_size += end - (text + text_size) + 10240;
+		// grow by 1/8 too: a big file is not copied every 10k of typing
+		text_size += end + size - (text + text_size) + 10240 + text_size / 8;
 		new_text = xrealloc(text, text_size);
 		bias = (new_text - text);
 		screenbegin += bias;
 		dot         += bias;
 		end         += bias;
-		p           += bias;
 		text = new_text;
 	}
+	return bias;
+}
+
+// Typing in insert mode changes text[] only around "dot", but each
+// key moved all the text after it. Instead, the text more than two
+// screens below "p" is parked at the back of text[], and the free
+// space in between is a gap which holes are made from and deleted
+// into. Everything else still sees text[] end at "end": a key which
+// may look further than a screen below "dot" closes the gap first,
+// see do_cmd(). Nothing is parked for a short move.
+static void gap_open(char *p)
+{
+	int n;
+
+	if (tail_len)
+		return;
+	for (n = 2 * rows; n > 0; n--) {
+		p = memchr(p, '\n', end - p);
+		if (!p)
+			return;	// near the end of text[]
+		p++;
+	}
+	n = end - p;
+	if (n < 64 * 1024)
+		return;
+	// text_grow() adds at least 1/8: parking is paid for by
+	// that much typing
+	p += text_grow(10240 + (end - text) / 8);
+	tail_len = n;
+	memmove(text + text_size - n, p, n);
+	end = p;
+}
+
+static void gap_close(void)
+{
+	if (tail_len) {
+		memmove(end, text + text_size - tail_len, tail_len);
+		end += tail_len;
+		tail_len = 0;
+	}
+}
+
+// open a hole in text[]
+// might reallocate text[]! use p += text_hole_make(p, ...),
+// and be careful to not use pointers into potentially freed text[]!
+static uintptr_t text_hole_make(char *p, int size)	// at "p", make a 'size' byte hole
+{
+	uintptr_t bias;
+
+	if (size <= 0)
+		return 0;
+	count_hole_lines();
+	newlines_changed(p);
+	if (end + size > text + text_size - tail_len)
+		gap_close();	// the gap is full
+	bias = text_grow(size);
+	p += bias;
+	end += size;		// adjust the new END
 	memmove(p + size, p, end - size - p);
 	memset(p, ' ', size);	// clear new hole
+	// the caller fills the hole, count its lines later
+	hole_start = p - text;
+	hole_len = size;
+	undo_push(UNDO_INS, p, size);
 	file_modified++;
 	return bias;
 }
@@ -2101,6 +2450,12 @@ static char *text_hole_delete(char *p, char *q) // delete "p" through "q", inclu
 		goto thd0;
 	if (dest < text || dest >= end)
 		goto thd0;
+	count_hole_lines();
+	newlines_changed(dest);
+	if (hole_size > 0) {
+		text_lines -= count_newlines(dest, hole_size);
+		undo_push(UNDO_DEL, dest, hole_size);
+	}
 	if (src >= end)
 		goto thd_atend;	// just delete the end of the buffer
 	memmove(dest, src, cnt);
@@ -2181,6 +2536,9 @@ static void show_help(void)
 #endif
 #if ENABLE_FEATURE_VI_WIN_RESIZE
 	"\n\tAdapt to window re-sizes"
+#endif
+#if ENABLE_FEATURE_VI_UNDO
+	"\n\tUndo with 'u', redo with ^R"
 #endif
 	);
 }
@@ -2837,15 +3195,17 @@ static int format_edit_status(void)
 	// (this will cause a mis-reporting of modified status
 	// once every MAXINT editing operations.)
 
-	// it would be nice to do a similar optimization here -- if
-	// we haven't done a motion that could have changed which line
-	// we're on, then we shouldn't have to do this count_lines()
-	cur = count_lines(text, dot);
+	// same as count_lines(text, dot), without counting from the top
+	cur = newlines_before(dot);
+	if (dot < end && *end_line(dot) == '\n')
+		cur++;
 
 	// reduce counting -- the total lines can't have
 	// changed if we haven't done any edits.
+	// text_hole_make() and friends keep text_lines up to date.
 	if (file_modified != last_file_modified) {
-		tot = cur + count_lines(dot, end - 1) - 1;
+		count_hole_lines();
+		tot = text_lines;
 		last_file_modified = file_modified;
 	}
 
@@ -2970,6 +3330,9 @@ static void refresh(int full_screen)
 		full_screen |= (c - columns) | (r - rows);
 	}
 	sync_cursor(dot, &crow, &ccol);	// where cursor will be (on "dot")
+	// the screen must not reach the gap (a window resize could)
+	if (tail_len && end_screen() >= end - 1)
+		gap_close();
 	tp = screenbegin;	// index into text[] of top line
 
 	// compare text[] to screen[] and mark screen[] lines that need updating
@@ -3084,6 +3447,10 @@ static void do_cmd(int c)
 //	msg = p = q = save_dot = buf; // quiet the compiler
 	memset(buf, '\0', 12);
 
+	// only typing text keeps the gap open, anything else
+	// may look further than a screen below "dot"
+	if (cmd_mode == 0 || !gap_key(c))
+		gap_close();
 	show_status_line();
 
 	/* if this is a cursor key, skip these checks */
@@ -3110,6 +3477,8 @@ static void do_cmd(int c)
 			cmd_mode = 1;	// convert to insert
 		} else {
 			if (1 <= c || Isprint(c)) {
+				if (gap_key(c))
+					gap_open(dot);
 				if (c != 27)
 					dot = yank_delete(dot, dot, 0, YANKDEL);	// delete char
 				dot = char_insert(dot, c);	// insert new char
@@ -3122,6 +3491,16 @@ static void do_cmd(int c)
 		if (c == KEYCODE_INSERT) goto dc5;
 		// insert the char c at "dot"
 		if (1 <= c || Isprint(c)) {
+			if (gap_key(c))
+				gap_open(dot);
+			if (plain_char(c) && input_pending()) {
+				c1 = insert_pending(c);
+				if (c1 == 0)
+					goto dc1;
+				// the key which ended the run
+				do_cmd(c1);
+				return;
+			}
 			dot = char_insert(dot, c);
 		}
 		goto dc1;
@@ -3168,7 +3547,6 @@ static void do_cmd(int c)
 		//case ']':	// ]-
 		//case '_':	// _-
 		//case '`':	// `-
-		//case 'u':	// u- FIXME- there is no undo
 		//case 'v':	// v-
 	default:			// unrecognized command
 		buf[0] = c;
@@ -3212,8 +3590,18 @@ static void do_cmd(int c)
 		dot_next();		// go to next B-o-l
 		dot = move_to_col(dot, ccol + offset);	// try stay in same col
 		break;
+#if ENABLE_FEATURE_VI_UNDO
+	case 'u':			// u- undo last change
+		undo_pop(0);
+		break;
+	case 18:			// ctrl-R  redo last undone change
+		undo_pop(1);
+		break;
+#endif
 	case 12:			// ctrl-L  force redraw whole screen
+#if !ENABLE_FEATURE_VI_UNDO
 	case 18:			// ctrl-R  force redraw
+#endif
 		place_cursor(0, 0, FALSE);	// put cursor in correct place
 		clear_to_eos();	// tel terminal to erase display
 		mysleep(10);
@@ -3659,8 +4047,7 @@ static void do_cmd(int c)
 		}
 		dot_end();		// move to NL
 		if (dot < end - 1) {	// make sure not last char in text[]
-			*dot++ = ' ';	// replace NL with space
-			file_modified++;
+			replace_char(dot++, ' ');	// replace NL with space
 			while (isblank(*dot)) {	// delete leading WS
 				dot_delete();
 			}
@@ -3686,7 +4073,7 @@ static void do_cmd(int c)
 	case 'O':			// O- open a empty line above
 		//    0i\n ESC -i
 		p = begin_line(dot);
-		if (p[-1] == '\n') {
+		if (p > text) {
 			dot_prev();
 	case 'o':			// o- open a empty line below; Yes, I know it is in the middle of the "if (..."
 			dot_end();
@@ -3862,8 +4249,7 @@ static void do_cmd(int c)
 	case 'r':			// r- replace the current char with user input
 		c1 = get_one_char();	// get the replacement char
 		if (*dot != '\n') {
-			*dot = c1;
-			file_modified++;
+			replace_char(dot, c1);
 		}
 		end_cmd_q();	// stop adding to q
 		break;
@@ -3907,11 +4293,9 @@ static void do_cmd(int c)
 			do_cmd(c);
 		}
 		if (islower(*dot)) {
-			*dot = toupper(*dot);
-			file_modified++;
+			replace_char(dot, toupper(*dot));
 		} else if (isupper(*dot)) {
-			*dot = tolower(*dot);
-			file_modified++;
+			replace_char(dot, tolower(*dot));
 		}
 		dot_right();
 		end_cmd_q();	// stop adding to q
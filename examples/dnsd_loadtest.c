@@ -0,0 +1,173 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * Query throughput benchmark for dnsd.
+ *
+ * Sends A and PTR queries for names of a generated config file
+ * to dnsd on localhost, keeping a window of queries in flight,
+ * and reports answered queries per second.
+ *
+ * gcc -O2 -o dnsd_loadtest dnsd_loadtest.c
+ * ./dnsd_loadtest -w /tmp/dnsd.conf -n 50000
+ * busybox dnsd -c /tmp/dnsd.conf -i 127.0.0.1 -p 5353 &
+ * ./dnsd_loadtest -p 5353 -n 50000 -q 500000
+ *
+ * Licensed under GPLv2, see file LICENSE in this source tree.
+ */
+#define _GNU_SOURCE /* strchrnul */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* names are hostN.zone.example, addresses 10.0.0.0 + N + 1 */
+#define ZONE "zone.example"
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void die(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static int write_conf(const char *file, unsigned count)
+{
+	FILE *fp = fopen(file, "w");
+	unsigned i;
+
+	if (!fp)
+		die(file);
+	for (i = 0; i < count; i++) {
+		uint32_t ip = 0x0a000000 + i + 1;
+		fprintf(fp, "host%u." ZONE " %u.%u.%u.%u\n", i,
+			ip >> 24, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff);
+	}
+	if (fclose(fp))
+		die(file);
+	return 0;
+}
+
+/* Encode dotted NAME as labels at P, return end */
+static uint8_t *put_name(uint8_t *p, const char *name)
+{
+	while (*name) {
+		const char *dot = strchrnul(name, '.');
+		*p = dot - name;
+		memcpy(p + 1, name, *p);
+		p += 1 + *p;
+		name = *dot ? dot + 1 : dot;
+	}
+	*p++ = 0;
+	return p;
+}
+
+static unsigned build_query(uint8_t *buf, uint16_t id, unsigned n, int ptr)
+{
+	char name[64];
+	uint8_t *p;
+
+	memset(buf, 0, 12);
+	buf[0] = id >> 8;
+	buf[1] = id;
+	buf[2] = 0x01; /* RD */
+	buf[5] = 1; /* one question */
+	if (ptr) {
+		uint32_t ip = 0x0a000000 + n + 1;
+		sprintf(name, "%u.%u.%u.%u.in-addr.arpa",
+			ip & 0xff, (ip >> 8) & 0xff, (ip >> 16) & 0xff, ip >> 24);
+	} else {
+		sprintf(name, "host%u." ZONE, n);
+	}
+	p = put_name(buf + 12, name);
+	*p++ = 0; *p++ = ptr ? 12 : 1; /* type */
+	*p++ = 0; *p++ = 1; /* class IN */
+	return p - buf;
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in srv;
+	uint8_t buf[512];
+	unsigned names = 1000, queries = 100000, window = 64, port = 53;
+	unsigned sent = 0, answered = 0, positive = 0, inflight = 0;
+	const char *conf_file = NULL;
+	double t;
+	int fd, c;
+
+	while ((c = getopt(argc, argv, "n:q:W:p:w:")) != -1) {
+		switch (c) {
+		case 'n': names = strtoul(optarg, NULL, 0); break;
+		case 'q': queries = strtoul(optarg, NULL, 0); break;
+		case 'W': window = strtoul(optarg, NULL, 0); break;
+		case 'p': port = strtoul(optarg, NULL, 0); break;
+		case 'w': conf_file = optarg; break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-n NAMES] [-q QUERIES] [-W WINDOW] [-p PORT]\n"
+				"       %s -w CONF_FILE [-n NAMES]\n",
+				argv[0], argv[0]);
+			return 1;
+		}
+	}
+	if (conf_file)
+		return write_conf(conf_file, names);
+	if (names == 0 || window == 0)
+		return 1;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		die("socket");
+	memset(&srv, 0, sizeof(srv));
+	srv.sin_family = AF_INET;
+	srv.sin_port = htons(port);
+	srv.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (struct sockaddr*)&srv, sizeof(srv)) < 0)
+		die("connect");
+
+	srand(1);
+	t = now();
+	while (answered < queries) {
+		struct pollfd pfd;
+		ssize_t len;
+
+		while (inflight < window && sent < queries) {
+			unsigned n = (unsigned)rand() % names;
+			len = build_query(buf, sent, n, sent & 1);
+			if (send(fd, buf, len, 0) == len) {
+				inflight++;
+				sent++;
+			}
+		}
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 1000) <= 0) {
+			/* lost queries: stop waiting for them */
+			answered += inflight;
+			inflight = 0;
+			continue;
+		}
+		len = recv(fd, buf, sizeof(buf), 0);
+		if (len < 12)
+			continue;
+		if (inflight)
+			inflight--;
+		answered++;
+		if ((buf[3] & 0x0f) == 0 && buf[7] != 0)
+			positive++;
+	}
+	t = now() - t;
+	printf("%u queries, %u answers, %u not found or lost, %.2f s, %.0f queries/s\n",
+		queries, positive, queries - positive, t, queries / t);
+	return 0;
+}
@@ -0,0 +1,278 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * Load generator for udhcpd.
+ *
+ * Replays DISCOVER/REQUEST exchanges for many clients against udhcpd
+ * on the loopback interface. It poses as a relay agent (giaddr set),
+ * so udhcpd answers with plain UDP packets instead of raw ones,
+ * and no real network or clients are needed.
+ *
+ * New addresses are ARP-probed by udhcpd, which takes seconds per
+ * address. To exercise a big pool quickly, generate a lease file
+ * first, then every replayed client already has a lease:
+ *
+ * gcc -O2 -o udhcpd_loadtest udhcpd_loadtest.c
+ * ./udhcpd_loadtest -w /tmp/leases -n 60000 -s 10.0.0.1
+ * cat >/tmp/udhcpd.conf <<EOF
+ * interface lo
+ * start 10.0.0.1
+ * end 10.0.255.254
+ * max_leases 65000
+ * lease_file /tmp/leases
+ * EOF
+ * busybox udhcpd -f -P 6767 /tmp/udhcpd.conf >/dev/null &
+ * ./udhcpd_loadtest -p 6767 -n 60000 -r 3
+ *
+ * Licensed under GPLv2, see file LICENSE in this source tree.
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SERVER_ADDR "127.0.0.1"
+/* udhcpd replies to giaddr:port, it must differ from SERVER_ADDR */
+#define RELAY_ADDR  "127.0.0.2"
+
+enum {
+	DHCPDISCOVER = 1,
+	DHCPOFFER    = 2,
+	DHCPREQUEST  = 3,
+	DHCPACK      = 5,
+	DHCPNAK      = 6,
+};
+
+struct dhcp_packet {
+	uint8_t op;
+	uint8_t htype;
+	uint8_t hlen;
+	uint8_t hops;
+	uint32_t xid;
+	uint16_t secs;
+	uint16_t flags;
+	uint32_t ciaddr;
+	uint32_t yiaddr;
+	uint32_t siaddr_nip;
+	uint32_t gateway_nip;
+	uint8_t chaddr[16];
+	uint8_t sname[64];
+	uint8_t file[128];
+	uint32_t cookie;
+	uint8_t options[308];
+} __attribute__((packed));
+
+/* Same layout as struct dyn_lease in dhcpd.h */
+struct dyn_lease {
+	uint32_t expires;
+	uint32_t lease_nip;
+	uint8_t lease_mac[6];
+	char hostname[20];
+	uint8_t pad[2];
+} __attribute__((packed));
+
+static void make_mac(uint8_t *mac, unsigned n)
+{
+	mac[0] = 0x02; /* locally administered */
+	mac[1] = 0x00;
+	mac[2] = n >> 24;
+	mac[3] = n >> 16;
+	mac[4] = n >> 8;
+	mac[5] = n;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void die(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static int write_lease_file(const char *file, unsigned count, const char *start)
+{
+	struct dyn_lease lease;
+	uint64_t written_at = time(NULL);
+	uint32_t ip;
+	unsigned i;
+	int fd;
+
+	ip = ntohl(inet_addr(start));
+	fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		die(file);
+	/* 64-bit big endian timestamp */
+	for (i = 0; i < 8; i++) {
+		uint8_t c = written_at >> (56 - i * 8);
+		if (write(fd, &c, 1) != 1)
+			die("write");
+	}
+	for (i = 0; i < count; i++) {
+		memset(&lease, 0, sizeof(lease));
+		lease.expires = htonl(24 * 60 * 60);
+		lease.lease_nip = htonl(ip + i);
+		make_mac(lease.lease_mac, i);
+		if (write(fd, &lease, sizeof(lease)) != sizeof(lease))
+			die("write");
+	}
+	close(fd);
+	return 0;
+}
+
+static unsigned build_packet(struct dhcp_packet *p, unsigned n, int type,
+		uint32_t requested, uint32_t server_id, uint32_t relay)
+{
+	uint8_t *o;
+
+	memset(p, 0, sizeof(*p));
+	p->op = 1; /* BOOTREQUEST */
+	p->htype = 1;
+	p->hlen = 6;
+	p->hops = 1;
+	p->xid = htonl(n);
+	p->gateway_nip = relay;
+	make_mac(p->chaddr, n);
+	p->cookie = htonl(0x63825363);
+	o = p->options;
+	*o++ = 53; *o++ = 1; *o++ = type;
+	if (requested) {
+		*o++ = 50; *o++ = 4; memcpy(o, &requested, 4); o += 4;
+	}
+	if (server_id) {
+		*o++ = 54; *o++ = 4; memcpy(o, &server_id, 4); o += 4;
+	}
+	*o++ = 255;
+	return o - (uint8_t*)p;
+}
+
+/* Returns message type, 0 on timeout */
+static int wait_reply(int fd, unsigned n, uint32_t *yiaddr, uint32_t *server_id)
+{
+	struct dhcp_packet p;
+	struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (poll(&pfd, 1, 1000) > 0) {
+		ssize_t len = recv(fd, &p, sizeof(p), 0);
+		uint8_t *o, *end;
+		int type = 0;
+
+		if (len < (ssize_t)offsetof(struct dhcp_packet, options))
+			continue;
+		if (p.op != 2 || p.xid != htonl(n))
+			continue; /* stale reply to a timed out request */
+		*yiaddr = p.yiaddr;
+		o = p.options;
+		end = (uint8_t*)&p + len;
+		while (o + 1 < end && *o != 255) {
+			if (*o == 0) {
+				o++;
+				continue;
+			}
+			if (o[0] == 53)
+				type = o[2];
+			if (o[0] == 54 && o[1] == 4)
+				memcpy(server_id, o + 2, 4);
+			o += 2 + o[1];
+		}
+		return type;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in srv, me;
+	struct dhcp_packet pkt;
+	unsigned count = 1000, rounds = 1, port = 67;
+	const char *lease_file = NULL, *start = "10.0.0.1";
+	unsigned r, n;
+	int fd, tx, c, one = 1;
+
+	while ((c = getopt(argc, argv, "n:r:p:w:s:")) != -1) {
+		switch (c) {
+		case 'n': count = strtoul(optarg, NULL, 0); break;
+		case 'r': rounds = strtoul(optarg, NULL, 0); break;
+		case 'p': port = strtoul(optarg, NULL, 0); break;
+		case 'w': lease_file = optarg; break;
+		case 's': start = optarg; break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-n CLIENTS] [-r ROUNDS] [-p PORT]\n"
+				"       %s -w LEASE_FILE [-n CLIENTS] [-s START_IP]\n",
+				argv[0], argv[0]);
+			return 1;
+		}
+	}
+	if (lease_file)
+		return write_lease_file(lease_file, count, start);
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		die("socket");
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&me, 0, sizeof(me));
+	me.sin_family = AF_INET;
+	me.sin_port = htons(port);
+	me.sin_addr.s_addr = inet_addr(RELAY_ADDR);
+	if (bind(fd, (struct sockaddr*)&me, sizeof(me)) < 0)
+		die("bind " RELAY_ADDR);
+	/* Send from an ephemeral port: udhcpd replies from a socket
+	 * connected to RELAY_ADDR:port, which would swallow our next
+	 * request if it came from that address and port while the reply
+	 * socket is still open */
+	tx = socket(AF_INET, SOCK_DGRAM, 0);
+	if (tx < 0)
+		die("socket");
+	memset(&srv, 0, sizeof(srv));
+	srv.sin_family = AF_INET;
+	srv.sin_port = htons(port);
+	srv.sin_addr.s_addr = inet_addr(SERVER_ADDR);
+
+	for (r = 1; r <= rounds; r++) {
+		unsigned acks = 0, naks = 0, timeouts = 0;
+		double t = now();
+
+		for (n = 0; n < count; n++) {
+			uint32_t yiaddr = 0, server_id = 0;
+			unsigned len;
+			int type;
+
+			len = build_packet(&pkt, n, DHCPDISCOVER, 0, 0, me.sin_addr.s_addr);
+			sendto(tx, &pkt, len, 0, (struct sockaddr*)&srv, sizeof(srv));
+			type = wait_reply(fd, n, &yiaddr, &server_id);
+			if (type != DHCPOFFER) {
+				timeouts++;
+				continue;
+			}
+			len = build_packet(&pkt, n, DHCPREQUEST, yiaddr, server_id, me.sin_addr.s_addr);
+			sendto(tx, &pkt, len, 0, (struct sockaddr*)&srv, sizeof(srv));
+			type = wait_reply(fd, n, &yiaddr, &server_id);
+			if (type == DHCPACK)
+				acks++;
+			else if (type == DHCPNAK)
+				naks++;
+			else
+				timeouts++;
+		}
+		t = now() - t;
+		printf("round %u: %u clients, %u ACK, %u NAK, %u lost, %.2f s, %.0f exchanges/s\n",
+			r, count, acks, naks, timeouts, t, count / t);
+	}
+	return 0;
+}
@@ -291,38 +291,15 @@ static void print_line(const char *line, size_t line_len, int linenum, char deco
 	}
 }
 
-#if ENABLE_EXTRA_COMPAT
-/* Unlike getline, this one removes trailing '\n' */
-static ssize_t FAST_FUNC bb_getline(char **line_ptr, size_t *line_alloc_len, FILE *file)
-{
-	ssize_t res_sz;
-	char *line;
-	int delim = (NUL_DELIMITED ? '\0' : '\n');
-
-	res_sz = getdelim(line_ptr, line_alloc_len, delim, file);
-	line = *line_ptr;
-
-	if (res_sz > 0) {
-		if (line[res_sz - 1] == delim)
-			line[--res_sz] = '\0';
-	} else {
-		free(line); /* uclibc allocates a buffer even on EOF. WTF? */
-	}
-	return res_sz;
-}
-#endif
-
 static int grep_file(FILE *file)
 {
+	line_reader_t *lr;
 	smalluint found;
 	int linenum = 0;
 	int nmatches = 0;
-#if !ENABLE_EXTRA_COMPAT
 	char *line;
-#else
-	char *line = NULL;
-	ssize_t line_len;
-	size_t line_alloc_len;
+	size_t line_len;
+#if ENABLE_EXTRA_COMPAT
 # define rm_so start[0]
 # define rm_eo end[0]
 #endif
@@ -334,13 +311,15 @@ static int grep_file(FILE *file)
 	enum { print_n_lines_after = 0 };
 #endif
 
-	while (
 #if !ENABLE_EXTRA_COMPAT
-		(line = xmalloc_fgetline(file)) != NULL
+	lr = line_reader_open(file, LR_NUL_ENDS_LINE);
 #else
-		(line_len = bb_getline(&line, &line_alloc_len, file)) >= 0
+	lr = line_reader_open(file, LR_KEEP_CR);
+	if (NUL_DELIMITED)
+		lr->delim = '\0';
 #endif
-	) {
+	/* line is modified in place by -o, but not kept past this iteration */
+	while ((line = line_reader_next(lr, &line_len)) != NULL) {
 		llist_t *pattern_ptr = pattern_head;
 		grep_list_data_t *gl = gl; /* for gcc */
 
@@ -406,7 +385,7 @@ static int grep_file(FILE *file)
 
 			/* quiet/print (non)matching file names only? */
 			if (option_mask32 & (OPT_q|OPT_l|OPT_L)) {
-				free(line); /* we don't need line anymore */
+				line_reader_free(lr);
 				if (BE_QUIET) {
 					/* manpage says about -q:
 					 * "exit immediately with zero status
@@ -503,23 +482,18 @@ static int grep_file(FILE *file)
 		else { /* no match */
 			/* if we need to print some context lines after the last match, do so */
 			if (print_n_lines_after) {
-				print_line(line, strlen(line), linenum, '-');
+				print_line(line, line_len, linenum, '-');
 				print_n_lines_after--;
 			} else if (lines_before) {
 				/* Add the line to the circular 'before' buffer */
 				free(before_buf[curpos]);
-				before_buf[curpos] = line;
+				before_buf[curpos] = line_reader_copy(line, line_len);
 				IF_EXTRA_COMPAT(before_buf_size[curpos] = line_len;)
 				curpos = (curpos + 1) % lines_before;
-				/* avoid free(line) - we took the line */
-				line = NULL;
 			}
 		}
 
 #endif /* ENABLE_FEATURE_GREP_CONTEXT */
-#if !ENABLE_EXTRA_COMPAT
-		free(line);
-#endif
 		/* Did we print all context after last requested match? */
 		if ((option_mask32 & OPT_m)
 		 && !print_n_lines_after
@@ -528,6 +502,7 @@ static int grep_file(FILE *file)
 			break;
 		}
 	} /* while (read line) */
+	line_reader_free(lr);
 
 	/* special-case file post-processing for options where we don't print line
 	 * matches, just filenames and possibly match counts */
@@ -35,6 +35,13 @@ typedef struct file_header_t {
 	char *tar__gname;
 #endif
 	off_t size;
+#if ENABLE_FEATURE_TAR_SPARSE
+	/* GNU sparse file: archive holds only the data parts
+	 * of a file of tar__sparse_realsize bytes */
+	off_t *tar__sparse_map; /* (offset, size) pairs */
+	unsigned tar__sparse_cnt;
+	off_t tar__sparse_realsize;
+#endif
 	uid_t uid;
 	gid_t gid;
 	mode_t mode;
@@ -43,6 +50,7 @@ typedef struct file_header_t {
 } file_header_t;
 
 struct hardlinks_t;
+typedef struct match_list_t match_list_t;
 
 typedef struct archive_handle_t {
 	/* Flags. 1st since it is most used member */
@@ -59,6 +67,9 @@ typedef struct archive_handle_t {
 	llist_t *reject;
 	/* List of files that have successfully been worked on */
 	llist_t *passed;
+	/* accept and reject lists compiled by filters for fast lookups */
+	match_list_t *accept_compiled;
+	match_list_t *reject_compiled;
 
 	/* Currently processed file's header */
 	file_header_t *file_header;
@@ -151,6 +162,15 @@ typedef struct tar_header_t {     /* byte offset */
 struct BUG_tar_header {
 	char c[sizeof(tar_header_t) == TAR_BLOCK_SIZE ? 1 : -1];
 };
+/* Old GNU sparse file (typeflag 'S') has no prefix[], its header holds
+ * the first entries of the map of data parts instead. More entries go
+ * into 512-byte extension blocks following the header.
+ * Each entry is {offset[12], numbytes[12]} */
+#define TAR_SPARSE_MAP       386 /* TAR_SPARSE_IN_HDR entries */
+#define TAR_SPARSE_EXTENDED  482 /* nonzero: extension block follows */
+#define TAR_SPARSE_REALSIZE  483 /* realsize[12] */
+#define TAR_SPARSE_IN_HDR      4
+#define TAR_SPARSE_IN_EXT     21 /* followed by isextended flag */
 
 
 
@@ -173,6 +193,7 @@ void data_skip(archive_handle_t *archive_handle) FAST_FUNC;
 void data_extract_all(archive_handle_t *archive_handle) FAST_FUNC;
 void data_extract_to_stdout(archive_handle_t *archive_handle) FAST_FUNC;
 void data_extract_to_command(archive_handle_t *archive_handle) FAST_FUNC;
+void data_extract_sparse(archive_handle_t *archive_handle, int dst_fd, int ignore_write_errors) FAST_FUNC;
 
 void header_skip(const file_header_t *file_header) FAST_FUNC;
 void header_list(const file_header_t *file_header) FAST_FUNC;
@@ -193,6 +214,8 @@ const char *strip_unsafe_prefix(const char *str) FAST_FUNC;
 void data_align(archive_handle_t *archive_handle, unsigned boundary) FAST_FUNC;
 const llist_t *find_list_entry(const llist_t *list, const char *filename) FAST_FUNC;
 const llist_t *find_list_entry2(const llist_t *list, const char *filename) FAST_FUNC;
+const llist_t *find_compiled_list_entry(match_list_t **compiled, const llist_t *list, const char *filename) FAST_FUNC;
+const llist_t *find_compiled_list_entry2(match_list_t **compiled, const llist_t *list, const char *filename) FAST_FUNC;
 
 /* A bit of bunzip2 internals are exposed for compressed help support: */
 typedef struct bunzip_data bunzip_data;
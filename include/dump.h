@@ -25,6 +25,17 @@ typedef struct PR {
 	char *cchar;			/* conversion character */
 	char *fmt;			/* printf format */
 	char *nospace;			/* no whitespace version */
+	/* fmt taken apart by compile_pr(), if it can be output without printf */
+	smallint fast;
+	smallint left;			/* '-' flag */
+	smallint zero;			/* '0' flag */
+	char conv;			/* conversion char, 0 for F_TEXT */
+	short width;
+	short prec;			/* -1 if not given */
+	unsigned short pre_len;		/* length of text before the conversion */
+	unsigned short post_len;
+	char *post;			/* text after the conversion */
+	char *tab;			/* preformatted output for one byte units */
 } PR;
 
 typedef struct FU {
@@ -773,6 +773,41 @@ extern char *xmalloc_fgetline(FILE *file) FAST_FUNC RETURNS_MALLOC;
 /* Same, but doesn't try to conserve space (may have some slack after the end) */
 /* extern char *xmalloc_fgetline_fast(FILE *file) FAST_FUNC RETURNS_MALLOC; */
 
+/* Block-buffered line reader. Lines are returned as slices of its buffer,
+ * without the delimiter and NUL-terminated, and stay valid only until
+ * the next line_reader_* call on the same reader. Use line_reader_copy()
+ * to keep one. It read()s fileno(fp) directly: don't mix with stdio
+ * reads on the same FILE.
+ */
+enum {
+	LR_NUL_ENDS_LINE = 1 << 0, /* NUL byte ends a line too (like xmalloc_fgets) */
+	LR_KEEP_CR       = 1 << 1, /* MINGW: don't strip '\r' before '\n' */
+};
+typedef struct line_reader_t {
+	FILE *fp;
+	char *buf;
+	unsigned size;  /* allocated minus one, buf[end] is always NUL */
+	unsigned pos;   /* start of unread data */
+	unsigned end;
+	int eol;        /* what ended the last line: delim, '\0' or EOF */
+	int error;      /* errno of a failed read, reported as EOF */
+	unsigned char delim; /* '\n' by default, can be changed between calls */
+	unsigned char flags;
+	smallint eof;
+} line_reader_t;
+line_reader_t *line_reader_open(FILE *fp, unsigned flags) FAST_FUNC;
+/* Returns NULL on EOF/error. *lenp (if not NULL) gets line length */
+char *line_reader_next(line_reader_t *lr, size_t *lenp) FAST_FUNC;
+/* Returns number of bytes added after lr->end, 0 on EOF/error */
+int line_reader_fill(line_reader_t *lr) FAST_FUNC;
+/* May read more data: invalidates the last returned line */
+int line_reader_eof(line_reader_t *lr) FAST_FUNC;
+char *line_reader_copy(const char *line, size_t len) FAST_FUNC RETURNS_MALLOC;
+/* Frees the reader, fp stays open */
+void line_reader_free(line_reader_t *lr) FAST_FUNC;
+/* Closes fp too, unless it is stdin */
+void line_reader_close(line_reader_t *lr) FAST_FUNC;
+
 void die_if_ferror(FILE *file, const char *msg) FAST_FUNC;
 void die_if_ferror_stdout(void) FAST_FUNC;
 int fflush_all(void) FAST_FUNC;
@@ -1432,6 +1467,9 @@ unsigned size_from_HISTFILESIZE(const char *hp);
 typedef struct line_input_t {
 	int flags;
 	const char *path_lookup;
+# if ENABLE_FEATURE_TAB_COMPLETION_PATH_CACHE
+	struct lineedit_path_cache *path_cache;
+# endif
 # if MAX_HISTORY
 	int cnt_history;
 	int cur_history;
@@ -1453,6 +1491,12 @@ enum {
 	FOR_SHELL = DO_HISTORY | SAVE_HISTORY | TAB_COMPLETION | USERNAME_COMPLETION,
 };
 line_input_t *new_line_input_t(int flags) FAST_FUNC;
+# if ENABLE_FEATURE_TAB_COMPLETION_PATH_CACHE
+/* Forget cached $PATH listings (for "hash -r") */
+void free_path_completion_cache(line_input_t *st) FAST_FUNC;
+# else
+#  define free_path_completion_cache(st) ((void)0)
+# endif
 /* So far static: void free_line_input_t(line_input_t *n) FAST_FUNC; */
 /*
  * maxsize must be >= 2.
@@ -1580,9 +1624,13 @@ enum {
 //procps_status_t* alloc_procps_scan(void) FAST_FUNC;
 void free_procps_scan(procps_status_t* sp) FAST_FUNC;
 procps_status_t* procps_scan(procps_status_t* sp, int flags) FAST_FUNC;
+/* Parse /proc/PID/stat contents (modifies buf), 0 if it is bogus */
+int procps_parse_stat(procps_status_t *sp, char *buf) FAST_FUNC;
 /* Format cmdline (up to col chars) into char buf[size] */
 /* Puts [comm] if cmdline is empty (-> process is a kernel thread) */
 void read_cmdline(char *buf, int size, unsigned pid, const char *comm) FAST_FUNC;
+/* Same, for sz bytes of /proc/PID/cmdline already in buf */
+void format_cmdline(char *buf, int size, int sz, const char *comm) FAST_FUNC;
 pid_t *find_pid_by_name(const char* procName) FAST_FUNC;
 pid_t *pidlist_reverse(pid_t *pidList) FAST_FUNC;
 int starts_with_cpu(const char *str) FAST_FUNC;
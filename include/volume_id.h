@@ -28,4 +28,5 @@ void display_uuid_cache(void);
  *    *fsname is replaced if device with such UUID or LABEL is found
  */
 int resolve_mount_spec(char **fsname);
+/* Probe this device instead of all devices in /dev */
 int add_to_uuid_cache(const char *device);
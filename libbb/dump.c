@@ -21,6 +21,7 @@ static const char size_conv_str[] ALIGN1 =
 
 static const char lcc[] ALIGN1 = "diouxX";
 
+enum { OBUF_SIZE = 16 * 1024 };
 
 typedef struct priv_dumper_t {
 	dumper_t pub;
@@ -32,6 +33,8 @@ typedef struct priv_dumper_t {
 	off_t address;           /* address/offset in stream */
 	int blocksize;
 	smallint exitval;        /* final exit value */
+	unsigned olen;
+	char *obuf;              /* output of put_fast() */
 
 	/* former statics */
 	smallint next__done;
@@ -96,6 +99,198 @@ static NOINLINE int bb_dump_size(FS *fs)
 	return cur_size;
 }
 
+/*
+ * The pieces are short, and the "rep movsb" gcc makes of memcpy
+ * or counted loops here costs more than formatting. Text is copied
+ * up to its terminator, padding and digits 8 bytes at a time:
+ * up to 15 bytes past the end may be overwritten.
+ */
+static char *put_text(char *dst, const char *src, char end)
+{
+	while (*src != end)
+		*dst++ = *src++;
+	return dst;
+}
+
+/* Not inlined: gcc would see the fill is a byte pattern and use memset */
+static NOINLINE char *put_fill(char *dst, uint64_t fill8, int cnt)
+{
+	char *end = dst + cnt;
+	while (dst < end) {
+		memcpy(dst, &fill8, 8);
+		dst += 8;
+	}
+	return end;
+}
+#define SPACES8 0x2020202020202020ULL
+#define ZEROES8 0x3030303030303030ULL
+
+/* Same output as printf(pr->fmt, v), for pr->fast formats */
+static char *format_pr(char *dst, PR *pr, unsigned v)
+{
+	char digits[32];
+	char *s, *e;
+	unsigned len, zeros;
+	int pad, neg = 0;
+	smallint isnum = (pr->flags & (F_ADDRESS | F_INT | F_UINT)) != 0;
+
+	if (pr->conv)
+		dst = put_text(dst, pr->fmt, '%');
+	e = s = digits + 16;
+	switch (pr->conv) {
+	case 0:   /* F_TEXT */
+	case 's': /* F_BPAD, always "" */
+		break;
+	case 'c':
+		*--s = v;
+		break;
+	case 'd':
+	case 'i':
+		if ((int)v < 0) {
+			neg = 1;
+			v = -v;
+		}
+		/* fall through */
+	case 'u':
+		do *--s = '0' + v % 10; while (v /= 10);
+		break;
+	case 'o':
+		do *--s = '0' + (v & 7); while (v >>= 3);
+		break;
+	default: /* 'x', 'X' */
+		do *--s = bb_hexdigits_upcase[v & 0xf] | (pr->conv & 0x20); while (v >>= 4);
+	}
+	len = e - s;
+
+	zeros = 0;
+	if (isnum && pr->prec >= 0) {
+		/* printf("%.0x", 0) prints nothing */
+		if (pr->prec == 0 && len == 1 && *s == '0')
+			len = 0;
+		if ((unsigned)pr->prec > len)
+			zeros = pr->prec - len;
+	}
+	pad = pr->width - (neg + zeros + len);
+	if (pad > 0 && !pr->left) {
+		if (isnum && pr->zero && pr->prec < 0)
+			zeros += pad;
+		else
+			dst = put_fill(dst, SPACES8, pad);
+		pad = 0;
+	}
+	if (neg)
+		*dst++ = '-';
+	if (zeros)
+		dst = put_fill(dst, ZEROES8, zeros);
+	memcpy(dst, s, 8);
+	memcpy(dst + 8, s + 8, 8);
+	dst += len;
+	if (pad > 0)
+		dst = put_fill(dst, SPACES8, pad);
+	return put_text(dst, pr->post, '\0');
+}
+
+/*
+ * printf is where a dump spends nearly all of its time. Formats
+ * made of text and one integer, %c or blank padding conversion,
+ * with at most '-' and '0' flags, width and precision (this covers
+ * all the builtin ones but -c) are taken apart here once,
+ * and put_fast() formats them directly into an output buffer.
+ * One byte conversions are formatted for all 256 values in advance.
+ */
+static void compile_pr(PR *pr)
+{
+	char buf[1600];
+	const char *convs;
+	char *p = pr->fmt;
+	unsigned n;
+
+	free(pr->tab);
+	pr->tab = NULL;
+	pr->fast = 0;
+	pr->conv = 0;
+	pr->width = 0;
+	pr->prec = -1;
+	pr->left = pr->zero = 0;
+	switch (pr->flags) {
+	case F_TEXT:
+		pr->pre_len = 0;
+		pr->post = p;
+		goto post;
+	case F_ADDRESS:
+		convs = "dox";
+		break;
+	case F_INT:
+		convs = "di";
+		break;
+	case F_UINT:
+		convs = "ouxX";
+		break;
+	case F_CHAR:
+	case F_P:
+		convs = "c";
+		break;
+	case F_BPAD:
+		convs = "s";
+		break;
+	default:
+		return;
+	}
+	while (*p != '%')
+		p++;
+	pr->pre_len = p - pr->fmt;
+	for (;;) {
+		p++;
+		if (*p == '-')
+			pr->left = 1;
+		else if (*p == '0')
+			pr->zero = 1;
+		else
+			break;
+	}
+	for (n = 0; isdigit(*p); p++)
+		if ((n = n * 10 + (*p - '0')) > 255)
+			return;
+	pr->width = n;
+	if (*p == '.') {
+		for (n = 0; isdigit(*++p);)
+			if ((n = n * 10 + (*p - '0')) > 255)
+				return;
+		pr->prec = n;
+	}
+	if (!*p || !strchr(convs, *p))
+		return;
+	pr->conv = *p;
+	/* printf may pad %c with zeros, and precision is undefined for it */
+	if (*p == 'c' && (pr->zero || pr->prec >= 0))
+		return;
+	pr->post = p + 1;
+ post:
+	n = strlen(pr->post);
+	if (pr->pre_len + n > 1024)
+		return;
+	pr->post_len = n;
+	pr->fast = 1;
+
+	if (pr->bcnt == 1 && (pr->flags & (F_CHAR | F_INT | F_P | F_UINT))) {
+		/* tab[16 * byte] is the output length, followed by the output */
+		char *tab = xmalloc(256 * 16);
+		for (n = 0; n < 256; n++) {
+			unsigned len, v = n;
+			if (pr->flags == F_P && !isprint_asciionly(n))
+				v = '.';
+			len = format_pr(buf, pr, v) - buf;
+			if (len > 15) {
+				free(tab);
+				return;
+			}
+			tab[16 * n] = len;
+			memcpy(tab + 16 * n + 1, buf, len);
+		}
+		pr->tab = tab;
+	}
+}
+
 static NOINLINE void rewrite(priv_dumper_t *dumper, FS *fs)
 {
 	enum { NOTOKAY, USEBCNT, USEPREC } sokay;
@@ -313,6 +508,10 @@ static NOINLINE void rewrite(priv_dumper_t *dumper, FS *fs)
 		if (!fu->nextfu)
 			break;
 	}
+
+	for (fu = fs->nextfu; fu; fu = fu->nextfu)
+		for (pr = fu->nextpr; pr; pr = pr->nextpr)
+			compile_pr(pr);
 }
 
 static void do_skip(priv_dumper_t *dumper, const char *fname, int statok)
@@ -367,6 +566,14 @@ static NOINLINE int next(priv_dumper_t *dumper)
 	/* NOTREACHED */
 }
 
+static void flush_obuf(priv_dumper_t *dumper)
+{
+	if (dumper->olen) {
+		fwrite(dumper->obuf, 1, dumper->olen, stdout);
+		dumper->olen = 0;
+	}
+}
+
 static unsigned char *get(priv_dumper_t *dumper)
 {
 	int n;
@@ -398,6 +605,7 @@ static unsigned char *get(priv_dumper_t *dumper)
 			}
 			if (dumper->pub.dump_vflag != ALL && !memcmp(dumper->get__curp, dumper->get__savp, nread)) {
 				if (dumper->pub.dump_vflag != DUP) {
+					flush_obuf(dumper);
 					puts("*");
 				}
 				return NULL;
@@ -430,6 +638,7 @@ static unsigned char *get(priv_dumper_t *dumper)
 				return dumper->get__curp;
 			}
 			if (dumper->pub.dump_vflag == WAIT) {
+				flush_obuf(dumper);
 				puts("*");
 			}
 			dumper->pub.dump_vflag = DUP;
@@ -460,6 +669,7 @@ static void bpad(PR *pr)
 			pr->nospace--;
 	while ((*p2++ = *p1++) != 0)
 		continue;
+	compile_pr(pr);
 }
 
 static const char conv_str[] ALIGN1 =
@@ -523,6 +733,45 @@ static void conv_u(PR *pr, unsigned char *p)
 	}
 }
 
+/* Output of a pr->fast print unit */
+static void put_fast(priv_dumper_t *dumper, PR *pr, unsigned char *bp, int cnt)
+{
+	char *dst;
+	unsigned v = 0;
+
+	/* text is <= 1024 bytes, padding <= 2 * 255, + 15 bytes of slack */
+	if (dumper->olen > OBUF_SIZE - 1600)
+		flush_obuf(dumper);
+	dst = dumper->obuf + dumper->olen;
+	if (pr->tab) {
+		const char *t = pr->tab + *bp * 16;
+		memcpy(dst, t + 1, 15);
+		dst += (unsigned char)t[0];
+	} else if (pr->flags == F_TEXT) {
+		dst = put_text(dst, pr->fmt, '\0');
+	} else {
+		switch (pr->flags) {
+		case F_ADDRESS:
+			v = (unsigned) dumper->address;
+			break;
+		case F_INT:
+		case F_UINT:
+			if (pr->bcnt == 2) {
+				unsigned short sval;
+				memcpy(&sval, bp, sizeof(sval));
+				v = (pr->flags == F_INT) ? (unsigned)(int)(short)sval : sval;
+			} else {
+				memcpy(&v, bp, sizeof(v));
+			}
+			break;
+		}
+		dst = format_pr(dst, pr, v);
+	}
+	if (cnt == 1 && pr->nospace)
+		dst -= pr->post + pr->post_len - pr->nospace;
+	dumper->olen = dst - dumper->obuf;
+}
+
 static void display(priv_dumper_t* dumper)
 {
 	FS *fs;
@@ -550,6 +799,11 @@ static void display(priv_dumper_t* dumper)
 						) {
 							bpad(pr);
 						}
+						if (pr->fast) {
+							put_fast(dumper, pr, bp, cnt);
+							continue;
+						}
+						flush_obuf(dumper);
 						if (cnt == 1 && pr->nospace) {
 							savech = *pr->nospace;
 							*pr->nospace = '\0';
@@ -643,6 +897,7 @@ static void display(priv_dumper_t* dumper)
 			}
 		}
 	}
+	flush_obuf(dumper);
 	if (dumper->endfu) {
 		/*
 		 * if eaddress not set, error or file size was multiple
@@ -691,6 +946,7 @@ int FAST_FUNC bb_dump_dump(dumper_t *pub_dumper, char **argv)
 	}
 
 	dumper->argv = argv;
+	dumper->obuf = xmalloc(OBUF_SIZE);
 	display(dumper);
 
 	return dumper->exitval;
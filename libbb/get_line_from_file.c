@@ -65,6 +65,130 @@ char* FAST_FUNC xmalloc_fgetline(FILE *file)
 	return c;
 }
 
+/* Line reader: reads big blocks with read() and hands out lines
+ * in place, no per-char getc() and no malloc per line.
+ * Think "grep 50gigabyte_file" again.
+ */
+enum { LINE_READER_BUFSIZE = 64 * 1024 };
+
+line_reader_t* FAST_FUNC line_reader_open(FILE *fp, unsigned flags)
+{
+	line_reader_t *lr = xzalloc(sizeof(*lr));
+
+	lr->fp = fp;
+	lr->flags = flags;
+	lr->delim = '\n';
+	/* buf is allocated by first line_reader_fill */
+	return lr;
+}
+
+int FAST_FUNC line_reader_fill(line_reader_t *lr)
+{
+	ssize_t n;
+
+	if (lr->eof)
+		return 0;
+	if (lr->pos != 0) {
+		/* move unread data to the front */
+		lr->end -= lr->pos;
+		memmove(lr->buf, lr->buf + lr->pos, lr->end);
+		lr->pos = 0;
+	}
+	if (lr->end == lr->size) {
+		/* buffer is full of one line (or not allocated yet) */
+		lr->size = lr->size ? lr->size * 2 + 1 : LINE_READER_BUFSIZE - 1;
+		lr->buf = xrealloc(lr->buf, lr->size + 1);
+	}
+	n = safe_read(fileno(lr->fp), lr->buf + lr->end, lr->size - lr->end);
+	if (n <= 0) {
+		if (n < 0)
+			lr->error = errno;
+		lr->eof = 1;
+		n = 0;
+	}
+	lr->end += n;
+	lr->buf[lr->end] = '\0';
+	return n;
+}
+
+char* FAST_FUNC line_reader_next(line_reader_t *lr, size_t *lenp)
+{
+	unsigned scan = 0; /* this many bytes after pos have no delimiter */
+	char *line, *p;
+	size_t len;
+
+	for (;;) {
+		unsigned avail = lr->end - lr->pos;
+
+		if (scan < avail) {
+			line = lr->buf + lr->pos;
+			p = memchr(line + scan, lr->delim, avail - scan);
+			if ((lr->flags & LR_NUL_ENDS_LINE) && lr->delim != '\0') {
+				char *z = memchr(line + scan, '\0',
+						(p ? p : line + avail) - (line + scan));
+				if (z)
+					p = z;
+			}
+			if (p) {
+				lr->eol = (unsigned char)*p;
+				break;
+			}
+			scan = avail;
+		}
+		if (!line_reader_fill(lr)) {
+			if (lr->pos == lr->end)
+				return NULL;
+			/* last line has no delimiter */
+			p = lr->buf + lr->end;
+			lr->eol = EOF;
+			break;
+		}
+	}
+
+	line = lr->buf + lr->pos;
+	len = p - line;
+	lr->pos += len + (lr->eol != EOF);
+	*p = '\0';
+#if ENABLE_PLATFORM_MINGW32
+	if (!(lr->flags & LR_KEEP_CR) && lr->eol != '\0'
+	 && len && line[len - 1] == '\r'
+	) {
+		line[--len] = '\0';
+	}
+#endif
+	if (lenp)
+		*lenp = len;
+	return line;
+}
+
+int FAST_FUNC line_reader_eof(line_reader_t *lr)
+{
+	return lr->pos == lr->end && !line_reader_fill(lr);
+}
+
+/* Lines may contain NULs (delim != '\0' and no LR_NUL_ENDS_LINE),
+ * so this is not xstrndup */
+char* FAST_FUNC line_reader_copy(const char *line, size_t len)
+{
+	char *s = xmalloc(len + 1);
+
+	memcpy(s, line, len);
+	s[len] = '\0';
+	return s;
+}
+
+void FAST_FUNC line_reader_free(line_reader_t *lr)
+{
+	free(lr->buf);
+	free(lr);
+}
+
+void FAST_FUNC line_reader_close(line_reader_t *lr)
+{
+	fclose_if_not_stdin(lr->fp);
+	line_reader_free(lr);
+}
+
 #if 0
 /* GNUism getline() should be faster (not tested) than a loop with fgetc */
 
@@ -753,6 +753,218 @@ static int path_parse(char ***p)
 	return npth;
 }
 
+# if ENABLE_FEATURE_TAB_COMPLETION_PATH_CACHE
+/* Reading every $PATH directory on every <tab> is slow, especially
+ * on network filesystems. Instead, names from each directory are kept
+ * in a sorted vector, and a directory is read again only if its
+ * mtime changes. Whether a name is a directory is found out (by stat)
+ * only when it first matches, and remembered too.
+ */
+struct path_dir_cache {
+	struct path_dir_cache *next;
+	char *dir;
+	/* names[i] is "name\0T", T is '/' for a directory,
+	 * 'f' for anything else, '?' if not known yet */
+	char **names;
+	unsigned cnt;
+	smallint valid;
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+};
+struct lineedit_path_cache {
+	char *path; /* $PATH the list below was made for */
+	struct path_dir_cache *dirs;
+};
+
+static void free_path_dir_cache(struct path_dir_cache *d)
+{
+	while (d->cnt)
+		free(d->names[--d->cnt]);
+	free(d->names);
+	d->names = NULL;
+	d->valid = 0;
+}
+
+void FAST_FUNC free_path_completion_cache(line_input_t *st)
+{
+	struct lineedit_path_cache *pc = st->path_cache;
+
+	if (!pc)
+		return;
+	while (pc->dirs) {
+		struct path_dir_cache *d = pc->dirs;
+		pc->dirs = d->next;
+		free_path_dir_cache(d);
+		free(d->dir);
+		free(d);
+	}
+	free(pc->path);
+	free(pc);
+	st->path_cache = NULL;
+}
+
+/* Return the list of $PATH directories, rebuilt if $PATH has changed */
+static struct path_dir_cache *get_path_cache(void)
+{
+	struct lineedit_path_cache *pc = state->path_cache;
+	struct path_dir_cache *old, **pp;
+	const char *pth;
+	char *path1[1];
+	char **paths = path1;
+	int npaths, i;
+
+	if (state->flags & WITH_PATH_LOOKUP)
+		pth = state->path_lookup;
+	else
+		pth = getenv("PATH");
+	if (!pth)
+		pth = "";
+
+	if (!pc)
+		pc = state->path_cache = xzalloc(sizeof(*pc));
+	else if (strcmp(pc->path, pth) == 0)
+		return pc->dirs;
+
+	/* Keep what was read for directories which are still in $PATH */
+	old = pc->dirs;
+	pp = &pc->dirs;
+	path1[0] = (char*)".";
+	npaths = path_parse(&paths);
+	for (i = 0; i < npaths; i++) {
+		struct path_dir_cache *d, **op;
+
+		for (op = &old; (d = *op) != NULL; op = &d->next) {
+			if (strcmp(d->dir, paths[i]) == 0) {
+				*op = d->next;
+				break;
+			}
+		}
+		if (!d) {
+			d = xzalloc(sizeof(*d));
+			d->dir = xstrdup(paths[i]);
+		}
+		*pp = d;
+		pp = &d->next;
+	}
+	*pp = NULL;
+	while (old) {
+		struct path_dir_cache *d = old;
+		old = d->next;
+		free_path_dir_cache(d);
+		free(d->dir);
+		free(d);
+	}
+	if (paths != path1) {
+		free(paths[0]);
+		free(paths);
+	}
+	free(pc->path);
+	pc->path = xstrdup(pth);
+	return pc->dirs;
+}
+
+static void read_path_dir(struct path_dir_cache *d)
+{
+	struct stat st;
+	DIR *dir;
+	struct dirent *next;
+
+	if (stat(d->dir, &st) != 0) {
+		free_path_dir_cache(d);
+		return;
+	}
+	if (d->valid
+	 && d->dev == st.st_dev && d->ino == st.st_ino
+	 && d->mtime == st.st_mtime
+	) {
+		return;
+	}
+
+	free_path_dir_cache(d);
+	dir = opendir(d->dir);
+	if (!dir)
+		return;
+	while ((next = readdir(dir)) != NULL) {
+		unsigned len = strlen(next->d_name);
+		char *name = xmalloc(len + 2);
+
+		strcpy(name, next->d_name);
+		name[len + 1] = '?';
+		d->names = xrealloc_vector(d->names, 6, d->cnt);
+		d->names[d->cnt++] = name;
+	}
+	closedir(dir);
+	qsort_string_vector(d->names, d->cnt);
+
+	d->dev = st.st_dev;
+	d->ino = st.st_ino;
+	d->mtime = st.st_mtime;
+	/* A change later in the same second would not show up in mtime:
+	 * if the directory was modified just now, read it again next time */
+	d->valid = (st.st_mtime != time(NULL));
+}
+
+static void complete_from_path_cache(const char *pfind, unsigned pf_len)
+{
+	struct path_dir_cache *d;
+
+	for (d = get_path_cache(); d; d = d->next) {
+		unsigned lo, hi;
+
+		read_path_dir(d);
+
+		/* find the first name >= pfind */
+		lo = 0;
+		hi = d->cnt;
+		while (lo < hi) {
+			unsigned mid = (lo + hi) / 2;
+			if (strcmp(d->names[mid], pfind) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		for (; lo < d->cnt; lo++) {
+			char *name_found = d->names[lo];
+			unsigned len;
+			char *type, *found;
+
+			if (strncmp(name_found, pfind, pf_len) != 0)
+				break;
+			/* .../<tab>: bash 3.2.0 shows dotfiles, but not . and .. */
+			if (!pfind[0] && DOT_OR_DOTDOT(name_found))
+				continue;
+
+			len = strlen(name_found);
+			type = &name_found[len + 1];
+			if (*type == '?') {
+				struct stat st;
+
+				found = concat_path_file(d->dir, name_found);
+				/* stat() to see whether it is a directory,
+				 * lstat() to still match dangling links */
+				if (stat(found, &st) && lstat(found, &st)) {
+					free(found);
+					continue; /* hmm, remove in progress? */
+				}
+				free(found);
+				*type = S_ISDIR(st.st_mode) ? '/' : 'f';
+			}
+
+			found = xmalloc(len + 2); /* +2: for slash and NUL */
+			strcpy(found, name_found);
+			if (*type == '/') {
+				/* name is a directory, add slash */
+				found[len] = '/';
+				found[len + 1] = '\0';
+			}
+			add_match(found);
+		}
+	}
+}
+# endif
+
 /* Complete command, directory or file name.
  * Return the length of the prefix used for matching.
  */
@@ -771,8 +983,15 @@ static NOINLINE unsigned complete_cmd_dir_file(const char *command, int type)
 
 	pfind = strrchr(command, '/');
 	if (!pfind) {
-		if (type == FIND_EXE_ONLY)
+		if (type == FIND_EXE_ONLY) {
+# if ENABLE_FEATURE_TAB_COMPLETION_PATH_CACHE
+			pf_len = strlen(command);
+			complete_from_path_cache(command, pf_len);
+			return pf_len;
+# else
 			npaths = path_parse(&paths);
+# endif
+		}
 		pfind = command;
 	} else {
 		/* point to 'l' in "..../last_component" */
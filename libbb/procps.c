@@ -283,6 +283,121 @@ int FAST_FUNC procps_read_smaps(pid_t pid, struct smaprec *total,
 #endif
 
 void BUG_comm_size(void);
+/* Parses /proc/PID/stat contents in buf (buf is modified).
+ * Returns 0 if data is bogus */
+int FAST_FUNC procps_parse_stat(procps_status_t *sp, char *buf)
+{
+	long tasknice;
+	char *cp, *comm1;
+	int tty;
+#if !ENABLE_FEATURE_FAST_TOP
+	int n;
+	unsigned long vsz, rss;
+#endif
+
+	cp = strrchr(buf, ')'); /* split into "PID (cmd" and "<rest>" */
+	/*if (!cp || cp[1] != ' ')
+		continue;*/
+	cp[0] = '\0';
+	if (sizeof(sp->comm) < 16)
+		BUG_comm_size();
+	comm1 = strchr(buf, '(');
+	/*if (comm1)*/
+		safe_strncpy(sp->comm, comm1 + 1, sizeof(sp->comm));
+
+#if !ENABLE_FEATURE_FAST_TOP
+	n = sscanf(cp+2,
+		"%c %u "               /* state, ppid */
+		"%u %u %d %*s "        /* pgid, sid, tty, tpgid */
+		"%*s %*s %*s %*s %*s " /* flags, min_flt, cmin_flt, maj_flt, cmaj_flt */
+		"%lu %lu "             /* utime, stime */
+		"%*s %*s %*s "         /* cutime, cstime, priority */
+		"%ld "                 /* nice */
+		"%*s %*s "             /* timeout, it_real_value */
+		"%lu "                 /* start_time */
+		"%lu "                 /* vsize */
+		"%lu "                 /* rss */
+# if ENABLE_FEATURE_TOP_SMP_PROCESS
+		"%*s %*s %*s %*s %*s %*s " /*rss_rlim, start_code, end_code, start_stack, kstk_esp, kstk_eip */
+		"%*s %*s %*s %*s "         /*signal, blocked, sigignore, sigcatch */
+		"%*s %*s %*s %*s "         /*wchan, nswap, cnswap, exit_signal */
+		"%d"                       /*cpu last seen on*/
+# endif
+		,
+		sp->state, &sp->ppid,
+		&sp->pgid, &sp->sid, &tty,
+		&sp->utime, &sp->stime,
+		&tasknice,
+		&sp->start_time,
+		&vsz,
+		&rss
+# if ENABLE_FEATURE_TOP_SMP_PROCESS
+		, &sp->last_seen_on_cpu
+# endif
+		);
+
+	if (n < 11)
+		return 0; /* bogus data */
+# if ENABLE_FEATURE_TOP_SMP_PROCESS
+	if (n < 11+15)
+		sp->last_seen_on_cpu = 0;
+# endif
+
+	/* vsz is in bytes and we want kb */
+	sp->vsz = vsz >> 10;
+	/* vsz is in bytes but rss is in *PAGES*! Can you believe that? */
+	sp->rss = rss << sp->shift_pages_to_kb;
+	sp->tty_major = (tty >> 8) & 0xfff;
+	sp->tty_minor = (tty & 0xff) | ((tty >> 12) & 0xfff00);
+#else
+/* This costs ~100 bytes more but makes top faster by 20%
+ * If you run 10000 processes, this may be important for you */
+	sp->state[0] = cp[2];
+	cp += 4;
+	sp->ppid = fast_strtoul_10(&cp);
+	sp->pgid = fast_strtoul_10(&cp);
+	sp->sid = fast_strtoul_10(&cp);
+	tty = fast_strtoul_10(&cp);
+	sp->tty_major = (tty >> 8) & 0xfff;
+	sp->tty_minor = (tty & 0xff) | ((tty >> 12) & 0xfff00);
+	cp = skip_fields(cp, 6); /* tpgid, flags, min_flt, cmin_flt, maj_flt, cmaj_flt */
+	sp->utime = fast_strtoul_10(&cp);
+	sp->stime = fast_strtoul_10(&cp);
+	cp = skip_fields(cp, 3); /* cutime, cstime, priority */
+	tasknice = fast_strtol_10(&cp);
+	cp = skip_fields(cp, 2); /* timeout, it_real_value */
+	sp->start_time = fast_strtoul_10(&cp);
+	/* vsz is in bytes and we want kb */
+	sp->vsz = fast_strtoul_10(&cp) >> 10;
+	/* vsz is in bytes but rss is in *PAGES*! Can you believe that? */
+	sp->rss = fast_strtoul_10(&cp) << sp->shift_pages_to_kb;
+# if ENABLE_FEATURE_TOP_SMP_PROCESS
+	/* (6): rss_rlim, start_code, end_code, start_stack, kstk_esp, kstk_eip */
+	/* (4): signal, blocked, sigignore, sigcatch */
+	/* (4): wchan, nswap, cnswap, exit_signal */
+	cp = skip_fields(cp, 14);
+//FIXME: is it safe to assume this field exists?
+	sp->last_seen_on_cpu = fast_strtoul_10(&cp);
+# endif
+#endif /* FEATURE_FAST_TOP */
+
+#if ENABLE_FEATURE_PS_ADDITIONAL_COLUMNS
+	sp->niceness = tasknice;
+#endif
+
+	if (sp->vsz == 0 && sp->state[0] != 'Z')
+		sp->state[1] = 'W';
+	else
+		sp->state[1] = ' ';
+	if (tasknice < 0)
+		sp->state[2] = '<';
+	else if (tasknice) /* > 0 */
+		sp->state[2] = 'N';
+	else
+		sp->state[2] = ' ';
+	return 1;
+}
+
 procps_status_t* FAST_FUNC procps_scan(procps_status_t* sp, int flags)
 {
 	if (!sp)
@@ -291,7 +406,6 @@ procps_status_t* FAST_FUNC procps_scan(procps_status_t* sp, int flags)
 	for (;;) {
 		struct dirent *entry;
 		char buf[PROCPS_BUFSIZE];
-		long tasknice;
 		unsigned pid;
 		int n;
 		char filename[sizeof("/proc/%u/task/%u/cmdline") + sizeof(int)*3 * 2];
@@ -370,116 +484,13 @@ procps_status_t* FAST_FUNC procps_scan(procps_status_t* sp, int flags)
 			| PSSCAN_TTY | PSSCAN_NICE
 			| PSSCAN_CPU)
 		) {
-			char *cp, *comm1;
-			int tty;
-#if !ENABLE_FEATURE_FAST_TOP
-			unsigned long vsz, rss;
-#endif
 			/* see proc(5) for some details on this */
 			strcpy(filename_tail, "stat");
 			n = read_to_buf(filename, buf);
 			if (n < 0)
 				continue; /* process probably exited */
-			cp = strrchr(buf, ')'); /* split into "PID (cmd" and "<rest>" */
-			/*if (!cp || cp[1] != ' ')
-				continue;*/
-			cp[0] = '\0';
-			if (sizeof(sp->comm) < 16)
-				BUG_comm_size();
-			comm1 = strchr(buf, '(');
-			/*if (comm1)*/
-				safe_strncpy(sp->comm, comm1 + 1, sizeof(sp->comm));
-
-#if !ENABLE_FEATURE_FAST_TOP
-			n = sscanf(cp+2,
-				"%c %u "               /* state, ppid */
-				"%u %u %d %*s "        /* pgid, sid, tty, tpgid */
-				"%*s %*s %*s %*s %*s " /* flags, min_flt, cmin_flt, maj_flt, cmaj_flt */
-				"%lu %lu "             /* utime, stime */
-				"%*s %*s %*s "         /* cutime, cstime, priority */
-				"%ld "                 /* nice */
-				"%*s %*s "             /* timeout, it_real_value */
-				"%lu "                 /* start_time */
-				"%lu "                 /* vsize */
-				"%lu "                 /* rss */
-# if ENABLE_FEATURE_TOP_SMP_PROCESS
-				"%*s %*s %*s %*s %*s %*s " /*rss_rlim, start_code, end_code, start_stack, kstk_esp, kstk_eip */
-				"%*s %*s %*s %*s "         /*signal, blocked, sigignore, sigcatch */
-				"%*s %*s %*s %*s "         /*wchan, nswap, cnswap, exit_signal */
-				"%d"                       /*cpu last seen on*/
-# endif
-				,
-				sp->state, &sp->ppid,
-				&sp->pgid, &sp->sid, &tty,
-				&sp->utime, &sp->stime,
-				&tasknice,
-				&sp->start_time,
-				&vsz,
-				&rss
-# if ENABLE_FEATURE_TOP_SMP_PROCESS
-				, &sp->last_seen_on_cpu
-# endif
-				);
-
-			if (n < 11)
+			if (!procps_parse_stat(sp, buf))
 				continue; /* bogus data, get next /proc/XXX */
-# if ENABLE_FEATURE_TOP_SMP_PROCESS
-			if (n < 11+15)
-				sp->last_seen_on_cpu = 0;
-# endif
-
-			/* vsz is in bytes and we want kb */
-			sp->vsz = vsz >> 10;
-			/* vsz is in bytes but rss is in *PAGES*! Can you believe that? */
-			sp->rss = rss << sp->shift_pages_to_kb;
-			sp->tty_major = (tty >> 8) & 0xfff;
-			sp->tty_minor = (tty & 0xff) | ((tty >> 12) & 0xfff00);
-#else
-/* This costs ~100 bytes more but makes top faster by 20%
- * If you run 10000 processes, this may be important for you */
-			sp->state[0] = cp[2];
-			cp += 4;
-			sp->ppid = fast_strtoul_10(&cp);
-			sp->pgid = fast_strtoul_10(&cp);
-			sp->sid = fast_strtoul_10(&cp);
-			tty = fast_strtoul_10(&cp);
-			sp->tty_major = (tty >> 8) & 0xfff;
-			sp->tty_minor = (tty & 0xff) | ((tty >> 12) & 0xfff00);
-			cp = skip_fields(cp, 6); /* tpgid, flags, min_flt, cmin_flt, maj_flt, cmaj_flt */
-			sp->utime = fast_strtoul_10(&cp);
-			sp->stime = fast_strtoul_10(&cp);
-			cp = skip_fields(cp, 3); /* cutime, cstime, priority */
-			tasknice = fast_strtol_10(&cp);
-			cp = skip_fields(cp, 2); /* timeout, it_real_value */
-			sp->start_time = fast_strtoul_10(&cp);
-			/* vsz is in bytes and we want kb */
-			sp->vsz = fast_strtoul_10(&cp) >> 10;
-			/* vsz is in bytes but rss is in *PAGES*! Can you believe that? */
-			sp->rss = fast_strtoul_10(&cp) << sp->shift_pages_to_kb;
-# if ENABLE_FEATURE_TOP_SMP_PROCESS
-			/* (6): rss_rlim, start_code, end_code, start_stack, kstk_esp, kstk_eip */
-			/* (4): signal, blocked, sigignore, sigcatch */
-			/* (4): wchan, nswap, cnswap, exit_signal */
-			cp = skip_fields(cp, 14);
-//FIXME: is it safe to assume this field exists?
-			sp->last_seen_on_cpu = fast_strtoul_10(&cp);
-# endif
-#endif /* FEATURE_FAST_TOP */
-
-#if ENABLE_FEATURE_PS_ADDITIONAL_COLUMNS
-			sp->niceness = tasknice;
-#endif
-
-			if (sp->vsz == 0 && sp->state[0] != 'Z')
-				sp->state[1] = 'W';
-			else
-				sp->state[1] = ' ';
-			if (tasknice < 0)
-				sp->state[2] = '<';
-			else if (tasknice) /* > 0 */
-				sp->state[2] = 'N';
-			else
-				sp->state[2] = ' ';
 		}
 
 #if ENABLE_FEATURE_TOPMEM
@@ -570,13 +581,8 @@ procps_status_t* FAST_FUNC procps_scan(procps_status_t* sp, int flags)
 
 #endif	/* ENABLE_PLATFORM_MINGW32 */
 
-void FAST_FUNC read_cmdline(char *buf, int col, unsigned pid, const char *comm)
+void FAST_FUNC format_cmdline(char *buf, int col, int sz, const char *comm)
 {
-	int sz;
-	char filename[sizeof("/proc/%u/cmdline") + sizeof(int)*3];
-
-	sprintf(filename, "/proc/%u/cmdline", pid);
-	sz = open_read_close(filename, buf, col - 1);
 	if (sz > 0) {
 		const char *base;
 		int comm_len;
@@ -619,6 +625,16 @@ void FAST_FUNC read_cmdline(char *buf, int col, unsigned pid, const char *comm)
 	}
 }
 
+void FAST_FUNC read_cmdline(char *buf, int col, unsigned pid, const char *comm)
+{
+	int sz;
+	char filename[sizeof("/proc/%u/cmdline") + sizeof(int)*3];
+
+	sprintf(filename, "/proc/%u/cmdline", pid);
+	sz = open_read_close(filename, buf, col - 1);
+	format_cmdline(buf, col, sz, comm);
+}
+
 /* from kernel:
 	//             pid comm S ppid pgid sid tty_nr tty_pgrp flg
 	sprintf(buffer,"%d (%s) %c %d  %d   %d  %d     %d       %lu %lu \
@@ -33,6 +33,17 @@
 //config:	default 9999999
 //config:	depends on LESS
 //config:
+//config:config FEATURE_LESS_SEEKABLE
+//config:	bool "Page regular files without reading them in"
+//config:	default y
+//config:	depends on LESS
+//config:	help
+//config:	  Regular files are not read into memory as a whole: only the lines
+//config:	  on screen are, by file offset. Line numbers come from a sparse
+//config:	  index which is filled only as far as needed. This makes opening,
+//config:	  jumping to the end of and searching huge files fast, and lifts
+//config:	  the FEATURE_LESS_MAXLINES limit for them.
+//config:
 //config:config FEATURE_LESS_BRACKETS
 //config:	bool "Enable bracket searching"
 //config:	default y
@@ -133,6 +144,12 @@ enum {
 	MAXLINES = CONFIG_FEATURE_LESS_MAXLINES,
 /* This many "after the end" lines we will show (at max) */
 	TILDES = 1,
+/* Regular files are read in blocks of this size (power of 2) */
+	SEEK_BLK = 64 * 1024,
+/* Line number index has an entry per (1 << SEEK_IDX_SHIFT) bytes */
+	SEEK_IDX_SHIFT = 20,
+/* Line count of files up to this size is shown by -M */
+	SEEK_COUNT_MAX = 16 * 1024 * 1024,
 };
 
 /* Command line options */
@@ -187,6 +204,22 @@ struct globals {
 	regex_t pattern;
 	smallint pattern_valid;
 #endif
+#if ENABLE_FEATURE_LESS_SEEKABLE
+	off_t top_off;     /* where the top screen line starts */
+	off_t top_line;    /* where the file line it belongs to starts */
+	off_t bottom_off;  /* where the line below the screen starts */
+	char *blk;         /* SEEK_BLK bytes of the file at blk_off */
+	off_t blk_off;
+	ssize_t blk_len;
+	unsigned *nl_idx;  /* nl_idx[i]: number of '\n' before i << SEEK_IDX_SHIFT */
+	unsigned nl_idx_cnt;
+	char *search_buf;  /* file lines being searched */
+	size_t search_size;
+# if ENABLE_FEATURE_LESS_MARKS
+	off_t mark_offs[15];
+# endif
+	smallint seekable;
+#endif
 #if ENABLE_FEATURE_LESS_ASK_TERMINAL
 	smallint winsize_err;
 #endif
@@ -226,6 +259,9 @@ struct globals {
 #define pattern             (G.pattern           )
 #define pattern_valid       (G.pattern_valid     )
 #endif
+#if ENABLE_FEATURE_LESS_SEEKABLE
+#define seekable            (G.seekable          )
+#endif
 #define terminated          (G.terminated        )
 #define term_orig           (G.term_orig         )
 #define term_less           (G.term_less         )
@@ -289,6 +325,512 @@ static void less_exit(int code)
 	exit(code);
 }
 
+#if ENABLE_FEATURE_LESS_SEEKABLE
+/* Regular files are paged by file offset: flines[] holds only
+ * the lines on screen (cur_fline is always 0), the rest of the file
+ * is read with pread() when needed. Line numbers come from nl_idx[],
+ * which is filled as far as it was ever asked for.
+ */
+static void buffer_fill_and_print(void);
+
+/* Make blk[] hold the byte at "off". Returns the number of bytes
+ * available there, 0 at EOF */
+static ssize_t seek_fetch(off_t off)
+{
+	if (off < G.blk_off || off >= G.blk_off + G.blk_len) {
+		G.blk_off = off & ~(off_t)(SEEK_BLK - 1);
+		G.blk_len = pread(STDIN_FILENO, G.blk, SEEK_BLK, G.blk_off);
+		if (G.blk_len < 0)
+			G.blk_len = 0;
+		if (off >= G.blk_off + G.blk_len)
+			return 0;
+	}
+	return G.blk_off + G.blk_len - off;
+}
+#define SEEK_PTR(off) (G.blk + ((off) - G.blk_off))
+
+static off_t seek_size(void)
+{
+	struct stat st;
+
+	if (fstat(STDIN_FILENO, &st) != 0)
+		return 0;
+	return st.st_size;
+}
+
+/* Where the file line after the one at "off" starts (EOF if none) */
+static off_t seek_next_line(off_t off)
+{
+	ssize_t n;
+
+	while ((n = seek_fetch(off)) != 0) {
+		char *p = memchr(SEEK_PTR(off), '\n', n);
+		if (p)
+			return off + (p - SEEK_PTR(off)) + 1;
+		off += n;
+	}
+	return off;
+}
+
+/* Where the file line holding the byte at "off" starts */
+static off_t seek_line_start(off_t off)
+{
+	while (off > 0) {
+		char *p;
+
+		seek_fetch(off - 1);
+		p = memrchr(G.blk, '\n', off - G.blk_off);
+		if (p)
+			return G.blk_off + (p - G.blk) + 1;
+		off = G.blk_off;
+	}
+	return 0;
+}
+
+/* Count '\n' in [from, to) */
+static unsigned seek_count_nl(off_t from, off_t to)
+{
+	unsigned cnt = 0;
+	ssize_t n;
+
+	while (from < to && (n = seek_fetch(from)) != 0) {
+		const char *p = SEEK_PTR(from);
+		const char *e;
+
+		if (n > to - from)
+			n = to - from;
+		e = p + n;
+		while ((p = memchr(p, '\n', e - p)) != NULL) {
+			cnt++;
+			p++;
+		}
+		from += n;
+	}
+	return cnt;
+}
+
+/* Line number (0-based) of the byte at "off" */
+static unsigned seek_lineno(off_t off)
+{
+	unsigned k = off >> SEEK_IDX_SHIFT;
+	unsigned i;
+
+	if (!G.nl_idx) {
+		G.nl_idx = xrealloc_vector(G.nl_idx, 6, 0);
+		G.nl_idx_cnt = 1;
+	}
+	while ((i = G.nl_idx_cnt) <= k) {
+		off_t end = (off_t)i << SEEK_IDX_SHIFT;
+
+		/* Index only complete chunks: the file may grow */
+		if (!seek_fetch(end - 1))
+			break;
+		G.nl_idx = xrealloc_vector(G.nl_idx, 6, i);
+		G.nl_idx[i] = G.nl_idx[i - 1]
+			+ seek_count_nl(end - (1 << SEEK_IDX_SHIFT), end);
+		G.nl_idx_cnt = i + 1;
+	}
+	if (k >= G.nl_idx_cnt)
+		k = G.nl_idx_cnt - 1;
+	return G.nl_idx[k] + seek_count_nl((off_t)k << SEEK_IDX_SHIFT, off);
+}
+
+/* Where line #n (0-based) starts, EOF if there are not that many */
+static off_t seek_line_off(unsigned n)
+{
+	unsigned i;
+	off_t off;
+
+	if (n == 0)
+		return 0;
+	seek_lineno(0);
+	while (G.nl_idx[G.nl_idx_cnt - 1] < n) {
+		i = G.nl_idx_cnt;
+		seek_lineno((off_t)i << SEEK_IDX_SHIFT);
+		if (G.nl_idx_cnt == i)
+			break;
+	}
+	i = G.nl_idx_cnt - 1;
+	while (G.nl_idx[i] >= n)
+		i--;
+	off = (off_t)i << SEEK_IDX_SHIFT;
+	n -= G.nl_idx[i];
+	do {
+		off_t next = seek_next_line(off);
+		if (next == off)
+			break;
+		off = next;
+	} while (--n);
+	return off;
+}
+
+/* Format the screen line starting at "off" into line[]
+ * the same way read_lines() does it. Returns where the next
+ * screen line starts, sets *term if this one ends a file line.
+ */
+static off_t seek_row(off_t off, char *line, int *term)
+{
+	int w = width;
+	unsigned pos = 0;
+	char *p = line;
+
+	if (option_mask32 & FLAG_N)
+		w -= 8;
+	*term = 0;
+	while (seek_fetch(off)) {
+		char c = *SEEK_PTR(off);
+		unsigned new_pos;
+
+		if (c == '\x8' && pos && p[-1] != '\t') {
+			off++;
+			pos--;
+			p--;
+			continue;
+		}
+		new_pos = pos + 1;
+		if (c == '\t') {
+			new_pos += 7;
+			new_pos &= (~7);
+		}
+		if ((int)new_pos >= w) {
+			/* Linewrap with only "" wrapping to next line:
+			 * read_lines() does not store that empty line */
+			if (c == '\n') {
+				off++;
+				*term = 1;
+			}
+			break;
+		}
+		pos = new_pos;
+		off++;
+		if (c == '\n') {
+			*term = 1;
+			break;
+		}
+		/* NUL is substituted by '\n'! */
+		if (c == '\0')
+			c = '\n';
+		*p++ = c;
+	}
+	*p = '\0';
+	if ((option_mask32 & FLAG_S) && !*term) {
+		off = seek_next_line(off);
+		*term = 1;
+	}
+	return off;
+}
+
+/* Move top of the screen one line down, fail if it is the last one */
+static int seek_step_down(void)
+{
+	char line[width + 1];
+	int term;
+	off_t off = seek_row(G.top_off, line, &term);
+
+	if (!seek_fetch(off))
+		return 0;
+	G.top_off = off;
+	if (term)
+		G.top_line = off;
+	return 1;
+}
+
+static int seek_step_up(void)
+{
+	char line[width + 1];
+	int term;
+	off_t off, next;
+
+	off = G.top_line;
+	if (G.top_off == off) {
+		if (off == 0)
+			return 0;
+		off = seek_line_start(off - 1);
+		G.top_line = off;
+	}
+	/* The last screen line of it above the old top */
+	while ((next = seek_row(off, line, &term)) < G.top_off && next != off)
+		off = next;
+	G.top_off = off;
+	return 1;
+}
+
+/* Put the lines from top_off on into flines[] */
+static void seek_fill(void)
+{
+	char line[width + 1];
+	uint32_t lineno = 0;
+	unsigned i;
+	off_t off;
+	int term;
+
+	/* As in cap_cur_fline(): do not scroll past the end */
+	i = max_displayed_line + 1 - TILDES;
+	off = G.top_off;
+	while (i && seek_fetch(off)) {
+		off = seek_row(off, line, &term);
+		i--;
+	}
+	while (i && seek_step_up())
+		i--;
+
+	if (option_mask32 & FLAG_N)
+		lineno = seek_lineno(G.top_line);
+	if (flines) {
+		for (i = 0; i <= max_fline; i++)
+			free(MEMPTR(flines[i]));
+	}
+	off = G.top_off;
+	i = 0;
+	do {
+		char *p;
+
+		off = seek_row(off, line, &term);
+		p = ((char*)xmalloc(strlen(line) + 1 + 4)) + 4;
+		strcpy(p, line);
+		LINENO(p) = lineno;
+		lineno += term;
+		flines = xrealloc_vector(flines, 8, i);
+		flines[i] = p;
+	} while (++i <= max_displayed_line && seek_fetch(off));
+	G.bottom_off = off;
+	max_fline = i - 1;
+	cur_fline = 0;
+}
+
+/* Called for each new file: page it by offset if it is a regular one */
+static void seek_open(void)
+{
+	struct stat st;
+
+	free(G.nl_idx);
+	G.nl_idx = NULL;
+	G.nl_idx_cnt = 0;
+	G.blk_len = 0;
+	G.top_off = G.top_line = 0;
+	/* "less <file" with part of the file already read by someone else
+	 * is left to read_lines() */
+	seekable = (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode)
+		&& lseek(STDIN_FILENO, 0, SEEK_CUR) == 0);
+	if (seekable) {
+		if (!G.blk)
+			G.blk = xmalloc(SEEK_BLK);
+		seek_fill();
+	}
+}
+
+/* Screen width or -S/-N changed */
+static void seek_rewrap(void)
+{
+	G.top_off = G.top_line;
+	seek_fill();
+}
+
+static void seek_scroll(int nlines)
+{
+	while (nlines > 0 && seek_step_down())
+		nlines--;
+	while (nlines < 0 && seek_step_up())
+		nlines++;
+	seek_fill();
+	buffer_fill_and_print();
+}
+
+/* Show the file line holding the byte at "off" at the top */
+static void seek_goto(off_t off)
+{
+	off_t size = seek_size();
+
+	if (off > size)
+		off = size;
+	G.top_off = G.top_line = seek_line_start(off);
+	seek_fill();
+	buffer_fill_and_print();
+}
+
+#if ENABLE_FEATURE_LESS_FLAGS
+/* Print " lines A-B/C " for m_status_print(),
+ * return percentage or -1 at the end of file */
+static int seek_m_status(void)
+{
+	off_t size = seek_size();
+	unsigned first = seek_lineno(G.top_line) + 1;
+
+	printf(" lines %u-%u/", first,
+		first + LINENO(flines[max_fline]) - LINENO(flines[0]));
+	/* Do not read a huge file just for this */
+	if (size <= SEEK_COUNT_MAX || (size >> SEEK_IDX_SHIFT) < G.nl_idx_cnt) {
+		unsigned n = seek_lineno(size);
+		if (size && seek_fetch(size - 1) && *SEEK_PTR(size - 1) != '\n')
+			n++;
+		printf("%u ", n);
+	} else {
+		printf("? ");
+	}
+	if (!seek_fetch(G.bottom_off))
+		return -1;
+	return size ? (int)(G.bottom_off * 100 / size) : 100;
+}
+#endif
+
+#if ENABLE_FEATURE_LESS_REGEXP
+/* Copy [from, to) to search_buf[], NUL-terminated. The pattern
+ * is compiled with REG_NEWLINE, so it can be run on many lines at once */
+static void seek_copy(off_t from, off_t to)
+{
+	char *p, *q;
+	ssize_t n;
+
+	if (to - from >= G.search_size) {
+		G.search_size = to - from + 1;
+		G.search_buf = xrealloc(G.search_buf, G.search_size);
+	}
+	p = G.search_buf;
+	while (from < to && (n = seek_fetch(from)) != 0) {
+		if (n > to - from)
+			n = to - from;
+		memcpy(p, SEEK_PTR(from), n);
+		p += n;
+		from += n;
+	}
+	*p = '\0';
+	/* NUL is substituted by '\n'! */
+	for (q = G.search_buf; (q = memchr(q, '\0', p - q)) != NULL; q++)
+		*q = '\n';
+}
+
+/* Go to the n-th file line matching the pattern below the top one
+ * (above it if n < 0). The top line itself is tried if "with_top" */
+static void seek_search(int n, int with_top)
+{
+	off_t size = seek_size();
+	off_t line = G.top_line;
+	regmatch_t m;
+
+	if (n > 0) {
+		if (!with_top)
+			line = seek_next_line(line);
+		/* Run the regex on SEEK_BLK worth of whole lines at a time */
+		while (line < size) {
+			off_t end = line + SEEK_BLK;
+
+			if (end < size) {
+				end = seek_line_start(end);
+				if (end == line)
+					end = seek_next_line(line);
+			} else {
+				end = size;
+			}
+			seek_copy(line, end);
+			if (regexec(&pattern, G.search_buf, 1, &m, 0) != 0) {
+				line = end;
+				continue;
+			}
+			line = seek_line_start(line + m.rm_so);
+			if (--n == 0)
+				goto found;
+			line = seek_next_line(line);
+		}
+	} else {
+		/* Matches are looked for in [start, end) */
+		off_t end = with_top ? seek_next_line(line) : line;
+
+		while (end > 0) {
+			off_t start = 0;
+			char *p;
+			int pos, last;
+
+			if (end > SEEK_BLK)
+				start = seek_line_start(end - SEEK_BLK);
+			seek_copy(start, end);
+			/* Want the last match here */
+			last = -1;
+			pos = 0;
+			while (regexec(&pattern, G.search_buf + pos, 1, &m, 0) == 0) {
+				last = pos + m.rm_so;
+				p = strchr(G.search_buf + last, '\n');
+				if (!p)
+					break;
+				pos = p - G.search_buf + 1;
+			}
+			if (last < 0) {
+				end = start;
+				continue;
+			}
+			line = seek_line_start(start + last);
+			if (++n == 0)
+				goto found;
+			end = line;
+		}
+	}
+	print_statusline("No matches found");
+	return;
+ found:
+	seek_goto(line);
+}
+#endif
+
+static void seek_save(FILE *fp)
+{
+	off_t off = 0;
+	ssize_t n;
+
+	while ((n = seek_fetch(off)) != 0) {
+		fwrite(SEEK_PTR(off), 1, n, fp);
+		off += n;
+	}
+}
+
+#if ENABLE_FEATURE_LESS_BRACKETS
+/* Move top of the screen to the closest screen line with "bracket",
+ * looking down from the top line (dir > 0) or up from the bottom one */
+static void seek_match_bracket(char bracket, int dir)
+{
+	char line[width + 1];
+	off_t top_off = G.top_off;
+	off_t top_line = G.top_line;
+	unsigned n;
+	int term;
+
+	if (dir > 0) {
+		while (seek_step_down()) {
+			seek_row(G.top_off, line, &term);
+			if (strchr(line, bracket))
+				goto found;
+		}
+	} else {
+		for (n = max_fline; n; n--)
+			seek_step_down();
+		do {
+			seek_row(G.top_off, line, &term);
+			if (strchr(line, bracket))
+				goto found;
+		} while (seek_step_up());
+	}
+	G.top_off = top_off;
+	G.top_line = top_line;
+	print_statusline("No matching bracket found");
+	return;
+ found:
+	seek_fill();
+	buffer_fill_and_print();
+}
+#endif
+
+#else
+enum { seekable = 0 };
+/* Used only if seekable, never defined otherwise */
+void seek_rewrap(void);
+void seek_scroll(int nlines);
+void seek_goto(off_t off);
+off_t seek_line_off(unsigned n);
+off_t seek_size(void);
+int seek_m_status(void);
+void seek_search(int n, int with_top);
+void seek_save(FILE *fp);
+void seek_match_bracket(char bracket, int dir);
+#endif /* FEATURE_LESS_SEEKABLE */
+
 #if (ENABLE_FEATURE_LESS_DASHCMD && ENABLE_FEATURE_LESS_LINENUMS) \
  || ENABLE_FEATURE_LESS_WINCH
 static void re_wrap(void)
@@ -305,6 +847,10 @@ static void re_wrap(void)
 	char **new_flines = NULL;
 	char *d;
 
+	if (seekable) {
+		seek_rewrap();
+		return;
+	}
 	if (option_mask32 & FLAG_N)
 		w -= 8;
 
@@ -416,6 +962,8 @@ static void read_lines(void)
 	unsigned seconds_p1 = 3; /* seconds_to_loop + 1 */
 #endif
 
+	if (seekable)
+		return;
 	if (option_mask32 & FLAG_N)
 		w -= 8;
 
@@ -579,16 +1127,22 @@ static void m_status_print(void)
 	printf(HIGHLIGHT"%s", filename);
 	if (num_files > 1)
 		printf(" (file %i of %i)", current_file, num_files);
-	printf(" lines %i-%i/%i ",
-			cur_fline + 1, cur_fline + max_displayed_line + 1,
-			max_fline + 1);
-	if (cur_fline >= (int)(max_fline - max_displayed_line)) {
+	if (seekable) {
+		percentage = seek_m_status();
+	} else {
+		printf(" lines %i-%i/%i ",
+				cur_fline + 1, cur_fline + max_displayed_line + 1,
+				max_fline + 1);
+		percentage = -1;
+		if (cur_fline < (int)(max_fline - max_displayed_line))
+			percentage = calc_percent();
+	}
+	if (percentage < 0) {
 		printf("(END)"NORMAL);
 		if (num_files > 1 && current_file != num_files)
 			printf(HIGHLIGHT" - next: %s"NORMAL, files[current_file]);
 		return;
 	}
-	percentage = calc_percent();
 	printf("%i%%"NORMAL, percentage);
 }
 #endif
@@ -597,6 +1151,7 @@ static void m_status_print(void)
 static void status_print(void)
 {
 	const char *p;
+	int at_top, at_end;
 
 	if (less_gets_pos >= 0) /* don't touch statusline while input is done! */
 		return;
@@ -610,13 +1165,21 @@ static void status_print(void)
 	/* No flags set */
 #endif
 
+	at_top = !cur_fline;
+	at_end = cur_fline >= (int)(max_fline - max_displayed_line);
+#if ENABLE_FEATURE_LESS_SEEKABLE
+	if (seekable) {
+		at_top = !G.top_off;
+		at_end = !seek_fetch(G.bottom_off);
+	}
+#endif
 	clear_line();
-	if (cur_fline && cur_fline < (int)(max_fline - max_displayed_line)) {
+	if (!at_top && !at_end) {
 		bb_putchar(':');
 		return;
 	}
 	p = "(END)";
-	if (!cur_fline)
+	if (at_top)
 		p = filename;
 	if (num_files > 1) {
 		printf(HIGHLIGHT"%s (file %i of %i)"NORMAL,
@@ -837,6 +1400,10 @@ static void buffer_fill_and_print(void)
 /* Move the buffer up and down in the file in order to scroll */
 static void buffer_down(int nlines)
 {
+	if (seekable) {
+		seek_scroll(nlines);
+		return;
+	}
 	cur_fline += nlines;
 	read_lines();
 	cap_cur_fline(nlines);
@@ -845,6 +1412,10 @@ static void buffer_down(int nlines)
 
 static void buffer_up(int nlines)
 {
+	if (seekable) {
+		seek_scroll(-nlines);
+		return;
+	}
 	cur_fline -= nlines;
 	if (cur_fline < 0) cur_fline = 0;
 	read_lines();
@@ -855,6 +1426,10 @@ static void buffer_line(int linenum)
 {
 	if (linenum < 0)
 		linenum = 0;
+	if (seekable) {
+		seek_goto(seek_line_off(linenum));
+		return;
+	}
 	cur_fline = linenum;
 	read_lines();
 	if (linenum + max_displayed_line > max_fline)
@@ -878,6 +1453,7 @@ static void open_file_and_read_lines(void)
 	readeof = 0;
 	last_line_pos = 0;
 	terminated = 1;
+	IF_FEATURE_LESS_SEEKABLE(seek_open();)
 	read_lines();
 }
 
@@ -925,10 +1501,12 @@ static int64_t getch_nowait(void)
 	rd = 1;
 	/* Are we interested in stdin? */
 //TODO: reuse code for determining this
-	if (!(option_mask32 & FLAG_S)
-	   ? !(max_fline > cur_fline + max_displayed_line)
-	   : !(max_fline >= cur_fline
-	       && max_lineno > LINENO(flines[cur_fline]) + max_displayed_line)
+	if (!seekable
+	 && (!(option_mask32 & FLAG_S)
+	    ? !(max_fline > cur_fline + max_displayed_line)
+	    : !(max_fline >= cur_fline
+	        && max_lineno > LINENO(flines[cur_fline]) + max_displayed_line)
+	    )
 	) {
 		if (eof_error > 0) /* did NOT reach eof yet */
 			rd = 0; /* yes, we are interested in stdin */
@@ -1138,6 +1716,11 @@ static void goto_match(int match)
 {
 	if (!pattern_valid)
 		return;
+	if (seekable) {
+		/* match_pos stays 0 */
+		seek_search(match - match_pos, 0);
+		return;
+	}
 	if (match < 0)
 		match = 0;
 	/* Try to find next match if eof isn't reached yet */
@@ -1197,7 +1780,9 @@ static void regex_process(void)
 
 	/* Compile the regex and check for errors */
 	err = regcomp_or_errmsg(&pattern, uncomp_regex,
-				(option_mask32 & FLAG_I) ? REG_ICASE : 0);
+				((option_mask32 & FLAG_I) ? REG_ICASE : 0)
+				/* seek_search() matches many lines at once */
+				| (ENABLE_FEATURE_LESS_SEEKABLE ? REG_NEWLINE : 0));
 	free(uncomp_regex);
 	if (err) {
 		print_statusline(err);
@@ -1207,6 +1792,14 @@ static void regex_process(void)
 
 	pattern_valid = 1;
 	match_pos = 0;
+	if (seekable) {
+		/* Like below: '/' looks past the top line, '?' from it */
+		if (option_mask32 & LESS_STATE_MATCH_BACKWARDS)
+			seek_search(-1, 1);
+		else
+			seek_search(1, 0);
+		return;
+	}
 	fill_match_lines(0);
 	while (match_pos < num_matches) {
 		if ((int)match_lines[match_pos] > cur_fline)
@@ -1269,6 +1862,10 @@ static void number_process(int first_digit)
 		buffer_line(num - 1);
 		break;
 	case 'p': case '%':
+		if (seekable) {
+			seek_goto(seek_size() * num / 100);
+			break;
+		}
 		num = num * (max_fline / 100); /* + max_fline / 2; */
 		cur_fline = num + max_displayed_line;
 		read_lines();
@@ -1314,6 +1911,8 @@ static void flag_change(void)
 		break;
 	case 'S':
 		option_mask32 ^= FLAG_S;
+		if (seekable)
+			seek_rewrap();
 		buffer_fill_and_print();
 		break;
 #if ENABLE_FEATURE_LESS_LINENUMS
@@ -1379,7 +1978,9 @@ static void save_input_to_file(void)
 			msg = "Error opening log file";
 			goto ret;
 		}
-		for (i = 0; i <= max_fline; i++)
+		if (seekable)
+			seek_save(fp);
+		else for (i = 0; i <= max_fline; i++)
 			fprintf(fp, "%s\n", flines[i]);
 		fclose(fp);
 		msg = "Done";
@@ -1404,6 +2005,9 @@ static void add_mark(void)
 
 		mark_lines[num_marks][0] = letter;
 		mark_lines[num_marks][1] = cur_fline;
+#if ENABLE_FEATURE_LESS_SEEKABLE
+		G.mark_offs[num_marks] = G.top_line;
+#endif
 		num_marks++;
 	} else {
 		print_statusline("Invalid mark letter");
@@ -1422,6 +2026,11 @@ static void goto_mark(void)
 	if (isalpha(letter)) {
 		for (i = 0; i <= num_marks; i++)
 			if (letter == mark_lines[i][0]) {
+#if ENABLE_FEATURE_LESS_SEEKABLE
+				if (seekable)
+					seek_goto(G.mark_offs[i]);
+				else
+#endif
 				buffer_line(mark_lines[i][1]);
 				break;
 			}
@@ -1459,6 +2068,10 @@ static void match_right_bracket(char bracket)
 		return;
 	}
 	bracket = opp_bracket(bracket);
+	if (seekable) {
+		seek_match_bracket(bracket, 1);
+		return;
+	}
 	for (i = cur_fline + 1; i < max_fline; i++) {
 		if (strchr(flines[i], bracket) != NULL) {
 			buffer_line(i);
@@ -1472,12 +2085,18 @@ static void match_left_bracket(char bracket)
 {
 	int i;
 
-	if (strchr(flines[cur_fline + max_displayed_line], bracket) == NULL) {
+	/* flines[] is only the screen if seekable, maybe not a full one */
+	i = seekable ? max_fline : cur_fline + max_displayed_line;
+	if (strchr(flines[i], bracket) == NULL) {
 		print_statusline("No bracket in bottom line");
 		return;
 	}
 
 	bracket = opp_bracket(bracket);
+	if (seekable) {
+		seek_match_bracket(bracket, -1);
+		return;
+	}
 	for (i = cur_fline + max_displayed_line; i >= 0; i--) {
 		if (strchr(flines[i], bracket) != NULL) {
 			buffer_line(i);
@@ -1513,6 +2132,10 @@ static void keypress_process(int keypress)
 		buffer_line(0);
 		break;
 	case KEYCODE_END: case 'G': case '>':
+		if (seekable) {
+			seek_goto(seek_size());
+			break;
+		}
 		cur_fline = MAXLINES;
 		read_lines();
 		buffer_line(cur_fline);
@@ -71,10 +71,28 @@ struct type_and_class {
 /* element of known name, ip address and reversed ip address */
 struct dns_entry {
 	struct dns_entry *next;
+	struct dns_entry *name_next; /* hash chains */
+	struct dns_entry *rip_next;
+	unsigned idx; /* position in config file, first match wins */
 	uint32_t ip;
 	char rip[IP_STRING_LEN]; /* length decimal reversed IP */
 	char name[1];
 };
+/* all records, hashed by name and by reversed IP */
+struct dns_table {
+	struct dns_entry *list;
+	struct dns_entry *wildcard; /* first "*" record, matches any name */
+	unsigned mask;
+	struct dns_entry **name_hash;
+	struct dns_entry **rip_hash;
+};
+
+/* recvmmsg/sendmmsg */
+#if defined(MSG_WAITFORONE) && defined(IP_PKTINFO)
+# define DNSD_BATCH 1
+#else
+# define DNSD_BATCH 0
+#endif
 
 #define OPT_verbose (option_mask32 & 1)
 #define OPT_silent  (option_mask32 & 2)
@@ -100,20 +118,101 @@ static void undot(char *rip)
 	}
 }
 
+static int is_wildcard(const struct dns_entry *d)
+{
+	return d->name[0] == 1 && d->name[1] == '*';
+}
+
+/* Case-insensitive, as names are compared with strcasecmp */
+static unsigned hash_name(const char *s)
+{
+	unsigned h = 0;
+	while (*s)
+		h = h * 31 + (unsigned char)tolower(*s++);
+	return h;
+}
+
+static unsigned hash_rip(const char *s, unsigned len)
+{
+	unsigned h = 0;
+	while (len--)
+		h = h * 31 + (unsigned char)*s++;
+	return h;
+}
+
+static void free_table(struct dns_table *t)
+{
+	while (t->list) {
+		struct dns_entry *m = t->list;
+		t->list = m->next;
+		free(m);
+	}
+	free(t->name_hash);
+	free(t->rip_hash);
+	free(t);
+}
+
+/*
+ * Hash the records. Duplicates are not hashed:
+ * lookups must find the first record, as the list walk used to
+ */
+static void hash_table(struct dns_table *t, unsigned count)
+{
+	struct dns_entry *m, *d;
+
+	t->mask = 15;
+	while (t->mask < count)
+		t->mask = (t->mask << 1) | 1;
+	t->name_hash = xzalloc((t->mask + 1) * sizeof(t->name_hash[0]));
+	t->rip_hash = xzalloc((t->mask + 1) * sizeof(t->rip_hash[0]));
+
+	for (m = t->list; m; m = m->next) {
+		unsigned h;
+
+		if (is_wildcard(m)) {
+			if (!t->wildcard)
+				t->wildcard = m;
+			continue;
+		}
+		h = hash_name(m->name) & t->mask;
+		for (d = t->name_hash[h]; d; d = d->name_next)
+			if (strcasecmp(d->name, m->name) == 0)
+				break;
+		if (!d) {
+			m->name_next = t->name_hash[h];
+			t->name_hash[h] = m;
+		}
+		h = hash_rip(m->rip, strlen(m->rip)) & t->mask;
+		for (d = t->rip_hash[h]; d; d = d->rip_next)
+			if (strcmp(d->rip, m->rip) == 0)
+				break;
+		if (!d) {
+			m->rip_next = t->rip_hash[h];
+			t->rip_hash[h] = m;
+		}
+	}
+}
+
 /*
- * Read hostname/IP records from file
+ * Read hostname/IP records from file.
+ * Returns NULL if the file can't be opened.
  */
-static struct dns_entry *parse_conf_file(const char *fileconf)
+static struct dns_table *parse_conf_file(const char *fileconf)
 {
 	char *token[2];
 	parser_t *parser;
-	struct dns_entry *m, *conf_data;
+	struct dns_entry *m;
 	struct dns_entry **nextp;
+	struct dns_table *t;
+	unsigned count;
 
-	conf_data = NULL;
-	nextp = &conf_data;
+	parser = config_open2(fileconf, fopen_or_warn_stdin);
+	if (!parser)
+		return NULL;
+	t = xzalloc(sizeof(*t));
+	nextp = &t->list;
+	count = 0;
 
-	parser = config_open(fileconf);
 	while (config_read(parser, token, 2, 2, "# \t", PARSE_NORMAL)) {
 		struct in_addr ip;
 		uint32_t v32;
@@ -131,6 +230,7 @@ static struct dns_entry *parse_conf_file(const char *fileconf)
 		/*m->next = NULL;*/
 		*nextp = m;
 		nextp = &m->next;
+		m->idx = count++;
 
 		m->name[0] = '.';
 		strcpy(m->name + 1, token[0]);
@@ -147,31 +247,23 @@ static struct dns_entry *parse_conf_file(const char *fileconf)
 		undot(m->rip);
 	}
 	config_close(parser);
-	return conf_data;
+	hash_table(t, count);
+	return t;
 }
 
 /*
  * Look query up in dns records and return answer if found.
  */
-static char *table_lookup(struct dns_entry *d,
+static char *table_lookup(struct dns_table *t,
 		uint16_t type,
 		char* query_string)
 {
-	while (d) {
-		unsigned len = d->name[0];
-		/* d->name[len] is the last (non NUL) char */
-#if DEBUG
-		char *p, *q;
-		q = query_string + 1;
-		p = d->name + 1;
-		fprintf(stderr, "%d/%d p:%s q:%s %d\n",
-			(int)strlen(p), len,
-			p, q, (int)strlen(q)
-		);
-#endif
-		if (type == htons(REQ_A)) {
-			/* search by host name */
-			if (len != 1 || d->name[1] != '*') {
+	struct dns_entry *d;
+	unsigned len;
+	int i;
+
+	if (type == htons(REQ_A)) {
+		/* search by host name */
 /* we are lax, hope no name component is ever >64 so that length
  * (which will be represented as 'A','B'...) matches a lowercase letter.
  * Actually, I think false matches are hard to construct.
@@ -181,30 +273,40 @@ static char *table_lookup(struct dns_entry *d,
  * [65+32]<65 same chars>1   <31 same chars>NUL
  * This example seems to be the minimal case when false match occurs.
  */
-				if (strcasecmp(d->name, query_string) != 0)
-					goto next;
-			}
-			return (char *)&d->ip;
+		d = t->name_hash[hash_name(query_string) & t->mask];
+		while (d && strcasecmp(d->name, query_string) != 0)
+			d = d->name_next;
+		/* "*" matches too, if it comes first in config file */
+		if (t->wildcard && (!d || t->wildcard->idx < d->idx))
+			d = t->wildcard;
 #if DEBUG
+		if (d)
 			fprintf(stderr, "Found IP:%x\n", (int)d->ip);
 #endif
-			return 0;
-		}
-		/* search by IP-address */
-		if ((len != 1 || d->name[1] != '*')
-		/* we assume (do not check) that query_string
-		 * ends in ".in-addr.arpa" */
-		 && strncmp(d->rip, query_string, strlen(d->rip)) == 0
-		) {
+		return d ? (char *)&d->ip : NULL;
+	}
+
+	/* search by IP-address.
+	 * d->rip is always 4 labels long, and must be a prefix of
+	 * query_string. We assume (do not check) that query_string
+	 * ends in ".in-addr.arpa" */
+	len = 0;
+	for (i = 0; i < 4; i++) {
+		unsigned char c = query_string[len];
+		if (c == 0 || c > strnlen(query_string + len + 1, c))
+			return NULL; /* fewer than 4 labels */
+		len += 1 + c;
+	}
+	d = t->rip_hash[hash_rip(query_string, len) & t->mask];
+	while (d) {
+		if (strncmp(d->rip, query_string, len) == 0 && d->rip[len] == '\0') {
 #if DEBUG
 			fprintf(stderr, "Found name:%s\n", d->name);
 #endif
 			return d->name;
 		}
- next:
-		d = d->next;
+		d = d->rip_next;
 	}
-
 	return NULL;
 }
 
@@ -368,7 +470,7 @@ Domain name in a message can be represented as either:
    - a pointer
    - a sequence of labels ending with a pointer
  */
-static int process_packet(struct dns_entry *conf_data,
+static int process_packet(struct dns_table *conf_data,
 		uint32_t conf_ttl,
 		uint8_t *buf)
 {
@@ -488,12 +590,139 @@ static int process_packet(struct dns_entry *conf_data,
 	return answb - buf;
 }
 
+#if DNSD_BATCH
+/* Receive and answer up to BATCH queries per system call */
+enum { BATCH = 16 };
+struct dns_batch {
+	struct mmsghdr in[BATCH];
+	struct mmsghdr out[BATCH];
+	struct iovec iov_in[BATCH];
+	struct iovec iov_out[BATCH];
+	union {
+		struct sockaddr sa;
+		struct sockaddr_in sin;
+# if ENABLE_FEATURE_IPV6
+		struct sockaddr_in6 sin6;
+# endif
+	} from[BATCH];
+	union {
+		char cmsg[CMSG_SPACE(sizeof(struct in_pktinfo))];
+# if ENABLE_FEATURE_IPV6 && defined(IPV6_PKTINFO)
+		char cmsg6[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+# endif
+	} ctl[BATCH];
+	/* Ensure buf is 32bit aligned (we need 16bit, but 32bit can't hurt) */
+	uint8_t buf[BATCH][MAX_PACK_LEN + 1] ALIGN4;
+};
+
+/*
+ * Turn IP_PKTINFO of a received query into the one for its reply,
+ * so that we reply from the address the query was sent to
+ * (see send_to_from). Returns NULL if there is none.
+ */
+static struct cmsghdr *reply_pktinfo(struct msghdr *msg)
+{
+	struct cmsghdr *cmsgptr;
+
+	for (cmsgptr = CMSG_FIRSTHDR(msg);
+			cmsgptr != NULL;
+			cmsgptr = CMSG_NXTHDR(msg, cmsgptr)
+	) {
+		if (cmsgptr->cmsg_level == IPPROTO_IP
+		 && cmsgptr->cmsg_type == IP_PKTINFO
+		) {
+			struct in_pktinfo pi;
+			memcpy(&pi, CMSG_DATA(cmsgptr), sizeof(pi));
+			pi.ipi_ifindex = 0;
+			pi.ipi_spec_dst = pi.ipi_addr;
+			memcpy(CMSG_DATA(cmsgptr), &pi, sizeof(pi));
+			return cmsgptr;
+		}
+# if ENABLE_FEATURE_IPV6 && defined(IPV6_PKTINFO)
+		if (cmsgptr->cmsg_level == IPPROTO_IPV6
+		 && cmsgptr->cmsg_type == IPV6_PKTINFO
+		) {
+			struct in6_pktinfo pi6;
+			memcpy(&pi6, CMSG_DATA(cmsgptr), sizeof(pi6));
+			pi6.ipi6_ifindex = 0;
+			memcpy(CMSG_DATA(cmsgptr), &pi6, sizeof(pi6));
+			return cmsgptr;
+		}
+# endif
+	}
+	return NULL;
+}
+
+/* Returns -1 if recvmmsg is not supported */
+static int serve_batch(struct dns_batch *b, int udps,
+		struct dns_table *conf_data, uint32_t conf_ttl)
+{
+	int i, n, cnt;
+
+	for (i = 0; i < BATCH; i++) {
+		struct msghdr *msg = &b->in[i].msg_hdr;
+		b->iov_in[i].iov_base = b->buf[i];
+		b->iov_in[i].iov_len = MAX_PACK_LEN + 1;
+		msg->msg_name = &b->from[i];
+		msg->msg_namelen = sizeof(b->from[i]);
+		msg->msg_iov = &b->iov_in[i];
+		msg->msg_iovlen = 1;
+		msg->msg_control = &b->ctl[i];
+		msg->msg_controllen = sizeof(b->ctl[i]);
+		msg->msg_flags = 0;
+	}
+	n = recvmmsg(udps, b->in, BATCH, MSG_WAITFORONE, NULL);
+	if (n < 0)
+		return (errno == ENOSYS) ? -1 : 0;
+
+	cnt = 0;
+	for (i = 0; i < n; i++) {
+		struct msghdr *msg = &b->in[i].msg_hdr;
+		struct msghdr *reply = &b->out[cnt].msg_hdr;
+		struct cmsghdr *cmsgptr;
+		int r = b->in[i].msg_len;
+
+		if (r < 12 || r > MAX_PACK_LEN) {
+			bb_error_msg("packet size %d, ignored", r);
+			continue;
+		}
+		if (OPT_verbose)
+			bb_error_msg("got UDP packet");
+		b->buf[i][r] = '\0'; /* paranoia */
+		r = process_packet(conf_data, conf_ttl, b->buf[i]);
+		if (r <= 0)
+			continue;
+		memset(reply, 0, sizeof(*reply));
+		b->iov_out[cnt].iov_base = b->buf[i];
+		b->iov_out[cnt].iov_len = r;
+		reply->msg_name = msg->msg_name;
+		reply->msg_namelen = msg->msg_namelen;
+		reply->msg_iov = &b->iov_out[cnt];
+		reply->msg_iovlen = 1;
+		cmsgptr = reply_pktinfo(msg);
+		if (cmsgptr) {
+			reply->msg_control = cmsgptr;
+			reply->msg_controllen = cmsgptr->cmsg_len;
+		}
+		cnt++;
+	}
+
+	/* sendmmsg stops at the first failing message: skip it and go on */
+	i = 0;
+	while (i < cnt) {
+		n = sendmmsg(udps, b->out + i, cnt - i, 0);
+		i += (n > 0) ? n : 1;
+	}
+	return 0;
+}
+#endif
+
 int dnsd_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int dnsd_main(int argc UNUSED_PARAM, char **argv)
 {
 	const char *listen_interface = "0.0.0.0";
 	const char *fileconf = "/etc/dnsd.conf";
-	struct dns_entry *conf_data;
+	struct dns_table *conf_data;
 	uint32_t conf_ttl = DEFAULT_TTL;
 	char *sttl, *sport;
 	len_and_sockaddr *lsa, *from, *to;
@@ -502,6 +731,9 @@ int dnsd_main(int argc UNUSED_PARAM, char **argv)
 	uint16_t port = 53;
 	/* Ensure buf is 32bit aligned (we need 16bit, but 32bit can't hurt) */
 	uint8_t buf[MAX_PACK_LEN + 1] ALIGN4;
+#if DNSD_BATCH
+	struct dns_batch *batch;
+#endif
 
 	opts = getopt32(argv, "vsi:c:t:p:d", &listen_interface, &fileconf, &sttl, &sport);
 	//if (opts & (1 << 0)) // -v
@@ -519,6 +751,10 @@ int dnsd_main(int argc UNUSED_PARAM, char **argv)
 	}
 
 	conf_data = parse_conf_file(fileconf);
+	if (!conf_data)
+		xfunc_die();
+	/* SIGHUP rereads config file */
+	signal_no_SA_RESTART_empty_mask(SIGHUP, record_signo);
 
 	lsa = xdotted2sockaddr(listen_interface, port);
 	udps = xsocket(lsa->u.sa.sa_family, SOCK_DGRAM, 0);
@@ -534,8 +770,32 @@ int dnsd_main(int argc UNUSED_PARAM, char **argv)
 		free(p);
 	}
 
+#if DNSD_BATCH
+	batch = xmalloc(sizeof(*batch));
+#endif
 	while (1) {
 		int r;
+
+		if (bb_got_signal) {
+			struct dns_table *t;
+
+			bb_got_signal = 0;
+			t = parse_conf_file(fileconf);
+			if (t) {
+				free_table(conf_data);
+				conf_data = t;
+				bb_error_msg("reread %s", fileconf);
+			}
+		}
+#if DNSD_BATCH
+		if (batch) {
+			if (serve_batch(batch, udps, conf_data, conf_ttl) == 0)
+				continue;
+			/* kernel has no recvmmsg */
+			free(batch);
+			batch = NULL;
+		}
+#endif
 		/* Try to get *DEST* address (to which of our addresses
 		 * this query was directed), and reply from the same address.
 		 * Or else we can exhibit usual UDP ugliness:
@@ -543,6 +803,8 @@ int dnsd_main(int argc UNUSED_PARAM, char **argv)
 		 * [ip1.multihomed.ip2] => reply from ip2 => peer (confused) */
 		memcpy(to, lsa, lsa_size);
 		r = recv_from_to(udps, buf, MAX_PACK_LEN + 1, 0, &from->u.sa, &to->u.sa, lsa->len);
+		if (r < 0 && errno == EINTR)
+			continue;
 		if (r < 12 || r > MAX_PACK_LEN) {
 			bb_error_msg("packet size %d, ignored", r);
 			continue;
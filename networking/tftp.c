@@ -4,6 +4,7 @@
  * Tries to follow RFC1350.
  * Only "octet" mode supported.
  * Optional blocksize negotiation (RFC2347 + RFC2348)
+ * Optional windowsize negotiation (RFC7440)
  *
  * Copyright (C) 2001 Magnus Damm <damm@opensource.se>
  *
@@ -34,6 +35,9 @@
 //usage:	IF_FEATURE_TFTP_BLOCKSIZE(
 //usage:     "\n	-b SIZE	Transfer blocks of SIZE octets"
 //usage:	)
+//usage:	IF_FEATURE_TFTP_WINDOWSIZE(
+//usage:     "\n	-w N	Send N blocks per ACK"
+//usage:	)
 //usage:
 //usage:#define tftpd_trivial_usage
 //usage:       "[-cr] [-u USER] [DIR]"
@@ -61,6 +65,9 @@
 #define TFTP_TIMEOUT_MS            100
 #define TFTP_MAXTIMEOUT_MS        2000
 #define TFTP_NUM_RETRIES            12  /* number of backed-off retries */
+/* Sender keeps a window of blocks in memory for resending,
+ * limit it to 64 * 64k. RFC7440 allows up to 65535 */
+#define TFTP_WINDOWSIZE_MAX         64
 
 /* opcodes we support */
 #define TFTP_RRQ   1
@@ -182,6 +189,20 @@ static int tftp_blksize_check(const char *blksize_str, int maxsize)
 	return blksize;
 }
 
+# if ENABLE_FEATURE_TFTP_WINDOWSIZE
+static int tftp_windowsize_check(const char *windowsize_str)
+{
+	unsigned windowsize = bb_strtou(windowsize_str, NULL, 10);
+	if (errno
+	 || (windowsize < 1) || (windowsize > 65535)
+	) {
+		bb_error_msg("bad windowsize '%s'", windowsize_str);
+		return -1;
+	}
+	return windowsize;
+}
+# endif
+
 static char *tftp_get_option(const char *option, char *buf, int len)
 {
 	int opt_val = 0;
@@ -230,16 +251,24 @@ static int tftp_protocol(
 #endif
 		/* 1 for tftp; 1/0 for tftpd depending whether client asked about it: */
 		IF_FEATURE_TFTP_BLOCKSIZE(, int want_transfer_size)
-		IF_FEATURE_TFTP_BLOCKSIZE(, int blksize))
+		IF_FEATURE_TFTP_BLOCKSIZE(, int blksize)
+		IF_FEATURE_TFTP_WINDOWSIZE(, int windowsize))
 {
 #if !ENABLE_FEATURE_TFTP_BLOCKSIZE
 	enum { blksize = TFTP_BLKSIZE_DEFAULT };
 #endif
+#if !ENABLE_FEATURE_TFTP_WINDOWSIZE
+	enum { windowsize = 1 };
+#else
+	/* Receiving: number of blocks got since we sent last ACK */
+	unsigned window_cnt = 0;
+	smallint gap_acked = 0;
+#endif
 
 	struct pollfd pfd[1];
 #define socket_fd (pfd[0].fd)
 	int len;
-	int send_len;
+	int send_len = send_len; /* for compiler */
 	IF_FEATURE_TFTP_BLOCKSIZE(smallint expect_OACK = 0;)
 	smallint finished = 0;
 	uint16_t opcode;
@@ -257,9 +286,28 @@ static int tftp_protocol(
 	 */
 	char *xbuf = xmalloc(io_bufsize);
 	char *rbuf = xmalloc(io_bufsize);
+	/* Sending: window of DATA pkts not ACKed yet. It's a ring
+	 * of windowsize pkts, wcnt of them starting at wfirst.
+	 * All but the very last one are io_bufsize long */
+	char *wbuf = NULL;
+	unsigned wfirst = 0, wcnt = 0;
+	int last_len = 0;
 
 	socket_fd = xsocket(peer_lsa->u.sa.sa_family, SOCK_DGRAM, 0);
 	setsockopt_reuseaddr(socket_fd);
+#if ENABLE_FEATURE_TFTP_WINDOWSIZE
+	if (windowsize > 1) {
+		/* Whole window may arrive before we read any of it.
+		 * Kernel accounts up to ~2x of data size per pkt.
+		 * Never shrink the buffer, small default may already be enough */
+		int rcvbuf = 0;
+		socklen_t optlen = sizeof(rcvbuf);
+		int want = 2 * windowsize * io_bufsize;
+		getsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &optlen);
+		if (rcvbuf < want)
+			setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &want, sizeof(want));
+	}
+#endif
 
 	if (!ENABLE_TFTP || our_lsa) { /* tftpd */
 		/* Create a socket which is:
@@ -335,7 +383,9 @@ static int tftp_protocol(
 		}
 /* gcc 4.3.1 would NOT optimize it out as it should! */
 #if ENABLE_FEATURE_TFTP_BLOCKSIZE
-		if (blksize != TFTP_BLKSIZE_DEFAULT || want_transfer_size) {
+		if (blksize != TFTP_BLKSIZE_DEFAULT || want_transfer_size
+		 IF_FEATURE_TFTP_WINDOWSIZE(|| windowsize != 1)
+		) {
 			/* Create and send OACK packet. */
 			/* For the download case, block_nr is still 1 -
 			 * we expect 1st ACK from peer to be for (block_nr-1),
@@ -391,11 +441,14 @@ static int tftp_protocol(
 		cp += sizeof("octet");
 
 # if ENABLE_FEATURE_TFTP_BLOCKSIZE
-		if (blksize == TFTP_BLKSIZE_DEFAULT && !want_transfer_size)
+		if (blksize == TFTP_BLKSIZE_DEFAULT && !want_transfer_size
+		 IF_FEATURE_TFTP_WINDOWSIZE(&& windowsize == 1)
+		) {
 			goto send_pkt;
+		}
 
 		/* Need to add option to pkt */
-		if ((&xbuf[io_bufsize - 1] - cp) < sizeof("blksize NNNNN tsize ") + sizeof(off_t)*3) {
+		if ((&xbuf[io_bufsize - 1] - cp) < sizeof("blksize NNNNN windowsize NNNNN tsize ") + sizeof(off_t)*3) {
 			bb_error_msg("remote filename is too long");
 			goto ret;
 		}
@@ -411,6 +464,14 @@ static int tftp_protocol(
 			cp += sizeof("blksize");
 			cp += snprintf(cp, 6, "%d", blksize) + 1;
 		}
+# if ENABLE_FEATURE_TFTP_WINDOWSIZE
+		if (windowsize != 1) {
+			/* add "windowsize", <nul>, windowsize, <nul> */
+			strcpy(cp, "windowsize");
+			cp += sizeof("windowsize");
+			cp += snprintf(cp, 6, "%d", windowsize) + 1;
+		}
+# endif
 		if (want_transfer_size) {
 			/* add "tsize", <nul>, size, <nul> (see RFC2349) */
 			/* if tftp and downloading, we send "0" (since we opened local_fd with O_TRUNC)
@@ -440,42 +501,64 @@ static int tftp_protocol(
 	/* Using mostly goto's - continue/break will be less clear
 	 * in where we actually jump to */
 	while (1) {
-		/* Build ACK or DATA */
+		if (CMD_PUT(option_mask32)) {
+			/* Build DATA pkts to fill up the window.
+			 * Not ACKed ones, if any, are resent too */
+			opcode = TFTP_DATA;
+			if (!wbuf)
+				wbuf = xmalloc(windowsize * io_bufsize);
+			while (wcnt < windowsize && !finished) {
+				cp = wbuf + ((wfirst + wcnt) % windowsize) * io_bufsize;
+				((uint16_t*)cp)[0] = htons(TFTP_DATA);
+				((uint16_t*)cp)[1] = htons(block_nr);
+				block_nr++;
+				len = full_read(local_fd, cp + 4, blksize);
+				if (len < 0) {
+					goto send_read_err_pkt;
+				}
+				if (len != blksize) {
+					finished = 1;
+					last_len = len + 4;
+				}
+				wcnt++;
+				IF_FEATURE_TFTP_PROGRESS_BAR(G.pos += len;)
+			}
+			goto send_window;
+		}
+		/* Build ACK */
 		cp = xbuf + 2;
 		*((uint16_t*)cp) = htons(block_nr);
 		cp += 2;
 		block_nr++;
 		opcode = TFTP_ACK;
-		if (CMD_PUT(option_mask32)) {
-			opcode = TFTP_DATA;
-			len = full_read(local_fd, cp, blksize);
-			if (len < 0) {
-				goto send_read_err_pkt;
-			}
-			if (len != blksize) {
-				finished = 1;
-			}
-			cp += len;
-			IF_FEATURE_TFTP_PROGRESS_BAR(G.pos += len;)
-		}
  send_pkt:
 		/* Send packet */
 		*((uint16_t*)xbuf) = htons(opcode); /* fill in opcode part */
 		send_len = cp - xbuf;
 		/* NB: send_len value is preserved in code below
 		 * for potential resend */
-
+ send_window:
 		retries = TFTP_NUM_RETRIES;  /* re-initialize */
 		waittime_ms = TFTP_TIMEOUT_MS;
 
  send_again:
+		if (wcnt) {
+			/* (Re)send DATA pkts, starting from 1st not ACKed one */
+			unsigned i;
+			for (i = 0; i < wcnt; i++) {
+				cp = wbuf + ((wfirst + i) % windowsize) * io_bufsize;
+				send_len = (finished && i == wcnt - 1) ? last_len : io_bufsize;
+				xsendto(socket_fd, cp, send_len, &peer_lsa->u.sa, peer_lsa->len);
+			}
+		} else {
 #if ENABLE_TFTP_DEBUG
-		fprintf(stderr, "sending %u bytes\n", send_len);
-		for (cp = xbuf; cp < &xbuf[send_len]; cp++)
-			fprintf(stderr, "%02x ", (unsigned char) *cp);
-		fprintf(stderr, "\n");
+			fprintf(stderr, "sending %u bytes\n", send_len);
+			for (cp = xbuf; cp < &xbuf[send_len]; cp++)
+				fprintf(stderr, "%02x ", (unsigned char) *cp);
+			fprintf(stderr, "\n");
 #endif
-		xsendto(socket_fd, xbuf, send_len, &peer_lsa->u.sa, peer_lsa->len);
+			xsendto(socket_fd, xbuf, send_len, &peer_lsa->u.sa, peer_lsa->len);
+		}
 
 #if ENABLE_FEATURE_TFTP_PROGRESS_BAR
 		if (is_bb_progress_inited(&G.pmt))
@@ -506,8 +589,8 @@ static int tftp_protocol(
 			if (waittime_ms > TFTP_MAXTIMEOUT_MS) {
 				waittime_ms = TFTP_MAXTIMEOUT_MS;
 			}
-
-			goto send_again; /* resend last sent pkt */
+			IF_FEATURE_TFTP_WINDOWSIZE(window_cnt = 0;)
+			goto send_again; /* resend last sent pkt(s) */
 		case 1:
 			if (!our_lsa) {
 				/* tftp (not tftpd!) receiving 1st packet */
@@ -580,6 +663,20 @@ static int tftp_protocol(
 					}
 					io_bufsize = blksize + 4;
 				}
+# if ENABLE_FEATURE_TFTP_WINDOWSIZE
+				{
+					int w = 1;
+					res = tftp_get_option("windowsize", &rbuf[2], len - 2);
+					if (res)
+						w = tftp_windowsize_check(res);
+					/* Peer may only lower it */
+					if (w < 0 || w > windowsize) {
+						error_pkt_reason = ERR_BAD_OPT;
+						goto send_err_pkt;
+					}
+					windowsize = w;
+				}
+# endif
 # if ENABLE_FEATURE_TFTP_PROGRESS_BAR
 				if (remote_file && G.size == 0) { /* if we don't know it yet */
 					res = tftp_get_option("tsize", &rbuf[2], len - 2);
@@ -605,6 +702,7 @@ static int tftp_protocol(
 				bb_error_msg("falling back to blocksize "TFTP_BLKSIZE_DEFAULT_STR);
 			blksize = TFTP_BLKSIZE_DEFAULT;
 			io_bufsize = TFTP_BLKSIZE_DEFAULT + 4;
+			IF_FEATURE_TFTP_WINDOWSIZE(windowsize = 1;)
 		}
 #endif
 		/* block_nr is already advanced to next block# we expect
@@ -622,8 +720,34 @@ static int tftp_protocol(
 					finished = 1;
 				}
 				IF_FEATURE_TFTP_PROGRESS_BAR(G.pos += sz;)
+#if ENABLE_FEATURE_TFTP_WINDOWSIZE
+				gap_acked = 0;
+				if (!finished && ++window_cnt < windowsize) {
+					/* Only the last block of a window is ACKed.
+					 * Have the ACK ready: we resend it on timeout */
+					((uint16_t*)xbuf)[0] = htons(TFTP_ACK);
+					((uint16_t*)xbuf)[1] = htons(block_nr);
+					send_len = 4;
+					block_nr++;
+					retries = TFTP_NUM_RETRIES;
+					waittime_ms = TFTP_TIMEOUT_MS;
+					goto recv_again;
+				}
+				window_cnt = 0;
+#endif
 				continue; /* send ACK */
 			}
+#if ENABLE_FEATURE_TFTP_WINDOWSIZE
+			/* A block is missing: ACK the last one we got (once),
+			 * peer resends the window starting after it */
+			if (windowsize > 1 && !gap_acked
+			 && (uint16_t)(recv_blk - block_nr) < 0x8000
+			) {
+				gap_acked = 1;
+				window_cnt = 0;
+				goto send_again;
+			}
+#endif
 /* Disabled to cope with servers with Sorcerer's Apprentice Syndrome */
 #if 0
 			if (recv_blk == (block_nr - 1)) {
@@ -635,11 +759,15 @@ static int tftp_protocol(
 		}
 
 		if (CMD_PUT(option_mask32) && (opcode == TFTP_ACK)) {
-			/* did peer ACK our last DATA pkt? */
-			if (recv_blk == (uint16_t) (block_nr - 1)) {
-				if (finished)
+			/* did peer ACK some of our DATA pkts?
+			 * (or our request/OACK, as "block 0") */
+			unsigned left = (uint16_t) (block_nr - 1 - recv_blk);
+			if (left < wcnt || (left == 0 && wcnt == 0)) {
+				wfirst = (wfirst + wcnt - left) % windowsize;
+				wcnt = left;
+				if (finished && wcnt == 0)
 					goto ret;
-				continue; /* send next block */
+				continue; /* send next block(s) */
 			}
 		}
 		/* Awww... recv'd packet is not recognized! */
@@ -660,6 +788,7 @@ static int tftp_protocol(
 		close(socket_fd);
 		free(xbuf);
 		free(rbuf);
+		free(wbuf);
 	}
 	return finished == 0; /* returns 1 on failure */
 
@@ -686,6 +815,10 @@ int tftp_main(int argc UNUSED_PARAM, char **argv)
 # if ENABLE_FEATURE_TFTP_BLOCKSIZE
 	const char *blksize_str = TFTP_BLKSIZE_DEFAULT_STR;
 	int blksize;
+# endif
+# if ENABLE_FEATURE_TFTP_WINDOWSIZE
+	const char *windowsize_str = "1";
+	int windowsize;
 # endif
 	int result;
 	int port;
@@ -699,9 +832,11 @@ int tftp_main(int argc UNUSED_PARAM, char **argv)
 
 	IF_GETPUT(opt =) getopt32(argv,
 			IF_FEATURE_TFTP_GET("g") IF_FEATURE_TFTP_PUT("p")
-				"l:r:" IF_FEATURE_TFTP_BLOCKSIZE("b:"),
+				"l:r:" IF_FEATURE_TFTP_BLOCKSIZE("b:")
+				IF_FEATURE_TFTP_WINDOWSIZE("w:"),
 			&local_file, &remote_file
-			IF_FEATURE_TFTP_BLOCKSIZE(, &blksize_str));
+			IF_FEATURE_TFTP_BLOCKSIZE(, &blksize_str)
+			IF_FEATURE_TFTP_WINDOWSIZE(, &windowsize_str));
 	argv += optind;
 
 # if ENABLE_FEATURE_TFTP_BLOCKSIZE
@@ -713,6 +848,9 @@ int tftp_main(int argc UNUSED_PARAM, char **argv)
 		return EXIT_FAILURE;
 	}
 # endif
+# if ENABLE_FEATURE_TFTP_WINDOWSIZE
+	windowsize = xatou_range(windowsize_str, 1, TFTP_WINDOWSIZE_MAX);
+# endif
 
 	if (remote_file) {
 		if (!local_file) {
@@ -744,6 +882,7 @@ int tftp_main(int argc UNUSED_PARAM, char **argv)
 		local_file, remote_file
 		IF_FEATURE_TFTP_BLOCKSIZE(, 1 /* want_transfer_size */)
 		IF_FEATURE_TFTP_BLOCKSIZE(, blksize)
+		IF_FEATURE_TFTP_WINDOWSIZE(, windowsize)
 	);
 	tftp_progress_done();
 
@@ -766,6 +905,7 @@ int tftpd_main(int argc UNUSED_PARAM, char **argv)
 	int opt, result, opcode;
 	IF_FEATURE_TFTP_BLOCKSIZE(int blksize = TFTP_BLKSIZE_DEFAULT;)
 	IF_FEATURE_TFTP_BLOCKSIZE(int want_transfer_size = 0;)
+	IF_FEATURE_TFTP_WINDOWSIZE(int windowsize = 1;)
 
 	INIT_G();
 
@@ -832,6 +972,19 @@ int tftpd_main(int argc UNUSED_PARAM, char **argv)
 					goto do_proto;
 				}
 			}
+# if ENABLE_FEATURE_TFTP_WINDOWSIZE
+			res = tftp_get_option("windowsize", opt_str, opt_len);
+			if (res) {
+				windowsize = tftp_windowsize_check(res);
+				if (windowsize < 0) {
+					error_pkt_reason = ERR_BAD_OPT;
+					goto do_proto;
+				}
+				/* we may agree to a smaller window */
+				if (windowsize > TFTP_WINDOWSIZE_MAX)
+					windowsize = TFTP_WINDOWSIZE_MAX;
+			}
+# endif
 			if (opcode != TFTP_WRQ /* download? */
 			/* did client ask us about file size? */
 			 && tftp_get_option("tsize", opt_str, opt_len)
@@ -865,6 +1018,7 @@ int tftpd_main(int argc UNUSED_PARAM, char **argv)
 		local_file IF_TFTP(, NULL /*remote_file*/)
 		IF_FEATURE_TFTP_BLOCKSIZE(, want_transfer_size)
 		IF_FEATURE_TFTP_BLOCKSIZE(, blksize)
+		IF_FEATURE_TFTP_WINDOWSIZE(, windowsize)
 	);
 
 	return result;
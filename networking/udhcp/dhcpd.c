@@ -364,7 +364,7 @@ int udhcpd_main(int argc UNUSED_PARAM, char **argv)
 		server_config.max_leases = num_ips;
 	}
 
-	g_leases = xzalloc(server_config.max_leases * sizeof(g_leases[0]));
+	init_leases();
 	read_leases(server_config.lease_file);
 
 	if (udhcp_read_interface(server_config.interface,
@@ -626,8 +626,8 @@ o DHCPREQUEST generated during REBINDING state:
 			 && lease  /* chaddr matches this lease */
 			 && requested_nip == lease->lease_nip
 			) {
-				memset(lease->lease_mac, 0, sizeof(lease->lease_mac));
-				lease->expires = time(NULL) + server_config.decline_time;
+				set_lease_expiry(lease, server_config.decline_time,
+						/*clear_mac:*/ 1, /*is_static:*/ static_lease_nip != 0);
 			}
 			break;
 
@@ -645,7 +645,8 @@ o DHCPREQUEST generated during REBINDING state:
 			 && lease  /* chaddr matches this lease */
 			 && packet.ciaddr == lease->lease_nip
 			) {
-				lease->expires = time(NULL);
+				set_lease_expiry(lease, 0,
+						/*clear_mac:*/ 0, /*is_static:*/ static_lease_nip != 0);
 			}
 			break;
 
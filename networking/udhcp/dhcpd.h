@@ -90,11 +90,13 @@ struct dyn_lease {
 
 extern struct dyn_lease *g_leases;
 
+void init_leases(void) FAST_FUNC;
 struct dyn_lease *add_lease(
 		const uint8_t *chaddr, uint32_t yiaddr,
 		leasetime_t leasetime,
 		const char *hostname, int hostname_len
 		) FAST_FUNC;
+void set_lease_expiry(struct dyn_lease *lease, leasetime_t leasetime, int clear_mac, int is_static) FAST_FUNC;
 int is_expired_lease(struct dyn_lease *lease) FAST_FUNC;
 struct dyn_lease *find_lease_by_mac(const uint8_t *mac) FAST_FUNC;
 struct dyn_lease *find_lease_by_nip(uint32_t nip) FAST_FUNC;
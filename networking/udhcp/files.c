@@ -120,9 +120,11 @@ void FAST_FUNC read_config(const char *file)
 void FAST_FUNC write_leases(void)
 {
 	int fd;
-	unsigned i;
+	unsigned i, n;
 	leasetime_t curr;
 	int64_t written_at;
+	/* Write in batches: a big pool means lots of leases */
+	struct dyn_lease buf[64];
 
 	fd = open_or_warn(server_config.lease_file, O_WRONLY|O_CREAT|O_TRUNC);
 	if (fd < 0)
@@ -133,27 +135,26 @@ void FAST_FUNC write_leases(void)
 	written_at = SWAP_BE64(written_at);
 	full_write(fd, &written_at, sizeof(written_at));
 
+	n = 0;
 	for (i = 0; i < server_config.max_leases; i++) {
-		leasetime_t tmp_time;
-
 		if (g_leases[i].lease_nip == 0)
 			continue;
 
-		/* Screw with the time in the struct, for easier writing */
-		tmp_time = g_leases[i].expires;
-
-		g_leases[i].expires -= curr;
-		if ((signed_leasetime_t) g_leases[i].expires < 0)
-			g_leases[i].expires = 0;
-		g_leases[i].expires = htonl(g_leases[i].expires);
-
-		/* No error check. If the file gets truncated,
-		 * we lose some leases on restart. Oh well. */
-		full_write(fd, &g_leases[i], sizeof(g_leases[i]));
-
-		/* Then restore it when done */
-		g_leases[i].expires = tmp_time;
+		/* Convert the copy, g_leases[] stays in host order */
+		buf[n] = g_leases[i];
+		buf[n].expires -= curr;
+		if ((signed_leasetime_t) buf[n].expires < 0)
+			buf[n].expires = 0;
+		buf[n].expires = htonl(buf[n].expires);
+
+		if (++n == ARRAY_SIZE(buf)) {
+			/* No error check. If the file gets truncated,
+			 * we lose some leases on restart. Oh well. */
+			full_write(fd, buf, sizeof(buf));
+			n = 0;
+		}
 	}
+	full_write(fd, buf, n * sizeof(buf[0]));
 	close(fd);
 
 	if (server_config.notify_file) {
@@ -7,22 +7,175 @@
 #include "common.h"
 #include "dhcpd.h"
 
+/* g_leases[] is indexed three ways, so that packet processing
+ * does not have to scan the whole table:
+ * - in-use leases are chained into hash buckets by MAC and by IP
+ *   (entries are lease index + 1, 0 terminates a chain);
+ * - all leases, including unused ones (which have expires == 0),
+ *   are kept in a binary min-heap ordered by expiration time.
+ * Every change to lease_mac, lease_nip or expires must go through
+ * unindex_lease() / index_lease().
+ */
+static struct lease_index {
+	unsigned hash_mask;
+	uint32_t *mac_head;
+	uint32_t *nip_head;
+	uint32_t *mac_next;
+	uint32_t *nip_next;
+	uint32_t *heap;     /* lease indexes */
+	uint32_t *heap_pos; /* lease index -> position in heap */
+} *L;
+
+static const uint8_t zero_mac[6];
+
+static unsigned hash_mac(const uint8_t *mac)
+{
+	unsigned i, hash = 0;
+
+	/* SDBM, as in find_free_or_expired_nip() */
+	for (i = 0; i < 6; i++)
+		hash = mac[i] + (hash << 6) + (hash << 16) - hash;
+	return hash & L->hash_mask;
+}
+
+static unsigned hash_nip(uint32_t nip)
+{
+	/* consecutive addresses land in consecutive buckets */
+	return ntohl(nip) & L->hash_mask;
+}
+
+static int lease_is_older(unsigned a, unsigned b)
+{
+	if (g_leases[a].expires != g_leases[b].expires)
+		return g_leases[a].expires < g_leases[b].expires;
+	return a < b;
+}
+
+static void heap_set(unsigned pos, unsigned idx)
+{
+	L->heap[pos] = idx;
+	L->heap_pos[idx] = pos;
+}
+
+/* Restore heap order after g_leases[idx].expires has changed */
+static void heap_fix(unsigned idx)
+{
+	unsigned pos = L->heap_pos[idx];
+
+	while (pos > 0) {
+		unsigned parent = (pos - 1) / 2;
+		if (!lease_is_older(idx, L->heap[parent]))
+			break;
+		heap_set(pos, L->heap[parent]);
+		pos = parent;
+	}
+	while (1) {
+		unsigned child = pos * 2 + 1;
+		if (child >= server_config.max_leases)
+			break;
+		if (child + 1 < server_config.max_leases
+		 && lease_is_older(L->heap[child + 1], L->heap[child])
+		) {
+			child++;
+		}
+		if (!lease_is_older(L->heap[child], idx))
+			break;
+		heap_set(pos, L->heap[child]);
+		pos = child;
+	}
+	heap_set(pos, idx);
+}
+
+static void chain_remove(uint32_t *head, uint32_t *next, unsigned idx)
+{
+	uint32_t *pp = head;
+
+	while (*pp) {
+		if (*pp == idx + 1) {
+			*pp = next[idx];
+			next[idx] = 0;
+			return;
+		}
+		pp = &next[*pp - 1];
+	}
+}
+
+static void unindex_lease(unsigned idx)
+{
+	struct dyn_lease *lease = &g_leases[idx];
+
+	if (memcmp(lease->lease_mac, zero_mac, 6) != 0)
+		chain_remove(&L->mac_head[hash_mac(lease->lease_mac)], L->mac_next, idx);
+	if (lease->lease_nip)
+		chain_remove(&L->nip_head[hash_nip(lease->lease_nip)], L->nip_next, idx);
+}
+
+static void index_lease(unsigned idx)
+{
+	struct dyn_lease *lease = &g_leases[idx];
+	unsigned h;
+
+	if (memcmp(lease->lease_mac, zero_mac, 6) != 0) {
+		h = hash_mac(lease->lease_mac);
+		L->mac_next[idx] = L->mac_head[h];
+		L->mac_head[h] = idx + 1;
+	}
+	if (lease->lease_nip) {
+		h = hash_nip(lease->lease_nip);
+		L->nip_next[idx] = L->nip_head[h];
+		L->nip_head[h] = idx + 1;
+	}
+	heap_fix(idx);
+}
+
+void FAST_FUNC init_leases(void)
+{
+	unsigned n = server_config.max_leases;
+	unsigned buckets = 16;
+	unsigned i;
+	uint32_t *p;
+
+	/* buckets >= max_leases, power of 2 */
+	while (buckets < n)
+		buckets <<= 1;
+
+	g_leases = xzalloc(n * sizeof(g_leases[0]));
+	L = xzalloc(sizeof(*L) + (buckets * 2 + n * 4) * sizeof(uint32_t));
+	L->hash_mask = buckets - 1;
+	p = (uint32_t*)(L + 1);
+	L->mac_head = p; p += buckets;
+	L->nip_head = p; p += buckets;
+	L->mac_next = p; p += n;
+	L->nip_next = p; p += n;
+	L->heap = p; p += n;
+	L->heap_pos = p;
+	/* All leases are empty (expires == 0): any order is a valid heap */
+	for (i = 0; i < n; i++)
+		heap_set(i, i);
+}
+
 /* Find the oldest expired lease, NULL if there are no expired leases */
 static struct dyn_lease *oldest_expired_lease(void)
 {
-	struct dyn_lease *oldest_lease = NULL;
-	leasetime_t oldest_time = time(NULL);
-	unsigned i;
+	struct dyn_lease *oldest_lease;
 
-	/* Unexpired leases have g_leases[i].expires >= current time
+	if (server_config.max_leases == 0)
+		return NULL;
+	/* Unexpired leases have expires >= current time
 	 * and therefore can't ever match */
-	for (i = 0; i < server_config.max_leases; i++) {
-		if (g_leases[i].expires < oldest_time) {
-			oldest_time = g_leases[i].expires;
-			oldest_lease = &g_leases[i];
-		}
-	}
-	return oldest_lease;
+	oldest_lease = &g_leases[L->heap[0]];
+	if (oldest_lease->expires < (leasetime_t) time(NULL))
+		return oldest_lease;
+	return NULL;
+}
+
+static void clear_lease(struct dyn_lease *lease)
+{
+	unsigned idx = lease - g_leases;
+
+	unindex_lease(idx);
+	memset(lease, 0, sizeof(*lease));
+	index_lease(idx);
 }
 
 /* Clear out all leases with matching nonzero chaddr OR yiaddr.
@@ -30,14 +183,19 @@ static struct dyn_lease *oldest_expired_lease(void)
  */
 static void clear_leases(const uint8_t *chaddr, uint32_t yiaddr)
 {
-	unsigned i;
+	struct dyn_lease *lease;
 
-	for (i = 0; i < server_config.max_leases; i++) {
-		if ((chaddr && memcmp(g_leases[i].lease_mac, chaddr, 6) == 0)
-		 || (yiaddr && g_leases[i].lease_nip == yiaddr)
-		) {
-			memset(&g_leases[i], 0, sizeof(g_leases[i]));
-		}
+	/* MACs and IPs of the leases in use are unique,
+	 * so there can be at most one match of each kind */
+	if (chaddr) {
+		lease = find_lease_by_mac(chaddr);
+		if (lease)
+			clear_lease(lease);
+	}
+	if (yiaddr) {
+		lease = find_lease_by_nip(yiaddr);
+		if (lease)
+			clear_lease(lease);
 	}
 }
 
@@ -57,6 +215,7 @@ struct dyn_lease* FAST_FUNC add_lease(
 	oldest = oldest_expired_lease();
 
 	if (oldest) {
+		unindex_lease(oldest - g_leases);
 		memset(oldest, 0, sizeof(*oldest));
 		if (hostname) {
 			char *p;
@@ -76,37 +235,52 @@ struct dyn_lease* FAST_FUNC add_lease(
 			memcpy(oldest->lease_mac, chaddr, 6);
 		oldest->lease_nip = yiaddr;
 		oldest->expires = time(NULL) + leasetime;
+		index_lease(oldest - g_leases);
 	}
 
 	return oldest;
 }
 
+/* Change expiration time of a lease (relative time, as in add_lease),
+ * optionally forgetting the client it was given to.
+ * Static leases are not in g_leases and not indexed */
+void FAST_FUNC set_lease_expiry(struct dyn_lease *lease, leasetime_t leasetime, int clear_mac, int is_static)
+{
+	if (!is_static)
+		unindex_lease(lease - g_leases);
+	if (clear_mac)
+		memset(lease->lease_mac, 0, sizeof(lease->lease_mac));
+	lease->expires = time(NULL) + leasetime;
+	if (!is_static)
+		index_lease(lease - g_leases);
+}
+
 /* True if a lease has expired */
 int FAST_FUNC is_expired_lease(struct dyn_lease *lease)
 {
 	return (lease->expires < (leasetime_t) time(NULL));
 }
 
-/* Find the first lease that matches MAC, NULL if no match */
+/* Find the lease that matches MAC, NULL if no match */
 struct dyn_lease* FAST_FUNC find_lease_by_mac(const uint8_t *mac)
 {
-	unsigned i;
+	uint32_t i;
 
-	for (i = 0; i < server_config.max_leases; i++)
-		if (memcmp(g_leases[i].lease_mac, mac, 6) == 0)
-			return &g_leases[i];
+	for (i = L->mac_head[hash_mac(mac)]; i; i = L->mac_next[i - 1])
+		if (memcmp(g_leases[i - 1].lease_mac, mac, 6) == 0)
+			return &g_leases[i - 1];
 
 	return NULL;
 }
 
-/* Find the first lease that matches IP, NULL is no match */
+/* Find the lease that matches IP, NULL is no match */
 struct dyn_lease* FAST_FUNC find_lease_by_nip(uint32_t nip)
 {
-	unsigned i;
+	uint32_t i;
 
-	for (i = 0; i < server_config.max_leases; i++)
-		if (g_leases[i].lease_nip == nip)
-			return &g_leases[i];
+	for (i = L->nip_head[hash_nip(nip)]; i; i = L->nip_next[i - 1])
+		if (g_leases[i - 1].lease_nip == nip)
+			return &g_leases[i - 1];
 
 	return NULL;
 }
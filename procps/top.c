@@ -51,6 +51,7 @@
  */
 
 #include "libbb.h"
+#include <sys/resource.h>
 
 
 typedef struct top_status_t {
@@ -106,8 +107,17 @@ struct globals {
 	cmp_funcp sort_function[1];
 #else
 	cmp_funcp sort_function[SORT_DEPTH];
+# if !ENABLE_FEATURE_TOP_INCREMENTAL
 	struct save_hist *prev_hist;
 	int prev_hist_count;
+# else
+	struct proc_entry **proc_hash;
+	unsigned proc_hash_mask;
+	unsigned proc_count;
+	unsigned proc_fds, proc_fd_budget;
+	unsigned sample_no;
+	DIR *proc_dir;
+# endif
 	jiffy_counts_t cur_jif, prev_jif;
 	/* int hist_iterations; */
 	unsigned total_pcpu;
@@ -136,6 +146,13 @@ struct BUG_bad_size {
 #define sort_function    (G.sort_function     )
 #define prev_hist        (G.prev_hist         )
 #define prev_hist_count  (G.prev_hist_count   )
+#define proc_hash        (G.proc_hash         )
+#define proc_hash_mask   (G.proc_hash_mask    )
+#define proc_count       (G.proc_count        )
+#define proc_fds         (G.proc_fds          )
+#define proc_fd_budget   (G.proc_fd_budget    )
+#define sample_no        (G.sample_no         )
+#define proc_dir         (G.proc_dir          )
 #define cur_jif          (G.cur_jif           )
 #define prev_jif         (G.prev_jif          )
 #define cpu_jif          (G.cpu_jif           )
@@ -277,6 +294,7 @@ static void get_jiffy_counts(void)
 	fclose(fp);
 }
 
+# if !ENABLE_FEATURE_TOP_INCREMENTAL
 static void do_stats(void)
 {
 	top_status_t *cur;
@@ -328,9 +346,294 @@ static void do_stats(void)
 	prev_hist = new_hist;
 	prev_hist_count = ntop;
 }
+# endif
 
 #endif /* FEATURE_TOP_CPU_USAGE_PERCENTAGE */
 
+#if ENABLE_FEATURE_TOP_INCREMENTAL
+/* Processes (or threads) seen by previous updates, hashed by pid.
+ * Their /proc/PID/stat stays open, next update only pread()s it.
+ */
+typedef struct proc_entry {
+	struct proc_entry *next;
+	unsigned pid;
+	int stat_fd;         /* -1: out of fd budget, open it every time */
+	unsigned seen;       /* sample_no of last update which saw it, 0: new */
+	unsigned long ticks;
+	int cmdline_len;     /* -1: not read yet */
+	char *cmdline;
+	char comm[COMM_LEN]; /* cmdline is reread when comm changes (exec) */
+} proc_entry;
+
+static void init_fd_budget(void)
+{
+	struct rlimit rl;
+
+	/* One fd per process: raise soft limit as far as we may */
+	getrlimit(RLIMIT_NOFILE, &rl);
+	if (rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		if (rl.rlim_cur > 1024*1024)
+			rl.rlim_cur = 1024*1024;
+		setrlimit(RLIMIT_NOFILE, &rl);
+		getrlimit(RLIMIT_NOFILE, &rl);
+	}
+	/* leave some for stdio, opendir etc */
+	proc_fd_budget = rl.rlim_cur > 64 ? rl.rlim_cur - 64 : 0;
+}
+
+static proc_entry *find_proc(unsigned pid)
+{
+	proc_entry *e;
+
+	if (!proc_hash)
+		return NULL;
+	e = proc_hash[pid & proc_hash_mask];
+	while (e && e->pid != pid)
+		e = e->next;
+	return e;
+}
+
+static void close_proc_fd(proc_entry *e)
+{
+	if (e->stat_fd >= 0) {
+		close(e->stat_fd);
+		e->stat_fd = -1;
+		proc_fds--;
+	}
+}
+
+#if ENABLE_FEATURE_USE_TERMIOS
+/* Only the interactive keys and cleanup on exit need this */
+static void free_procs(void)
+{
+	unsigned i;
+
+	if (!proc_hash)
+		return;
+	for (i = 0; i <= proc_hash_mask; i++) {
+		proc_entry *e = proc_hash[i];
+		while (e) {
+			proc_entry *next = e->next;
+			close_proc_fd(e);
+			free(e->cmdline);
+			free(e);
+			e = next;
+		}
+	}
+	free(proc_hash);
+	proc_hash = NULL;
+	proc_hash_mask = 0;
+	proc_count = 0;
+}
+#endif
+
+static proc_entry *add_proc(unsigned pid)
+{
+	proc_entry *e, **b;
+
+	/* keep chains short: grow when there are more entries than buckets */
+	if (proc_count >= proc_hash_mask) {
+		unsigned i, old_size = proc_hash ? proc_hash_mask + 1 : 0;
+		unsigned new_mask = old_size ? old_size * 2 - 1 : 255;
+		proc_entry **new_hash = xzalloc((new_mask + 1) * sizeof(new_hash[0]));
+
+		for (i = 0; i < old_size; i++) {
+			e = proc_hash[i];
+			while (e) {
+				proc_entry *next = e->next;
+				b = &new_hash[e->pid & new_mask];
+				e->next = *b;
+				*b = e;
+				e = next;
+			}
+		}
+		free(proc_hash);
+		proc_hash = new_hash;
+		proc_hash_mask = new_mask;
+	}
+	e = xzalloc(sizeof(*e));
+	e->pid = pid;
+	e->stat_fd = -1;
+	e->cmdline_len = -1;
+	b = &proc_hash[pid & proc_hash_mask];
+	e->next = *b;
+	*b = e;
+	proc_count++;
+	return e;
+}
+
+/* Read [TGID/task/]PID/stat into a new top[] element */
+static void sample_proc(unsigned tgid, unsigned pid, procps_status_t *sp)
+{
+	char buf[1024]; /* as in procps_scan() */
+	char path[sizeof("%u/task/%u/stat") + sizeof(int)*3 * 2];
+	proc_entry *e;
+	top_status_t *cur;
+	struct stat sb;
+	int fd, n;
+	smallint retried = 0;
+
+	e = find_proc(pid);
+	if (!e)
+		e = add_proc(pid);
+	for (;;) {
+		fd = e->stat_fd;
+		if (fd < 0) {
+			if (tgid)
+				sprintf(path, "%u/task/%u/stat", tgid, pid);
+			else
+				sprintf(path, "%u/stat", pid);
+			fd = open(path, O_RDONLY);
+			if (fd < 0)
+				return; /* exited */
+			close_on_exec_on(fd);
+			if (proc_fds < proc_fd_budget) {
+				e->stat_fd = fd;
+				proc_fds++;
+			}
+		}
+		n = pread(fd, buf, sizeof(buf) - 1, 0);
+		if (n > 0)
+			break;
+		/* It exited (fd is stale). But readdir showed the PID,
+		 * it may be a new process: forget the old one, reopen */
+		if (e->stat_fd >= 0)
+			close_proc_fd(e);
+		else
+			close(fd);
+		if (retried)
+			return;
+		retried = 1;
+		e->seen = 0;
+		e->comm[0] = '\0';
+	}
+	buf[n] = '\0';
+	n = fstat(fd, &sb);
+	if (e->stat_fd < 0)
+		close(fd);
+	if (n != 0 || !procps_parse_stat(sp, buf))
+		return;
+
+	n = ntop;
+	top = xrealloc_vector(top, 6, ntop++);
+	cur = &top[n];
+	cur->pid = pid;
+	cur->ppid = sp->ppid;
+	cur->vsz = sp->vsz;
+	cur->ticks = sp->stime + sp->utime;
+	/* Effective UID, as stat("/proc/PID") gives */
+	cur->uid = sb.st_uid;
+	strcpy(cur->state, sp->state);
+	strcpy(cur->comm, sp->comm);
+#if ENABLE_FEATURE_TOP_SMP_PROCESS
+	cur->last_seen_on_cpu = sp->last_seen_on_cpu;
+#endif
+	cur->pcpu = 0;
+	if (e->seen) {
+		cur->pcpu = cur->ticks - e->ticks;
+		total_pcpu += cur->pcpu;
+	}
+	e->ticks = cur->ticks;
+	if (strcmp(e->comm, sp->comm) != 0) {
+		strcpy(e->comm, sp->comm);
+		free(e->cmdline);
+		e->cmdline = NULL;
+		e->cmdline_len = -1;
+	}
+	e->seen = sample_no;
+}
+
+/* Fill top[] from /proc. Returns 0 if there was no previous sample
+ * to compute %CPU against */
+static int sample_procs(unsigned scan_mask UNUSED_PARAM)
+{
+	procps_status_t sp;
+	struct dirent *de;
+	unsigned i, had_prev;
+
+	had_prev = proc_count;
+	sample_no++;
+	total_pcpu = 0;
+	if (!proc_dir) {
+		init_fd_budget();
+		proc_dir = xopendir("."); /* we are in /proc */
+	} else {
+		rewinddir(proc_dir);
+	}
+	memset(&sp, 0, sizeof(sp));
+	while ((de = readdir(proc_dir)) != NULL) {
+		unsigned pid = bb_strtou(de->d_name, NULL, 10);
+		if (errno)
+			continue;
+#if ENABLE_FEATURE_SHOW_THREADS
+		if (scan_mask & PSSCAN_TASKS) {
+			char path[sizeof("%u/task") + sizeof(int)*3];
+			DIR *task_dir;
+
+			sprintf(path, "%u/task", pid);
+			task_dir = opendir(path);
+			if (!task_dir)
+				continue;
+			while ((de = readdir(task_dir)) != NULL) {
+				unsigned tid = bb_strtou(de->d_name, NULL, 10);
+				if (!errno)
+					sample_proc(pid, tid, &sp);
+			}
+			closedir(task_dir);
+			continue;
+		}
+#endif
+		sample_proc(0, pid, &sp);
+	}
+
+	/* Forget processes which are gone */
+	for (i = 0; proc_hash && i <= proc_hash_mask; i++) {
+		proc_entry **pp = &proc_hash[i];
+		while (*pp) {
+			proc_entry *e = *pp;
+			if (e->seen == sample_no) {
+				pp = &e->next;
+				continue;
+			}
+			*pp = e->next;
+			close_proc_fd(e);
+			free(e->cmdline);
+			free(e);
+			proc_count--;
+		}
+	}
+	return had_prev != 0;
+}
+
+/* read_cmdline() which reads /proc/PID/cmdline only once per process */
+static void read_cached_cmdline(char *buf, int col, unsigned pid, const char *comm)
+{
+	proc_entry *e = find_proc(pid);
+	int sz;
+
+	if (!e) {
+		read_cmdline(buf, col, pid, comm);
+		return;
+	}
+	if (e->cmdline_len < 0) {
+		char path[sizeof("%u/cmdline") + sizeof(int)*3];
+
+		sprintf(path, "%u/cmdline", pid);
+		e->cmdline = xmalloc(LINE_BUF_SIZE);
+		sz = open_read_close(path, e->cmdline, LINE_BUF_SIZE);
+		e->cmdline_len = sz > 0 ? sz : 0;
+	}
+	sz = e->cmdline_len;
+	if (sz > col - 1)
+		sz = col - 1;
+	memcpy(buf, e->cmdline, sz);
+	format_cmdline(buf, col, sz, comm);
+}
+#else
+# define read_cached_cmdline read_cmdline
+#endif /* FEATURE_TOP_INCREMENTAL */
+
 #if ENABLE_FEATURE_TOP_CPU_GLOBAL_PERCENTS && ENABLE_FEATURE_TOP_DECIMALS
 /* formats 7 char string (8 with terminating NUL) */
 static char *fmt_100percent_8(char pbuf[8], unsigned value, unsigned total)
@@ -629,7 +932,7 @@ static NOINLINE void display_process_list(int lines_rem, int scr_width)
 				IF_FEATURE_TOP_CPU_USAGE_PERCENTAGE(, SHOW_STAT(pcpu))
 		);
 		if ((int)(col + 1) < scr_width)
-			read_cmdline(line_buf + col, scr_width - col, s->pid, s->comm);
+			read_cached_cmdline(line_buf + col, scr_width - col, s->pid, s->comm);
 		fputs(line_buf, stdout);
 		/* printf(" %d/%d %lld/%lld", s->pcpu, total_pcpu,
 			cur_jif.busy - prev_jif.busy, cur_jif.total - prev_jif.total); */
@@ -646,7 +949,9 @@ static NOINLINE void display_process_list(int lines_rem, int scr_width)
 
 static void clearmems(void)
 {
-	clear_username_cache();
+	/* With FEATURE_TOP_INCREMENTAL, keep usernames between updates */
+	if (!ENABLE_FEATURE_TOP_INCREMENTAL)
+		clear_username_cache();
 	free(top);
 	top = NULL;
 	ntop = 0;
@@ -659,7 +964,10 @@ static void reset_term(void)
 	tcsetattr_stdin_TCSANOW(&initial_settings);
 	if (ENABLE_FEATURE_CLEAN_UP) {
 		clearmems();
-# if ENABLE_FEATURE_TOP_CPU_USAGE_PERCENTAGE
+# if ENABLE_FEATURE_TOP_INCREMENTAL
+		free_procs();
+		clear_username_cache();
+# elif ENABLE_FEATURE_TOP_CPU_USAGE_PERCENTAGE
 		free(prev_hist);
 # endif
 	}
@@ -899,6 +1207,8 @@ static unsigned handle_input(unsigned scan_mask, unsigned interval)
 		 IF_FEATURE_TOPMEM(&& scan_mask != TOPMEM_MASK)
 		) {
 			scan_mask ^= PSSCAN_TASKS;
+			/* stat of a process and of its main thread differ */
+			IF_FEATURE_TOP_INCREMENTAL(free_procs();)
 			continue;
 		}
 # endif
@@ -920,9 +1230,13 @@ static unsigned handle_input(unsigned scan_mask, unsigned interval)
 #  if ENABLE_FEATURE_TOPMEM
 		if (c == 's') {
 			scan_mask = TOPMEM_MASK;
+#   if ENABLE_FEATURE_TOP_INCREMENTAL
+			free_procs();
+#   else
 			free(prev_hist);
 			prev_hist = NULL;
 			prev_hist_count = 0;
+#   endif
 			sort_field = (sort_field + 1) % NUM_SORT_FIELD;
 			continue;
 		}
@@ -1098,6 +1412,18 @@ int top_main(int argc UNUSED_PARAM, char **argv)
 				col = LINE_BUF_SIZE - 2;
 		}
 
+#if ENABLE_FEATURE_TOP_INCREMENTAL
+		if (scan_mask != TOPMEM_MASK) {
+			if (!sample_procs(scan_mask) && ntop != 0) {
+				/* nothing to compare with yet */
+				get_jiffy_counts();
+				usleep(100000);
+				clearmems();
+				continue;
+			}
+			get_jiffy_counts();
+		} else
+#endif
 		/* read process IDs & status for all the processes */
 		while ((p = procps_scan(p, scan_mask)) != NULL) {
 			int n;
@@ -1145,7 +1471,9 @@ int top_main(int argc UNUSED_PARAM, char **argv)
 		}
 
 		if (scan_mask != TOPMEM_MASK) {
-#if ENABLE_FEATURE_TOP_CPU_USAGE_PERCENTAGE
+#if ENABLE_FEATURE_TOP_INCREMENTAL
+			qsort(top, ntop, sizeof(top_status_t), (void*)mult_lvl_cmp);
+#elif ENABLE_FEATURE_TOP_CPU_USAGE_PERCENTAGE
 			if (!prev_hist_count) {
 				do_stats();
 				usleep(100000);
@@ -37,6 +37,9 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <sys/poll.h>
 #include <sys/file.h>
+#if ENABLE_FEATURE_RUNSVDIR_INOTIFY
+# include <sys/inotify.h>
+#endif
 #include "libbb.h"
 #include "runit_lib.h"
 
@@ -62,9 +65,16 @@ struct globals {
 	char *rplog;
 	int rploglen;
 	struct fd_pair logpipe;
-	struct pollfd pfd[1];
 	unsigned stamplog;
 #endif
+#if ENABLE_FEATURE_RUNSVDIR_LOG || ENABLE_FEATURE_RUNSVDIR_INOTIFY
+	/* [0]: log pipe, [1]: inotify fd, unused ones are -1 */
+	struct pollfd pfd[2];
+#endif
+#if ENABLE_FEATURE_RUNSVDIR_INOTIFY
+	int svdir_wd;           /* watch on svdir, -1 if none */
+	smallint svdir_changed; /* got inotify event, rescan now */
+#endif
 } FIX_ALIASING;
 #define G (*(struct globals*)&bb_common_bufsiz1)
 #define sv          (G.sv          )
@@ -75,8 +85,22 @@ struct globals {
 #define logpipe     (G.logpipe     )
 #define pfd         (G.pfd         )
 #define stamplog    (G.stamplog    )
+#define inotify_fd  (pfd[1].fd     )
+#if ENABLE_FEATURE_RUNSVDIR_INOTIFY
+#define svdir_wd    (G.svdir_wd    )
+#define svdir_changed (G.svdir_changed)
+#else
+#define svdir_wd    -1
+#define svdir_changed 0
+#endif
+#if ENABLE_FEATURE_RUNSVDIR_LOG || ENABLE_FEATURE_RUNSVDIR_INOTIFY
 #define INIT_G() do { \
+	pfd[0].fd = pfd[1].fd = -1; \
+	IF_FEATURE_RUNSVDIR_INOTIFY(svdir_wd = -1;) \
 } while (0)
+#else
+#define INIT_G() do { } while (0)
+#endif
 
 static void fatal2_cannot(const char *m1, const char *m2)
 {
@@ -98,6 +122,69 @@ static void warnx(const char *m1)
 }
 #endif
 
+#if ENABLE_FEATURE_RUNSVDIR_INOTIFY
+/* Entries appearing or disappearing are all we care about,
+ * writes inside service dirs do not concern us */
+#define SVDIR_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO \
+		| IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+/* Called with svdir as current directory */
+static void watch_svdir(void)
+{
+	if (svdir_wd >= 0 || inotify_fd < 0)
+		return;
+	svdir_wd = inotify_add_watch(inotify_fd, ".", SVDIR_EVENTS);
+	if (svdir_wd < 0)
+		warn2_cannot("watch ", svdir);
+}
+
+static void unwatch_svdir(void)
+{
+	if (svdir_wd >= 0) {
+		inotify_rm_watch(inotify_fd, svdir_wd);
+		svdir_wd = -1;
+	}
+}
+
+static void read_svdir_events(void)
+{
+	union {
+		struct inotify_event ie;
+		char buf[sizeof(struct inotify_event) + NAME_MAX + 1];
+	} u;
+	ssize_t len;
+	int n = 10;
+
+	do {
+		while ((len = read(inotify_fd, &u, sizeof(u))) > 0) {
+			char *p = u.buf;
+			while (len > 0) {
+				struct inotify_event *ie = (void*)p;
+				if (ie->wd == svdir_wd) {
+					if (ie->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+						/* svdir itself is gone or moved away:
+						 * poll for it until it is back */
+						unwatch_svdir();
+					}
+					svdir_changed = 1;
+				} else if (ie->mask & IN_Q_OVERFLOW) {
+					svdir_changed = 1;
+				}
+				/* else: leftovers of a watch we removed */
+				p += sizeof(*ie) + ie->len;
+				len -= sizeof(*ie) + ie->len;
+			}
+		}
+		/* "mkdir sv/foo; cp run sv/foo" should not start runsv
+		 * in an empty dir: wait until things are quiet for 0.1 sec,
+		 * but not longer than a second */
+	} while (--n && poll(&pfd[1], 1, 100) > 0);
+}
+#else
+#define watch_svdir()   ((void)0)
+#define unwatch_svdir() ((void)0)
+#endif
+
 /* inlining + vfork -> bigger code */
 static NOINLINE pid_t runsv(const char *name)
 {
@@ -282,6 +369,14 @@ int runsvdir_main(int argc UNUSED_PARAM, char **argv)
 		warnx("log service disabled");
 	}
  run:
+#endif
+#if ENABLE_FEATURE_RUNSVDIR_INOTIFY
+	inotify_fd = inotify_init();
+	if (inotify_fd >= 0) {
+		close_on_exec_on(inotify_fd);
+		ndelay_on(inotify_fd);
+		pfd[1].events = POLLIN;
+	}
 #endif
 	curdir = open(".", O_RDONLY|O_NDELAY);
 	if (curdir == -1)
@@ -306,24 +401,38 @@ int runsvdir_main(int argc UNUSED_PARAM, char **argv)
 		}
 
 		now = monotonic_sec();
-		if ((int)(now - stampcheck) >= 0) {
-			/* wait at least a second */
+		if ((int)(now - stampcheck) >= 0 || svdir_changed) {
+			/* wait at least a second, unless inotify
+			 * told us that svdir was modified */
 			stampcheck = now + 1;
 
 			if (stat(svdir, &s) != -1) {
-				if (need_rescan || s.st_mtime != last_mtime
+				/* With an inotify watch, mtime is not interesting.
+				 * We still have to notice svdir being replaced
+				 * (e.g. symlink switched by runsvchdir) */
+				if (need_rescan || svdir_changed
+				 || (svdir_wd < 0 && s.st_mtime != last_mtime)
 				 || s.st_ino != last_ino || s.st_dev != last_dev
 				) {
 					/* svdir modified */
 					if (chdir(svdir) != -1) {
+						if (s.st_ino != last_ino || s.st_dev != last_dev)
+							unwatch_svdir();
 						last_mtime = s.st_mtime;
 						last_dev = s.st_dev;
 						last_ino = s.st_ino;
+#if ENABLE_FEATURE_RUNSVDIR_INOTIFY
+						/* events arriving from now on
+						 * trigger another rescan */
+						svdir_changed = 0;
+#endif
+						watch_svdir();
 						/* if the svdir changed this very second, wait until the
 						 * next second, because we won't be able to detect more
 						 * changes within this second */
-						while (time(NULL) == last_mtime)
-							usleep(100000);
+						if (svdir_wd < 0)
+							while (time(NULL) == last_mtime)
+								usleep(100000);
 						need_rescan = do_rescan();
 						while (fchdir(curdir) == -1) {
 							warn2_cannot("change directory, pausing", "");
@@ -345,18 +454,23 @@ int runsvdir_main(int argc UNUSED_PARAM, char **argv)
 				stamplog = now + 900;
 			}
 		}
-		pfd[0].revents = 0;
 #endif
 		deadline = (need_rescan ? 1 : 5);
 		sig_block(SIGCHLD);
-#if ENABLE_FEATURE_RUNSVDIR_LOG
-		if (rplog)
-			poll(pfd, 1, deadline*1000);
-		else
+#if ENABLE_FEATURE_RUNSVDIR_LOG || ENABLE_FEATURE_RUNSVDIR_INOTIFY
+		/* fds which are -1 are ignored */
+		pfd[0].revents = pfd[1].revents = 0;
+		poll(pfd, 2, deadline*1000);
+#else
+		sleep(deadline);
 #endif
-			sleep(deadline);
 		sig_unblock(SIGCHLD);
 
+#if ENABLE_FEATURE_RUNSVDIR_INOTIFY
+		if (pfd[1].revents & POLLIN)
+			read_svdir_events();
+#endif
+
 #if ENABLE_FEATURE_RUNSVDIR_LOG
 		if (pfd[0].revents & POLLIN) {
 			char ch;
@@ -61,6 +61,10 @@ ttimeout
 !processor
     tells svlogd to feed each recent log file through processor
     (see above) on log file rotation. By default log files are not processed.
+z
+    tells svlogd to compress each recent log file with gzip on log file
+    rotation. This works like !gzip, but runs gzip code built into
+    busybox, without executing a shell and a gzip binary.
 ua.b.c.d[:port]
     tells svlogd to transmit the first len characters of selected
     log messages to the IP address a.b.c.d, port number port.
@@ -136,6 +140,9 @@ log message, you can use a pattern like this instead
 /*usage:   "\n""NNUM - min number files to retain" - confusing */
 /*usage:   "\n""tSEC - rotate file if it get SEC seconds old" - confusing */
 //usage:   "\n""!PROG - process rotated log with PROG"
+//usage:	IF_FEATURE_SVLOGD_GZIP(
+//usage:   "\n""z - compress rotated log with gzip"
+//usage:	)
 /*usage:   "\n""uIPADDR - send log over UDP" - unsupported */
 /*usage:   "\n""UIPADDR - send log over UDP and DONT log" - unsupported */
 /*usage:   "\n""pPFX - prefix each line with PFX" - unsupported */
@@ -155,8 +162,16 @@ struct logdir {
 	////char *btmp;
 	/* pattern list to match, in "aa\0bb\0\cc\0\0" form */
 	char *inst;
+	/* "!processor" or "z" config line */
 	char *processor;
 	char *name;
+	/* Names of rotated logfiles, oldest first: old[old_first..old_end-1].
+	 * Timestamped names sort in rotation order, so we only
+	 * append new ones and drop the oldest ones */
+	char (*old)[FMT_PTIME];
+	unsigned old_first;
+	unsigned old_end;
+	unsigned old_max;
 	unsigned size;
 	unsigned sizemax;
 	unsigned nmax;
@@ -369,6 +384,83 @@ static void fmt_time_bernstein_25(char *s)
 	bin2hex(s, (char*)pack, 12);
 }
 
+static void add_old(struct logdir *ld, const char *fn)
+{
+	if (ld->old_end == ld->old_max) {
+		if (ld->old_first && ld->old_first >= ld->old_max / 2) {
+			/* At least half is free at the front, reuse it */
+			ld->old_end -= ld->old_first;
+			memmove(ld->old, ld->old + ld->old_first, ld->old_end * sizeof(ld->old[0]));
+			ld->old_first = 0;
+		} else {
+			void *p;
+			while (!(p = realloc(ld->old, (ld->old_max * 2 + 16) * sizeof(ld->old[0]))))
+				pause_nomem();
+			ld->old = p;
+			ld->old_max = ld->old_max * 2 + 16;
+		}
+	}
+	strcpy(ld->old[ld->old_end++], fn);
+}
+
+/* Processor finished: "@...u" is now "@...s" */
+static void rename_old(struct logdir *ld, const char *from, const char *to)
+{
+	unsigned i = ld->old_end;
+
+	/* It is almost always the newest one */
+	while (i > ld->old_first) {
+		if (strcmp(ld->old[--i], from) == 0) {
+			strcpy(ld->old[i], to);
+			break;
+		}
+	}
+}
+
+static int cmp_old(const void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+
+/* (Re)build the list of rotated logfiles. Called with cwd = ld's dir */
+static void scan_old(struct logdir *ld)
+{
+	DIR *d;
+	struct dirent *f;
+
+	ld->old_first = ld->old_end = 0;
+	while (!(d = opendir(".")))
+		pause2cannot("open directory, want rotate", ld->name);
+	errno = 0;
+	while ((f = readdir(d))) {
+		if ((f->d_name[0] == '@') && (strlen(f->d_name) == 27)) {
+			if (f->d_name[26] == 't') {
+				if (unlink(f->d_name) == -1)
+					warn2("can't unlink processor leftover", f->d_name);
+			} else {
+				add_old(ld, f->d_name);
+			}
+			errno = 0;
+		}
+	}
+	if (errno)
+		warn2("can't read directory", ld->name);
+	closedir(d);
+	qsort(ld->old, ld->old_end, sizeof(ld->old[0]), cmp_old);
+}
+
+/* Unlink the oldest logfile and forget it. If it can't be unlinked,
+ * it stays in the list. Called with cwd = ld's dir */
+static int unlink_oldest(struct logdir *ld)
+{
+	if (unlink(ld->old[ld->old_first]) == -1 && errno != ENOENT) {
+		warn2("can't unlink oldest logfile", ld->name);
+		return -1;
+	}
+	ld->old_first++;
+	return 0;
+}
+
 static void processorstart(struct logdir *ld)
 {
 	char sv_ch;
@@ -386,8 +478,22 @@ static void processorstart(struct logdir *ld)
 	if (!G.shell)
 		G.shell = xstrdup(get_shell_name());
 
-	while ((pid = vfork()) == -1)
+	/* Unflushed stderr would be written twice by fork'ed child */
+	fflush_all();
+	for (;;) {
+#if ENABLE_FEATURE_SVLOGD_GZIP && BB_MMU
+		/* Built-in gzip runs in the child, needs real fork.
+		 * Not a thread: gzip code keeps its state in globals
+		 * and exits on errors, which would take svlogd down */
+		if (ld->processor[0] == 'z')
+			pid = fork();
+		else
+#endif
+			pid = vfork();
+		if (pid != -1)
+			break;
 		pause2cannot("vfork for processor", ld->name);
+	}
 	if (!pid) {
 		int fd;
 
@@ -420,7 +526,27 @@ static void processorstart(struct logdir *ld)
 		fd = xopen("newstate", O_WRONLY|O_NDELAY|O_TRUNC|O_CREAT);
 		xmove_fd(fd, 5);
 
-		execl(G.shell, G.shell, "-c", ld->processor, (char*) NULL);
+#if ENABLE_FEATURE_SVLOGD_GZIP
+		if (ld->processor[0] == 'z') {
+			char *argv[2];
+			argv[0] = (char*)"gzip";
+			argv[1] = NULL;
+# if BB_MMU
+			/* We are a fork'ed copy, our handlers must go */
+			bb_signals(0
+				+ (1 << SIGTERM)
+				+ (1 << SIGALRM)
+				+ (1 << SIGHUP)
+				+ (1 << SIGCHLD)
+				, SIG_DFL);
+			sig_unblock(SIGCHLD);
+			run_applet_and_exit("gzip", argv);
+# endif
+			execv(bb_busybox_exec_path, argv);
+			bb_perror_msg_and_die(FATAL"can't %s processor %s", "run", ld->name);
+		}
+#endif
+		execl(G.shell, G.shell, "-c", ld->processor + 1, (char*) NULL);
 		bb_perror_msg_and_die(FATAL"can't %s processor %s", "run", ld->name);
 	}
 	ld->fnsave[26] = sv_ch; /* ...restore */
@@ -461,6 +587,7 @@ static unsigned processorstop(struct logdir *ld)
 	while (chmod(f, 0744) == -1)
 		pause2cannot("set mode of processed", ld->name);
 	ld->fnsave[26] = 'u';
+	rename_old(ld, ld->fnsave, f);
 	if (unlink(ld->fnsave) == -1)
 		bb_error_msg(WARNING"can't unlink: %s/%s", ld->name, ld->fnsave);
 	while (rename("newstate", "state") == -1)
@@ -474,37 +601,11 @@ static unsigned processorstop(struct logdir *ld)
 
 static void rmoldest(struct logdir *ld)
 {
-	DIR *d;
-	struct dirent *f;
-	char oldest[FMT_PTIME];
-	int n = 0;
-
-	oldest[0] = 'A'; oldest[1] = oldest[27] = 0;
-	while (!(d = opendir(".")))
-		pause2cannot("open directory, want rotate", ld->name);
-	errno = 0;
-	while ((f = readdir(d))) {
-		if ((f->d_name[0] == '@') && (strlen(f->d_name) == 27)) {
-			if (f->d_name[26] == 't') {
-				if (unlink(f->d_name) == -1)
-					warn2("can't unlink processor leftover", f->d_name);
-			} else {
-				++n;
-				if (strcmp(f->d_name, oldest) < 0)
-					memcpy(oldest, f->d_name, 27);
-			}
-			errno = 0;
-		}
-	}
-	if (errno)
-		warn2("can't read directory", ld->name);
-	closedir(d);
-
-	if (ld->nmax && (n > ld->nmax)) {
+	while (ld->nmax && (ld->old_end - ld->old_first > ld->nmax)) {
 		if (verbose)
-			bb_error_msg(INFO"delete: %s/%s", ld->name, oldest);
-		if ((*oldest == '@') && (unlink(oldest) == -1))
-			warn2("can't unlink oldest logfile", ld->name);
+			bb_error_msg(INFO"delete: %s/%s", ld->name, ld->old[ld->old_first]);
+		if (unlink_oldest(ld) != 0)
+			break; /* try again on next rotation */
 	}
 }
 
@@ -557,6 +658,7 @@ static unsigned rotate(struct logdir *ld)
 		}
 		while (rename("current", ld->fnsave) == -1)
 			pause2cannot("rename current", ld->name);
+		add_old(ld, ld->fnsave);
 		while ((ld->fdcur = open("current", O_WRONLY|O_NDELAY|O_APPEND|O_CREAT, 0600)) == -1)
 			pause2cannot("create new current", ld->name);
 		while ((ld->filecur = fdopen(ld->fdcur, "a")) == NULL) ////
@@ -593,44 +695,19 @@ static int buffer_pwrite(int n, char *s, unsigned len)
 		i = fwrite(s, 1, len, ld->filecur);
 		if (i == len) break;
 
-		if ((errno == ENOSPC) && (ld->nmin < ld->nmax)) {
-			DIR *d;
-			struct dirent *f;
-			char oldest[FMT_PTIME];
-			int j = 0;
-
+		if ((errno == ENOSPC) && (ld->nmin < ld->nmax)
+		 && (ld->old_end - ld->old_first > ld->nmin)
+		) {
 			while (fchdir(ld->fddir) == -1)
 				pause2cannot("change directory, want remove old logfile",
 							 ld->name);
-			oldest[0] = 'A';
-			oldest[1] = oldest[27] = '\0';
-			while (!(d = opendir(".")))
-				pause2cannot("open directory, want remove old logfile",
-							 ld->name);
-			errno = 0;
-			while ((f = readdir(d)))
-				if ((f->d_name[0] == '@') && (strlen(f->d_name) == 27)) {
-					++j;
-					if (strcmp(f->d_name, oldest) < 0)
-						memcpy(oldest, f->d_name, 27);
-				}
-			if (errno) warn2("can't read directory, want remove old logfile",
-					ld->name);
-			closedir(d);
+			bb_error_msg(WARNING"out of disk space, delete: %s/%s",
+					ld->name, ld->old[ld->old_first]);
 			errno = ENOSPC;
-			if (j > ld->nmin) {
-				if (*oldest == '@') {
-					bb_error_msg(WARNING"out of disk space, delete: %s/%s",
-							ld->name, oldest);
-					errno = 0;
-					if (unlink(oldest) == -1) {
-						warn2("can't unlink oldest logfile", ld->name);
-						errno = ENOSPC;
-					}
-					while (fchdir(fdwdir) == -1)
-						pause1cannot("change to initial working directory");
-				}
-			}
+			if (unlink_oldest(ld) == 0)
+				errno = 0;
+			while (fchdir(fdwdir) == -1)
+				pause1cannot("change to initial working directory");
 		}
 		if (errno)
 			pause2cannot("write to current", ld->name);
@@ -781,6 +858,12 @@ static NOINLINE unsigned logdir_open(struct logdir *ld, const char *fn)
 					ld->processor = wstrdup(s);
 				}
 				break;
+#if ENABLE_FEATURE_SVLOGD_GZIP
+			case 'z':
+				free(ld->processor);
+				ld->processor = wstrdup("z");
+				break;
+#endif
 			}
 			s = np;
 		}
@@ -794,6 +877,8 @@ static NOINLINE unsigned logdir_open(struct logdir *ld, const char *fn)
 		}
 	}
 
+	scan_old(ld);
+
 	/* open current */
 	i = stat("current", &st);
 	if (i != -1) {
@@ -808,6 +893,7 @@ static NOINLINE unsigned logdir_open(struct logdir *ld, const char *fn)
 			} while (errno != ENOENT);
 			while (rename("current", ld->fnsave) == -1)
 				pause2cannot("rename current", ld->name);
+			add_old(ld, ld->fnsave);
 			rmoldest(ld);
 			i = -1;
 		} else {
@@ -50,6 +50,9 @@
 
 #define JOBS ENABLE_ASH_JOB_CONTROL
 
+/* $(cmd) without a fork, see evalbackcmd_nofork() */
+#define NOFORK_BACKQ ENABLE_FEATURE_SH_NOFORK
+
 #ifndef __MINGW32__
 #include <paths.h>
 #endif
@@ -61,6 +64,7 @@
 #include "unicode.h"
 
 #include "shell_common.h"
+#include "match.h"
 #if ENABLE_SH_MATH_SUPPORT
 # include "math.h"
 #endif
@@ -205,7 +209,7 @@
 //applet:IF_FEATURE_SH_IS_ASH(APPLET_ODDNAME(sh, ash, BB_DIR_BIN, BB_SUID_DROP, sh))
 //applet:IF_FEATURE_BASH_IS_ASH(APPLET_ODDNAME(bash, ash, BB_DIR_BIN, BB_SUID_DROP, bash))
 
-//kbuild:lib-$(CONFIG_ASH) += ash.o ash_ptr_hack.o shell_common.o
+//kbuild:lib-$(CONFIG_ASH) += ash.o ash_ptr_hack.o shell_common.o match.o
 //kbuild:lib-$(CONFIG_ASH_RANDOM_SUPPORT) += random.o
 
 #if ENABLE_PLATFORM_MINGW32
@@ -220,6 +224,8 @@ struct forkshell {
 	struct globals_var *gvp;
 	struct globals_misc *gmp;
 	struct tblentry **cmdtable;
+	unsigned cmdtable_mask;
+	unsigned cmdtable_cnt;
 	struct localvar *localvars;
 	/* struct alias **atab; */
 	/* struct parsefile *g_parsefile; */
@@ -246,9 +252,11 @@ static int spawn_forkshell(struct job *jp, struct forkshell *fs, int mode);
 
 /* ============ Hash table sizes. Configurable. */
 
-#define VTABSIZE 39
-#define ATABSIZE 39
-#define CMDTABLESIZE 31         /* should be prime */
+/* Initial sizes, must be powers of 2. Tables double in size
+ * when they get more entries than buckets */
+#define VTABSIZE 64
+#define ATABSIZE 16
+#define CMDTABLESIZE 32
 
 
 /* ============ Shell options */
@@ -380,6 +388,11 @@ struct globals_misc {
 #endif
 	pid_t backgndpid;        /* pid of last background process */
 	smallint job_warning;    /* user was warned about stopped jobs (can be 2, 1 or 0). */
+#if NOFORK_BACKQ
+	/* $(cmd) output file, see evalbackcmd_nofork() */
+	int backq_fd;
+	pid_t backq_fd_pid;      /* process which created backq_fd */
+#endif
 };
 extern struct globals_misc *const ash_ptr_to_globals_misc;
 #define G_misc (*ash_ptr_to_globals_misc)
@@ -405,6 +418,8 @@ extern struct globals_misc *const ash_ptr_to_globals_misc;
 #define random_gen  (G_misc.random_gen )
 #define backgndpid  (G_misc.backgndpid )
 #define job_warning (G_misc.job_warning)
+#define backq_fd     (G_misc.backq_fd    )
+#define backq_fd_pid (G_misc.backq_fd_pid)
 #define INIT_G_misc() do { \
 	(*(struct globals_misc**)&ash_ptr_to_globals_misc) = xzalloc(sizeof(G_misc)); \
 	barrier(); \
@@ -1981,7 +1996,9 @@ struct globals_var {
 	struct redirtab *redirlist;
 	int g_nullredirs;
 	int preverrout_fd;   /* save fd2 before print debug if xflag is set. */
-	struct var *vartab[VTABSIZE];
+	struct var **vartab;
+	unsigned vartab_mask; /* number of buckets - 1 */
+	unsigned vartab_cnt;  /* number of variables */
 	struct var varinit[ARRAY_SIZE(varinit_data)];
 };
 extern struct globals_var *const ash_ptr_to_globals_var;
@@ -1991,11 +2008,15 @@ extern struct globals_var *const ash_ptr_to_globals_var;
 #define g_nullredirs  (G_var.g_nullredirs )
 #define preverrout_fd (G_var.preverrout_fd)
 #define vartab        (G_var.vartab       )
+#define vartab_mask   (G_var.vartab_mask  )
+#define vartab_cnt    (G_var.vartab_cnt   )
 #define varinit       (G_var.varinit      )
 #define INIT_G_var() do { \
 	unsigned i; \
 	(*(struct globals_var**)&ash_ptr_to_globals_var) = xzalloc(sizeof(G_var)); \
 	barrier(); \
+	vartab = xzalloc(VTABSIZE * sizeof(vartab[0])); \
+	vartab_mask = VTABSIZE - 1; \
 	for (i = 0; i < ARRAY_SIZE(varinit_data); i++) { \
 		varinit[i].flags    = varinit_data[i].flags; \
 		varinit[i].var_text = varinit_data[i].var_text; \
@@ -2099,18 +2120,81 @@ varcmp(const char *p, const char *q)
 	return c - d;
 }
 
+/* ============ Hash tables
+ *
+ * Variables, aliases and commands are kept in chained hash tables
+ * of 2^N buckets, which grow as entries are added.
+ */
+
+/* Entries of all of them start with the "next" pointer */
+struct hashentry {
+	struct hashentry *next;
+};
+
+/* FNV-1a hash of a name, up to '=' if any ("VAR=value") */
+static unsigned
+hash_name(const char *p)
+{
+	unsigned hashval = 2166136261U;
+
+	while (*p && *p != '=')
+		hashval = (hashval ^ (unsigned char) *p++) * 16777619;
+	return hashval;
+}
+
+/*
+ * Double the number of buckets in a table. *mask is the number
+ * of buckets - 1, key() returns the name of an entry.
+ * Pointers into the old table are invalid afterwards.
+ */
+static void *
+grow_hashtab(void *table, unsigned *mask, const char *(*key)(void *))
+{
+	struct hashentry **old = table;
+	struct hashentry **new;
+	unsigned oldsize = *mask + 1;
+	unsigned i;
+
+	INT_OFF;
+	new = ckzalloc(2 * oldsize * sizeof(new[0]));
+	*mask = 2 * oldsize - 1;
+	for (i = 0; i < oldsize; i++) {
+		struct hashentry *e, *next;
+
+		for (e = old[i]; e; e = next) {
+			struct hashentry **pp = &new[hash_name(key(e)) & *mask];
+
+			next = e->next;
+			e->next = *pp;
+			*pp = e;
+		}
+	}
+	free(old);
+	INT_ON;
+	return new;
+}
+
 /*
  * Find the appropriate entry in the hash table from the name.
  */
 static struct var **
 hashvar(const char *p)
 {
-	unsigned hashval;
+	return &vartab[hash_name(p) & vartab_mask];
+}
 
-	hashval = ((unsigned char) *p) << 4;
-	while (*p && *p != '=')
-		hashval += (unsigned char) *p++;
-	return &vartab[hashval % VTABSIZE];
+static const char *
+var_key(void *vp)
+{
+	return ((struct var *)vp)->var_text;
+}
+
+/* Called after a variable is added */
+static void
+var_added(void)
+{
+	if (++vartab_cnt > vartab_mask)
+		vartab = grow_hashtab(vartab, &vartab_mask, var_key);
 }
 
 static int
@@ -2144,6 +2228,7 @@ initvar(void)
 		vpp = hashvar(vp->var_text);
 		vp->next = *vpp;
 		*vpp = vp;
+		var_added();
 	} while (++vp < end);
 }
 
@@ -2168,7 +2253,7 @@ lookupvar(const char *name)
 
 	v = *findvar(hashvar(name), name);
 	if (v) {
-#if ENABLE_ASH_RANDOM_SUPPORT
+#if VDYNAMIC
 	/*
 	 * Dynamic variables are implemented roughly the same way they are
 	 * in bash. Namely, they're "special" so long as they aren't unset.
@@ -2242,11 +2327,14 @@ setvareq(char *s, int flags)
 		vp->next = *vpp;
 		/*vp->func = NULL; - ckzalloc did it */
 		*vpp = vp;
+		vpp = NULL;
 	}
 	if (!(flags & (VTEXTFIXED|VSTACK|VNOSAVE)))
 		s = ckstrdup(s);
 	vp->var_text = s;
 	vp->flags = flags;
+	if (!vpp) /* new variable, now that it has a name */
+		var_added();
 }
 
 /*
@@ -2337,7 +2425,7 @@ unsetvar(const char *s)
 		retval = 1;
 		if (flags & VREADONLY)
 			goto out;
-#if ENABLE_ASH_RANDOM_SUPPORT
+#if VDYNAMIC
 		vp->flags &= ~VDYNAMIC;
 #endif
 		if (flags & VUNSET)
@@ -2348,6 +2436,7 @@ unsetvar(const char *s)
 				free((char*)vp->var_text);
 			*vpp = vp->next;
 			free(vp);
+			vartab_cnt--;
 			INT_ON;
 		} else {
 			setvar(s, 0, 0);
@@ -2400,7 +2489,7 @@ listvars(int on, int off, char ***end)
 				*ep++ = (char*)vp->var_text;
 			}
 		}
-	} while (++vpp < vartab + VTABSIZE);
+	} while (++vpp <= vartab + vartab_mask);
 	if (ep == stackstrend())
 		ep = growstackstr();
 	if (end)
@@ -3296,28 +3385,25 @@ struct alias {
 };
 
 
-static struct alias **atab; // [ATABSIZE];
+static struct alias **atab; // [atab_mask + 1];
+static unsigned atab_mask;
+static unsigned atab_cnt;
 #define INIT_G_alias() do { \
 	atab = xzalloc(ATABSIZE * sizeof(atab[0])); \
+	atab_mask = ATABSIZE - 1; \
 } while (0)
 
+static const char *
+alias_key(void *ap)
+{
+	return ((struct alias *)ap)->name;
+}
 
 static struct alias **
 __lookupalias(const char *name) {
-	unsigned int hashval;
 	struct alias **app;
-	const char *p;
-	unsigned int ch;
 
-	p = name;
-
-	ch = (unsigned char)*p;
-	hashval = ch << 4;
-	while (ch) {
-		hashval += ch;
-		ch = (unsigned char)*++p;
-	}
-	app = &atab[hashval % ATABSIZE];
+	app = &atab[hash_name(name) & atab_mask];
 
 	for (; *app; app = &(*app)->next) {
 		if (strcmp(name, (*app)->name) == 0) {
@@ -3352,6 +3438,7 @@ freealias(struct alias *ap)
 	free(ap->name);
 	free(ap->val);
 	free(ap);
+	atab_cnt--;
 	return next;
 }
 
@@ -3377,6 +3464,8 @@ setalias(const char *name, const char *val)
 		/*ap->flag = 0; - ckzalloc did it */
 		/*ap->next = NULL;*/
 		*app = ap;
+		if (++atab_cnt > atab_mask)
+			atab = grow_hashtab(atab, &atab_mask, alias_key);
 	}
 	INT_ON;
 }
@@ -3405,7 +3494,7 @@ rmaliases(void)
 	int i;
 
 	INT_OFF;
-	for (i = 0; i < ATABSIZE; i++) {
+	for (i = 0; i <= atab_mask; i++) {
 		app = &atab[i];
 		for (ap = *app; ap; ap = *app) {
 			*app = freealias(*app);
@@ -3436,7 +3525,7 @@ aliascmd(int argc UNUSED_PARAM, char **argv)
 	if (!argv[1]) {
 		int i;
 
-		for (i = 0; i < ATABSIZE; i++) {
+		for (i = 0; i <= atab_mask; i++) {
 			for (ap = atab[i]; ap; ap = ap->next) {
 				printalias(ap);
 			}
@@ -5821,7 +5910,7 @@ redirectsafe(union node *redir, int flags)
 static arith_t
 ash_arith(const char *s)
 {
-	arith_state_t math_state;
+	static arith_state_t math_state; /* static: has a cache */
 	arith_t result;
 
 	math_state.lookupvar = lookupvar;
@@ -5992,7 +6081,17 @@ rmescapes(char *str, int flag)
 	}
 	return r;
 }
-#define pmatch(a, b) !fnmatch((a), (b), 0)
+
+static int
+pmatch(const char *pattern, const char *string)
+{
+	int r;
+
+	INT_OFF; /* compiled patterns are malloced */
+	r = match_glob(pattern, string);
+	INT_ON;
+	return r;
+}
 
 /*
  * Prepare a pattern for a expmeta (internal glob(3)) call.
@@ -6172,6 +6271,9 @@ struct backcmd {                /* result of evalbackcmd */
 static uint8_t back_exitstatus; /* exit status of backquoted command */
 #define EV_EXIT 01              /* exit after evaluating tree */
 static void evaltree(union node *, int);
+#if NOFORK_BACKQ
+static int evalbackcmd_nofork(union node *, struct backcmd *);
+#endif
 
 #if ENABLE_PLATFORM_MINGW32
 static void
@@ -6204,6 +6306,10 @@ evalbackcmd(union node *n, struct backcmd *result)
 	result->jp = NULL;
 	if (n == NULL)
 		goto out;
+#if NOFORK_BACKQ
+	if (evalbackcmd_nofork(n, result))
+		goto out;
+#endif
 
 	saveherefd = herefd;
 	herefd = -1;
@@ -6517,106 +6623,46 @@ argstr(char *p, int flags, struct strlist *var_str_list)
  breakloop: ;
 }
 
+/*
+ * Match pattern against prefixes or suffixes of rmesc (see scan_and_match),
+ * return the position in startp where the match starts or ends.
+ */
 static char *
-scanleft(char *startp, char *rmesc, char *rmescend UNUSED_PARAM,
-		char *pattern, int quotes, int zero)
+scan_rmesc(char *startp, char *rmesc, char *pattern, int quotes, unsigned flags)
 {
-	char *loc, *loc2;
-	char c;
+	char *loc2;
+	int len;
 
-	loc = startp;
-	loc2 = rmesc;
-	do {
-		int match;
-		const char *s = loc2;
+	INT_OFF;
+	loc2 = scan_and_match(rmesc, pattern, flags);
+	INT_ON;
+	if (!loc2)
+		return NULL;
+	/* Skip as many chars in startp, it has CTLESCs if quotes */
+	for (len = loc2 - rmesc; len; len--) {
+		if (quotes && (unsigned char)*startp == CTLESC)
+			startp++;
+		startp++;
+	}
+	return startp;
+}
 
-		c = *loc2;
-		if (zero) {
-			*loc2 = '\0';
-			s = rmesc;
-		}
-		match = pmatch(pattern, s);
-
-		*loc2 = c;
-		if (match)
-			return loc;
-		if (quotes && (unsigned char)*loc == CTLESC)
-			loc++;
-		loc++;
-		loc2++;
-	} while (c);
-	return NULL;
+/* Shortest prefix if zero, else longest suffix */
+static char *
+scanleft(char *startp, char *rmesc, char *rmescend UNUSED_PARAM,
+		char *pattern, int quotes, int zero)
+{
+	return scan_rmesc(startp, rmesc, pattern, quotes,
+		SCAN_MOVE_FROM_LEFT + (zero ? SCAN_MATCH_LEFT_HALF : SCAN_MATCH_RIGHT_HALF));
 }
 
+/* Longest prefix if match_at_start, else shortest suffix */
 static char *
-scanright(char *startp, char *rmesc, char *rmescend,
+scanright(char *startp, char *rmesc, char *rmescend UNUSED_PARAM,
 		char *pattern, int quotes, int match_at_start)
 {
-#if !ENABLE_ASH_OPTIMIZE_FOR_SIZE
-	int try2optimize = match_at_start;
-#endif
-	int esc = 0;
-	char *loc;
-	char *loc2;
-
-	/* If we called by "${v/pattern/repl}" or "${v//pattern/repl}":
-	 * startp="escaped_value_of_v" rmesc="raw_value_of_v"
-	 * rmescend=""(ptr to NUL in rmesc) pattern="pattern" quotes=match_at_start=1
-	 * Logic:
-	 * loc starts at NUL at the end of startp, loc2 starts at the end of rmesc,
-	 * and on each iteration they go back two/one char until they reach the beginning.
-	 * We try to find a match in "raw_value_of_v", "raw_value_of_", "raw_value_of" etc.
-	 */
-	/* TODO: document in what other circumstances we are called. */
-
-	for (loc = pattern - 1, loc2 = rmescend; loc >= startp; loc2--) {
-		int match;
-		char c = *loc2;
-		const char *s = loc2;
-		if (match_at_start) {
-			*loc2 = '\0';
-			s = rmesc;
-		}
-		match = pmatch(pattern, s);
-		//bb_error_msg("pmatch(pattern:'%s',s:'%s'):%d", pattern, s, match);
-		*loc2 = c;
-		if (match)
-			return loc;
-#if !ENABLE_ASH_OPTIMIZE_FOR_SIZE
-		if (try2optimize) {
-			/* Maybe we can optimize this:
-			 * if pattern ends with unescaped *, we can avoid checking
-			 * shorter strings: if "foo*" doesnt match "raw_value_of_v",
-			 * it wont match truncated "raw_value_of_" strings too.
-			 */
-			unsigned plen = strlen(pattern);
-			/* Does it end with "*"? */
-			if (plen != 0 && pattern[--plen] == '*') {
-				/* "xxxx*" is not escaped */
-				/* "xxx\*" is escaped */
-				/* "xx\\*" is not escaped */
-				/* "x\\\*" is escaped */
-				int slashes = 0;
-				while (plen != 0 && pattern[--plen] == '\\')
-					slashes++;
-				if (!(slashes & 1))
-					break; /* ends with unescaped "*" */
-			}
-			try2optimize = 0;
-		}
-#endif
-		loc--;
-		if (quotes) {
-			if (--esc < 0) {
-				esc = esclen(startp, loc);
-			}
-			if (esc % 2) {
-				esc--;
-				loc--;
-			}
-		}
-	}
-	return NULL;
+	return scan_rmesc(startp, rmesc, pattern, quotes,
+		SCAN_MOVE_FROM_RIGHT + (match_at_start ? SCAN_MATCH_LEFT_HALF : SCAN_MATCH_RIGHT_HALF));
 }
 
 static void varunset(const char *, const char *, const char *, int) NORETURN;
@@ -7746,8 +7792,11 @@ struct tblentry {
 };
 
 static struct tblentry **cmdtable;
+static unsigned cmdtable_mask; /* number of buckets - 1 */
+static unsigned cmdtable_cnt;
 #define INIT_G_cmdtable() do { \
 	cmdtable = xzalloc(CMDTABLESIZE * sizeof(cmdtable[0])); \
+	cmdtable_mask = CMDTABLESIZE - 1; \
 } while (0)
 
 static int builtinloc = -1;     /* index in path of %builtin, or -1 */
@@ -7897,7 +7946,7 @@ clearcmdentry(int firstchange)
 	struct tblentry *cmdp;
 
 	INT_OFF;
-	for (tblp = cmdtable; tblp < &cmdtable[CMDTABLESIZE]; tblp++) {
+	for (tblp = cmdtable; tblp <= &cmdtable[cmdtable_mask]; tblp++) {
 		pp = tblp;
 		while ((cmdp = *pp) != NULL) {
 			if ((cmdp->cmdtype == CMDNORMAL &&
@@ -7907,6 +7956,7 @@ clearcmdentry(int firstchange)
 			) {
 				*pp = cmdp->next;
 				free(cmdp);
+				cmdtable_cnt--;
 			} else {
 				pp = &cmdp->next;
 			}
@@ -7926,20 +7976,22 @@ clearcmdentry(int firstchange)
  */
 static struct tblentry **lastcmdentry;
 
+static const char *
+cmd_key(void *cmdp)
+{
+	return ((struct tblentry *)cmdp)->cmdname;
+}
+
 static struct tblentry *
 cmdlookup(const char *name, int add)
 {
-	unsigned int hashval;
-	const char *p;
 	struct tblentry *cmdp;
 	struct tblentry **pp;
 
-	p = name;
-	hashval = (unsigned char)*p << 4;
-	while (*p)
-		hashval += (unsigned char)*p++;
-	hashval &= 0x7FFF;
-	pp = &cmdtable[hashval % CMDTABLESIZE];
+	/* Grow now, lastcmdentry must point into the table in use */
+	if (add && cmdtable_cnt >= cmdtable_mask)
+		cmdtable = grow_hashtab(cmdtable, &cmdtable_mask, cmd_key);
+	pp = &cmdtable[hash_name(name) & cmdtable_mask];
 	for (cmdp = *pp; cmdp; cmdp = cmdp->next) {
 		if (strcmp(cmdp->cmdname, name) == 0)
 			break;
@@ -7953,6 +8005,7 @@ cmdlookup(const char *name, int add)
 		/*cmdp->next = NULL; - ckzalloc did it */
 		cmdp->cmdtype = CMDUNKNOWN;
 		strcpy(cmdp->cmdname, name);
+		cmdtable_cnt++;
 	}
 	lastcmdentry = pp;
 	return cmdp;
@@ -7972,6 +8025,7 @@ delete_cmd_entry(void)
 	if (cmdp->cmdtype == CMDFUNCTION)
 		freefunc(cmdp->param.func);
 	free(cmdp);
+	cmdtable_cnt--;
 	INT_ON;
 }
 
@@ -8004,11 +8058,14 @@ hashcmd(int argc UNUSED_PARAM, char **argv UNUSED_PARAM)
 
 	if (nextopt("r") != '\0') {
 		clearcmdentry(0);
+#if ENABLE_FEATURE_EDITING
+		free_path_completion_cache(line_input_state);
+#endif
 		return 0;
 	}
 
 	if (*argptr == NULL) {
-		for (pp = cmdtable; pp < &cmdtable[CMDTABLESIZE]; pp++) {
+		for (pp = cmdtable; pp <= &cmdtable[cmdtable_mask]; pp++) {
 			for (cmdp = *pp; cmdp; cmdp = cmdp->next) {
 				if (cmdp->cmdtype == CMDNORMAL)
 					printentry(cmdp);
@@ -8044,7 +8101,7 @@ hashcd(void)
 	struct tblentry **pp;
 	struct tblentry *cmdp;
 
-	for (pp = cmdtable; pp < &cmdtable[CMDTABLESIZE]; pp++) {
+	for (pp = cmdtable; pp <= &cmdtable[cmdtable_mask]; pp++) {
 		for (cmdp = *pp; cmdp; cmdp = cmdp->next) {
 			if (cmdp->cmdtype == CMDNORMAL
 			 || (cmdp->cmdtype == CMDBUILTIN
@@ -9386,7 +9443,6 @@ static void
 mklocal(char *name)
 {
 	struct localvar *lvp;
-	struct var **vpp;
 	struct var *vp;
 
 	INT_OFF;
@@ -9399,15 +9455,15 @@ mklocal(char *name)
 	} else {
 		char *eq;
 
-		vpp = hashvar(name);
-		vp = *findvar(vpp, name);
+		vp = *findvar(hashvar(name), name);
 		eq = strchr(name, '=');
 		if (vp == NULL) {
 			if (eq)
 				setvareq(name, VSTRFIXED);
 			else
 				setvar(name, NULL, VSTRFIXED);
-			vp = *vpp;      /* the new variable */
+			/* the new variable (the table may have grown) */
+			vp = *findvar(hashvar(name), name);
 			lvp->flags = VUNSET;
 		} else {
 			lvp->text = vp->var_text;
@@ -9974,6 +10030,234 @@ goodname(const char *p)
 	return endofname(p)[0] == '\0';
 }
 
+#if NOFORK_BACKQ
+/*
+ * Can expanding this word change the state of the shell?
+ * ${v=word} and arithmetic can assign, ${v?word} can exit,
+ * and reading a dynamic variable like $RANDOM advances it.
+ */
+static int
+expansion_has_side_effects(const char *p)
+{
+	for (; *p; p++) {
+		unsigned char c = *p;
+
+		if (c == CTLESC) {
+			p++;
+			continue;
+		}
+		if (c == CTLARI)
+			return 1;
+		if (c == CTLVAR) {
+			int subtype = p[1] & VSTYPE;
+			if (subtype == VSASSIGN
+			 || subtype == VSQUESTION
+#if ENABLE_ASH_BASH_COMPAT
+			 || subtype == VSSUBSTR /* ${v:expr:expr} */
+#endif
+			) {
+				return 1;
+			}
+#if VDYNAMIC
+			{
+				struct var *v = *findvar(hashvar(p + 2), p + 2);
+				if (v && (v->flags & VDYNAMIC))
+					return 1;
+			}
+#endif
+		}
+	}
+	return 0;
+}
+
+/*
+ * $(cmd), where cmd is a single builtin which only produces output,
+ * or a NOFORK applet, runs in this shell with stdout redirected to
+ * a temporary file. This saves a fork per $(basename "$f") etc.
+ * Returns 0 if cmd has to run in a subshell after all.
+ */
+static int
+evalbackcmd_nofork(union node *n, struct backcmd *result)
+{
+	static const char pure_builtins[] ALIGN1 =
+		"echo\0""false\0""printf\0""pwd\0""test\0""true\0";
+	struct nodelist *saveargbackq;
+	struct ifsregion saveifs, *savelastp;
+	char *savedest;
+	struct arglist arglist;
+	struct cmdentry cmdentry;
+	union node *argp;
+	struct strlist *sp;
+	char **argv;
+	int argc;
+	int applet_no;
+	int save1, status, e;
+	int saveexitstatus;
+	smallint saveeflag;
+	off_t len;
+
+	if (n->type != NCMD || !n->ncmd.args
+	 || n->ncmd.assign || n->ncmd.redirect
+	 /* "unset variable" error must exit the subshell, not us */
+	 || uflag
+	 || !goodname(n->ncmd.args->narg.text)
+	) {
+		return 0;
+	}
+	for (argp = n->ncmd.args; argp; argp = argp->narg.next) {
+		if (expansion_has_side_effects(argp->narg.text))
+			return 0;
+	}
+
+	find_command(n->ncmd.args->narg.text, &cmdentry, 0, pathval());
+	applet_no = -1;
+	if (cmdentry.cmdtype == CMDBUILTIN) {
+		if (index_in_strings(pure_builtins, cmdentry.u.cmd->name + 1) < 0)
+			return 0;
+	} else if (cmdentry.cmdtype == CMDNORMAL) {
+		/* find_command() encodes applet_no as (-2 - applet_no) */
+		applet_no = (- cmdentry.u.index - 2);
+		if (applet_no < 0 || !APPLET_IS_NOFORK(applet_no))
+			return 0;
+	} else {
+		return 0;
+	}
+
+	if (backq_fd_pid != getpid()) {
+		/* Not created yet, or inherited from the parent shell:
+		 * sharing the file offset with it will not work */
+		char *name;
+		const char *tmpdir = getenv("TMPDIR");
+		int fd;
+
+		/* On Windows it is not inherited at all, see below */
+		if (backq_fd_pid && !ENABLE_PLATFORM_MINGW32)
+			close(backq_fd);
+		backq_fd_pid = 0;
+#if ENABLE_PLATFORM_MINGW32
+		if (!tmpdir)
+			tmpdir = getenv("TEMP");
+#endif
+		name = xasprintf("%s/ash.XXXXXX", tmpdir ? tmpdir : "/tmp");
+#if ENABLE_PLATFORM_MINGW32
+		/* Open files can't be unlinked, have it deleted on close.
+		 * fcntl(F_SETFD) does nothing here, and a dup() of a
+		 * O_NOINHERIT fd is inheritable again. So keep fds
+		 * below 10 busy, and open it right where it stays */
+		backq_fd = -1;
+		if (mktemp(name)) {
+			char busy[10];
+			int i;
+
+			memset(busy, 0, sizeof(busy));
+			while ((fd = open("/dev/null", O_RDONLY | O_NOINHERIT)) >= 0 && fd < 10)
+				busy[fd] = 1;
+			if (fd >= 0)
+				close(fd);
+			backq_fd = open(name, O_RDWR | O_CREAT | O_EXCL | O_TEMPORARY | O_NOINHERIT, 0600);
+			for (i = 0; i < 10; i++)
+				if (busy[i])
+					close(i);
+		}
+		free(name);
+		if (backq_fd < 0)
+			return 0;
+#else
+		fd = mkstemp(name);
+		if (fd >= 0)
+			unlink(name);
+		free(name);
+		if (fd < 0)
+			return 0;
+		backq_fd = copyfd(fd, 10);
+		close(fd);
+		if (backq_fd < 0)
+			return 0;
+		close_on_exec_on(backq_fd);
+#endif
+		backq_fd_pid = getpid();
+	}
+
+	/* We are in the middle of expanding a word, save its state */
+	saveargbackq = argbackq;
+	saveifs = ifsfirst;
+	savelastp = ifslastp;
+	savedest = expdest;
+
+	arglist.lastp = &arglist.list;
+	for (argp = n->ncmd.args; argp; argp = argp->narg.next)
+		expandarg(argp, &arglist, EXP_FULL | EXP_TILDE);
+	*arglist.lastp = NULL;
+
+	argbackq = saveargbackq;
+	ifsfirst = saveifs;
+	ifslastp = savelastp;
+	expdest = savedest;
+
+	argc = 0;
+	for (sp = arglist.list; sp; sp = sp->next)
+		argc++;
+	argv = stalloc(sizeof(char *) * (argc + 1));
+	argc = 0;
+	for (sp = arglist.list; sp; sp = sp->next)
+		argv[argc++] = sp->text;
+	argv[argc] = NULL;
+
+	flush_stdout_stderr();
+	/* Output goes to the start of the file; whatever is left
+	 * past its end from an earlier $(cmd) is not read */
+	lseek(backq_fd, 0, SEEK_SET);
+	save1 = dup(1); /* fails if stdout is closed */
+	if (save1 >= 0 && save1 < 10) {
+		/* move it out of the way of the user's fds */
+		int fd = copyfd(save1, 10);
+		if (fd >= 0) {
+			close(save1);
+			save1 = fd;
+		}
+	}
+	dup2(backq_fd, 1);
+
+	/* In a subshell, these would be left alone */
+	saveexitstatus = exitstatus;
+	saveeflag = eflag;
+	eflag = 0;
+	e = 0;
+	if (applet_no >= 0) {
+		status = run_nofork_applet(applet_no, argv);
+	} else {
+		e = evalbltin(cmdentry.u.cmd, argc, argv);
+		status = exitstatus;
+		if (e)
+			status = (exception_type == EXINT) ? 128 + SIGINT : 2;
+	}
+	flush_stdout_stderr();
+	eflag = saveeflag;
+	exitstatus = saveexitstatus;
+
+	if (save1 >= 0) {
+		dup2(save1, 1);
+		close(save1);
+	} else {
+		close(1);
+	}
+	if (e && exception_type == EXINT)
+		longjmp(exception_handler->loc, 1);
+
+	len = lseek(backq_fd, 0, SEEK_CUR);
+	if (len > 0) {
+		result->buf = xmalloc(len);
+		lseek(backq_fd, 0, SEEK_SET);
+		result->nleft = full_read(backq_fd, result->buf, len);
+		if (result->nleft < 0)
+			result->nleft = 0;
+	}
+	back_exitstatus = status;
+	TRACE(("evalbackcmd_nofork: status %d, %d bytes\n", status, result->nleft));
+	return 1;
+}
+#endif
+
 
 /*
  * Search for a command.  This is called before we fork so that the
@@ -14035,23 +14319,23 @@ tblentry_copy(struct tblentry *tep)
 }
 
 static void
-cmdtable_size(struct tblentry **cmdtablep)
+cmdtable_size(struct tblentry **cmdtablep, unsigned size)
 {
 	int i;
-	nodeptrsize += CMDTABLESIZE;
-	funcblocksize += sizeof(struct tblentry *)*CMDTABLESIZE;
-	for (i = 0; i < CMDTABLESIZE; i++)
+	nodeptrsize += size;
+	funcblocksize += sizeof(struct tblentry *)*size;
+	for (i = 0; i < size; i++)
 		tblentry_size(cmdtablep[i]);
 }
 
 static struct tblentry **
-cmdtable_copy(struct tblentry **cmdtablep)
+cmdtable_copy(struct tblentry **cmdtablep, unsigned size)
 {
 	struct tblentry **new = funcblock;
 	int i;
 
-	funcblock = (char *) funcblock + sizeof(struct tblentry *)*CMDTABLESIZE;
-	for (i = 0; i < CMDTABLESIZE; i++) {
+	funcblock = (char *) funcblock + sizeof(struct tblentry *)*size;
+	for (i = 0; i < size; i++) {
 		new[i] = tblentry_copy(cmdtablep[i]);
 		SAVE_PTR(new[i]);
 	}
@@ -14129,6 +14413,8 @@ redirtab_copy(struct redirtab *rdtp)
 #undef redirlist
 #undef varinit
 #undef vartab
+#undef vartab_mask
+#undef vartab_cnt
 static void
 globals_var_size(struct globals_var *gvp)
 {
@@ -14137,11 +14423,13 @@ globals_var_size(struct globals_var *gvp)
 	funcblocksize += sizeof(struct globals_var);
 	argv_size(gvp->shellparam.p);
 	redirtab_size(gvp->redirlist);
-	for (i = 0; i < VTABSIZE; i++)
+	funcblocksize += sizeof(struct var *) * (gvp->vartab_mask + 1);
+	for (i = 0; i <= gvp->vartab_mask; i++)
 		var_size(gvp->vartab[i]);
 	for (i = 0; i < ARRAY_SIZE(varinit_data); i++)
 		var_size(gvp->varinit+i);
-	nodeptrsize += 2 + VTABSIZE; /* gvp->redirlist, gvp->shellparam.p, vartab  */
+	/* gvp->redirlist, gvp->shellparam.p, gvp->vartab, vartab[] */
+	nodeptrsize += 3 + gvp->vartab_mask + 1;
 }
 
 #undef g_nullredirs
@@ -14166,7 +14454,12 @@ globals_var_copy(struct globals_var *gvp)
 
 	new->g_nullredirs = gvp->g_nullredirs;
 	new->preverrout_fd = gvp->preverrout_fd;
-	for (i = 0; i < VTABSIZE; i++) {
+	new->vartab_mask = gvp->vartab_mask;
+	new->vartab_cnt = gvp->vartab_cnt;
+	new->vartab = funcblock;
+	funcblock = (char *) funcblock + sizeof(struct var *) * (gvp->vartab_mask + 1);
+	SAVE_PTR(new->vartab);
+	for (i = 0; i <= gvp->vartab_mask; i++) {
 		new->vartab[i] = var_copy(gvp->vartab[i]);
 		SAVE_PTR(new->vartab[i]);
 	}
@@ -14222,7 +14515,7 @@ forkshell_size(struct forkshell *fs)
 	funcblocksize += sizeof(struct forkshell);
 	globals_var_size(fs->gvp);
 	globals_misc_size(fs->gmp);
-	cmdtable_size(fs->cmdtable);
+	cmdtable_size(fs->cmdtable, fs->cmdtable_mask + 1);
 	localvar_size(fs->localvars);
 	/* optlist_transfer(sending, fd); */
 	/* misc_transfer(sending, fd); */
@@ -14246,7 +14539,7 @@ forkshell_copy(struct forkshell *fs)
 	memcpy(new, fs, sizeof(struct forkshell)); /* non-pointer stuff */
 	new->gvp = globals_var_copy(fs->gvp);
 	new->gmp = globals_misc_copy(fs->gmp);
-	new->cmdtable = cmdtable_copy(fs->cmdtable);
+	new->cmdtable = cmdtable_copy(fs->cmdtable, fs->cmdtable_mask + 1);
 	new->localvars = localvar_copy(fs->localvars);
 	SAVE_PTR4(new->gvp, new->gmp, new->cmdtable, new->localvars);
 
@@ -14278,6 +14571,8 @@ forkshell_prepare(struct forkshell *fs)
 	fs->gvp = ash_ptr_to_globals_var;
 	fs->gmp = ash_ptr_to_globals_misc;
 	fs->cmdtable = cmdtable;
+	fs->cmdtable_mask = cmdtable_mask;
+	fs->cmdtable_cnt = cmdtable_cnt;
 	fs->localvars = localvars;
 
 	nodeptrsize = 1;	/* NULL terminated */
@@ -14348,7 +14643,7 @@ forkshell_init(const char *idstr)
 	fs->fp = forkpoints[fs->fpid];
 	for (i = 0; i < ARRAY_SIZE(varinit_data); i++)
 		fs->gvp->varinit[i].var_func = varinit_data[i].var_func;
-	for (i = 0; i < CMDTABLESIZE; i++) {
+	for (i = 0; i <= fs->cmdtable_mask; i++) {
 		struct tblentry *e = fs->cmdtable[i];
 		while (e) {
 			if (e->cmdtype == CMDBUILTIN)
@@ -14368,6 +14663,8 @@ forkshell_init(const char *idstr)
 	*gmpp = fs->gmp;
 	localvars = fs->localvars;
 	cmdtable = fs->cmdtable;
+	cmdtable_mask = fs->cmdtable_mask;
+	cmdtable_cnt = fs->cmdtable_cnt;
 
 	fs->fp(fs);
 }
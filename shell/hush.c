@@ -639,6 +639,8 @@ struct parse_context {
 #define setenv(...) setenv_is_leaky_dont_use()
 struct variable {
 	struct variable *next;
+	struct variable **pprev; /* &previous->next, or &G.top_var */
+	struct variable *hash_next; /* next in G.var_hash[] bucket */
 	char *varstr;        /* points to "name=" portion */
 #if ENABLE_HUSH_LOCAL
 	unsigned func_nest_level;
@@ -746,6 +748,9 @@ struct globals {
 #if ENABLE_HUSH_RANDOM_SUPPORT
 	random_t random_gen;
 #endif
+#if ENABLE_SH_MATH_SUPPORT
+	arith_state_t math_state; /* kept: it caches compiled expressions */
+#endif
 #if ENABLE_HUSH_JOB
 	int run_list_level;
 	int last_jobid;
@@ -790,6 +795,11 @@ struct globals {
 	const char *ifs;
 	const char *cwd;
 	struct variable *top_var;
+	struct variable **top_var_tail; /* &last->next, or &G.top_var */
+	/* Index of top_var by name, 2^N buckets */
+	struct variable **var_hash;
+	unsigned var_hash_mask;
+	unsigned var_cnt;
 	char **expanded_assignments;
 #if ENABLE_HUSH_FUNCTIONS
 	struct function *top_func;
@@ -1567,6 +1577,7 @@ static void hush_exit(int exitcode)
 			cur_var = cur_var->next;
 			free(tmp);
 		}
+		free(G.var_hash);
 	}
 #endif
 
@@ -1679,23 +1690,103 @@ static const char *get_cwd(int force)
 /*
  * Shell and environment variable support
  */
-static struct variable **get_ptr_to_local_var(const char *name, unsigned len)
+
+/* Variables are kept in the G.top_var list in order of creation,
+ * and indexed by name in the G.var_hash table.
+ * Always use link_var/unlink_var to add/remove them. */
+static unsigned hash_var_name(const char *name, unsigned len)
+{
+	/* FNV-1a */
+	unsigned hashval = 2166136261U;
+
+	while (len--)
+		hashval = (hashval ^ (unsigned char) *name++) * 16777619;
+	return hashval;
+}
+
+static struct variable **var_hash_bucket(const char *varstr)
+{
+	unsigned len = strchr(varstr, '=') - varstr;
+
+	return &G.var_hash[hash_var_name(varstr, len) & G.var_hash_mask];
+}
+
+static void var_hash_grow(void)
+{
+	struct variable **old = G.var_hash;
+	unsigned oldsize = old ? G.var_hash_mask + 1 : 0;
+	unsigned i;
+
+	G.var_hash_mask = oldsize ? 2 * oldsize - 1 : 63;
+	G.var_hash = xzalloc((G.var_hash_mask + 1) * sizeof(G.var_hash[0]));
+	for (i = 0; i < oldsize; i++) {
+		struct variable *cur, *next;
+
+		for (cur = old[i]; cur; cur = next) {
+			struct variable **bucket = var_hash_bucket(cur->varstr);
+
+			next = cur->hash_next;
+			cur->hash_next = *bucket;
+			*bucket = cur;
+		}
+	}
+	free(old);
+}
+
+/* Append var to the list. var->varstr must be set */
+static void link_var(struct variable *var)
+{
+	struct variable **bucket;
+
+	var->next = NULL;
+	var->pprev = G.top_var_tail;
+	*G.top_var_tail = var;
+	G.top_var_tail = &var->next;
+
+	if (!G.var_hash || G.var_cnt > G.var_hash_mask)
+		var_hash_grow();
+	G.var_cnt++;
+	bucket = var_hash_bucket(var->varstr);
+	var->hash_next = *bucket;
+	*bucket = var;
+}
+
+/* Remove var from the list. It is not freed */
+static void unlink_var(struct variable *var)
 {
 	struct variable **pp;
+
+	*var->pprev = var->next;
+	if (var->next)
+		var->next->pprev = var->pprev;
+	else
+		G.top_var_tail = var->pprev;
+
+	pp = var_hash_bucket(var->varstr);
+	while (*pp != var)
+		pp = &(*pp)->hash_next;
+	*pp = var->hash_next;
+	G.var_cnt--;
+}
+
+static struct variable *get_local_var(const char *name, unsigned len)
+{
 	struct variable *cur;
 
-	pp = &G.top_var;
-	while ((cur = *pp) != NULL) {
+	if (!G.var_hash)
+		return NULL;
+	cur = G.var_hash[hash_var_name(name, len) & G.var_hash_mask];
+	while (cur) {
 		if (strncmp(cur->varstr, name, len) == 0 && cur->varstr[len] == '=')
-			return pp;
-		pp = &cur->next;
+			return cur;
+		cur = cur->hash_next;
 	}
 	return NULL;
 }
 
 static const char* FAST_FUNC get_local_var_value(const char *name)
 {
-	struct variable **vpp;
+	struct variable *var;
 	unsigned len = strlen(name);
 
 	if (G.expanded_assignments) {
@@ -1708,9 +1799,9 @@ static const char* FAST_FUNC get_local_var_value(const char *name)
 		}
 	}
 
-	vpp = get_ptr_to_local_var(name, len);
-	if (vpp)
-		return (*vpp)->varstr + len + 1;
+	var = get_local_var(name, len);
+	if (var)
+		return var->varstr + len + 1;
 
 	if (strcmp(name, "PPID") == 0)
 		return utoa(G.root_ppid);
@@ -1745,7 +1836,6 @@ static const char* FAST_FUNC get_local_var_value(const char *name)
 #endif
 static int set_local_var(char *str, int flg_export, int local_lvl, int flg_read_only)
 {
-	struct variable **var_pp;
 	struct variable *cur;
 	char *eq_sign;
 	int name_len;
@@ -1757,12 +1847,8 @@ static int set_local_var(char *str, int flg_export, int local_lvl, int flg_read_
 	}
 
 	name_len = eq_sign - str + 1; /* including '=' */
-	var_pp = &G.top_var;
-	while ((cur = *var_pp) != NULL) {
-		if (strncmp(cur->varstr, str, name_len) != 0) {
-			var_pp = &cur->next;
-			continue;
-		}
+	cur = get_local_var(str, name_len - 1);
+	if (cur) {
 		/* We found an existing var with this name */
 		if (cur->flg_read_only) {
 #if !BB_MMU
@@ -1784,7 +1870,7 @@ static int set_local_var(char *str, int flg_export, int local_lvl, int flg_read_
 			 * and existing one is global, or local
 			 * from enclosing function.
 			 * Remove and save old one: */
-			*var_pp = cur->next;
+			unlink_var(cur);
 			cur->next = *G.shadowed_vars_pp;
 			*G.shadowed_vars_pp = cur;
 			/* bash 3.2.33(1) and exported vars:
@@ -1797,7 +1883,7 @@ static int set_local_var(char *str, int flg_export, int local_lvl, int flg_read_
 			 */
 			if (cur->flg_export)
 				flg_export = 1;
-			break;
+			goto new_var;
 		}
 #endif
 		if (strcmp(cur->varstr + name_len, eq_sign + 1) == 0) {
@@ -1821,12 +1907,15 @@ static int set_local_var(char *str, int flg_export, int local_lvl, int flg_read_
 	}
 
 	/* Not found - create new variable struct */
+#if ENABLE_HUSH_LOCAL
+ new_var:
+#endif
 	cur = xzalloc(sizeof(*cur));
 #if ENABLE_HUSH_LOCAL
 	cur->func_nest_level = local_lvl;
 #endif
-	cur->next = *var_pp;
-	*var_pp = cur;
+	cur->varstr = str; /* link_var hashes it */
+	link_var(cur);
 
  set_str_and_exp:
 	cur->varstr = str;
@@ -1860,28 +1949,23 @@ static void set_pwd_var(int exp)
 static int unset_local_var_len(const char *name, int name_len)
 {
 	struct variable *cur;
-	struct variable **var_pp;
 
 	if (!name)
 		return EXIT_SUCCESS;
-	var_pp = &G.top_var;
-	while ((cur = *var_pp) != NULL) {
-		if (strncmp(cur->varstr, name, name_len) == 0 && cur->varstr[name_len] == '=') {
-			if (cur->flg_read_only) {
-				bb_error_msg("%s: readonly variable", name);
-				return EXIT_FAILURE;
-			}
-			*var_pp = cur->next;
-			debug_printf_env("%s: unsetenv '%s'\n", __func__, cur->varstr);
-			bb_unsetenv(cur->varstr);
-			if (name_len == 3 && cur->varstr[0] == 'P' && cur->varstr[1] == 'S')
-				cmdedit_update_prompt();
-			if (!cur->max_len)
-				free(cur->varstr);
-			free(cur);
-			return EXIT_SUCCESS;
+	cur = get_local_var(name, name_len);
+	if (cur) {
+		if (cur->flg_read_only) {
+			bb_error_msg("%s: readonly variable", name);
+			return EXIT_FAILURE;
 		}
-		var_pp = &cur->next;
+		unlink_var(cur);
+		debug_printf_env("%s: unsetenv '%s'\n", __func__, cur->varstr);
+		bb_unsetenv(cur->varstr);
+		if (name_len == 3 && cur->varstr[0] == 'P' && cur->varstr[1] == 'S')
+			cmdedit_update_prompt();
+		if (!cur->max_len)
+			free(cur->varstr);
+		free(cur);
 	}
 	return EXIT_SUCCESS;
 }
@@ -1922,8 +2006,7 @@ static void add_vars(struct variable *var)
 
 	while (var) {
 		next = var->next;
-		var->next = G.top_var;
-		G.top_var = var;
+		link_var(var);
 		if (var->flg_export) {
 			debug_printf_env("%s: restoring exported '%s'\n", __func__, var->varstr);
 			putenv(var->varstr);
@@ -1944,17 +2027,15 @@ static struct variable *set_vars_and_save_old(char **strings)
 	s = strings;
 	while (*s) {
 		struct variable *var_p;
-		struct variable **var_pp;
 		char *eq;
 
 		eq = strchr(*s, '=');
 		if (eq) {
-			var_pp = get_ptr_to_local_var(*s, eq - *s);
-			if (var_pp) {
+			var_p = get_local_var(*s, eq - *s);
+			if (var_p) {
 				/* Remove variable from global linked list */
-				var_p = *var_pp;
 				debug_printf_env("%s: removing '%s'\n", __func__, var_p->varstr);
-				*var_pp = var_p->next;
+				unlink_var(var_p);
 				/* Add it to returned list */
 				var_p->next = old;
 				old = var_p;
@@ -4858,20 +4939,20 @@ static char *encode_then_expand_string(const char *str, int process_bkslash, int
 #if ENABLE_SH_MATH_SUPPORT
 static arith_t expand_and_evaluate_arith(const char *arg, const char **errmsg_p)
 {
-	arith_state_t math_state;
+	arith_state_t *const math_state = &G.math_state;
 	arith_t res;
 	char *exp_str;
 
-	math_state.lookupvar = get_local_var_value;
-	math_state.setvar = set_local_var_from_halves;
-	//math_state.endofname = endofname;
+	math_state->lookupvar = get_local_var_value;
+	math_state->setvar = set_local_var_from_halves;
+	//math_state->endofname = endofname;
 	exp_str = encode_then_expand_string(arg, /*process_bkslash:*/ 1, /*unbackslash:*/ 1);
-	res = arith(&math_state, exp_str ? exp_str : arg);
+	res = arith(math_state, exp_str ? exp_str : arg);
 	free(exp_str);
 	if (errmsg_p)
-		*errmsg_p = math_state.errmsg;
-	if (math_state.errmsg)
-		die_if_script(math_state.errmsg);
+		*errmsg_p = math_state->errmsg;
+	if (math_state->errmsg)
+		die_if_script(math_state->errmsg);
 	return res;
 }
 #endif
@@ -6301,19 +6382,17 @@ static int run_function(const struct function *funcp, char **argv)
 # if ENABLE_HUSH_LOCAL
 	{
 		struct variable *var;
-		struct variable **var_pp;
+		struct variable *next;
 
-		var_pp = &G.top_var;
-		while ((var = *var_pp) != NULL) {
-			if (var->func_nest_level < G.func_nest_level) {
-				var_pp = &var->next;
+		for (var = G.top_var; var; var = next) {
+			next = var->next;
+			if (var->func_nest_level < G.func_nest_level)
 				continue;
-			}
 			/* Unexport */
 			if (var->flg_export)
 				bb_unsetenv(var->varstr);
 			/* Remove from global list */
-			*var_pp = var->next;
+			unlink_var(var);
 			/* Free */
 			if (!var->max_len)
 				free(var->varstr);
@@ -7439,7 +7518,7 @@ static int run_list(struct pipe *pi)
 			while (*argv) {
 				char *pattern = expand_string_to_string(*argv, /*unbackslash:*/ 1);
 				/* TODO: which FNM_xxx flags to use? */
-				cond_code = (fnmatch(pattern, case_word, /*flags:*/ 0) != 0);
+				cond_code = !match_glob(pattern, case_word);
 				free(pattern);
 				if (cond_code == 0) { /* match! we will execute this branch */
 					free(case_word); /* make future "word)" stop */
@@ -7758,17 +7837,17 @@ int hush_main(int argc, char **argv)
 	 * currently living in the environment */
 	debug_printf_env("unsetenv '%s'\n", "HUSH_VERSION");
 	unsetenv("HUSH_VERSION"); /* in case it exists in initial env */
-	G.top_var = shell_ver;
-	cur_var = G.top_var;
+	G.top_var_tail = &G.top_var;
+	link_var(shell_ver);
 	e = environ;
 	if (e) while (*e) {
 		char *value = strchr(*e, '=');
 		if (value) { /* paranoia */
-			cur_var->next = xzalloc(sizeof(*cur_var));
-			cur_var = cur_var->next;
+			cur_var = xzalloc(sizeof(*cur_var));
 			cur_var->varstr = *e;
 			cur_var->max_len = strlen(*e);
 			cur_var->flg_export = 1;
+			link_var(cur_var);
 		}
 		e++;
 	}
@@ -8328,10 +8407,9 @@ static void helper_export_local(char **argv, int exp, int lvl)
 		/* So far we do not check that name is valid (TODO?) */
 
 		if (*name_end == '\0') {
-			struct variable *var, **vpp;
+			struct variable *var;
 
-			vpp = get_ptr_to_local_var(name, name_end - name);
-			var = vpp ? *vpp : NULL;
+			var = get_local_var(name, name_end - name);
 
 			if (exp == -1) { /* unexporting? */
 				/* export -n NAME (without =VALUE) */
@@ -13,7 +13,9 @@
  * was re-ported from NetBSD and debianized.
  */
 #ifdef STANDALONE
+# include <ctype.h>
 # include <stdbool.h>
+# include <stdint.h>
 # include <stdio.h>
 # include <stdlib.h>
 # include <string.h>
@@ -21,13 +23,249 @@
 # define FAST_FUNC /* nothing */
 # define PUSH_AND_SET_FUNCTION_VISIBILITY_TO_HIDDEN /* nothing */
 # define POP_SAVED_FUNCTION_VISIBILITY /* nothing */
+# define ALIGN1 /* nothing */
+# define xzalloc(size) calloc(1, (size))
+# define xstrdup(s) strdup(s)
 #else
 # include "libbb.h"
 #endif
 #include <fnmatch.h>
 #include "match.h"
 
-char* FAST_FUNC scan_and_match(char *string, const char *pattern, unsigned flags)
+/* Compiled patterns.
+ *
+ * A pattern is compiled into a sequence of up to 63 elements,
+ * each being either "*" or a set of chars which match one char.
+ * It is run as a bit-parallel NFA: bit i of the state is set if
+ * the first i elements matched the text seen so far (or, when
+ * running backwards, the last n-i elements).
+ * This finds all matching prefixes or suffixes in one pass.
+ *
+ * Only plain ASCII is handled. Patterns with [=x=], [.x.],
+ * unterminated [ or trailing \, or strings with chars >= 0x80
+ * (which may be multibyte) fall back to fnmatch.
+ */
+#define MAX_ELEMS 63
+#define CACHE_SIZE 8
+
+struct glob_prog {
+	char *pattern; /* the cache key */
+	int nelem;     /* < 0: not compilable */
+	uint64_t star; /* bit i: element i is "*" */
+	uint64_t chars[128]; /* bit i: element i matches this char */
+};
+
+static struct glob_prog *cache[CACHE_SIZE];
+static unsigned cache_next;
+
+static const char char_classes[] ALIGN1 =
+	"alnum\0""alpha\0""blank\0""cntrl\0""digit\0""graph\0"
+	"lower\0""print\0""punct\0""space\0""upper\0""xdigit\0";
+
+static int in_class(int idx, int c)
+{
+	switch (idx) {
+	case 0: return isalnum(c);
+	case 1: return isalpha(c);
+	case 2: return c == ' ' || c == '\t';
+	case 3: return iscntrl(c);
+	case 4: return isdigit(c);
+	case 5: return c > ' ' && c < 0x7f; /* graph */
+	case 6: return islower(c);
+	case 7: return c >= ' ' && c < 0x7f; /* print */
+	case 8: return ispunct(c);
+	case 9: return isspace(c);
+	case 10: return isupper(c);
+	}
+	return isxdigit(c);
+}
+
+/* Parse [...] at p (points after '['), set bit in prog->chars.
+ * Returns ptr past ']', or NULL if we can't handle it */
+static const char *compile_bracket(struct glob_prog *prog, const char *p, uint64_t bit)
+{
+	uint8_t set[128];
+	int negate = 0;
+	int c;
+
+	memset(set, 0, sizeof(set));
+	if (*p == '!' || *p == '^') {
+		negate = 1;
+		p++;
+	}
+	c = (unsigned char)*p++;
+	do {
+		int hi;
+
+		if (c == '\0' || c >= 0x80)
+			return NULL;
+		if (c == '[' && *p == ':') {
+			const char *end = strstr(p + 1, ":]");
+			const char *name = char_classes;
+			int idx = 0;
+
+			if (!end)
+				return NULL;
+			while (strncmp(name, p + 1, end - p - 1) != 0 || name[end - p - 1] != '\0') {
+				name += strlen(name) + 1;
+				if (!*name)
+					return NULL;
+				idx++;
+			}
+			for (c = 1; c < 128; c++)
+				if (in_class(idx, c))
+					set[c] = 1;
+			p = end + 2;
+			continue;
+		}
+		if (c == '[' && (*p == '=' || *p == '.'))
+			return NULL;
+		if (c == '\\') {
+			c = (unsigned char)*p++;
+			if (c == '\0' || c >= 0x80)
+				return NULL;
+		}
+		hi = c;
+		if (p[0] == '-' && p[1] != ']') {
+			hi = (unsigned char)p[1];
+			p += 2;
+			if (hi == '\\')
+				hi = (unsigned char)*p++;
+			if (hi == '\0' || hi >= 0x80 || hi == '[')
+				return NULL;
+		}
+		while (c <= hi)
+			set[c++] = 1;
+	} while ((c = (unsigned char)*p++) != ']');
+
+	for (c = 1; c < 128; c++)
+		if (set[c] ^ negate)
+			prog->chars[c] |= bit;
+	return p;
+}
+
+static void compile(struct glob_prog *prog, const char *p)
+{
+	int n = 0;
+
+	for (;;) {
+		uint64_t bit = (uint64_t)1 << n;
+		int c = (unsigned char)*p++;
+
+		if (c == '\0')
+			break;
+		if (n == MAX_ELEMS || c >= 0x80)
+			goto fail;
+		if (c == '*') {
+			/* "**" is the same as "*" */
+			if (prog->star & (bit >> 1))
+				continue;
+			prog->star |= bit;
+		} else if (c == '?') {
+			for (c = 1; c < 128; c++)
+				prog->chars[c] |= bit;
+		} else if (c == '[') {
+			p = compile_bracket(prog, p, bit);
+			if (!p)
+				goto fail;
+		} else {
+			if (c == '\\') {
+				c = (unsigned char)*p++;
+				if (c == '\0' || c >= 0x80)
+					goto fail;
+			}
+			prog->chars[c] |= bit;
+		}
+		n++;
+	}
+	prog->nelem = n;
+	return;
+ fail:
+	prog->nelem = -1;
+}
+
+static struct glob_prog *get_prog(const char *pattern)
+{
+	struct glob_prog *prog;
+	int i;
+
+	for (i = 0; i < CACHE_SIZE; i++) {
+		prog = cache[i];
+		if (prog && strcmp(prog->pattern, pattern) == 0)
+			goto ret;
+	}
+	prog = cache[cache_next];
+	if (prog)
+		free(prog->pattern);
+	else
+		prog = cache[cache_next] = xzalloc(sizeof(*prog));
+	memset(prog, 0, sizeof(*prog));
+	prog->pattern = xstrdup(pattern);
+	compile(prog, pattern);
+	cache_next = (cache_next + 1) % CACHE_SIZE;
+ ret:
+	return prog->nelem >= 0 ? prog : NULL;
+}
+
+/* Run prog over string[0..len) forwards (or backwards from the end).
+ * Returns length of the shortest (or the longest) matching prefix
+ * (or suffix), -1 if none, -2 if string has chars we can't handle */
+static int run_prog(const struct glob_prog *prog, const char *string, int len,
+		int backwards, int longest)
+{
+	uint64_t end = (uint64_t)1 << prog->nelem;
+	uint64_t star = prog->star;
+	uint64_t state, accept;
+	int found = -1;
+	int i;
+
+	if (backwards) {
+		state = end;
+		state |= (state >> 1) & star;
+		accept = 1;
+	} else {
+		state = 1;
+		state |= (state & star) << 1;
+		accept = end;
+	}
+	for (i = 0; ; i++) {
+		int c;
+
+		if (state & accept) {
+			found = i;
+			if (!longest)
+				break;
+		}
+		if (i == len || !state)
+			break;
+		c = (unsigned char)string[backwards ? len - 1 - i : i];
+		if (c >= 0x80)
+			return -2;
+		if (backwards) {
+			state = ((state >> 1) & prog->chars[c]) | (state & (star << 1));
+			state |= (state >> 1) & star;
+		} else {
+			state = ((state & prog->chars[c]) << 1) | (state & star);
+			state |= (state & star) << 1;
+		}
+	}
+	return found;
+}
+
+int FAST_FUNC match_glob(const char *pattern, const char *string)
+{
+	const struct glob_prog *prog = get_prog(pattern);
+
+	if (prog) {
+		int len = strlen(string);
+		int r = run_prog(prog, string, len, /*backwards:*/ 0, /*longest:*/ 1);
+		if (r != -2)
+			return r == len;
+	}
+	return fnmatch(pattern, string, 0) == 0;
+}
+
+static char *scan_and_fnmatch(char *string, const char *pattern, unsigned flags)
 {
 	char *loc;
 	char *end;
@@ -93,6 +331,26 @@ char* FAST_FUNC scan_and_match(char *string, const char *pattern, unsigned flags
 	return NULL;
 }
 
+char* FAST_FUNC scan_and_match(char *string, const char *pattern, unsigned flags)
+{
+	const struct glob_prog *prog = get_prog(pattern);
+
+	if (prog) {
+		int len = strlen(string);
+		int backwards = (flags & SCAN_MATCH_RIGHT_HALF);
+		/* ${v##pat} and ${v%%pat} want the longest match,
+		 * the latter is found by moving from the left */
+		int longest = backwards ? (flags & SCAN_MOVE_FROM_LEFT) : (flags & SCAN_MOVE_FROM_RIGHT);
+		int r = run_prog(prog, string, len, backwards, longest);
+
+		if (r == -1)
+			return NULL;
+		if (r >= 0)
+			return backwards ? string + len - r : string + r;
+	}
+	return scan_and_fnmatch(string, pattern, flags);
+}
+
 #ifdef STANDALONE
 int main(int argc, char *argv[])
 {
@@ -5,8 +5,6 @@
 
 PUSH_AND_SET_FUNCTION_VISIBILITY_TO_HIDDEN
 
-//TODO! Why ash.c still uses internal version?!
-
 enum {
 	SCAN_MOVE_FROM_LEFT = (1 << 0),
 	SCAN_MOVE_FROM_RIGHT = (1 << 1),
@@ -15,6 +13,8 @@ enum {
 };
 
 char* FAST_FUNC scan_and_match(char *string, const char *pattern, unsigned flags);
+/* Like fnmatch(pattern, string, 0) == 0 */
+int FAST_FUNC match_glob(const char *pattern, const char *string);
 
 static inline unsigned pick_scan(char op1, char op2)
 {
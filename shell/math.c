@@ -250,9 +250,37 @@ typedef struct remembered_name {
 	const char *var;
 } remembered_name;
 
+#if ENABLE_SH_MATH_CACHE
+/* Which numbers and variables evaluate_string() pushes and which
+ * operators it applies depends only on the expression text, not on
+ * the values. We record it as a RPN program and replay it when
+ * the same expression is evaluated again.
+ */
+typedef struct arith_insn {
+	arith_t val;
+	const char *var;   /* variable name, or NULL if number */
+	operator op;       /* TOK_NUM: push val/var, else apply op */
+} arith_insn;
+
+struct arith_prog {
+	struct arith_prog *next;
+	char *expr;        /* the cache key */
+	unsigned npush;    /* how big numstack must be */
+	unsigned ncode;
+	arith_insn code[];
+	/* followed by variable names and expr */
+};
+
+#define ARITH_CACHE_SIZE 16
+#endif
+
 
 static arith_t FAST_FUNC
 evaluate_string(arith_state_t *math_state, const char *expr);
+#if ENABLE_SH_MATH_CACHE
+static void
+save_prog(arith_state_t *math_state, const char *expr, arith_insn *code, unsigned ncode);
+#endif
 
 static const char*
 arith_lookup_val(arith_state_t *math_state, var_or_num_t *t)
@@ -522,6 +550,23 @@ evaluate_string(arith_state_t *math_state, const char *expr)
 	/* Stack of operator tokens */
 	operator *const stack = alloca(expr_len * sizeof(stack[0]));
 	operator *stackptr = stack;
+#if ENABLE_SH_MATH_CACHE
+	/* Every token is recorded at most once, and takes at least one char.
+	 * We don't record recursive evaluations of variable values */
+	arith_insn *const code = !math_state->list_of_recursed_names
+		? alloca(expr_len * sizeof(code[0])) : NULL;
+	unsigned ncode = 0;
+# define RECORD(o, n, v) do { \
+	if (code) { \
+		code[ncode].op = (o); \
+		code[ncode].val = (n); \
+		code[ncode].var = (v); \
+		ncode++; \
+	} \
+} while (0)
+#else
+# define RECORD(o, n, v) ((void)0)
+#endif
 
 	/* Start with a left paren */
 	*stackptr++ = lasttok = TOK_LPAREN;
@@ -563,6 +608,10 @@ evaluate_string(arith_state_t *math_state, const char *expr)
 				/* expression is $((var)) only, lookup now */
 				errmsg = arith_lookup_val(math_state, numstack);
 			}
+#if ENABLE_SH_MATH_CACHE
+			if (code && !errmsg)
+				save_prog(math_state, start_expr, code, ncode);
+#endif
 			goto ret;
 		}
 
@@ -574,6 +623,7 @@ evaluate_string(arith_state_t *math_state, const char *expr)
 			safe_strncpy(numstackptr->var, expr, var_name_size);
 			expr = p;
  num:
+			RECORD(TOK_NUM, numstackptr->var ? 0 : numstackptr->val, numstackptr->var);
 			numstackptr->second_val_present = 0;
 			numstackptr++;
 			lasttok = TOK_NUM;
@@ -687,6 +737,7 @@ evaluate_string(arith_state_t *math_state, const char *expr)
 						break;
 					}
 				}
+				RECORD(prev_op, 0, NULL);
 				errmsg = arith_apply(math_state, prev_op, numstack, &numstackptr);
 				if (errmsg)
 					goto err_with_custom_msg;
@@ -707,13 +758,118 @@ evaluate_string(arith_state_t *math_state, const char *expr)
  ret:
 	math_state->errmsg = errmsg;
 	return numstack->val;
+#undef RECORD
+}
+
+#if ENABLE_SH_MATH_CACHE
+static void
+save_prog(arith_state_t *math_state, const char *expr, arith_insn *code, unsigned ncode)
+{
+	struct arith_prog *prog, **pp;
+	unsigned size, npush, i;
+	char *str;
+
+	npush = 0;
+	size = sizeof(*prog) + ncode * sizeof(code[0]) + strlen(expr) + 1;
+	for (i = 0; i < ncode; i++) {
+		if (code[i].op == TOK_NUM) {
+			npush++;
+			if (code[i].var)
+				size += strlen(code[i].var) + 1;
+		}
+	}
+	prog = xmalloc(size);
+	prog->npush = npush;
+	prog->ncode = ncode;
+	str = (char*)&prog->code[ncode];
+	for (i = 0; i < ncode; i++) {
+		prog->code[i] = code[i];
+		if (code[i].var) {
+			prog->code[i].var = str;
+			str = stpcpy(str, code[i].var) + 1;
+		}
+	}
+	prog->expr = str;
+	strcpy(str, expr);
+
+	/* Insert at the head, drop the oldest one if there are too many */
+	prog->next = math_state->cache;
+	math_state->cache = prog;
+	i = 0;
+	for (pp = &prog->next; *pp; pp = &(*pp)->next) {
+		if (++i == ARITH_CACHE_SIZE) {
+			free(*pp);
+			*pp = NULL;
+			break;
+		}
+	}
+}
+
+static struct arith_prog *
+find_prog(arith_state_t *math_state, const char *expr)
+{
+	struct arith_prog *prog, **pp;
+
+	expr = skip_whitespace(expr);
+	for (pp = &math_state->cache; (prog = *pp) != NULL; pp = &prog->next) {
+		if (strcmp(prog->expr, expr) == 0) {
+			/* Move to front */
+			*pp = prog->next;
+			prog->next = math_state->cache;
+			math_state->cache = prog;
+			return prog;
+		}
+	}
+	return NULL;
+}
+
+/* Same as evaluate_string() would do, minus parsing */
+static arith_t
+run_prog(arith_state_t *math_state, const struct arith_prog *prog)
+{
+	var_or_num_t *const numstack = alloca(prog->npush * sizeof(numstack[0]));
+	var_or_num_t *numstackptr = numstack;
+	const arith_insn *insn = prog->code;
+	const arith_insn *end = insn + prog->ncode;
+	const char *errmsg = NULL;
+
+	for (; insn < end; insn++) {
+		if (insn->op == TOK_NUM) {
+			numstackptr->val = insn->val;
+			numstackptr->var = (char*)insn->var;
+			numstackptr->second_val_present = 0;
+			numstackptr++;
+			continue;
+		}
+		errmsg = arith_apply(math_state, insn->op, numstack, &numstackptr);
+		if (errmsg) {
+			numstack->val = -1;
+			goto ret;
+		}
+	}
+	/* Programs are saved only if they leave one value */
+	if (numstack->var)
+		errmsg = arith_lookup_val(math_state, numstack);
+ ret:
+	math_state->errmsg = errmsg;
+	return numstack->val;
 }
+#endif
 
 arith_t FAST_FUNC
 arith(arith_state_t *math_state, const char *expr)
 {
+#if ENABLE_SH_MATH_CACHE
+	struct arith_prog *prog;
+#endif
+
 	math_state->errmsg = NULL;
 	math_state->list_of_recursed_names = NULL;
+#if ENABLE_SH_MATH_CACHE
+	prog = find_prog(math_state, expr);
+	if (prog)
+		return run_prog(math_state, prog);
+#endif
 	return evaluate_string(math_state, expr);
 }
 
@@ -88,6 +88,11 @@ typedef struct arith_state_t {
 	arith_var_set_t       setvar;
 //	arith_var_endofname_t endofname;
 	void                 *list_of_recursed_names;
+#if ENABLE_SH_MATH_CACHE
+	/* Compiled expressions, most recently used first.
+	 * Must be NULL initially, keep the state around to benefit */
+	struct arith_prog    *cache;
+#endif
 } arith_state_t;
 
 arith_t FAST_FUNC arith(arith_state_t *state, const char *expr);
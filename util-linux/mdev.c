@@ -9,9 +9,14 @@
  */
 
 //usage:#define mdev_trivial_usage
-//usage:       "[-s]"
+//usage:       "[-s]" IF_FEATURE_MDEV_DAEMON(" | -d [-f] | -i")
 //usage:#define mdev_full_usage "\n\n"
 //usage:       "	-s	Scan /sys and populate /dev during system boot\n"
+//usage:	IF_FEATURE_MDEV_DAEMON(
+//usage:       "	-d	Scan, then handle uevents from kernel (daemon)\n"
+//usage:       "	-f	Run in foreground\n"
+//usage:       "	-i	Handle uevents read from stdin\n"
+//usage:	)
 //usage:       "\n"
 //usage:       "It can be run by kernel as a hotplug helper. To activate it:\n"
 //usage:       " echo /sbin/mdev > /proc/sys/kernel/hotplug\n"
@@ -44,6 +49,9 @@
 
 #include "libbb.h"
 #include "xregex.h"
+#if ENABLE_FEATURE_MDEV_DAEMON
+# include <linux/netlink.h>
+#endif
 
 /* "mdev -s" scans /sys/class/xxx, looking for directories which have dev
  * file (it is of the form "M:m\n"). Example: /sys/class/tty/tty0/dev
@@ -94,13 +102,45 @@
  * Then "command args..." is executed (via sh -c 'command args...').
  * @:execute on creation, $:on deletion, *:on both.
  * This happens regardless of /sys/class/.../dev existence.
+ *
+ * mdev -d does the same as mdev -s, then stays around and handles
+ * uevents the kernel sends over netlink, the same way as mdev called
+ * as hotplug helper would. mdev -i handles uevents read from stdin,
+ * in the same format: "ACTION@DEVPATH\0" followed by "VAR=VALUE\0"
+ * for each variable of the event.
  */
 
+/* mdev.conf line, parsed */
+struct rule {
+	bool keep_matching;
+	bool regex_compiled;
+	bool regex_has_slash;
+	mode_t mode;
+	int maj, min0, min1; /* @maj,min0-min1 rule if maj >= 0 */
+	struct bb_uidgid_t ugid;
+	char *envvar;        /* $envvar=regex rule if not NULL */
+	char *ren_mv;        /* ">path", "=path" or "!" */
+	IF_FEATURE_MDEV_EXEC(char *r_cmd;) /* "@cmd", "$cmd" or "*cmd" */
+	regex_t match;
+};
+
 struct globals {
 	int root_major, root_minor;
 	char *subsystem;
+#if ENABLE_FEATURE_MDEV_CONF
+	const char *filename; /* set if config is to be (re)opened */
+	parser_t *parser;
+	/* mdev -s and -d parse the config only once:
+	 * rules read so far are kept here, NULL terminated */
+	struct rule **rule_vec;
+	unsigned rule_idx;
+#endif
+	struct rule cur_rule;
 } FIX_ALIASING;
 #define G (*(struct globals*)&bb_common_bufsiz1)
+#define INIT_G() do { \
+	IF_FEATURE_MDEV_CONF(G.filename = "/etc/mdev.conf";) \
+} while (0)
 
 /* Prevent infinite loops in /sys symlinks */
 #define MAX_SYSFS_DEPTH 3
@@ -108,6 +148,170 @@ struct globals {
 /* We use additional 64+ bytes in make_device() */
 #define SCRATCH_SIZE 80
 
+static void make_default_cur_rule(void)
+{
+	memset(&G.cur_rule, 0, sizeof(G.cur_rule));
+	G.cur_rule.maj = -1; /* "not a @major,minor rule" */
+	G.cur_rule.mode = 0660;
+}
+
+#if ENABLE_FEATURE_MDEV_CONF
+
+static void clean_up_rule(struct rule *rule)
+{
+	free(rule->envvar);
+	if (rule->regex_compiled)
+		regfree(&rule->match);
+	free(rule->ren_mv);
+	IF_FEATURE_MDEV_EXEC(free(rule->r_cmd);)
+}
+
+static void clean_up_cur_rule(void)
+{
+	clean_up_rule(&G.cur_rule);
+	make_default_cur_rule();
+}
+
+/* Parse next config line into G.cur_rule (which is in default state).
+ * Returns 0 on EOF */
+static int parse_next_rule(void)
+{
+	char *tokens[4];
+	char *val;
+
+	for (;;) {
+		if (!config_read(G.parser, tokens, 4, 3, "# \t", PARSE_NORMAL)) {
+			config_close(G.parser);
+			G.parser = NULL;
+			return 0;
+		}
+
+		/* Fields: [-]regex uid:gid mode [alias] [cmd] */
+
+		val = tokens[0];
+		G.cur_rule.keep_matching = ('-' == val[0]);
+		val += G.cur_rule.keep_matching; /* swallow leading dash */
+
+		if (val[0] == '@') {
+			/* @major,minor[-minor2] */
+			/* (useful when name is ambiguous:
+			 * "/sys/class/usb/lp0" and
+			 * "/sys/class/printer/lp0") */
+			int sc = sscanf(val, "@%u,%u-%u",
+					&G.cur_rule.maj,
+					&G.cur_rule.min0,
+					&G.cur_rule.min1);
+			if (sc < 1 || G.cur_rule.maj < 0)
+				goto next_rule; /* matches nothing */
+			if (sc == 1) {
+				/* @major: any minor */
+				G.cur_rule.min0 = 0;
+				G.cur_rule.min1 = INT_MAX;
+			} else if (sc == 2) {
+				/* @major,minor */
+				G.cur_rule.min1 = G.cur_rule.min0;
+			}
+		} else {
+			/* Match against either "subsystem/device_name"
+			 * or "device_name" alone */
+			G.cur_rule.regex_has_slash = (strchr(val, '/') != NULL);
+			if (val[0] == '$') {
+				/* $envvar=regex: regex to match
+				 * an environment variable */
+				char *eq = strchr(++val, '=');
+				if (!eq)
+					goto next_rule; /* matches nothing */
+				G.cur_rule.envvar = xstrndup(val, eq - val);
+				val = eq + 1;
+			}
+			xregcomp(&G.cur_rule.match, val, REG_EXTENDED);
+			G.cur_rule.regex_compiled = 1;
+		}
+
+		/* 2nd field: uid:gid - device ownership */
+		if (get_uidgid(&G.cur_rule.ugid, tokens[1], /*allow_numeric:*/ 1) == 0)
+			bb_error_msg("unknown user/group %s on line %d", tokens[1], G.parser->lineno);
+
+		/* 3rd field: mode - device permissions */
+		bb_parse_mode(tokens[2], &G.cur_rule.mode);
+
+		/* 4th field (opt): ">|=alias" or "!" to not create the node */
+		val = tokens[3];
+		if (ENABLE_FEATURE_MDEV_RENAME && val && strchr(">=!", val[0])) {
+			char *s = skip_non_whitespace(val);
+			if (val[0] != '!' || s == val + 1) {
+				G.cur_rule.ren_mv = xstrndup(val, s - val);
+				val = (s[0] && s[1]) ? s + 1 : NULL;
+			}
+		}
+
+		if (ENABLE_FEATURE_MDEV_EXEC && val) {
+			if (!strchr("$@*", val[0])) {
+				bb_error_msg("bad line %u", G.parser->lineno);
+				goto next_rule;
+			}
+			IF_FEATURE_MDEV_EXEC(G.cur_rule.r_cmd = xstrdup(val);)
+		}
+
+		return 1;
+ next_rule:
+		clean_up_cur_rule();
+	}
+}
+
+/* Returns the next rule to try, starting from the first one after
+ * G.rule_idx = 0. After the last config line, returns a rule
+ * which matches everything and has default settings.
+ * Unless the rules are cached, the caller must not use the returned
+ * rule after the next call.
+ */
+static const struct rule *next_rule(void)
+{
+	struct rule *rule;
+
+	/* Open conf file if we didn't do it yet */
+	if (!G.parser && G.filename) {
+		G.parser = config_open2(G.filename, fopen_for_read);
+		G.filename = NULL;
+	}
+
+	if (G.rule_vec) {
+		/* Do we have this rule parsed already? */
+		if (G.rule_vec[G.rule_idx])
+			return G.rule_vec[G.rule_idx++];
+		make_default_cur_rule();
+	} else {
+		clean_up_cur_rule();
+	}
+
+	/* Parse one more rule if file isn't fully read */
+	rule = &G.cur_rule;
+	if (G.parser && parse_next_rule() && G.rule_vec) {
+		rule = memcpy(xmalloc(sizeof(*rule)), &G.cur_rule, sizeof(*rule));
+		G.rule_vec = xrealloc_vector(G.rule_vec, 4, G.rule_idx);
+		G.rule_vec[G.rule_idx++] = rule;
+		make_default_cur_rule();
+	}
+	return rule;
+}
+
+/* Keep parsed rules around for the following make_device() calls */
+static void cache_rules(void)
+{
+	G.rule_vec = xrealloc_vector(G.rule_vec, 4, 0);
+}
+
+#else
+
+static const struct rule *next_rule(void)
+{
+	make_default_cur_rule();
+	return &G.cur_rule;
+}
+#define cache_rules() ((void)0)
+
+#endif
+
 /* Builds an alias path.
  * This function potentionally reallocates the alias parameter.
  * Only used for ENABLE_FEATURE_MDEV_RENAME
@@ -143,8 +347,6 @@ static void make_device(char *path, int delete)
 {
 	char *device_name, *subsystem_slash_devname;
 	int major, minor, type, len;
-	mode_t mode;
-	parser_t *parser;
 
 	/* Try to read major/minor string.  Note that the kernel puts \n after
 	 * the data, so we don't need to worry about null terminating the string
@@ -198,186 +400,113 @@ static void make_device(char *path, int delete)
 	}
 
 	/* If we have config file, look up user settings */
-	if (ENABLE_FEATURE_MDEV_CONF)
-		parser = config_open2("/etc/mdev.conf", fopen_for_read);
-
-	do {
-		int keep_matching;
-		struct bb_uidgid_t ugid;
-		char *tokens[4];
+	IF_FEATURE_MDEV_CONF(G.rule_idx = 0;) /* restart from the first rule */
+	for (;;) {
+		const struct rule *rule;
+		const char *str_to_match;
+		regmatch_t off[1 + 9 * ENABLE_FEATURE_MDEV_RENAME_REGEXP];
 		char *command = NULL;
 		char *alias = NULL;
 		char aliaslink = aliaslink; /* for compiler */
 
-		/* Defaults in case we won't match any line */
-		ugid.uid = ugid.gid = 0;
-		keep_matching = 0;
-		mode = 0660;
-
-		if (ENABLE_FEATURE_MDEV_CONF
-		 && config_read(parser, tokens, 4, 3, "# \t", PARSE_NORMAL)
-		) {
-			char *val;
-			char *str_to_match;
-			regmatch_t off[1 + 9 * ENABLE_FEATURE_MDEV_RENAME_REGEXP];
+		rule = next_rule();
 
-			val = tokens[0];
-			keep_matching = ('-' == val[0]);
-			val += keep_matching; /* swallow leading dash */
+		str_to_match = rule->regex_has_slash ? path : device_name;
 
-			/* Match against either "subsystem/device_name"
-			 * or "device_name" alone */
-			str_to_match = strchr(val, '/') ? path : device_name;
-
-			/* Fields: regex uid:gid mode [alias] [cmd] */
-
-			if (val[0] == '@') {
-				/* @major,minor[-minor2] */
-				/* (useful when name is ambiguous:
-				 * "/sys/class/usb/lp0" and
-				 * "/sys/class/printer/lp0") */
-				int cmaj, cmin0, cmin1, sc;
-				if (major < 0)
-					continue; /* no dev, no match */
-				sc = sscanf(val, "@%u,%u-%u", &cmaj, &cmin0, &cmin1);
-				if (sc < 1
-				 || major != cmaj
-				 || (sc == 2 && minor != cmin0)
-				 || (sc == 3 && (minor < cmin0 || minor > cmin1))
-				) {
-					continue; /* this line doesn't match */
-				}
-				goto line_matches;
+		if (rule->maj >= 0) {
+			/* @major,minor[-minor2] */
+			if (major != rule->maj
+			 || minor < rule->min0 || minor > rule->min1
+			) {
+				continue; /* this line doesn't match */
 			}
-			if (val[0] == '$') {
-				/* regex to match an environment variable */
-				char *eq = strchr(++val, '=');
-				if (!eq)
-					continue;
-				*eq = '\0';
-				str_to_match = getenv(val);
-				if (!str_to_match)
-					continue;
-				str_to_match -= strlen(val) + 1;
-				*eq = '=';
+			/* no %1..9 for this rule */
+			memset(off, 0xff, sizeof(off));
+		}
+		if (rule->envvar) {
+			str_to_match = getenv(rule->envvar);
+			if (!str_to_match)
+				continue;
+		}
+		if (rule->regex_compiled) {
+			int result = regexec(&rule->match, str_to_match, ARRAY_SIZE(off), off, 0);
+			//bb_error_msg("matches:");
+			//for (int i = 0; i < ARRAY_SIZE(off); i++) {
+			//	if (off[i].rm_so < 0) continue;
+			//	bb_error_msg("match %d: '%.*s'\n", i,
+			//		(int)(off[i].rm_eo - off[i].rm_so),
+			//		device_name + off[i].rm_so);
+			//}
+
+			/* If no match, skip rest of line */
+			/* (regexec returns whole pattern as "range" 0) */
+			if (result
+			 || off[0].rm_so
+			 || ((int)off[0].rm_eo != (int)strlen(str_to_match))
+			) {
+				continue; /* this line doesn't match */
 			}
-			/* else: regex to match [subsystem/]device_name */
-
-			{
-				regex_t match;
-				int result;
-
-				xregcomp(&match, val, REG_EXTENDED);
-				result = regexec(&match, str_to_match, ARRAY_SIZE(off), off, 0);
-				regfree(&match);
-				//bb_error_msg("matches:");
-				//for (int i = 0; i < ARRAY_SIZE(off); i++) {
-				//	if (off[i].rm_so < 0) continue;
-				//	bb_error_msg("match %d: '%.*s'\n", i,
-				//		(int)(off[i].rm_eo - off[i].rm_so),
-				//		device_name + off[i].rm_so);
-				//}
-
-				/* If no match, skip rest of line */
-				/* (regexec returns whole pattern as "range" 0) */
-				if (result
-				 || off[0].rm_so
-				 || ((int)off[0].rm_eo != (int)strlen(str_to_match))
-				) {
-					continue; /* this line doesn't match */
-				}
+		}
+		/* This line matches. Stop after executing it
+		 * unless rule->keep_matching == 1 */
+
+		if (ENABLE_FEATURE_MDEV_RENAME && rule->ren_mv) {
+			const char *a = rule->ren_mv;
+
+			aliaslink = a[0];
+			if (aliaslink == '!') {
+				/* "!": suppress node creation/deletion */
+				major = -2;
 			}
- line_matches:
-			/* This line matches. Stop parsing after parsing
-			 * the rest the line unless keep_matching == 1 */
-
-			/* 2nd field: uid:gid - device ownership */
-			if (get_uidgid(&ugid, tokens[1], /*allow_numeric:*/ 1) == 0)
-				bb_error_msg("unknown user/group %s on line %d", tokens[1], parser->lineno);
-
-			/* 3rd field: mode - device permissions */
-			bb_parse_mode(tokens[2], &mode);
-
-			val = tokens[3];
-			/* 4th field (opt): ">|=alias" or "!" to not create the node */
-
-			if (ENABLE_FEATURE_MDEV_RENAME && val) {
-				char *a, *s, *st;
-
-				a = val;
-				s = strchrnul(val, ' ');
-				st = strchrnul(val, '\t');
-				if (st < s)
-					s = st;
-				st = (s[0] && s[1]) ? s+1 : NULL;
-
-				aliaslink = a[0];
-				if (aliaslink == '!' && s == a+1) {
-					val = st;
-					/* "!": suppress node creation/deletion */
-					major = -2;
-				}
-				else if (aliaslink == '>' || aliaslink == '=') {
-					val = st;
-					s[0] = '\0';
-					if (ENABLE_FEATURE_MDEV_RENAME_REGEXP) {
-						char *p;
-						unsigned i, n;
-
-						/* substitute %1..9 with off[1..9], if any */
-						n = 0;
-						s = a;
-						while (*s)
-							if (*s++ == '%')
-								n++;
-
-						p = alias = xzalloc(strlen(a) + n * strlen(str_to_match));
-						s = a + 1;
-						while (*s) {
-							*p = *s;
-							if ('%' == *s) {
-								i = (s[1] - '0');
-								if (i <= 9 && off[i].rm_so >= 0) {
-									n = off[i].rm_eo - off[i].rm_so;
-									strncpy(p, str_to_match + off[i].rm_so, n);
-									p += n - 1;
-									s++;
-								}
-							}
-							p++;
+			else if (ENABLE_FEATURE_MDEV_RENAME_REGEXP) {
+				char *p;
+				const char *s;
+				unsigned i, n;
+
+				/* substitute %1..9 with off[1..9], if any */
+				n = 0;
+				s = a;
+				while (*s)
+					if (*s++ == '%')
+						n++;
+
+				p = alias = xzalloc(strlen(a) + n * strlen(str_to_match));
+				s = a + 1;
+				while (*s) {
+					*p = *s;
+					if ('%' == *s) {
+						i = (s[1] - '0');
+						if (i <= 9 && off[i].rm_so >= 0) {
+							n = off[i].rm_eo - off[i].rm_so;
+							strncpy(p, str_to_match + off[i].rm_so, n);
+							p += n - 1;
 							s++;
 						}
-					} else {
-						alias = xstrdup(a + 1);
 					}
+					p++;
+					s++;
 				}
+			} else {
+				alias = xstrdup(a + 1);
 			}
+		}
 
-			if (ENABLE_FEATURE_MDEV_EXEC && val) {
-				const char *s = "$@*";
-				const char *s2 = strchr(s, val[0]);
-
-				if (!s2) {
-					bb_error_msg("bad line %u", parser->lineno);
-					if (ENABLE_FEATURE_MDEV_RENAME)
-						free(alias);
-					continue;
-				}
-
-				/* Are we running this command now?
-				 * Run $cmd on delete, @cmd on create, *cmd on both
+#if ENABLE_FEATURE_MDEV_EXEC
+		if (rule->r_cmd) {
+			/* Are we running this command now?
+			 * Run $cmd on delete, @cmd on create, *cmd on both
+			 */
+			const char *s = "$@*";
+			const char *s2 = strchr(s, rule->r_cmd[0]);
+			if (s2 - s != delete) {
+				/* We are here if: '*',
+				 * or: '@' and delete = 0,
+				 * or: '$' and delete = 1
 				 */
-				if (s2 - s != delete) {
-					/* We are here if: '*',
-					 * or: '@' and delete = 0,
-					 * or: '$' and delete = 1
-					 */
-					command = xstrdup(val + 1);
-				}
+				command = xstrdup(rule->r_cmd + 1);
 			}
 		}
-
-		/* End of field parsing */
+#endif
 
 		/* "Execute" the line we found */
 		{
@@ -388,13 +517,13 @@ static void make_device(char *path, int delete)
 				node_name = alias = build_alias(alias, device_name);
 
 			if (!delete && major >= 0) {
-				if (mknod(node_name, mode | type, makedev(major, minor)) && errno != EEXIST)
+				if (mknod(node_name, rule->mode | type, makedev(major, minor)) && errno != EEXIST)
 					bb_perror_msg("can't create '%s'", node_name);
 				if (major == G.root_major && minor == G.root_minor)
 					symlink(node_name, "root");
 				if (ENABLE_FEATURE_MDEV_CONF) {
-					chmod(node_name, mode);
-					chown(node_name, ugid.uid, ugid.gid);
+					chmod(node_name, rule->mode);
+					chown(node_name, rule->ugid.uid, rule->ugid.gid);
 				}
 				if (ENABLE_FEATURE_MDEV_RENAME && alias) {
 					if (aliaslink == '>')
@@ -429,14 +558,10 @@ static void make_device(char *path, int delete)
 
 		/* We found matching line.
 		 * Stop unless it was prefixed with '-' */
-		if (ENABLE_FEATURE_MDEV_CONF && !keep_matching)
+		if (!rule->keep_matching)
 			break;
+	} /* for (;;) */
 
-	/* end of "while line is read from /etc/mdev.conf" */
-	} while (ENABLE_FEATURE_MDEV_CONF);
-
-	if (ENABLE_FEATURE_MDEV_CONF)
-		config_close(parser);
 	free(subsystem_slash_devname);
 }
 
@@ -536,11 +661,205 @@ static void load_firmware(const char *firmware, const char *sysfs_path)
 	}
 }
 
+static void initial_scan(char *temp)
+{
+	struct stat st;
+
+	xstat("/", &st);
+	G.root_major = major(st.st_dev);
+	G.root_minor = minor(st.st_dev);
+
+	/* ACTION_FOLLOWLINKS is needed since in newer kernels
+	 * /sys/block/loop* (for example) are symlinks to dirs,
+	 * not real directories.
+	 * (kernel's CONFIG_SYSFS_DEPRECATED makes them real dirs,
+	 * but we can't enforce that on users)
+	 */
+	if (access("/sys/class/block", F_OK) != 0) {
+		/* Scan obsolete /sys/block only if /sys/class/block
+		 * doesn't exist. Otherwise we'll have dupes.
+		 * Also, do not complain if it doesn't exist.
+		 * Some people configure kernel to have no blockdevs.
+		 */
+		recursive_action("/sys/block",
+			ACTION_RECURSE | ACTION_FOLLOWLINKS | ACTION_QUIET,
+			fileAction, dirAction, temp, 0);
+	}
+	recursive_action("/sys/class",
+		ACTION_RECURSE | ACTION_FOLLOWLINKS,
+		fileAction, dirAction, temp, 0);
+	free(G.subsystem);
+	G.subsystem = NULL;
+}
+
+/* Handle the event described by $ACTION, $DEVPATH etc */
+static void process_action(char *temp, int in_daemon UNUSED_PARAM)
+{
+	static const char keywords[] ALIGN1 = "remove\0add\0";
+	enum { OP_remove = 0, OP_add };
+	char *fw;
+	smalluint op;
+
+	op = index_in_strings(keywords, getenv("ACTION"));
+	G.subsystem = getenv("SUBSYSTEM");
+	fw = getenv("FIRMWARE");
+
+	snprintf(temp, PATH_MAX, "/sys%s", getenv("DEVPATH"));
+	if (op == OP_remove) {
+		/* Ignoring "remove firmware". It was reported
+		 * to happen and to cause erroneous deletion
+		 * of device nodes. */
+		if (!fw)
+			make_device(temp, /*delete:*/ 1);
+	}
+	else if (op == OP_add) {
+		make_device(temp, /*delete:*/ 0);
+		if (ENABLE_FEATURE_MDEV_LOAD_FIRMWARE) {
+			if (fw) {
+#if ENABLE_FEATURE_MDEV_DAEMON && BB_MMU
+				/* load_firmware may wait for a long time,
+				 * changes current dir and dies on errors */
+				if (in_daemon) {
+					if (fork() == 0) {
+						load_firmware(fw, temp);
+						_exit(EXIT_SUCCESS);
+					}
+					return;
+				}
+#endif
+				load_firmware(fw, temp);
+				xchdir("/dev");
+			}
+		}
+	}
+	G.subsystem = NULL;
+}
+
+#if ENABLE_FEATURE_MDEV_DAEMON
+
+/* Enough for any uevent: kernel's UEVENT_BUFFER_SIZE is 2048 */
+#define UEVENT_BUFSIZE (8 * 1024)
+
+static int open_uevent_socket(void)
+{
+	struct sockaddr_nl sa;
+	int fd;
+	int rcvbuf = 1024 * 1024;
+
+	fd = xsocket(AF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
+	/* Coldplug of many devices generates bursts of events,
+	 * don't lose them while we are running commands */
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+	sa.nl_groups = 1; /* kernel's uevents */
+	xbind(fd, (struct sockaddr *) &sa, sizeof(sa));
+	return fd;
+}
+
+static void run_event(char *temp, char **vars, unsigned nvars)
+{
+	unsigned i;
+
+	for (i = 0; i < nvars; i++)
+		putenv(vars[i]);
+	if (getenv("ACTION") && getenv("DEVPATH"))
+		process_action(temp, /*in_daemon:*/ 1);
+	for (i = 0; i < nvars; i++)
+		bb_unsetenv_and_free(vars[i]);
+	/* Reap firmware loaders */
+	while (wait_any_nohang(NULL) > 0)
+		continue;
+}
+
+/* Read uevents from FD and handle them. They consist of NUL-terminated
+ * strings: "ACTION@DEVPATH", then "VAR=VALUE" for each variable.
+ * A netlink socket delivers one event per recv(). Otherwise,
+ * an event ends where the next "ACTION@DEVPATH" starts, or at EOF:
+ * stdin can be a pipe or a stream socket.
+ */
+static void uevent_loop(char *temp, int fd, int netlink)
+{
+	char *buf = xmalloc(UEVENT_BUFSIZE + 1);
+	char **vars = NULL;
+	unsigned nvars = 0;
+	unsigned len = 0;
+	int eof = 0;
+
+	while (!eof) {
+		char *p, *z, *end;
+		ssize_t n;
+
+		if (netlink) {
+			struct sockaddr_nl sa;
+			socklen_t salen = sizeof(sa);
+
+			n = recvfrom(fd, buf, UEVENT_BUFSIZE, 0, (struct sockaddr *) &sa, &salen);
+			if (n < 0) {
+				if (errno == ENOBUFS) {
+					/* We lost some events, catch up */
+					bb_error_msg("uevent queue overflow, rescanning");
+					initial_scan(temp);
+				} else if (errno != EINTR) {
+					bb_perror_msg_and_die("recv");
+				}
+				continue;
+			}
+			if (sa.nl_pid != 0)
+				continue; /* not from kernel */
+			len = n;
+		} else {
+			n = safe_read(fd, buf + len, UEVENT_BUFSIZE - len);
+			if (n < 0)
+				bb_perror_msg_and_die(bb_msg_read_error);
+			eof = (n == 0);
+			len += n;
+		}
+		/* At the end of a datagram or of input, add an empty
+		 * string: it completes the event as "ACTION@DEVPATH" would */
+		if (netlink || eof)
+			buf[len++] = '\0';
+
+		p = buf;
+		end = buf + len;
+		while ((z = memchr(p, '\0', end - p)) != NULL) {
+			if (strchr(p, '=')) {
+				vars = xrealloc_vector(vars, 4, nvars);
+				vars[nvars++] = xstrdup(p);
+			} else if (nvars) {
+				run_event(temp, vars, nvars);
+				nvars = 0;
+			}
+			p = z + 1;
+		}
+		/* Keep incomplete string for the next read */
+		len = end - p;
+		if (len >= UEVENT_BUFSIZE)
+			len = 0; /* no NUL in sight, this is garbage */
+		memmove(buf, p, len);
+	}
+	if (ENABLE_FEATURE_CLEAN_UP) {
+		free(vars);
+		free(buf);
+	}
+}
+
+#endif
+
 int mdev_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int mdev_main(int argc UNUSED_PARAM, char **argv)
 {
+	enum {
+		OPT_s = (1 << 0),
+		OPT_d = (1 << 1) * ENABLE_FEATURE_MDEV_DAEMON,
+		OPT_f = (1 << 2) * ENABLE_FEATURE_MDEV_DAEMON,
+		OPT_i = (1 << 3) * ENABLE_FEATURE_MDEV_DAEMON,
+	};
+	unsigned opt;
 	RESERVE_CONFIG_BUFFER(temp, PATH_MAX + SCRATCH_SIZE);
 
+	INIT_G();
+
 	/* We can be called as hotplug helper */
 	/* Kernel cannot provide suitable stdio fds for us, do it ourself */
 	bb_sanitize_stdio();
@@ -548,45 +867,42 @@ int mdev_main(int argc UNUSED_PARAM, char **argv)
 	/* Force the configuration file settings exactly */
 	umask(0);
 
+	opt = getopt32(argv, "s" IF_FEATURE_MDEV_DAEMON("dfi"));
+
 	xchdir("/dev");
 
-	if (argv[1] && strcmp(argv[1], "-s") == 0) {
+	if (opt & (OPT_s | OPT_d | OPT_i)) {
 		/* Scan:
 		 * mdev -s
+		 * and/or handle a stream of events:
+		 * mdev -d, mdev -i
+		 * Parse mdev.conf only once for all of it
 		 */
-		struct stat st;
-
-		xstat("/", &st);
-		G.root_major = major(st.st_dev);
-		G.root_minor = minor(st.st_dev);
-
-		/* ACTION_FOLLOWLINKS is needed since in newer kernels
-		 * /sys/block/loop* (for example) are symlinks to dirs,
-		 * not real directories.
-		 * (kernel's CONFIG_SYSFS_DEPRECATED makes them real dirs,
-		 * but we can't enforce that on users)
-		 */
-		if (access("/sys/class/block", F_OK) != 0) {
-			/* Scan obsolete /sys/block only if /sys/class/block
-			 * doesn't exist. Otherwise we'll have dupes.
-			 * Also, do not complain if it doesn't exist.
-			 * Some people configure kernel to have no blockdevs.
-			 */
-			recursive_action("/sys/block",
-				ACTION_RECURSE | ACTION_FOLLOWLINKS | ACTION_QUIET,
-				fileAction, dirAction, temp, 0);
+		cache_rules();
+#if ENABLE_FEATURE_MDEV_DAEMON
+		if (opt & OPT_d) {
+			/* Listen before scanning: no event can fall between.
+			 * Scan before daemonizing: when "mdev -d" returns,
+			 * coldplug is done. On NOMMU, the re-executed daemon
+			 * finds the socket still open as fd 3 */
+			if (!re_execed) {
+				xmove_fd(open_uevent_socket(), 3);
+				initial_scan(temp);
+			}
+			if (!(opt & OPT_f))
+				bb_daemonize_or_rexec(DAEMON_DEVNULL_STDIO, argv);
+			close_on_exec_on(3);
+			uevent_loop(temp, 3, /*netlink:*/ 1);
 		}
-		recursive_action("/sys/class",
-			ACTION_RECURSE | ACTION_FOLLOWLINKS,
-			fileAction, dirAction, temp, 0);
+		if (opt & OPT_i)
+			uevent_loop(temp, STDIN_FILENO, /*netlink:*/ 0);
+#endif
+		if (opt & OPT_s)
+			initial_scan(temp);
 	} else {
-		char *fw;
 		char *seq;
 		char *action;
 		char *env_path;
-		static const char keywords[] ALIGN1 = "remove\0add\0";
-		enum { OP_remove = 0, OP_add };
-		smalluint op;
 
 		/* Hotplug:
 		 * env ACTION=... DEVPATH=... SUBSYSTEM=... [SEQNUM=...] mdev
@@ -595,11 +911,8 @@ int mdev_main(int argc UNUSED_PARAM, char **argv)
 		 */
 		action = getenv("ACTION");
 		env_path = getenv("DEVPATH");
-		G.subsystem = getenv("SUBSYSTEM");
-		if (!action || !env_path /*|| !G.subsystem*/)
+		if (!action || !env_path /*|| !getenv("SUBSYSTEM")*/)
 			bb_show_usage();
-		fw = getenv("FIRMWARE");
-		op = index_in_strings(keywords, action);
 		/* If it exists, does /dev/mdev.seq match $SEQNUM?
 		 * If it does not match, earlier mdev is running
 		 * in parallel, and we need to wait */
@@ -625,21 +938,7 @@ int mdev_main(int argc UNUSED_PARAM, char **argv)
 			} while (--timeout);
 		}
 
-		snprintf(temp, PATH_MAX, "/sys%s", env_path);
-		if (op == OP_remove) {
-			/* Ignoring "remove firmware". It was reported
-			 * to happen and to cause erroneous deletion
-			 * of device nodes. */
-			if (!fw)
-				make_device(temp, /*delete:*/ 1);
-		}
-		else if (op == OP_add) {
-			make_device(temp, /*delete:*/ 0);
-			if (ENABLE_FEATURE_MDEV_LOAD_FIRMWARE) {
-				if (fw)
-					load_firmware(fw, temp);
-			}
-		}
+		process_action(temp, /*in_daemon:*/ 0);
 
 		if (seq) {
 			xopen_xwrite_close("mdev.seq", utoa(xatou(seq) + 1));
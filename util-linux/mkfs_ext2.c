@@ -18,13 +18,14 @@
 //usage:       "[-m RESERVED_PERCENT] "
 /* //usage:    "[-o creator-os] [-O feature[,...]] [-q] " */
 /* //usage:    "[r fs-revision-level] [-E extended-options] [-v] [-F] " */
-//usage:       "[-L LABEL] "
+//usage:       "[-L LABEL] [-E lazy_itable_init] "
 /* //usage:    "[-M last-mounted-directory] [-S] [-T filesystem-type] " */
 //usage:       "BLOCKDEV [KBYTES]"
 //usage:#define mkfs_ext2_full_usage "\n\n"
 //usage:       "	-b BLK_SIZE	Block size, bytes"
 /* //usage:  "\n	-c		Check device for bad blocks" */
-/* //usage:  "\n	-E opts		Set extended options" */
+//usage:     "\n	-E lazy_itable_init	Don't zero inode tables"
+//usage:     "\n			(device must read as zeros)"
 /* //usage:  "\n	-f size		Fragment size in bytes" */
 //usage:     "\n	-F		Force"
 /* //usage:  "\n	-g N		Number of blocks in a block group" */
@@ -47,6 +48,7 @@
 /* //usage:  "\n	-v		Verbose" */
 
 #include "libbb.h"
+#include <sys/uio.h>
 #include <linux/fs.h>
 #include <linux/ext2_fs.h>
 
@@ -154,11 +156,112 @@ static uint32_t has_super(uint32_t x)
 
 #define fd 3	/* predefined output descriptor */
 
+// Writes are staged: PUTs to adjacent offsets are collected in put_buf,
+// optionally followed by a run of zeros, and go out in one pwritev()
+// when the next write is not contiguous (or at the end).
+#define ZERO_BUF_SIZE (64 * 1024)
+#define ZERO_IOVS     16
+struct globals {
+	uint64_t put_off;    // device offset of staged data
+	uint64_t put_zeros;  // zero bytes queued after staged data
+	uint32_t put_len;    // bytes staged in put_buf
+	uint32_t put_size;   // put_buf capacity
+	uint8_t *put_buf;
+	uint8_t *zero_buf;
+	// Bytes at the start of the device which may hold old data.
+	// Beyond this point (e.g. in a new or just extended image file)
+	// everything reads as zeros already
+	uint64_t dirty_size;
+} FIX_ALIASING;
+#define G (*(struct globals*)&bb_common_bufsiz1)
+
+static void flush_puts(void)
+{
+	while (G.put_len | G.put_zeros) {
+		struct iovec iov[1 + ZERO_IOVS];
+		uint64_t zeros = G.put_zeros;
+		unsigned cnt = 0;
+		ssize_t n;
+
+		if (G.put_len) {
+			iov[0].iov_base = G.put_buf;
+			iov[0].iov_len = G.put_len;
+			cnt = 1;
+		}
+		while (zeros && cnt <= ZERO_IOVS) {
+			if (!G.zero_buf)
+				G.zero_buf = xzalloc(ZERO_BUF_SIZE);
+			iov[cnt].iov_base = G.zero_buf;
+			iov[cnt].iov_len = zeros < ZERO_BUF_SIZE ? zeros : ZERO_BUF_SIZE;
+			zeros -= iov[cnt].iov_len;
+			cnt++;
+		}
+//		bb_info_msg("WRITE[%llu]:[%u]+[%llu]", G.put_off, G.put_len, G.put_zeros);
+		n = pwritev(fd, iov, cnt, G.put_off);
+		if (n <= 0)
+			bb_perror_msg_and_die(bb_msg_write_error);
+		G.put_off += n;
+		if (n < G.put_len) {
+			G.put_len -= n;
+			memmove(G.put_buf, G.put_buf + n, G.put_len);
+			continue;
+		}
+		n -= G.put_len;
+		G.put_len = 0;
+		G.put_zeros -= n;
+	}
+}
+
 static void PUT(uint64_t off, void *buf, uint32_t size)
 {
 //	bb_info_msg("PUT[%llu]:[%u]", off, size);
-	xlseek(fd, off, SEEK_SET);
-	xwrite(fd, buf, size);
+	if (G.put_zeros
+	 || off != G.put_off + G.put_len
+	 || G.put_len + size > G.put_size
+	) {
+		flush_puts();
+		if (size > G.put_size) {
+			G.put_size = MAX(size, ZERO_BUF_SIZE);
+			free(G.put_buf);
+			G.put_buf = xmalloc(G.put_size);
+		}
+		G.put_off = off;
+	}
+	memcpy(G.put_buf + G.put_len, buf, size);
+	G.put_len += size;
+}
+
+// Make [off, off+len) read as zeros
+static void ZERO(uint64_t off, uint64_t len)
+{
+//	bb_info_msg("ZERO[%llu]:[%llu]", off, len);
+	if (off >= G.dirty_size)
+		return;
+	if (len > G.dirty_size - off)
+		len = G.dirty_size - off;
+
+	// staged data, if any, lies before this range: no need to flush it first
+#if defined(FALLOC_FL_PUNCH_HOLE) && defined(FALLOC_FL_KEEP_SIZE)
+	// files: deallocates the range; block devices (Linux 4.9+):
+	// succeeds only if the device guarantees zeros afterwards
+	if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off, len) == 0)
+		return;
+#endif
+#ifdef BLKZEROOUT
+	{
+		uint64_t range[2];
+		range[0] = off;
+		range[1] = len;
+		if (ioctl(fd, BLKZEROOUT, range) == 0)
+			return;
+	}
+#endif
+	// write zeros out, together with what was PUT right before if adjacent
+	if (G.put_zeros || off != G.put_off + G.put_len) {
+		flush_puts();
+		G.put_off = off;
+	}
+	G.put_zeros = len;
 }
 
 // 128 and 256-byte inodes:
@@ -240,6 +343,7 @@ int mkfs_ext2_main(int argc UNUSED_PARAM, char **argv)
 	uint32_t lost_and_found_blocks;
 	time_t timestamp;
 	const char *label = "";
+	char *ext_opts = NULL;
 	struct stat st;
 	struct ext2_super_block *sb; // superblock
 	struct ext2_group_desc *gd; // group descriptors
@@ -254,7 +358,7 @@ int mkfs_ext2_main(int argc UNUSED_PARAM, char **argv)
 		/*lbfi:*/ NULL, &bs, NULL, &bpi,
 		/*IJGN:*/ &user_inodesize, NULL, NULL, NULL,
 		/*mogL:*/ &reserved_percent, NULL, NULL, &label,
-		/*MOrE:*/ NULL, NULL, NULL, NULL,
+		/*MOrE:*/ NULL, NULL, NULL, &ext_opts,
 		/*TU:*/ NULL, NULL);
 	argv += optind; // argv[0] -- device
 
@@ -263,6 +367,22 @@ int mkfs_ext2_main(int argc UNUSED_PARAM, char **argv)
 	xfstat(fd, &st, argv[0]);
 	if (!S_ISBLK(st.st_mode) && !(option_mask32 & OPT_F))
 		bb_error_msg_and_die("%s: not a block device", argv[0]);
+	// a regular file reads as zeros past its current end
+	G.dirty_size = S_ISREG(st.st_mode) ? st.st_size : (uint64_t)-1LL;
+	if (option_mask32 & OPT_E) {
+		char *opt;
+		while ((opt = strsep(&ext_opts, ",")) != NULL) {
+			if (strcmp(opt, "lazy_itable_init") == 0
+			 || strcmp(opt, "lazy_itable_init=1") == 0
+			) {
+				// ext2 has no uninit_bg flag telling kernel
+				// and fsck that inode tables are not initialized,
+				// so this is only correct if they are zeros already
+				G.dirty_size = 0;
+			}
+			// other extended options are silently ignored
+		}
+	}
 
 	// check if it is mounted
 	// N.B. what if we format a file? find_mount_point will return false negative since
@@ -589,12 +709,15 @@ int mkfs_ext2_main(int argc UNUSED_PARAM, char **argv)
 			// mark unused trailing inodes
 			blocks_per_group - inodes_per_group
 		);
-		// dump inode bitmap
-		//PUT((uint64_t)(FETCH_LE32(gd[i].bg_block_bitmap)) * blocksize, buf, blocksize);
-		//but it's right after block bitmap, so we can just:
-		xwrite(fd, buf, blocksize);
+		// dump inode bitmap (it's right after block bitmap,
+		// both go out in one write)
+		PUT((uint64_t)(FETCH_LE32(gd[i].bg_inode_bitmap)) * blocksize, buf, blocksize);
 		STORE_LE(gd[i].bg_free_inodes_count, gd[i].bg_free_inodes_count);
 
+		// zero inode table (it follows inode bitmap)
+		ZERO((uint64_t)(FETCH_LE32(gd[i].bg_inode_table)) * blocksize,
+			(uint64_t)inode_table_blocks * blocksize);
+
 		// count overall free blocks
 		sb->s_free_blocks_count += free_blocks;
 	}
@@ -602,6 +725,9 @@ int mkfs_ext2_main(int argc UNUSED_PARAM, char **argv)
 
 	// dump filesystem skeleton structures
 //	printf("Writing superblocks and filesystem accounting information: ");
+	// zero boot sectors (goes out together with the 1st superblock)
+	memset(buf, 0, blocksize);
+	PUT(0, buf, 1024); // N.B. 1024 <= blocksize, so buf[0..1023] contains zeros
 	for (i = 0, pos = first_block; i < ngroups; i++, pos += blocks_per_group) {
 		// dump superblock and group descriptors and their backups
 		if (has_super(i)) {
@@ -613,14 +739,6 @@ int mkfs_ext2_main(int argc UNUSED_PARAM, char **argv)
 		}
 	}
 
-	// zero boot sectors
-	memset(buf, 0, blocksize);
-	PUT(0, buf, 1024); // N.B. 1024 <= blocksize, so buf[0..1023] contains zeros
-	// zero inode tables
-	for (i = 0; i < ngroups; ++i)
-		for (n = 0; n < inode_table_blocks; ++n)
-			PUT((uint64_t)(FETCH_LE32(gd[i].bg_inode_table) + n) * blocksize,
-				buf, blocksize);
 
 	// prepare directory inode
 	inode = (struct ext2_inode *)buf;
@@ -683,8 +801,12 @@ int mkfs_ext2_main(int argc UNUSED_PARAM, char **argv)
 	strcpy(dir->name3, "lost+found");
 	PUT((uint64_t)(FETCH_LE32(gd[0].bg_inode_table) + inode_table_blocks + 0) * blocksize, buf, blocksize);
 
+	flush_puts();
+
 	// cleanup
 	if (ENABLE_FEATURE_CLEAN_UP) {
+		free(G.zero_buf);
+		free(G.put_buf);
 		free(buf);
 		free(gd);
 		free(sb);
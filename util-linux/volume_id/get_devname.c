@@ -20,26 +20,63 @@ static struct uuidCache_s {
 	char *label;
 	char *uc_uuid; /* prefix makes it easier to grep for */
 	IF_FEATURE_BLKID_TYPE(const char *type;)
+	IF_FEATURE_VOLUMEID_CACHE(smallint cached;)
 } *uuidCache;
 
-#if !ENABLE_FEATURE_BLKID_TYPE
-#define get_label_uuid(fd, label, uuid, type) \
-	get_label_uuid(fd, label, uuid)
-#define uuidcache_addentry(device, label, uuid, type) \
-	uuidcache_addentry(device, label, uuid)
+/* A device queued for probing */
+struct probe_s {
+	char *device;
+	IF_FEATURE_VOLUMEID_CACHE(char *key;)
+	/* label etc came from the cache file */
+	smallint cached;
+	smallint is_blk;
+	/* NULL until probed. "" if not found */
+	char *label;
+	char *uuid;
+	char *type;
+};
+
+/* Fixed size: probing children write these to one pipe,
+ * and writes smaller than PIPE_BUF do not interleave */
+struct probe_result {
+	unsigned idx;
+	char label[VOLUME_ID_LABEL_SIZE + 1];
+	char uuid[VOLUME_ID_UUID_SIZE + 1];
+	char type[VOLUME_ID_FORMAT_SIZE];
+};
+
+static struct probe_s *probe_vec;
+static unsigned probe_cnt;
+
+#if ENABLE_FEATURE_VOLUMEID_CACHE
+/* Contents of the cache file */
+static struct probe_s *cache_vec;
+static unsigned cache_cnt;
+/* 0: not loaded, 1: loaded, 2: loaded, but do not use it
+ * (it gave a wrong answer, or blkid wants what is on the devices now) */
+static smallint cache_state;
+/* Some of uuidCache came from the cache file */
+static smallint cache_used;
+#else
+# define cache_used 0
 #endif
 
-/* Returns !0 on error.
- * Otherwise, returns malloc'ed strings for label and uuid
- * (and they can't be NULL, although they can be "").
- * NB: closes fd. */
+/* Returns !0 on error, or if neither label nor uuid is found.
+ * Otherwise, fills r->label, r->uuid and r->type
+ * (they can be "", but not both label and uuid). */
 static int
-get_label_uuid(int fd, char **label, char **uuid, const char **type)
+get_label_uuid(const char *device, struct probe_result *r)
 {
 	int rv = 1;
+	int fd;
 	uint64_t size;
 	struct volume_id *vid;
 
+	memset(r, 0, sizeof(*r));
+	fd = open(device, O_RDONLY);
+	if (fd < 0)
+		return rv;
+
 	/* fd is owned by vid now */
 	vid = volume_id_open_node(fd);
 
@@ -50,13 +87,14 @@ get_label_uuid(int fd, char **label, char **uuid, const char **type)
 		goto ret;
 
 	if (vid->label[0] != '\0' || vid->uuid[0] != '\0') {
-		*label = xstrndup(vid->label, sizeof(vid->label));
-		*uuid  = xstrndup(vid->uuid, sizeof(vid->uuid));
+		safe_strncpy(r->label, vid->label, sizeof(r->label));
+		safe_strncpy(r->uuid, vid->uuid, sizeof(r->uuid));
 #if ENABLE_FEATURE_BLKID_TYPE
-		*type = vid->type;
-		dbg("found label '%s', uuid '%s', type '%s'", *label, *uuid, *type);
+		if (vid->type)
+			safe_strncpy(r->type, vid->type, sizeof(r->type));
+		dbg("found label '%s', uuid '%s', type '%s'", r->label, r->uuid, r->type);
 #else
-		dbg("found label '%s', uuid '%s'", *label, *uuid);
+		dbg("found label '%s', uuid '%s'", r->label, r->uuid);
 #endif
 		rv = 0;
 	}
@@ -65,9 +103,9 @@ get_label_uuid(int fd, char **label, char **uuid, const char **type)
 	return rv;
 }
 
-/* NB: we take ownership of (malloc'ed) label and uuid */
+/* NB: we take ownership of (malloc'ed) strings in p */
 static void
-uuidcache_addentry(char *device, /*int major, int minor,*/ char *label, char *uuid, const char *type)
+uuidcache_addentry(struct probe_s *p)
 {
 	struct uuidCache_s *last;
 
@@ -82,15 +120,265 @@ uuidcache_addentry(char *device, /*int major, int minor,*/ char *label, char *uu
 	/*last->next = NULL; - xzalloc did it*/
 //	last->major = major;
 //	last->minor = minor;
-	last->device = device;
-	last->label = label;
-	last->uc_uuid = uuid;
-	IF_FEATURE_BLKID_TYPE(last->type = type;)
+	last->device = p->device;
+	last->label = p->label;
+	last->uc_uuid = p->uuid;
+	IF_FEATURE_BLKID_TYPE(last->type = p->type[0] ? p->type : NULL;)
+	IF_FEATURE_VOLUMEID_CACHE(last->cached = p->cached;)
+}
+
+#if ENABLE_FEATURE_VOLUMEID_CACHE
+/* Probe results are reused while the device number (inode
+ * for image files), size and mtime stay the same */
+static char *make_key(const struct stat *st)
+{
+	unsigned long long id = st->st_ino;
+	unsigned long long size = st->st_size;
+
+	if (S_ISBLK(st->st_mode)) {
+		char buf[sizeof("/sys/dev/block/%u:%u/size") + sizeof(int)*3*2];
+		ssize_t len;
+
+		id = st->st_rdev;
+		/* Size in sectors. Does not open (and spin up) the device */
+		sprintf(buf, "/sys/dev/block/%u:%u/size",
+			(unsigned)major(st->st_rdev), (unsigned)minor(st->st_rdev));
+		len = open_read_close(buf, buf, sizeof(buf) - 1);
+		buf[len > 0 ? len : 0] = '\0';
+		size = strtoull(buf, NULL, 10);
+	}
+	return xasprintf("%llx:%llx:%lx.%lx", id, size,
+		(unsigned long)st->st_mtime, (unsigned long)st->st_mtim.tv_nsec);
+}
+
+static const char *cache_file(void)
+{
+	const char *name = NULL;
+
+	/* Setuid mount or findfs must not read, or create as root,
+	 * a file the user has chosen */
+	if (getuid() == geteuid() && getgid() == getegid())
+		name = getenv("BLKID_FILE");
+	return name ? name : CONFIG_VOLUMEID_CACHE_FILE;
+}
+
+/* The cache file has a line per device:
+ * DEVICE<tab>KEY<tab>TYPE<tab>LABEL<tab>UUID
+ */
+static void load_cache(void)
+{
+	FILE *fp;
+	char *line;
+
+	cache_state = 1;
+	fp = fopen_for_read(cache_file());
+	if (!fp)
+		return;
+	while ((line = xmalloc_fgetline(fp)) != NULL) {
+		struct probe_s *c;
+		char *f[5];
+		int i;
+
+		f[0] = line;
+		for (i = 1; i < 5; i++) {
+			f[i] = strchr(f[i - 1], '\t');
+			if (!f[i])
+				break;
+			*f[i]++ = '\0';
+		}
+		if (i < 5 || strchr(f[4], '\t')) {
+			free(line);
+			continue;
+		}
+		cache_vec = xrealloc_vector(cache_vec, 6, cache_cnt);
+		c = &cache_vec[cache_cnt++];
+		c->device = f[0];
+		c->key = f[1];
+		c->type = f[2];
+		c->label = f[3];
+		c->uuid = f[4];
+	}
+	fclose(fp);
+}
+
+/* Replaces the cache with probe_vec. ALL: probe_vec has all devices,
+ * otherwise cached devices which are not in probe_vec are kept */
+static void save_cache(int all)
+{
+	const char *name;
+	char *tmp;
+	unsigned i, j;
+	int fd;
+	FILE *fp;
+
+	if (!all) {
+		for (j = 0; j < cache_cnt; j++) {
+			for (i = 0; i < probe_cnt; i++)
+				if (strcmp(cache_vec[j].device, probe_vec[i].device) == 0)
+					break;
+			if (i == probe_cnt) {
+				probe_vec = xrealloc_vector(probe_vec, 6, probe_cnt);
+				probe_vec[probe_cnt++] = cache_vec[j];
+			}
+		}
+	}
+	free(cache_vec);
+	cache_vec = probe_vec;
+	cache_cnt = probe_cnt;
+	probe_vec = NULL;
+	probe_cnt = 0;
+
+	name = cache_file();
+	if (!name[0])
+		return;
+	tmp = xasprintf("%s.XXXXXX", name);
+	fd = mkstemp(tmp);
+	if (fd < 0)
+		goto ret; /* not root? */
+	fp = xfdopen_for_write(fd);
+	for (i = 0; i < cache_cnt; i++) {
+		struct probe_s *c = &cache_vec[i];
+		/* Would break the format. Such devices are probed every time */
+		if (strpbrk(c->device, "\t\n") || strpbrk(c->label, "\t\n"))
+			continue;
+		fprintf(fp, "%s\t%s\t%s\t%s\t%s\n",
+			c->device, c->key, c->type, c->label, c->uuid);
+	}
+	if (fclose(fp) != 0 || rename(tmp, name) != 0)
+		unlink(tmp);
+ ret:
+	free(tmp);
+}
+#endif
+
+static void store_result(struct probe_s *p, struct probe_result *r)
+{
+	p->label = xstrdup(r->label);
+	p->uuid = xstrdup(r->uuid);
+	p->type = xstrdup(r->type);
+}
+
+#if BB_MMU && CONFIG_VOLUMEID_PROBE_JOBS > 1
+/* Probes unprobed block devices in several processes, so that
+ * a slow device does not hold up the rest. Image files are
+ * left for the caller to probe: reading them in parallel is slower.
+ * So is whatever is left unprobed because fork failed */
+static void probe_in_children(void)
+{
+	pid_t pid[CONFIG_VOLUMEID_PROBE_JOBS];
+	struct probe_result r;
+	struct fd_pair pp;
+	unsigned jobs, j, i, k;
+
+	k = 0;
+	for (i = 0; i < probe_cnt; i++)
+		k += (!probe_vec[i].label && probe_vec[i].is_blk);
+	if (k < 2)
+		return;
+	jobs = MIN(k, CONFIG_VOLUMEID_PROBE_JOBS);
+	xpiped_pair(pp);
+	for (j = 0; j < jobs; j++) {
+		pid[j] = fork();
+		if (pid[j] < 0)
+			break;
+		if (pid[j] == 0) {
+			close(pp.rd);
+			/* Every jobs'th unprobed device, starting from j'th */
+			k = 0;
+			for (i = 0; i < probe_cnt; i++) {
+				if (probe_vec[i].label || !probe_vec[i].is_blk)
+					continue;
+				if (k++ % jobs != j)
+					continue;
+				get_label_uuid(probe_vec[i].device, &r);
+				r.idx = i;
+				full_write(pp.wr, &r, sizeof(r));
+			}
+			_exit(EXIT_SUCCESS);
+		}
+	}
+	close(pp.wr);
+	while (full_read(pp.rd, &r, sizeof(r)) == sizeof(r)) {
+		if (r.idx < probe_cnt && !probe_vec[r.idx].label)
+			store_result(&probe_vec[r.idx], &r);
+	}
+	close(pp.rd);
+	while (j != 0)
+		safe_waitpid(pid[--j], NULL, 0);
+}
+#endif
+
+static void queue_device(const char *device, struct stat *statbuf)
+{
+	probe_vec = xrealloc_vector(probe_vec, 6, probe_cnt);
+	probe_vec[probe_cnt].device = xstrdup(device);
+	IF_FEATURE_VOLUMEID_CACHE(probe_vec[probe_cnt].key = make_key(statbuf);)
+	probe_vec[probe_cnt].is_blk = S_ISBLK(statbuf->st_mode);
+	probe_cnt++;
+}
+
+/* Probes queued devices (unless the cache knows them),
+ * adds those with label or uuid to uuidCache.
+ * ALL: all devices in the system were queued */
+static void uuidcache_probe(int all UNUSED_PARAM)
+{
+	struct probe_result r;
+	struct probe_s *p;
+	unsigned i, todo;
+
+	todo = probe_cnt;
+#if ENABLE_FEATURE_VOLUMEID_CACHE
+	if (!cache_state)
+		load_cache();
+	for (i = 0; cache_state == 1 && i < probe_cnt; i++) {
+		unsigned j;
+
+		p = &probe_vec[i];
+		for (j = 0; j < cache_cnt; j++) {
+			struct probe_s *c = &cache_vec[j];
+			if (strcmp(c->key, p->key) == 0
+			 && strcmp(c->device, p->device) == 0
+			) {
+				p->label = c->label;
+				p->uuid = c->uuid;
+				p->type = c->type;
+				p->cached = 1;
+				todo--;
+				break;
+			}
+		}
+	}
+#endif
+#if BB_MMU && CONFIG_VOLUMEID_PROBE_JOBS > 1
+	if (todo > 1)
+		probe_in_children();
+#endif
+	for (i = 0; i < probe_cnt; i++) {
+		p = &probe_vec[i];
+		if (!p->label) {
+			get_label_uuid(p->device, &r);
+			store_result(p, &r);
+		}
+		if (p->label[0] || p->uuid[0]) {
+			uuidcache_addentry(p);
+			IF_FEATURE_VOLUMEID_CACHE(cache_used |= p->cached;)
+		}
+	}
+
+#if ENABLE_FEATURE_VOLUMEID_CACHE
+	/* New or changed devices, or (if all) gone ones? */
+	if (todo != 0 || (all && probe_cnt != cache_cnt)) {
+		save_cache(all);
+		return;
+	}
+	/* Everything came from the cache, don't write it back */
+#endif
+	free(probe_vec);
+	probe_vec = NULL;
+	probe_cnt = 0;
 }
 
-/* If get_label_uuid() on device_name returns success,
- * add a cache entry for this device.
- * If device node does not exist, it will be temporarily created. */
+/* If device is a block device, queue it for probing */
 static int FAST_FUNC
 uuidcache_check_device(const char *device,
 		struct stat *statbuf,
@@ -109,7 +397,7 @@ uuidcache_check_device(const char *device,
 	if (major(statbuf->st_rdev) == 2)
 		return TRUE;
 
-	add_to_uuid_cache(device);
+	queue_device(device, statbuf);
 
 	return TRUE;
 }
@@ -121,6 +409,13 @@ uuidcache_init(void)
 	if (uuidCache)
 		return;
 
+	/* Devices given to add_to_uuid_cache() */
+	if (probe_cnt) {
+		uuidcache_probe(0);
+		if (uuidCache)
+			return;
+	}
+
 	/* We were scanning /proc/partitions
 	 * and /proc/sys/dev/cdrom/info here.
 	 * Missed volume managers. I see that "standard" blkid uses these:
@@ -137,6 +432,7 @@ uuidcache_init(void)
 		NULL, /* dir_action */
 		NULL, /* userData */
 		0 /* depth */);
+	uuidcache_probe(1);
 }
 
 #define UUID   1
@@ -219,6 +515,13 @@ void display_uuid_cache(void)
 {
 	struct uuidCache_s *u;
 
+#if ENABLE_FEATURE_VOLUMEID_CACHE
+	/* e2label or mkfs change neither size nor mtime of the device
+	 * node: print what is on the devices now. The results still
+	 * refresh the cache for findfs and mount */
+	load_cache();
+	cache_state = 2;
+#endif
 	uuidcache_init();
 	u = uuidCache;
 	while (u) {
@@ -236,60 +539,72 @@ void display_uuid_cache(void)
 	}
 }
 
+/* Queues device to be probed instead of scanning /dev.
+ * Returns 0 if it does not exist */
 int add_to_uuid_cache(const char *device)
 {
-	char *uuid = uuid; /* for compiler */
-	char *label = label;
-#if ENABLE_FEATURE_BLKID_TYPE
-	const char *type = type;
-#endif
-	int fd;
+	struct stat st;
 
-	fd = open(device, O_RDONLY);
-	if (fd < 0)
+	if (stat(device, &st) != 0)
 		return 0;
-
-	/* get_label_uuid() closes fd in all cases (success & failure) */
-	if (get_label_uuid(fd, &label, &uuid, &type) == 0) {
-		/* uuidcache_addentry() takes ownership of all four params */
-		uuidcache_addentry(xstrdup(device), /*ma, mi,*/ label, uuid, type);
-		return 1;
-	}
-	return 0;
+	queue_device(device, &st);
+	return 1;
 }
 
 
 /* Used by mount and findfs */
 
-char *get_devname_from_label(const char *spec)
+static int matches(int n, const char *spec, const char *label, const char *uuid)
+{
+	if (n == VOL)
+		return label[0] && strcmp(spec, label) == 0;
+	/* case of hex numbers doesn't matter */
+	return strcasecmp(spec, uuid) == 0;
+}
+
+static char *get_devname_from_x(int n, const char *spec)
 {
 	struct uuidCache_s *uc;
 
+ again:
 	uuidcache_init();
 	uc = uuidCache;
 	while (uc) {
-		if (uc->label[0] && strcmp(spec, uc->label) == 0) {
+		if (matches(n, spec, uc->label, uc->uc_uuid)) {
+#if ENABLE_FEATURE_VOLUMEID_CACHE
+			struct probe_result r;
+
+			/* Before mounting it, make sure it is still there */
+			if (uc->cached
+			 && (get_label_uuid(uc->device, &r) != 0
+			    || !matches(n, spec, r.label, r.uuid))
+			) {
+				break;
+			}
+#endif
 			return xstrdup(uc->device);
 		}
 		uc = uc->next;
 	}
+	if (cache_used) {
+		/* Relabeled device whose size and mtime did not change?
+		 * Don't trust the cache, probe everything */
+		IF_FEATURE_VOLUMEID_CACHE(cache_state = 2;)
+		IF_FEATURE_VOLUMEID_CACHE(cache_used = 0;)
+		uuidCache = NULL;
+		goto again;
+	}
 	return NULL;
 }
 
-char *get_devname_from_uuid(const char *spec)
+char *get_devname_from_label(const char *spec)
 {
-	struct uuidCache_s *uc;
+	return get_devname_from_x(VOL, spec);
+}
 
-	uuidcache_init();
-	uc = uuidCache;
-	while (uc) {
-		/* case of hex numbers doesn't matter */
-		if (strcasecmp(spec, uc->uc_uuid) == 0) {
-			return xstrdup(uc->device);
-		}
-		uc = uc->next;
-	}
-	return NULL;
+char *get_devname_from_uuid(const char *spec)
+{
+	return get_devname_from_x(UUID, spec);
 }
 
 int resolve_mount_spec(char **fsname)
@@ -193,6 +193,10 @@ set:
 /* Do not use xlseek here. With it, single corrupted filesystem
  * may result in attempt to seek past device -> exit.
  * It's better to ignore such fs and continue.  */
+/* Superblock buffer of the previous probe. When many devices are probed,
+ * this saves malloc, free (and heap trim) and page faults per device */
+static uint8_t *spare_sbbuf;
+
 void *volume_id_get_buffer(struct volume_id *id, uint64_t off, size_t len)
 {
 	uint8_t *dst;
@@ -207,7 +211,10 @@ void *volume_id_get_buffer(struct volume_id *id, uint64_t off, size_t len)
 	 /* && off <= SB_BUFFER_SIZE - want this paranoid overflow check? */
 	) {
 		if (id->sbbuf == NULL) {
-			id->sbbuf = xmalloc(SB_BUFFER_SIZE);
+			id->sbbuf = spare_sbbuf;
+			spare_sbbuf = NULL;
+			if (!id->sbbuf)
+				id->sbbuf = xmalloc(SB_BUFFER_SIZE);
 		}
 		small_off = off;
 		dst = id->sbbuf;
@@ -272,7 +279,10 @@ void *volume_id_get_buffer(struct volume_id *id, uint64_t off, size_t len)
 
 void volume_id_free_buffer(struct volume_id *id)
 {
-	free(id->sbbuf);
+	if (id->sbbuf) {
+		free(spare_sbbuf);
+		spare_sbbuf = id->sbbuf;
+	}
 	id->sbbuf = NULL;
 	id->sbbuf_len = 0;
 	free(id->seekbuf);